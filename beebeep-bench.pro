@@ -0,0 +1,9 @@
+include(beebeep.pri)
+
+# Build with: qmake beebeep-bench.pro && make
+# Run: test/beebeep-bench
+
+TEMPLATE = subdirs
+
+SUBDIRS += bench
+bench.file = src/bench.pro
@@ -0,0 +1,18 @@
+include(src.pro)
+
+# Command line benchmarks of cipher, handshake, message parsing, discovery addresses, subnet scanning and file transfer
+# Results are printed on stdout as one JSON object per line
+
+TARGET = beebeep-bench
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES -= desktop/Main.cpp
+HEADERS += bench/BeeBench.h
+SOURCES += bench/BeeBench.cpp
+INCLUDEPATH += $$PWD/bench
+
+win32: RC_FILE =
+macx: QMAKE_INFO_PLIST =
+
+message( Benchmark target: $$TARGET )
@@ -0,0 +1,632 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "BeeBench.h"
+#include "Broadcaster.h"
+#include "BuildFileHashes.h"
+#include "CipherContext.h"
+#include "ConnectionSocket.h"
+#include "ECDH.h"
+#include "FileTransferPeer.h"
+#include "Listener.h"
+#include "NetworkManager.h"
+#include "NetworkScanner.h"
+#include "Protocol.h"
+#include "Random.h"
+#include "Settings.h"
+#include "TimerWheel.h"
+
+/*
+  Benchmarks of the network hot paths. Every result is printed to stdout
+  as a JSON object on a single line, for example:
+    { "bench": "encrypt_frame_level5", "size": 1024, "iterations": 8192, "ns_per_op": 812.4, "mb_per_s": 1202.1 }
+*/
+
+static void printResult( const QString& bench_name, int data_size, int iterations, qint64 elapsed_ns, const QString& extra_fields = QString() )
+{
+  double ns_per_op = iterations > 0 ? static_cast<double>( elapsed_ns ) / iterations : 0.0;
+  double mb_per_s = 0.0;
+  if( data_size > 0 && elapsed_ns > 0 )
+    mb_per_s = (static_cast<double>( data_size ) * iterations / 1048576.0) / (static_cast<double>( elapsed_ns ) / 1000000000.0);
+  QString result = QString( "{ \"bench\": \"%1\", \"size\": %2, \"iterations\": %3, \"ns_per_op\": %4, \"mb_per_s\": %5%6 }" )
+                     .arg( bench_name ).arg( data_size ).arg( iterations )
+                     .arg( ns_per_op, 0, 'f', 1 ).arg( mb_per_s, 0, 'f', 1 )
+                     .arg( extra_fields.isEmpty() ? QString() : QString( ", %1" ).arg( extra_fields ) );
+  fprintf( stdout, "%s\n", qPrintable( result ) );
+  fflush( stdout );
+}
+
+static QByteArray randomData( int data_size )
+{
+  QByteArray data_random( data_size, '\0' );
+  for( int i = 0; i < data_size; i++ )
+    data_random[ i ] = static_cast<char>( Random::number32( 0, 255 ) );
+  return data_random;
+}
+
+static int iterationsForSize( int data_size )
+{
+  return qBound( 16, (16 * 1048576) / qMax( 1, data_size ), 100000 );
+}
+
+static QByteArray benchCipherKey()
+{
+  ECDH::Keys keys_1;
+  ECDH::Keys keys_2;
+  keys_1.create();
+  keys_2.create();
+  keys_1.generateSharedKey( keys_2.publicKey() );
+  return Protocol::instance().createCipherKey( keys_1.sharedKey(), Protocol::instance().datastreamMaxVersion() );
+}
+
+static void benchCipher( const QByteArray& cipher_key )
+{
+  QList<int> data_sizes;
+  data_sizes << 64 << 1024 << 16384 << 65536 << 1048576;
+  QElapsedTimer timer;
+
+  foreach( int data_size, data_sizes )
+  {
+    QByteArray data_plain = randomData( data_size );
+    int iterations = iterationsForSize( data_size );
+    QByteArray data_result;
+
+    timer.start();
+    for( int i = 0; i < iterations; i++ )
+      data_result = Protocol::instance().encryptByteArray( data_plain, cipher_key, BEEBEEP_PROTO_VERSION );
+    printResult( "encrypt_protocol", data_size, iterations, timer.nsecsElapsed() );
+
+    QByteArray data_encrypted = data_result;
+    timer.start();
+    for( int i = 0; i < iterations; i++ )
+      data_result = Protocol::instance().decryptByteArray( data_encrypted, cipher_key, BEEBEEP_PROTO_VERSION );
+    printResult( "decrypt_protocol", data_size, iterations, timer.nsecsElapsed() );
+
+    CipherContext cipher_context;
+    Protocol::instance().setupCipherContext( &cipher_context, cipher_key, BEEBEEP_PROTO_VERSION );
+    timer.start();
+    for( int i = 0; i < iterations; i++ )
+      data_result = cipher_context.encrypt( data_plain );
+    printResult( "encrypt_context_level4", data_size, iterations, timer.nsecsElapsed() );
+
+    timer.start();
+    for( int i = 0; i < iterations; i++ )
+      data_result = cipher_context.decrypt( data_encrypted );
+    printResult( "decrypt_context_level4", data_size, iterations, timer.nsecsElapsed() );
+
+    CipherContext client_context;
+    CipherContext server_context;
+    Protocol::instance().setupCipherContext( &client_context, cipher_key, BEEBEEP_PROTO_VERSION );
+    Protocol::instance().setupCipherContext( &server_context, cipher_key, BEEBEEP_PROTO_VERSION );
+    client_context.setupAuthenticatedEncryption( false );
+    server_context.setupAuthenticatedEncryption( true );
+
+    // Frames must be decrypted in the same order: they are prepared before
+    int frame_iterations = qMin( iterations, qMax( 16, (32 * 1048576) / data_size ) );
+    QList<QByteArray> frames;
+    timer.start();
+    for( int i = 0; i < frame_iterations; i++ )
+      frames.append( client_context.encryptFrame( data_plain ) );
+    printResult( "encrypt_frame_level5", data_size, frame_iterations, timer.nsecsElapsed(),
+                 QString( "\"aesni\": %1" ).arg( CipherContext::hasHardwareAcceleration() ? "true" : "false" ) );
+
+    bool frames_are_valid = true;
+    timer.start();
+    for( int i = 0; i < frame_iterations; i++ )
+    {
+      if( server_context.decryptFrame( frames.at( i ) ).size() != data_size )
+        frames_are_valid = false;
+    }
+    printResult( "decrypt_frame_level5", data_size, frame_iterations, timer.nsecsElapsed(),
+                 QString( "\"aesni\": %1, \"valid\": %2" ).arg( CipherContext::hasHardwareAcceleration() ? "true" : "false", frames_are_valid ? "true" : "false" ) );
+  }
+}
+
+static void benchKeys( const QByteArray& cipher_key )
+{
+  QElapsedTimer timer;
+  CipherContext cipher_context;
+  int iterations = 20000;
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    Protocol::instance().setupCipherContext( &cipher_context, cipher_key, BEEBEEP_PROTO_VERSION );
+  printResult( "key_schedule", 0, iterations, timer.nsecsElapsed() );
+
+  ECDH::Keys keys_1;
+  ECDH::Keys keys_2;
+  iterations = 200;
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    keys_1.create();
+  printResult( "ecdh_create_keys", 0, iterations, timer.nsecsElapsed() );
+
+  keys_2.create();
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    keys_1.generateSharedKey( keys_2.publicKey() );
+  printResult( "ecdh_shared_key", 0, iterations, timer.nsecsElapsed() );
+
+  QByteArray shared_key = keys_1.sharedKey();
+  iterations = 20000;
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    Protocol::instance().createCipherKey( shared_key, Protocol::instance().datastreamMaxVersion() );
+  printResult( "create_cipher_key", 0, iterations, timer.nsecsElapsed() );
+}
+
+static bool messagesAreEqual( const Message& m1, const Message& m2 )
+{
+  return m1.type() == m2.type() && m1.id() == m2.id() && m1.flags() == m2.flags() && m1.data() == m2.data()
+      && m1.text() == m2.text() && m1.timestamp() == m2.timestamp();
+}
+
+static void benchMessageParser()
+{
+  Message m( Message::Chat, 123456, QString( "Hello from the BeeBEEP message parser benchmark. " ).repeated( 4 ) );
+  m.addFlag( Message::Private );
+  m.setData( QString( "chat-private-id%1data" ).arg( QChar( 0x2028 ) ) );
+  QDateTime dt_now = QDateTime::currentDateTime();
+  dt_now.setTime( QTime( dt_now.time().hour(), dt_now.time().minute(), dt_now.time().second() ) );
+  m.setTimestamp( dt_now );
+
+  QByteArray text_message = Protocol::instance().fromMessage( m, BINARY_MESSAGE_PROTO_VERSION - 1 );
+  // Milliseconds in timestamp are not accepted by the fast path: the same message is parsed by the slow one
+  QString iso_timestamp = m.timestamp().toUTC().toString( Qt::ISODate );
+  QString iso_timestamp_with_ms = iso_timestamp.left( 19 ) + QLatin1String( ".000" ) + iso_timestamp.mid( 19 );
+  QByteArray legacy_text_message = QString::fromUtf8( text_message ).replace( iso_timestamp, iso_timestamp_with_ms ).toUtf8();
+  QByteArray binary_message = Protocol::instance().fromMessage( m, BINARY_MESSAGE_PROTO_VERSION );
+
+  QElapsedTimer timer;
+  int iterations = 100000;
+  Message m_parsed;
+
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    m_parsed = Protocol::instance().toMessage( text_message, BINARY_MESSAGE_PROTO_VERSION - 1 );
+  printResult( "parse_text_fast", text_message.size(), iterations, timer.nsecsElapsed(),
+               QString( "\"identical\": %1" ).arg( messagesAreEqual( m, m_parsed ) ? "true" : "false" ) );
+
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    m_parsed = Protocol::instance().toMessage( legacy_text_message, BINARY_MESSAGE_PROTO_VERSION - 1 );
+  printResult( "parse_text_legacy", legacy_text_message.size(), iterations, timer.nsecsElapsed(),
+               QString( "\"identical\": %1" ).arg( messagesAreEqual( m, m_parsed ) ? "true" : "false" ) );
+
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    m_parsed = Protocol::instance().toMessage( binary_message, BINARY_MESSAGE_PROTO_VERSION );
+  printResult( "parse_binary", binary_message.size(), iterations, timer.nsecsElapsed(),
+               QString( "\"identical\": %1" ).arg( messagesAreEqual( m, m_parsed ) ? "true" : "false" ) );
+
+  QByteArray message_data;
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    message_data = Protocol::instance().fromMessage( m, BINARY_MESSAGE_PROTO_VERSION - 1 );
+  printResult( "serialize_text", message_data.size(), iterations, timer.nsecsElapsed() );
+
+  timer.start();
+  for( int i = 0; i < iterations; i++ )
+    message_data = Protocol::instance().fromMessage( m, BINARY_MESSAGE_PROTO_VERSION );
+  printResult( "serialize_binary", message_data.size(), iterations, timer.nsecsElapsed() );
+}
+
+static QList<NetworkAddress> subnetAddresses( int num_addresses )
+{
+  // Hosts of the subnet 10.1.0.0/16 and beyond
+  QList<NetworkAddress> network_addresses;
+  for( int i = 0; i < num_addresses; i++ )
+    network_addresses.append( NetworkAddress( QHostAddress( static_cast<quint32>( 0x0A010000 + i ) ), static_cast<quint16>( DEFAULT_LISTENER_PORT ) ) );
+  return network_addresses;
+}
+
+static void benchBroadcasterAddresses()
+{
+  QElapsedTimer timer;
+  QList<int> address_counts;
+  address_counts << 1024 << 16384 << 65536;
+
+  foreach( int num_addresses, address_counts )
+  {
+    QList<NetworkAddress> network_addresses = subnetAddresses( num_addresses );
+    Broadcaster* broadcaster = new Broadcaster( Q_NULLPTR );
+
+    int addresses_added = 0;
+    timer.start();
+    foreach( NetworkAddress na, network_addresses )
+    {
+      if( broadcaster->addNetworkAddress( na ) )
+        addresses_added++;
+    }
+    printResult( "broadcaster_add_addresses", 0, num_addresses, timer.nsecsElapsed(), QString( "\"addresses\": %1" ).arg( addresses_added ) );
+
+    int duplicates_found = 0;
+    timer.start();
+    foreach( NetworkAddress na, network_addresses )
+    {
+      if( !broadcaster->addNetworkAddress( na ) )
+        duplicates_found++;
+    }
+    printResult( "broadcaster_add_duplicates", 0, num_addresses, timer.nsecsElapsed(), QString( "\"duplicates\": %1" ).arg( duplicates_found ) );
+
+    broadcaster->stopBroadcasting();
+    delete broadcaster;
+
+    int broadcast_addresses = 0;
+    timer.start();
+    foreach( NetworkAddress na, network_addresses )
+    {
+      if( NetworkManager::instance().isBroadcastAddress( na.hostAddress() ) )
+        broadcast_addresses++;
+    }
+    printResult( "is_broadcast_address", 0, num_addresses, timer.nsecsElapsed(), QString( "\"broadcast\": %1" ).arg( broadcast_addresses ) );
+  }
+
+  // Previous bookkeeping with linear lookups in a list, as reference
+  int num_addresses = 16384;
+  QList<NetworkAddress> network_addresses = subnetAddresses( num_addresses );
+  QList<NetworkAddress> network_address_list;
+  timer.start();
+  foreach( NetworkAddress na, network_addresses )
+  {
+    if( !network_address_list.contains( na ) )
+      network_address_list.append( na );
+  }
+  printResult( "list_add_addresses", 0, num_addresses, timer.nsecsElapsed(), QString( "\"addresses\": %1" ).arg( network_address_list.size() ) );
+
+  int broadcast_addresses = 0;
+  timer.start();
+  foreach( NetworkAddress na, network_addresses )
+  {
+    if( na.hostAddress().toString().contains( "255" ) )
+      broadcast_addresses++;
+  }
+  printResult( "string_broadcast_address", 0, num_addresses, timer.nsecsElapsed(), QString( "\"broadcast\": %1" ).arg( broadcast_addresses ) );
+}
+
+static bool benchNetworkScanner()
+{
+  // Fake listeners in the loopback subnet: the scanner has to find all of them and nothing else
+  QList<QTcpServer*> listeners;
+  quint16 listener_port = 0;
+  for( int i = 1; i <= 8; i++ )
+  {
+    QTcpServer* listener = new QTcpServer;
+    if( !listener->listen( QHostAddress( QString( "127.0.0.%1" ).arg( i * 10 ) ), listener_port ) )
+    {
+      delete listener;
+      continue;
+    }
+    listener_port = listener->serverPort();
+    listeners.append( listener );
+  }
+
+  if( listeners.isEmpty() )
+  {
+    fprintf( stdout, "{ \"bench\": \"scan_loopback\", \"error\": \"unable to listen on loopback\" }\n" );
+    return false;
+  }
+
+  NetworkScanner network_scanner;
+  QEventLoop event_loop;
+  QObject::connect( &network_scanner, SIGNAL( finished() ), &event_loop, SLOT( quit() ) );
+  QTimer::singleShot( 30000, &event_loop, SLOT( quit() ) );
+  QElapsedTimer timer;
+  timer.start();
+  network_scanner.addSubnet( QHostAddress( "127.0.0.0" ), 24, listener_port );
+  event_loop.exec();
+  qint64 elapsed_ns = timer.nsecsElapsed();
+  network_scanner.stop();
+
+  printResult( "scan_loopback", 0, network_scanner.hostsProbed(), elapsed_ns,
+               QString( "\"found\": %1, \"expected\": %2, \"rtt_ms\": %3" ).arg( network_scanner.hostsFound() ).arg( listeners.size() ).arg( network_scanner.smoothedRtt() ) );
+  bool all_listeners_found = network_scanner.hostsFound() == listeners.size();
+  if( !all_listeners_found )
+    fprintf( stdout, "{ \"bench\": \"scan_loopback\", \"error\": \"%d hosts found and %d expected\" }\n", network_scanner.hostsFound(), listeners.size() );
+  qDeleteAll( listeners );
+  return all_listeners_found;
+}
+
+static void benchHandshake()
+{
+  HandshakeBench handshake_bench;
+  if( !handshake_bench.start() )
+  {
+    fprintf( stdout, "{ \"bench\": \"handshake_loopback\", \"error\": \"unable to listen on loopback\" }\n" );
+    return;
+  }
+
+  int iterations = 20;
+  int handshakes_completed = 0;
+  qint64 elapsed_ns = 0;
+  for( int i = 0; i < iterations; i++ )
+  {
+    qint64 handshake_ns = handshake_bench.runHandshake( 5000 );
+    if( handshake_ns >= 0 )
+    {
+      elapsed_ns += handshake_ns;
+      handshakes_completed++;
+    }
+  }
+  printResult( "handshake_loopback", 0, handshakes_completed, elapsed_ns, QString( "\"failed\": %1" ).arg( iterations - handshakes_completed ) );
+}
+
+static bool benchFileHashesKeepAlive()
+{
+  // The upload builds the content hashes for three confirm timeouts: the download has to wait for the file header
+  int file_size = 1048576;
+  QString source_file_path = QDir::temp().absoluteFilePath( QLatin1String( "beebench-source.dat" ) );
+  QString download_file_path = QDir::temp().absoluteFilePath( QLatin1String( "beebench-download.dat" ) );
+  QFile::remove( download_file_path );
+  QFile source_file( source_file_path );
+  if( !source_file.open( QIODevice::WriteOnly ) || source_file.write( randomData( file_size ) ) != file_size )
+  {
+    fprintf( stdout, "{ \"bench\": \"download_file_hashes_keep_alive\", \"error\": \"unable to write the file to upload\" }\n" );
+    return false;
+  }
+  source_file.close();
+
+  Settings::instance().setFileTransferConfirmTimeout( 2000 );
+  Settings::instance().setResumeFileTransfer( false );
+  Settings::instance().setUserRecognitionMethod( Settings::RecognizeByAccountAndDomain ); // both the peers are the local user
+  QDir().mkpath( Settings::instance().cacheFolder() );
+
+  FileHashesBench file_hashes_bench( source_file_path );
+  if( !file_hashes_bench.start() )
+  {
+    fprintf( stdout, "{ \"bench\": \"download_file_hashes_keep_alive\", \"error\": \"unable to listen on loopback\" }\n" );
+    QFile::remove( source_file_path );
+    return false;
+  }
+
+  int hashing_time = 3 * Settings::instance().fileTransferConfirmTimeout();
+  qint64 elapsed_ns = file_hashes_bench.runDownload( download_file_path, hashing_time, hashing_time + 20000 );
+  bool download_completed = elapsed_ns >= 0 && QFileInfo( download_file_path ).size() == file_size;
+  printResult( "download_file_hashes_keep_alive", file_size, download_completed ? 1 : 0, download_completed ? elapsed_ns : 0,
+               QString( "\"hashing_ms\": %1, \"confirm_timeout_ms\": %2" ).arg( hashing_time ).arg( Settings::instance().fileTransferConfirmTimeout() ) );
+  if( !download_completed )
+    fprintf( stdout, "{ \"bench\": \"download_file_hashes_keep_alive\", \"error\": \"the download has not survived the file hashes\" }\n" );
+  QFile::remove( source_file_path );
+  QFile::remove( download_file_path );
+  return download_completed;
+}
+
+
+HandshakeBench::HandshakeBench( QObject* parent )
+  : QObject( parent ), mp_listener( Q_NULLPTR ), mp_serverSocket( Q_NULLPTR ), mp_clientSocket( Q_NULLPTR ),
+    mp_eventLoop( Q_NULLPTR ), m_authenticationsRequested( 0 ), m_hasFailed( false )
+{
+  mp_listener = new Listener( this );
+  connect( mp_listener, SIGNAL( newConnection( qintptr ) ), this, SLOT( onNewConnection( qintptr ) ) );
+}
+
+bool HandshakeBench::start()
+{
+  return mp_listener->listen( QHostAddress::LocalHost, 0 );
+}
+
+qint64 HandshakeBench::runHandshake( int timeout_ms )
+{
+  QEventLoop event_loop;
+  mp_eventLoop = &event_loop;
+  m_authenticationsRequested = 0;
+  m_hasFailed = false;
+
+  mp_clientSocket = new ConnectionSocket( this );
+  connect( mp_clientSocket, SIGNAL( authenticationRequested( const QByteArray& ) ), this, SLOT( onAuthenticationRequested() ) );
+  connect( mp_clientSocket, SIGNAL( abortRequest() ), this, SLOT( onAbortRequest() ) );
+
+  QElapsedTimer timer;
+  timer.start();
+  QTimer::singleShot( timeout_ms, &event_loop, SLOT( quit() ) );
+  mp_clientSocket->connectToNetworkAddress( NetworkAddress( QHostAddress::LocalHost, mp_listener->serverPort() ) );
+  event_loop.exec();
+  qint64 elapsed_ns = timer.nsecsElapsed();
+
+  bool handshake_completed = !m_hasFailed && m_authenticationsRequested >= 2;
+  mp_eventLoop = Q_NULLPTR;
+  closeSockets();
+  return handshake_completed ? elapsed_ns : -1;
+}
+
+void HandshakeBench::onNewConnection( qintptr socket_descriptor )
+{
+  mp_serverSocket = new ConnectionSocket( this );
+  connect( mp_serverSocket, SIGNAL( authenticationRequested( const QByteArray& ) ), this, SLOT( onAuthenticationRequested() ) );
+  connect( mp_serverSocket, SIGNAL( abortRequest() ), this, SLOT( onAbortRequest() ) );
+  mp_serverSocket->initSocket( socket_descriptor, mp_listener->serverPort() );
+}
+
+void HandshakeBench::onAuthenticationRequested()
+{
+  m_authenticationsRequested++;
+  if( m_authenticationsRequested >= 2 && mp_eventLoop )
+    mp_eventLoop->quit();
+}
+
+void HandshakeBench::onAbortRequest()
+{
+  m_hasFailed = true;
+  if( mp_eventLoop )
+    mp_eventLoop->quit();
+}
+
+void HandshakeBench::closeSockets()
+{
+  if( mp_clientSocket )
+  {
+    mp_clientSocket->disconnect( this );
+    mp_clientSocket->abortConnection();
+    mp_clientSocket->deleteLater();
+    mp_clientSocket = Q_NULLPTR;
+  }
+
+  if( mp_serverSocket )
+  {
+    mp_serverSocket->disconnect( this );
+    mp_serverSocket->abortConnection();
+    mp_serverSocket->deleteLater();
+    mp_serverSocket = Q_NULLPTR;
+  }
+}
+
+
+FileHashesBench::FileHashesBench( const QString& source_file_path, QObject* parent )
+  : QObject( parent ), mp_listener( Q_NULLPTR ), mp_uploadPeer( Q_NULLPTR ), mp_downloadPeer( Q_NULLPTR ),
+    mp_eventLoop( Q_NULLPTR ), m_sourceFilePath( source_file_path ), m_hashingTime( 0 )
+{
+  mp_listener = new Listener( this );
+  connect( mp_listener, SIGNAL( newConnection( qintptr ) ), this, SLOT( onNewConnection( qintptr ) ) );
+}
+
+bool FileHashesBench::start()
+{
+  return mp_listener->listen( QHostAddress::LocalHost, 0 );
+}
+
+qint64 FileHashesBench::runDownload( const QString& download_file_path, int hashing_time_ms, int timeout_ms )
+{
+  QEventLoop event_loop;
+  mp_eventLoop = &event_loop;
+  m_hashingTime = hashing_time_ms;
+
+  QFileInfo source_file_info( m_sourceFilePath );
+  FileInfo file_info( Protocol::instance().newId(), FileInfo::Download );
+  file_info.setNameAndSuffix( source_file_info.fileName() );
+  file_info.setSize( source_file_info.size() );
+  file_info.setPath( download_file_path );
+  file_info.setFileHash( QLatin1String( "beebench-file-hashes" ) );
+  file_info.setNetworkAddress( NetworkAddress( QHostAddress::LocalHost, mp_listener->serverPort() ) );
+
+  mp_downloadPeer = new FileTransferPeer( this );
+  mp_downloadPeer->setTransferType( FileInfo::Download );
+  mp_downloadPeer->setId( Protocol::instance().newId() );
+  mp_downloadPeer->setFileInfo( FileInfo::Download, file_info );
+  mp_downloadPeer->setRemoteUserId( Settings::instance().localUser().id() );
+  connect( mp_downloadPeer, SIGNAL( operationCompleted() ), this, SLOT( onDownloadFinished() ) );
+
+  QElapsedTimer timer;
+  timer.start();
+  QTimer::singleShot( timeout_ms, &event_loop, SLOT( quit() ) );
+  mp_downloadPeer->startConnection();
+  event_loop.exec();
+  qint64 elapsed_ns = timer.nsecsElapsed();
+
+  bool download_completed = mp_downloadPeer->isTransferCompleted();
+  mp_eventLoop = Q_NULLPTR;
+  closePeers();
+  return download_completed ? elapsed_ns : -1;
+}
+
+void FileHashesBench::onNewConnection( qintptr socket_descriptor )
+{
+  mp_uploadPeer = new FileTransferPeer( this );
+  mp_uploadPeer->setTransferType( FileInfo::Upload );
+  mp_uploadPeer->setId( Protocol::instance().newId() );
+  mp_uploadPeer->setConnectionDescriptor( socket_descriptor, mp_listener->serverPort() );
+  connect( mp_uploadPeer, SIGNAL( fileUploadRequest( const FileInfo& ) ), this, SLOT( onFileUploadRequest( const FileInfo& ) ) );
+  mp_uploadPeer->startConnection();
+}
+
+void FileHashesBench::onFileUploadRequest( const FileInfo& fi )
+{
+  // As FileTransfer does when the content hashes of the file are not in cache
+  FileInfo file_info = fi;
+  file_info.setPath( m_sourceFilePath );
+  file_info.setSize( QFileInfo( m_sourceFilePath ).size() );
+  mp_uploadPeer->waitFileHashes( file_info );
+  QTimer::singleShot( m_hashingTime, this, SLOT( onFileHashesBuilt() ) );
+}
+
+void FileHashesBench::onFileHashesBuilt()
+{
+  if( !mp_uploadPeer || !mp_uploadPeer->isActive() )
+    return;
+  BuildFileHashes bfh;
+  bfh.setFilePath( m_sourceFilePath );
+  bfh.buildHashes();
+  FileInfo file_info = mp_uploadPeer->fileInfo();
+  file_info.setContentHash( bfh.contentHash() );
+  file_info.setChunkHashes( bfh.chunkHashes() );
+  mp_uploadPeer->startUpload( file_info );
+}
+
+void FileHashesBench::onDownloadFinished()
+{
+  if( mp_eventLoop )
+    mp_eventLoop->quit();
+}
+
+void FileHashesBench::closePeers()
+{
+  if( mp_downloadPeer )
+  {
+    mp_downloadPeer->disconnect( this );
+    if( mp_downloadPeer->isActive() && !mp_downloadPeer->isTransferCompleted() )
+      mp_downloadPeer->cancelTransfer();
+    mp_downloadPeer->deleteLater();
+    mp_downloadPeer = Q_NULLPTR;
+  }
+
+  if( mp_uploadPeer )
+  {
+    mp_uploadPeer->disconnect( this );
+    if( mp_uploadPeer->isActive() && !mp_uploadPeer->isTransferCompleted() )
+      mp_uploadPeer->cancelTransfer();
+    mp_uploadPeer->deleteLater();
+    mp_uploadPeer = Q_NULLPTR;
+  }
+}
+
+
+int main( int argc, char *argv[] )
+{
+#if QT_VERSION >= 0x050000
+  // Benchmarks do not need a display
+  if( qgetenv( "QT_QPA_PLATFORM" ).isEmpty() )
+    qputenv( "QT_QPA_PLATFORM", "offscreen" );
+#endif
+  QApplication bench_app( argc, argv );
+  Q_UNUSED( bench_app )
+  Random::init();
+  Settings::instance().createLocalUser( QLatin1String( "BeeBench" ) );
+  Settings::instance().loadDefaults();
+
+  fprintf( stdout, "{ \"info\": \"beebeep-bench\", \"version\": \"%s\", \"proto\": %d, \"qt\": \"%s\", \"aesni\": %s }\n",
+           BEEBEEP_VERSION, BEEBEEP_PROTO_VERSION, qVersion(), CipherContext::hasHardwareAcceleration() ? "true" : "false" );
+
+  QByteArray cipher_key = benchCipherKey();
+  benchCipher( cipher_key );
+  benchKeys( cipher_key );
+  benchMessageParser();
+  benchBroadcasterAddresses();
+  benchHandshake();
+  int bench_result = benchNetworkScanner() ? 0 : 1;
+  if( !benchFileHashesKeepAlive() )
+    bench_result = 1;
+
+  NetworkManager::close();
+  TimerWheel::close();
+  Protocol::close();
+  Settings::close();
+  return bench_result;
+}
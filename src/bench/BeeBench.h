@@ -0,0 +1,102 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_BEEBENCH_H
+#define BEEBEEP_BEEBENCH_H
+
+#include "Config.h"
+class ConnectionSocket;
+class FileInfo;
+class FileTransferPeer;
+class Listener;
+
+
+/*
+  Measures the full HELLO handshake (ECDH keys, cipher key and first
+  encrypted frames) between two ConnectionSocket over loopback.
+*/
+
+class HandshakeBench : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit HandshakeBench( QObject* parent = Q_NULLPTR );
+
+  bool start();
+  qint64 runHandshake( int timeout_ms ); // elapsed ns or -1 if the handshake fails
+
+protected slots:
+  void onNewConnection( qintptr );
+  void onAuthenticationRequested();
+  void onAbortRequest();
+
+protected:
+  void closeSockets();
+
+private:
+  Listener* mp_listener;
+  ConnectionSocket* mp_serverSocket;
+  ConnectionSocket* mp_clientSocket;
+  QEventLoop* mp_eventLoop;
+  int m_authenticationsRequested;
+  bool m_hasFailed;
+
+};
+
+
+/*
+  Downloads a file over loopback while the upload builds the content
+  hashes for longer than the file transfer confirm timeout.
+*/
+
+class FileHashesBench : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit FileHashesBench( const QString& source_file_path, QObject* parent = Q_NULLPTR );
+
+  bool start();
+  qint64 runDownload( const QString& download_file_path, int hashing_time_ms, int timeout_ms ); // elapsed ns or -1 if the download fails
+
+protected slots:
+  void onNewConnection( qintptr );
+  void onFileUploadRequest( const FileInfo& );
+  void onFileHashesBuilt();
+  void onDownloadFinished();
+
+protected:
+  void closePeers();
+
+private:
+  Listener* mp_listener;
+  FileTransferPeer* mp_uploadPeer;
+  FileTransferPeer* mp_downloadPeer;
+  QEventLoop* mp_eventLoop;
+  QString m_sourceFilePath;
+  int m_hashingTime;
+
+};
+
+#endif // BEEBEEP_BEEBENCH_H
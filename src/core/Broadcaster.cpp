@@ -24,18 +24,183 @@
 #include "Broadcaster.h"
 #include "Hive.h"
 #include "NetworkManager.h"
+#include "NetworkScanner.h"
 #include "Protocol.h"
 #include "Settings.h"
+#include "TimerWheel.h"
 #include "UserManager.h"
+#if defined( Q_OS_LINUX ) && !defined( Q_OS_ANDROID ) && QT_VERSION >= 0x050000
+  #define BEEBEEP_USE_NATIVE_DATAGRAM_BATCH
+  #include <sys/socket.h>
+  #include <netinet/in.h>
+  #include <string.h>
+#endif
+
+
+const int MAX_DATAGRAMS_IN_BATCH = 256;
+const int PEER_ANNOUNCEMENT_WINDOW = 5000; // ms
+
+#ifdef BEEBEEP_USE_NATIVE_DATAGRAM_BATCH
+static bool nativeSocketAddress( int socket_family, const QHostAddress& ha, quint16 port, sockaddr_storage* sa, socklen_t* sa_len )
+{
+  memset( sa, 0, sizeof( sockaddr_storage ) );
+  if( socket_family == AF_INET )
+  {
+    if( ha.protocol() != QAbstractSocket::IPv4Protocol )
+      return false;
+    sockaddr_in* sa_in = reinterpret_cast<sockaddr_in*>( sa );
+    sa_in->sin_family = AF_INET;
+    sa_in->sin_port = htons( port );
+    sa_in->sin_addr.s_addr = htonl( ha.toIPv4Address() );
+    *sa_len = sizeof( sockaddr_in );
+    return true;
+  }
+
+  if( socket_family == AF_INET6 )
+  {
+    if( !ha.scopeId().isEmpty() )
+      return false; // Qt resolves the interface of the scope
+    sockaddr_in6* sa_in6 = reinterpret_cast<sockaddr_in6*>( sa );
+    sa_in6->sin6_family = AF_INET6;
+    sa_in6->sin6_port = htons( port );
+    if( ha.protocol() == QAbstractSocket::IPv4Protocol )
+    {
+      // IPv4-mapped address for the dual stack socket
+      quint32 ipv4 = ha.toIPv4Address();
+      sa_in6->sin6_addr.s6_addr[ 10 ] = 0xff;
+      sa_in6->sin6_addr.s6_addr[ 11 ] = 0xff;
+      sa_in6->sin6_addr.s6_addr[ 12 ] = static_cast<quint8>( ipv4 >> 24 );
+      sa_in6->sin6_addr.s6_addr[ 13 ] = static_cast<quint8>( ipv4 >> 16 );
+      sa_in6->sin6_addr.s6_addr[ 14 ] = static_cast<quint8>( ipv4 >> 8 );
+      sa_in6->sin6_addr.s6_addr[ 15 ] = static_cast<quint8>( ipv4 );
+    }
+    else if( ha.protocol() == QAbstractSocket::IPv6Protocol )
+    {
+      Q_IPV6ADDR ipv6 = ha.toIPv6Address();
+      memcpy( &sa_in6->sin6_addr, &ipv6, sizeof( ipv6 ) );
+    }
+    else
+      return false;
+    *sa_len = sizeof( sockaddr_in6 );
+    return true;
+  }
 
+  return false;
+}
+
+// Sends the datagrams with one system call and returns how many of them are sent: the sent ones are marked in the vector
+static int nativeWriteDatagrams( qintptr socket_descriptor, const QList< QPair<NetworkAddress, QByteArray> >& datagrams, int from, QVector<bool>* datagrams_sent )
+{
+  sockaddr_storage local_sa;
+  socklen_t local_sa_len = sizeof( local_sa );
+  if( ::getsockname( static_cast<int>( socket_descriptor ), reinterpret_cast<sockaddr*>( &local_sa ), &local_sa_len ) != 0 )
+    return 0;
+
+  QVector<sockaddr_storage> sa_list( datagrams.size() );
+  QVector<iovec> iov_list( datagrams.size() );
+  QVector<mmsghdr> msg_list( datagrams.size() );
+  QVector<int> indexes;
+  indexes.reserve( datagrams.size() );
+  for( int i = from; i < datagrams.size(); i++ )
+  {
+    const QPair<NetworkAddress, QByteArray>& dg = datagrams.at( i );
+    int msg_index = indexes.size();
+    socklen_t sa_len = 0;
+    if( !nativeSocketAddress( local_sa.ss_family, dg.first.hostAddress(), dg.first.hostPort(), &sa_list[ msg_index ], &sa_len ) )
+      continue;
+    iov_list[ msg_index ].iov_base = const_cast<char*>( dg.second.constData() );
+    iov_list[ msg_index ].iov_len = static_cast<size_t>( dg.second.size() );
+    memset( &msg_list[ msg_index ], 0, sizeof( mmsghdr ) );
+    msg_list[ msg_index ].msg_hdr.msg_name = &sa_list[ msg_index ];
+    msg_list[ msg_index ].msg_hdr.msg_namelen = sa_len;
+    msg_list[ msg_index ].msg_hdr.msg_iov = &iov_list[ msg_index ];
+    msg_list[ msg_index ].msg_hdr.msg_iovlen = 1;
+    indexes.append( i );
+  }
+
+  int num_sent = 0;
+  while( num_sent < indexes.size() )
+  {
+    int ret = ::sendmmsg( static_cast<int>( socket_descriptor ), msg_list.data() + num_sent, static_cast<unsigned int>( indexes.size() - num_sent ), 0 );
+    if( ret <= 0 )
+      break; // the remaining datagrams are sent by Qt
+    for( int i = num_sent; i < num_sent + ret; i++ )
+      (*datagrams_sent)[ indexes.at( i ) ] = true;
+    num_sent += ret;
+  }
+  return num_sent;
+}
+
+// Drains the datagrams pending in the socket without blocking
+static int nativeReadDatagrams( qintptr socket_descriptor, int max_datagrams, QList< QPair<NetworkAddress, QByteArray> >* datagrams )
+{
+  const int batch_size = 32;
+  const int buffer_size = 4096;
+  QByteArray buffer( batch_size * buffer_size, '\0' );
+  sockaddr_storage sa_list[ batch_size ];
+  iovec iov_list[ batch_size ];
+  mmsghdr msg_list[ batch_size ];
+  int num_read = 0;
+
+  while( num_read < max_datagrams )
+  {
+    int num_msg = qMin( batch_size, max_datagrams - num_read );
+    memset( msg_list, 0, sizeof( msg_list ) );
+    for( int i = 0; i < num_msg; i++ )
+    {
+      iov_list[ i ].iov_base = buffer.data() + i * buffer_size;
+      iov_list[ i ].iov_len = buffer_size;
+      msg_list[ i ].msg_hdr.msg_name = &sa_list[ i ];
+      msg_list[ i ].msg_hdr.msg_namelen = sizeof( sockaddr_storage );
+      msg_list[ i ].msg_hdr.msg_iov = &iov_list[ i ];
+      msg_list[ i ].msg_hdr.msg_iovlen = 1;
+    }
+
+    int ret = ::recvmmsg( static_cast<int>( socket_descriptor ), msg_list, static_cast<unsigned int>( num_msg ), MSG_DONTWAIT, Q_NULLPTR );
+    if( ret <= 0 )
+      break;
+
+    for( int i = 0; i < ret; i++ )
+    {
+      num_read++;
+      if( msg_list[ i ].msg_hdr.msg_flags & MSG_TRUNC )
+      {
+        qWarning() << "Broadcaster has received a truncated datagram";
+        continue;
+      }
+
+      QHostAddress sender_ip( reinterpret_cast<sockaddr*>( &sa_list[ i ] ) );
+      quint16 sender_port = 0;
+      if( sa_list[ i ].ss_family == AF_INET )
+        sender_port = ntohs( reinterpret_cast<sockaddr_in*>( &sa_list[ i ] )->sin_port );
+      else if( sa_list[ i ].ss_family == AF_INET6 )
+        sender_port = ntohs( reinterpret_cast<sockaddr_in6*>( &sa_list[ i ] )->sin6_port );
+      bool is_ipv4 = false;
+      quint32 ipv4 = sender_ip.toIPv4Address( &is_ipv4 );
+      if( is_ipv4 && sender_ip.protocol() == QAbstractSocket::IPv6Protocol )
+        sender_ip = QHostAddress( ipv4 );
+
+      datagrams->append( qMakePair( NetworkAddress( sender_ip, sender_port ), QByteArray( buffer.constData() + i * buffer_size, static_cast<int>( msg_list[ i ].msg_len ) ) ) );
+    }
+
+    if( ret < num_msg )
+      break;
+  }
+  return num_read;
+}
+#endif
 
 Broadcaster::Broadcaster( QObject *parent )
-  : QObject( parent ), m_networkAddresses(), m_newBroadcastRequested( false ),
+  : QObject( parent ), m_networkAddresses(), m_networkAddressSet(), m_newBroadcastRequested( false ),
     m_networkAddressesWaitingForLoopback(), m_multicastGroupAddress(), m_isMulticastDatagramSent( false ),
-    m_lastDatagramSentTimestamp(), m_networkAddressesIsSorted( false )
+    m_lastDatagramSentTimestamp(), m_networkAddressesIsSorted( false ), m_timerId( 0 ),
+    m_outgoingDatagrams(), m_peerAnnouncements(), m_elapsedTimer()
 {
   mp_receiverSocket = new QUdpSocket( this );
   mp_senderSocket = new QUdpSocket( this );
+  m_elapsedTimer.start();
+  mp_networkScanner = new NetworkScanner( this );
+  connect( mp_networkScanner, SIGNAL( hostFound( const NetworkAddress& ) ), this, SLOT( onNetworkScannerHostFound( const NetworkAddress& ) ) );
 }
 
 bool Broadcaster::startBroadcastServer()
@@ -128,11 +293,11 @@ bool Broadcaster::startBroadcastServer()
   }
 #endif
 
-  if( !m_networkAddresses.isEmpty() )
-    m_networkAddresses.clear();
+  clearNetworkAddresses();
   if( !m_networkAddressesWaitingForLoopback.isEmpty() )
     m_networkAddressesWaitingForLoopback.clear();
   m_newBroadcastRequested = false;
+  mp_networkScanner->loadCache( Settings::instance().networkScannerCacheFilePath() );
   return true;
 }
 
@@ -176,13 +341,18 @@ void Broadcaster::stopBroadcasting()
   }
 
   qDebug() << "Broadcaster stops to search users";
+  mp_networkScanner->stop();
+  mp_networkScanner->saveCache( Settings::instance().networkScannerCacheFilePath() );
 
-  if( !m_networkAddresses.isEmpty() )
-    m_networkAddresses.clear();
+  clearNetworkAddresses();
   if( !m_networkAddressesWaitingForLoopback.isEmpty() )
     m_networkAddressesWaitingForLoopback.clear();
   m_newBroadcastRequested = false;
   m_isMulticastDatagramSent = false;
+  m_outgoingDatagrams.clear();
+  m_peerAnnouncements.clear();
+  TimerWheel::instance().cancel( m_timerId );
+  m_timerId = 0;
 }
 
 void Broadcaster::sendBroadcast()
@@ -190,6 +360,22 @@ void Broadcaster::sendBroadcast()
   m_isMulticastDatagramSent = false;
   sendMulticastDatagram();
   m_newBroadcastRequested = true;
+  scheduleBroadcastTimeout();
+}
+
+void Broadcaster::scheduleBroadcastTimeout()
+{
+  if( m_timerId > 0 && TimerWheel::instance().isScheduled( m_timerId ) )
+    return;
+
+  // No timer when there is nothing to do
+  if( m_networkAddresses.isEmpty() && !m_newBroadcastRequested && m_networkAddressesWaitingForLoopback.isEmpty() )
+  {
+    m_timerId = 0;
+    return;
+  }
+
+  m_timerId = TimerWheel::instance().schedule( TICK_INTERVAL, this, "onBroadcastTimeout" );
 }
 
 bool Broadcaster::addNetworkAddress( const NetworkAddress& network_address, bool split_ipv4_address )
@@ -197,11 +383,18 @@ bool Broadcaster::addNetworkAddress( const NetworkAddress& network_address, bool
   if( !network_address.isHostAddressValid() )
     return false;
 
-  if( m_networkAddresses.contains( network_address ) )
+  if( m_networkAddressSet.contains( network_address ) )
     return false;
 
   int list_size = m_networkAddresses.size();
 
+  // Hosts with a listener port are probed by the scanner and only the responsive ones are contacted
+  if( split_ipv4_address && network_address.isHostPortValid() && mp_networkScanner->addBroadcastAddress( network_address ) )
+  {
+    m_networkAddressSet.insert( network_address );
+    return true;
+  }
+
   if( split_ipv4_address && (network_address.isHostPortValid() || !NetworkManager::instance().isInLocalBroadcastAddresses( network_address.hostAddress() ) ))
   {
     QList<QHostAddress> host_addresses_to_add = NetworkManager::instance().splitInIPv4HostAddresses( network_address.hostAddress() );
@@ -211,14 +404,21 @@ bool Broadcaster::addNetworkAddress( const NetworkAddress& network_address, bool
     foreach( QHostAddress ha, host_addresses_to_add )
     {
       NetworkAddress na( ha, network_address.hostPort() );
-      if( !m_networkAddresses.contains( na ) )
+      if( !m_networkAddressSet.contains( na ) )
+      {
+        m_networkAddressSet.insert( na );
         m_networkAddresses.append( na );
+      }
     }
   }
   else
+  {
+    m_networkAddressSet.insert( network_address );
     m_networkAddresses.append( network_address );
+  }
 
   m_networkAddressesIsSorted = list_size == m_networkAddresses.size();
+  scheduleBroadcastTimeout();
   return true;
 }
 
@@ -227,29 +427,70 @@ bool Broadcaster::broadcastToNetworkAddress( const NetworkAddress& na )
   if( !na.isHostAddressValid() )
     return false;
 
-  QByteArray broadcast_data = Protocol::instance().broadcastMessage( na.hostAddress() );
-  quint16 default_port = static_cast<quint16>( Settings::instance().defaultBroadcastPort() );
-  quint16 host_port = na.isHostPortValid() ? na.hostPort() : default_port;
-  if( mp_senderSocket->writeDatagram( broadcast_data, na.hostAddress(), host_port ) > 0 )
+  quint16 host_port = na.isHostPortValid() ? na.hostPort() : static_cast<quint16>( Settings::instance().defaultBroadcastPort() );
+  m_outgoingDatagrams.append( qMakePair( NetworkAddress( na.hostAddress(), host_port ), Protocol::instance().broadcastMessage( na.hostAddress() ) ) );
+  return true;
+}
+
+int Broadcaster::flushDatagrams()
+{
+  if( m_outgoingDatagrams.isEmpty() )
+    return 0;
+
+  QList< QPair<NetworkAddress, QByteArray> > datagrams = m_outgoingDatagrams;
+  m_outgoingDatagrams.clear();
+  QVector<bool> datagrams_sent( datagrams.size(), false );
+  int num_sent = 0;
+
+#ifdef BEEBEEP_USE_NATIVE_DATAGRAM_BATCH
+  int first_native_datagram = 0;
+  if( mp_senderSocket->state() != QAbstractSocket::BoundState )
+  {
+    // Qt binds the sender socket with the first datagram
+    datagrams_sent[ 0 ] = mp_senderSocket->writeDatagram( datagrams.first().second, datagrams.first().first.hostAddress(), datagrams.first().first.hostPort() ) > 0;
+    if( datagrams_sent[ 0 ] )
+      num_sent++;
+    first_native_datagram = 1;
+  }
+
+  if( first_native_datagram < datagrams.size() && mp_senderSocket->state() == QAbstractSocket::BoundState )
+    num_sent += nativeWriteDatagrams( mp_senderSocket->socketDescriptor(), datagrams, first_native_datagram, &datagrams_sent );
+#endif
+
+  for( int i = 0; i < datagrams.size(); i++ )
   {
+    const NetworkAddress& na = datagrams.at( i ).first;
+    if( !datagrams_sent[ i ] )
+    {
+      if( mp_senderSocket->writeDatagram( datagrams.at( i ).second, na.hostAddress(), na.hostPort() ) > 0 )
+      {
+        datagrams_sent[ i ] = true;
+        num_sent++;
+      }
+      else
+      {
+        qWarning() << "Unable to send datagram to" << qPrintable( na.hostAddress().toString() ) << na.hostPort();
+        continue;
+      }
+    }
+
 #ifdef BEEBEEP_DEBUG
-    qDebug() << "Broadcaster sends datagram to" << qPrintable( na.hostAddress().toString() ) << host_port;
+    qDebug() << "Broadcaster sends datagram to" << qPrintable( na.hostAddress().toString() ) << na.hostPort();
 #endif
-    if( na.hostAddress() == NetworkManager::instance().localBroadcastAddress() && host_port == default_port )
+    if( na.hostAddress() == NetworkManager::instance().localBroadcastAddress() && na.hostPort() == Settings::instance().defaultBroadcastPort() )
     {
-      m_networkAddressesWaitingForLoopback.append( QPair<NetworkAddress,QDateTime>( na, QDateTime::currentDateTime() ) );
+      m_networkAddressesWaitingForLoopback.insert( na, QDateTime::currentDateTime() );
 #ifdef BEEBEEP_DEBUG
       qDebug() << "Waiting for loopback datagram from" << qPrintable( na.hostAddress().toString() );
 #endif
     }
-    m_lastDatagramSentTimestamp = QDateTime::currentDateTime();
-    return true;
-  }
-  else
-  {
-    qWarning() << "Unable to send datagram to" << qPrintable( na.hostAddress().toString() ) << host_port;
-    return false;
   }
+
+  if( num_sent > 0 )
+    m_lastDatagramSentTimestamp = QDateTime::currentDateTime();
+  if( num_sent > 1 )
+    qDebug() << "Broadcaster sends" << num_sent << "datagrams";
+  return num_sent;
 }
 
 void Broadcaster::checkLoopbackDatagram()
@@ -257,17 +498,17 @@ void Broadcaster::checkLoopbackDatagram()
 #ifdef BEEBEEP_DEBUG
   qDebug() << "Check" << m_networkAddressesWaitingForLoopback.size() << "loopback datagram";
 #endif
-  QList< QPair<NetworkAddress, QDateTime> >::iterator it = m_networkAddressesWaitingForLoopback.begin();
+  QHash<NetworkAddress, QDateTime>::iterator it = m_networkAddressesWaitingForLoopback.begin();
   while( it != m_networkAddressesWaitingForLoopback.end() )
   {
 #if QT_VERSION >= 0x040700
-    if( it->second.msecsTo( QDateTime::currentDateTime() ) > 5600 )
+    if( it.value().msecsTo( QDateTime::currentDateTime() ) > 5600 )
 #else
-    if( it->second.secsTo( QDateTime::currentDateTime() ) > 5 )
+    if( it.value().secsTo( QDateTime::currentDateTime() ) > 5 )
 #endif
     {
-      qWarning() << "Broadcaster didn't received yet a loopback datagram from" << qPrintable( it->first.toString() );
-      if( !m_multicastGroupAddress.isNull() && it->first.hostAddress() == m_multicastGroupAddress && !Settings::instance().broadcastToLocalSubnetAlways() )
+      qWarning() << "Broadcaster didn't received yet a loopback datagram from" << qPrintable( it.key().toString() );
+      if( !m_multicastGroupAddress.isNull() && it.key().hostAddress() == m_multicastGroupAddress && !Settings::instance().broadcastToLocalSubnetAlways() )
       {
         qDebug() << "Broadcaster also tries to send to datagram to local address" << qPrintable( NetworkManager::instance().localBroadcastAddress().toString() );
         addHostAddress( NetworkManager::instance().localBroadcastAddress() );
@@ -281,27 +522,20 @@ void Broadcaster::checkLoopbackDatagram()
 
 void Broadcaster::removeHostAddressFromWaitingList( const QHostAddress& host_address )
 {
-  QList< QPair<NetworkAddress, QDateTime> >::iterator it = m_networkAddressesWaitingForLoopback.begin();
-  while( it != m_networkAddressesWaitingForLoopback.end() )
-  {
-    if( it->first.hostAddress() == host_address )
-    {
-      qDebug() << "Broadcaster has received loopback datagram from" << qPrintable( it->first.toString() );
-      it = m_networkAddressesWaitingForLoopback.erase( it );
-    }
-    else
-      ++it;
-  }
+  // Only the datagrams sent to the default broadcast port wait for their loopback
+  NetworkAddress na( host_address, static_cast<quint16>( Settings::instance().defaultBroadcastPort() ) );
+  if( m_networkAddressesWaitingForLoopback.remove( na ) > 0 )
+    qDebug() << "Broadcaster has received loopback datagram from" << qPrintable( na.toString() );
 }
 
-void Broadcaster::readBroadcastDatagram()
+int Broadcaster::readPendingDatagrams( QList< QPair<NetworkAddress, QByteArray> >* datagrams )
 {
   int num_datagram_read = 0;
-  while( mp_receiverSocket->hasPendingDatagrams() && num_datagram_read < MAX_NUM_OF_LOOP_IN_CONNECTON_SOCKECT )
+  while( mp_receiverSocket->hasPendingDatagrams() && num_datagram_read < MAX_DATAGRAMS_IN_BATCH )
   {
     num_datagram_read++;
     QHostAddress sender_ip;
-    quint16 sender_port;
+    quint16 sender_port = 0;
     QByteArray datagram;
 
     datagram.resize( static_cast<int>(mp_receiverSocket->pendingDatagramSize()) );
@@ -311,6 +545,53 @@ void Broadcaster::readBroadcastDatagram()
       qWarning() << "Broadcasting has found and error reading datagram" << num_datagram_read;
       continue;
     }
+    datagrams->append( qMakePair( NetworkAddress( sender_ip, sender_port ), datagram ) );
+
+#ifdef BEEBEEP_USE_NATIVE_DATAGRAM_BATCH
+    // Qt has enabled again the read notifications: the remaining datagrams are drained with few system calls
+    num_datagram_read += nativeReadDatagrams( mp_receiverSocket->socketDescriptor(), MAX_DATAGRAMS_IN_BATCH - num_datagram_read, datagrams );
+#endif
+  }
+  return num_datagram_read;
+}
+
+void Broadcaster::removeExpiredPeerAnnouncements()
+{
+  qint64 now = m_elapsedTimer.elapsed();
+  QHash<QString, qint64>::iterator it = m_peerAnnouncements.begin();
+  while( it != m_peerAnnouncements.end() )
+  {
+    if( it.value() + PEER_ANNOUNCEMENT_WINDOW <= now )
+      it = m_peerAnnouncements.erase( it );
+    else
+      ++it;
+  }
+}
+
+bool Broadcaster::isPeerAlreadyAnnounced( const NetworkAddress& na )
+{
+  // Expired announcements are removed once for each burst of datagrams: here only the peer is checked
+  qint64 now = m_elapsedTimer.elapsed();
+  QString peer_key = na.toString();
+  QHash<QString, qint64>::iterator it = m_peerAnnouncements.find( peer_key );
+  if( it != m_peerAnnouncements.end() && it.value() + PEER_ANNOUNCEMENT_WINDOW > now )
+    return true;
+  m_peerAnnouncements.insert( peer_key, now );
+  return false;
+}
+
+void Broadcaster::readBroadcastDatagram()
+{
+  QList< QPair<NetworkAddress, QByteArray> > datagrams;
+  int num_datagram_read = readPendingDatagrams( &datagrams );
+  int num_peers_found = 0;
+  if( num_datagram_read > 0 )
+    removeExpiredPeerAnnouncements();
+
+  for( QList< QPair<NetworkAddress, QByteArray> >::const_iterator it = datagrams.constBegin(); it != datagrams.constEnd(); ++it )
+  {
+    const QHostAddress& sender_ip = it->first.hostAddress();
+    const QByteArray& datagram = it->second;
 
     if( datagram.size() <= Protocol::instance().messageMinimumSize() )
     {
@@ -356,6 +637,16 @@ void Broadcaster::readBroadcastDatagram()
       continue;
     }
 
+    // The same peer is received from multicast, broadcast and hosts addresses: only the first one is new
+    if( isPeerAlreadyAnnounced( NetworkAddress( sender_ip, static_cast<quint16>( sender_listener_port ) ) ) )
+    {
+#ifdef BEEBEEP_DEBUG
+      qDebug() << "Broadcaster skips the repeated announcement of peer" << qPrintable( sender_ip.toString() ) << sender_listener_port;
+#endif
+      continue;
+    }
+
+    num_peers_found++;
     if( host_address_from_datagram.isNull() )
       qDebug() << "Broadcaster has found new peer" << qPrintable( sender_ip.toString() ) << sender_listener_port;
     else
@@ -364,7 +655,7 @@ void Broadcaster::readBroadcastDatagram()
   }
 
   if( num_datagram_read > 1 )
-    qDebug() << "Broadcaster read" << num_datagram_read << "datagrams";
+    qDebug() << "Broadcaster read" << num_datagram_read << "datagrams with" << num_peers_found << "new peers";
 }
 
 void Broadcaster::updateUsersAddedManually()
@@ -385,13 +676,25 @@ void Broadcaster::updateUsersAddedManually()
   }
 }
 
+QSet<NetworkAddress> Broadcaster::connectedUserNetworkAddresses() const
+{
+  QSet<NetworkAddress> connected_network_addresses;
+  connected_network_addresses.insert( Settings::instance().localUser().networkAddress() );
+  foreach( User u, UserManager::instance().userList().toList() )
+  {
+    if( u.isStatusConnected() )
+      connected_network_addresses.insert( u.networkAddress() );
+  }
+  return connected_network_addresses;
+}
+
 int Broadcaster::updateUsersFromHive()
 {
   int hive_users_to_contact = 0;
+  QSet<NetworkAddress> connected_network_addresses = connectedUserNetworkAddresses();
   foreach( NetworkAddress na, Hive::instance().networkAddresses() )
   {
-    User u = UserManager::instance().findUserByNetworkAddress( na );
-    if( u.isValid() && u.isStatusConnected() )
+    if( connected_network_addresses.contains( na ) )
       continue;
     if( addNetworkAddress( na, false ) )
       hive_users_to_contact++;
@@ -399,6 +702,29 @@ int Broadcaster::updateUsersFromHive()
   return hive_users_to_contact;
 }
 
+int Broadcaster::updateRecentUsers()
+{
+  int recent_users_to_contact = 0;
+  foreach( User u, UserManager::instance().userList().toList() )
+  {
+    if( u.isFavorite() && !u.isStatusConnected() && addNetworkAddress( u.networkAddress(), false ) )
+      recent_users_to_contact++;
+  }
+
+  if( !Settings::instance().useHive() )
+    return recent_users_to_contact;
+
+  QSet<NetworkAddress> connected_network_addresses = connectedUserNetworkAddresses();
+  foreach( NetworkAddress na, Hive::instance().recentNetworkAddresses() )
+  {
+    if( connected_network_addresses.contains( na ) )
+      continue;
+    if( addNetworkAddress( na, false ) )
+      recent_users_to_contact++;
+  }
+  return recent_users_to_contact;
+}
+
 QList<NetworkAddress> Broadcaster::updateAddressesToSearchUsers()
 {
 #ifdef BEEBEEP_DEBUG
@@ -407,7 +733,7 @@ QList<NetworkAddress> Broadcaster::updateAddressesToSearchUsers()
 
   QList<NetworkAddress> network_address_list;
   m_networkAddressesWaitingForLoopback.clear();
-  m_networkAddresses.clear();
+  clearNetworkAddresses();
 
   if( Settings::instance().useOnlyMulticast() )
   {
@@ -474,9 +800,9 @@ QList<NetworkAddress> Broadcaster::updateAddressesToSearchUsers()
   }
 
   updateUsersAddedManually();
-  int offline_users_to_add = 0;
+  int offline_users_to_add = updateRecentUsers();
   if( Settings::instance().useHive() )
-    offline_users_to_add = updateUsersFromHive();
+    offline_users_to_add += updateUsersFromHive();
 
   if( Settings::instance().broadcastToOfflineUsers() )
   {
@@ -494,8 +820,9 @@ QList<NetworkAddress> Broadcaster::updateAddressesToSearchUsers()
   return network_address_list;
 }
 
-void Broadcaster::onTickEvent( int )
+void Broadcaster::onBroadcastTimeout()
 {
+  m_timerId = 0;
   if( !m_networkAddressesWaitingForLoopback.isEmpty() )
     checkLoopbackDatagram();
 
@@ -532,6 +859,15 @@ void Broadcaster::onTickEvent( int )
   }
   else
     contactNetworkAddresses();
+
+  scheduleBroadcastTimeout();
+}
+
+void Broadcaster::onNetworkScannerHostFound( const NetworkAddress& na )
+{
+  if( isPeerAlreadyAnnounced( na ) )
+    return;
+  emit newPeerFound( na.hostAddress(), na.hostPort() );
 }
 
 void Broadcaster::sendMulticastDatagram()
@@ -542,7 +878,7 @@ void Broadcaster::sendMulticastDatagram()
     if( mp_senderSocket->writeDatagram( broadcast_data, m_multicastGroupAddress, static_cast<quint16>(Settings::instance().defaultBroadcastPort()) ) > 0 )
     {
       qDebug() << "Broadcaster sends multicast datagram to" << qPrintable( m_multicastGroupAddress.toString() ) << Settings::instance().defaultBroadcastPort();
-      m_networkAddressesWaitingForLoopback.append( QPair<NetworkAddress, QDateTime>( NetworkAddress( m_multicastGroupAddress, static_cast<quint16>( Settings::instance().defaultBroadcastPort() ) ), QDateTime::currentDateTime() ) );
+      m_networkAddressesWaitingForLoopback.insert( NetworkAddress( m_multicastGroupAddress, static_cast<quint16>( Settings::instance().defaultBroadcastPort() ) ), QDateTime::currentDateTime() );
       m_lastDatagramSentTimestamp = QDateTime::currentDateTime();
       m_isMulticastDatagramSent = true;
 #ifdef BEEBEEP_DEBUG
@@ -564,15 +900,21 @@ void Broadcaster::contactNetworkAddresses()
     return;
 
   int contacted_users = 0;
+  int datagrams_to_send = 0;
   while( !m_networkAddresses.isEmpty() )
   {
+    // Recent and favorite users are contacted at once, the others after the answers to the datagrams
+    if( datagrams_to_send > 0 && !isNetworkAddressForBroadcast( m_networkAddresses.first() ) )
+      break;
+
     NetworkAddress na = m_networkAddresses.takeFirst();
+    m_networkAddressSet.remove( na );
     if( na.isHostAddressValid() )
     {
       if( isNetworkAddressForBroadcast( na ) )
       {
-         if( broadcastToNetworkAddress( na ) )
-           return;
+        if( broadcastToNetworkAddress( na ) )
+          datagrams_to_send++;
       }
       else
       {
@@ -584,10 +926,16 @@ void Broadcaster::contactNetworkAddresses()
       }
     }
 
-    if( contacted_users >= Settings::instance().maxUsersToConnectInATick() )
+    if( contacted_users >= Settings::instance().maxUsersToConnectInATick() || datagrams_to_send >= MAX_DATAGRAMS_IN_BATCH )
       break;
   }
 
+  if( datagrams_to_send > 0 )
+  {
+    flushDatagrams();
+    return;
+  }
+
 #ifdef BEEBEEP_DEBUG
   qDebug() << "Broadcaster has contacted" << contacted_users << "network addresses";
 #endif
@@ -595,7 +943,21 @@ void Broadcaster::contactNetworkAddresses()
 
 bool Broadcaster::isNetworkAddressForBroadcast( const NetworkAddress& na ) const
 {
-  return (na.isIPv4Address() && na.hostAddress().toString().contains( "255" )) || na.hostPort() == Settings::instance().defaultBroadcastPort();
+  return na.hostPort() == Settings::instance().defaultBroadcastPort() || NetworkManager::instance().isBroadcastAddress( na.hostAddress() );
+}
+
+bool Broadcaster::isNetworkAddressToContactFirst( const NetworkAddress& na, const QSet<NetworkAddress>& favorite_network_addresses ) const
+{
+  if( favorite_network_addresses.contains( na ) )
+    return true;
+  return Settings::instance().useHive() && Hive::instance().isPeerRecentlyActive( na );
+}
+
+void Broadcaster::clearNetworkAddresses()
+{
+  m_networkAddresses.clear();
+  m_networkAddressSet.clear();
+  m_networkAddressesIsSorted = false;
 }
 
 bool Broadcaster::sortNetworkAddresses()
@@ -604,24 +966,36 @@ bool Broadcaster::sortNetworkAddresses()
     return false;
   if( m_networkAddressesIsSorted )
     return true;
+  // The user list is scanned once and not for each address
+  QSet<NetworkAddress> favorite_network_addresses;
+  foreach( User u, UserManager::instance().userList().toList() )
+  {
+    if( u.isFavorite() )
+      favorite_network_addresses.insert( u.networkAddress() );
+  }
+
+  QList<NetworkAddress> first_network_addresses;
   QList<NetworkAddress> broadcast_network_addresses;
   QList<NetworkAddress> direct_network_addresses;
   foreach( NetworkAddress na, m_networkAddresses )
   {
     if( isNetworkAddressForBroadcast( na ) )
       broadcast_network_addresses.append( na );
+    else if( isNetworkAddressToContactFirst( na, favorite_network_addresses ) )
+      first_network_addresses.append( na );
     else
       direct_network_addresses.append( na );
   }
 
-  if( !broadcast_network_addresses.isEmpty() )
-  {
-    m_networkAddresses = broadcast_network_addresses;
-    if( !direct_network_addresses.isEmpty() )
-      m_networkAddresses.append( direct_network_addresses );
-  }
-  else
-    m_networkAddresses = direct_network_addresses;
+  // Only the most relevant users are contacted before the datagrams are sent
+  if( Settings::instance().useHive() )
+    first_network_addresses = Hive::instance().sortByPriority( first_network_addresses );
+  while( first_network_addresses.size() > Settings::instance().maxUsersToConnectInATick() )
+    direct_network_addresses.prepend( first_network_addresses.takeLast() );
+
+  m_networkAddresses = first_network_addresses;
+  m_networkAddresses.append( broadcast_network_addresses );
+  m_networkAddresses.append( direct_network_addresses );
   m_networkAddressesIsSorted = true;
   return true;
 }
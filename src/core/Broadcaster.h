@@ -26,6 +26,7 @@
 
 #include "Config.h"
 #include "NetworkAddress.h"
+class NetworkScanner;
 
 
 class Broadcaster : public QObject
@@ -37,11 +38,11 @@ public:
   bool startBroadcastServer();
   void stopBroadcasting();
 
-  void onTickEvent( int );
   inline void setAddOfflineUsersInNetworkAddresses( bool );
 
   void updateUsersAddedManually();
   int updateUsersFromHive();
+  int updateRecentUsers();
   inline const QHostAddress& multicastGroupAddress() const;
 
   inline bool addNetworkAddress( const NetworkAddress& );
@@ -55,31 +56,47 @@ signals:
 private slots:
   void readBroadcastDatagram();
   void contactNetworkAddresses();
+  void onBroadcastTimeout();
+  void onNetworkScannerHostFound( const NetworkAddress& );
 
 protected:
   bool sortNetworkAddresses();
   void sendMulticastDatagram();
   bool broadcastToNetworkAddress( const NetworkAddress& );
+  int flushDatagrams();
+  int readPendingDatagrams( QList< QPair<NetworkAddress, QByteArray> >* );
+  void removeExpiredPeerAnnouncements();
+  bool isPeerAlreadyAnnounced( const NetworkAddress& );
 
   bool addNetworkAddress( const NetworkAddress&, bool split_ipv4_address );
   inline bool addHostAddress( const QHostAddress& );
   QList<NetworkAddress> updateAddressesToSearchUsers();
 
   void checkLoopbackDatagram();
+  void scheduleBroadcastTimeout();
   void removeHostAddressFromWaitingList( const QHostAddress& );
 
   bool isNetworkAddressForBroadcast( const NetworkAddress& ) const;
+  QSet<NetworkAddress> connectedUserNetworkAddresses() const;
+  bool isNetworkAddressToContactFirst( const NetworkAddress&, const QSet<NetworkAddress>& favorite_network_addresses ) const;
+  void clearNetworkAddresses();
 
 private:
   QUdpSocket* mp_receiverSocket;
   QUdpSocket* mp_senderSocket;
-  QList<NetworkAddress> m_networkAddresses;
+  QList<NetworkAddress> m_networkAddresses; // recent and favorite users, broadcast addresses and then the others
+  QSet<NetworkAddress> m_networkAddressSet;
   bool m_newBroadcastRequested;
-  QList< QPair<NetworkAddress, QDateTime> > m_networkAddressesWaitingForLoopback;
+  QHash<NetworkAddress, QDateTime> m_networkAddressesWaitingForLoopback;
   QHostAddress m_multicastGroupAddress;
   bool m_isMulticastDatagramSent;
   QDateTime m_lastDatagramSentTimestamp;
   bool m_networkAddressesIsSorted;
+  int m_timerId;
+  QList< QPair<NetworkAddress, QByteArray> > m_outgoingDatagrams;
+  QHash<QString, qint64> m_peerAnnouncements; // peer listener address, time of the latest announcement
+  QElapsedTimer m_elapsedTimer;
+  NetworkScanner* mp_networkScanner;
 
 };
 
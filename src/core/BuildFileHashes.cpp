@@ -0,0 +1,84 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "BuildFileHashes.h"
+#include "FileChunkMap.h"
+
+
+BuildFileHashes::BuildFileHashes( QObject* parent )
+  : QObject( parent ), m_filePath( "" ), m_fileSize( 0 ), m_lastModified(),
+    m_chunkHashes(), m_contentHash( "" ), m_elapsedTime( 0 )
+{
+  setObjectName( "BuildFileHashes" );
+}
+
+void BuildFileHashes::setFilePath( const QString& new_value )
+{
+  m_filePath = new_value;
+}
+
+void BuildFileHashes::buildHashes()
+{
+  QElapsedTimer elapsed_timer;
+  elapsed_timer.start();
+  m_chunkHashes.clear();
+  m_contentHash = "";
+
+  QFileInfo file_info( m_filePath );
+  m_fileSize = file_info.size();
+  m_lastModified = file_info.lastModified();
+
+  QFile file( m_filePath );
+  if( file.open( QIODevice::ReadOnly ) )
+  {
+    m_chunkHashes.reserve( FileChunkMap::chunksInFile( m_fileSize ) * FileChunkMap::chunkHashSize() );
+    bool read_error = false;
+    FileSizeType bytes_read = 0;
+    while( bytes_read < m_fileSize )
+    {
+      QByteArray chunk_data = file.read( FileChunkMap::chunkSize() );
+      if( chunk_data.isEmpty() )
+      {
+        read_error = true;
+        break;
+      }
+      m_chunkHashes.append( FileChunkMap::chunkHash( chunk_data ) );
+      bytes_read += chunk_data.size();
+    }
+    file.close();
+
+    if( !read_error )
+      m_contentHash = FileChunkMap::contentHash( m_chunkHashes );
+    else
+      m_chunkHashes.clear();
+  }
+
+  if( m_contentHash.isEmpty() )
+    qWarning() << "Unable to build the content hashes of the file" << qPrintable( m_filePath );
+
+  m_elapsedTime = elapsed_timer.elapsed();
+#ifdef BEEBEEP_DEBUG
+  qDebug() << "Content hashes of the file" << qPrintable( m_filePath ) << "built in" << m_elapsedTime << "ms";
+#endif
+  emit hashesCompleted();
+}
@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_BUILDFILEHASHES_H
+#define BEEBEEP_BUILDFILEHASHES_H
+
+#include "Config.h"
+
+
+class BuildFileHashes : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit BuildFileHashes( QObject* parent = Q_NULLPTR );
+
+  void setFilePath( const QString& );
+
+  inline const QString& filePath() const;
+  inline FileSizeType fileSize() const;
+  inline const QDateTime& lastModified() const;
+  inline const QByteArray& chunkHashes() const;
+  inline const QString& contentHash() const; // empty if the file can not be read
+  inline qint64 elapsedTime() const;
+
+signals:
+  void hashesCompleted();
+
+public slots:
+  void buildHashes();
+
+private:
+  QString m_filePath;
+  FileSizeType m_fileSize;
+  QDateTime m_lastModified;
+  QByteArray m_chunkHashes;
+  QString m_contentHash;
+  qint64 m_elapsedTime;
+
+};
+
+
+// Inline Functions
+inline const QString& BuildFileHashes::filePath() const { return m_filePath; }
+inline FileSizeType BuildFileHashes::fileSize() const { return m_fileSize; }
+inline const QDateTime& BuildFileHashes::lastModified() const { return m_lastModified; }
+inline const QByteArray& BuildFileHashes::chunkHashes() const { return m_chunkHashes; }
+inline const QString& BuildFileHashes::contentHash() const { return m_contentHash; }
+inline qint64 BuildFileHashes::elapsedTime() const { return m_elapsedTime; }
+
+#endif // BEEBEEP_BUILDFILEHASHES_H
@@ -0,0 +1,377 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "CipherContext.h"
+
+#if !defined( BEEBEEP_DISABLE_AESNI )
+  #if defined( __GNUC__ ) && ( defined( __x86_64__ ) || defined( __i386__ ) )
+    #define CIPHER_CONTEXT_USE_AESNI
+    #define CIPHER_CONTEXT_AESNI_TARGET __attribute__(( target( "aes,sse2" ) ))
+    #include <cpuid.h>
+    #include <wmmintrin.h>
+  #elif defined( _MSC_VER ) && ( defined( _M_X64 ) || defined( _M_IX86 ) )
+    #define CIPHER_CONTEXT_USE_AESNI
+    #define CIPHER_CONTEXT_AESNI_TARGET
+    #include <intrin.h>
+    #include <wmmintrin.h>
+  #endif
+#endif
+
+const int AUTHENTICATION_TAG_SIZE = 16;
+const int FRAME_COUNTER_SIZE = 8;
+const int STREAM_PARALLEL_BLOCKS = 4;
+
+
+#ifdef CIPHER_CONTEXT_USE_AESNI
+static bool cpuHasAesInstructions()
+{
+#if defined( _MSC_VER )
+  int cpu_info[ 4 ];
+  __cpuid( cpu_info, 1 );
+  return (cpu_info[ 2 ] & (1 << 25)) != 0;
+#else
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+    return false;
+  return (ecx & (1 << 25)) != 0;
+#endif
+}
+
+static const bool CPU_HAS_AES_INSTRUCTIONS = cpuHasAesInstructions();
+
+static CIPHER_CONTEXT_AESNI_TARGET void aesniXorKeyStream( const unsigned long* round_keys, int nrounds, const unsigned char* counter_block,
+                                                            unsigned char* data, int data_size )
+{
+  // Round keys of Rijndael tables are big endian words: AES-NI wants them as bytes
+  unsigned char rk_bytes[ (NROUNDS(ENCRYPTION_KEYBITS) + 1) * ENCRYPTED_DATA_BLOCK_SIZE ];
+  for( int i = 0; i < (nrounds + 1) * 4; i++ )
+  {
+    rk_bytes[ i * 4 ] = static_cast<unsigned char>( round_keys[ i ] >> 24 );
+    rk_bytes[ i * 4 + 1 ] = static_cast<unsigned char>( round_keys[ i ] >> 16 );
+    rk_bytes[ i * 4 + 2 ] = static_cast<unsigned char>( round_keys[ i ] >> 8 );
+    rk_bytes[ i * 4 + 3 ] = static_cast<unsigned char>( round_keys[ i ] );
+  }
+  __m128i rk[ NROUNDS(ENCRYPTION_KEYBITS) + 1 ];
+  for( int i = 0; i <= nrounds; i++ )
+    rk[ i ] = _mm_loadu_si128( reinterpret_cast<const __m128i*>( rk_bytes + i * ENCRYPTED_DATA_BLOCK_SIZE ) );
+
+  unsigned char counters[ STREAM_PARALLEL_BLOCKS * ENCRYPTED_DATA_BLOCK_SIZE ];
+  for( int i = 0; i < STREAM_PARALLEL_BLOCKS; i++ )
+    memcpy( counters + i * ENCRYPTED_DATA_BLOCK_SIZE, counter_block, ENCRYPTED_DATA_BLOCK_SIZE );
+
+  quint64 block_index = 0;
+  int pos = 0;
+  while( pos < data_size )
+  {
+    // Four independent blocks are ciphered together to fill the AES pipeline
+    __m128i blocks[ STREAM_PARALLEL_BLOCKS ];
+    for( int i = 0; i < STREAM_PARALLEL_BLOCKS; i++ )
+    {
+      qToBigEndian<quint64>( block_index + static_cast<quint64>( i ), counters + i * ENCRYPTED_DATA_BLOCK_SIZE + FRAME_COUNTER_SIZE );
+      blocks[ i ] = _mm_xor_si128( _mm_loadu_si128( reinterpret_cast<const __m128i*>( counters + i * ENCRYPTED_DATA_BLOCK_SIZE ) ), rk[ 0 ] );
+    }
+    for( int r = 1; r < nrounds; r++ )
+    {
+      for( int i = 0; i < STREAM_PARALLEL_BLOCKS; i++ )
+        blocks[ i ] = _mm_aesenc_si128( blocks[ i ], rk[ r ] );
+    }
+    for( int i = 0; i < STREAM_PARALLEL_BLOCKS; i++ )
+      blocks[ i ] = _mm_aesenclast_si128( blocks[ i ], rk[ nrounds ] );
+
+    for( int i = 0; i < STREAM_PARALLEL_BLOCKS && pos < data_size; i++ )
+    {
+      if( data_size - pos >= ENCRYPTED_DATA_BLOCK_SIZE )
+      {
+        __m128i data_block = _mm_loadu_si128( reinterpret_cast<const __m128i*>( data + pos ) );
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( data + pos ), _mm_xor_si128( data_block, blocks[ i ] ) );
+        pos += ENCRYPTED_DATA_BLOCK_SIZE;
+      }
+      else
+      {
+        unsigned char key_stream[ ENCRYPTED_DATA_BLOCK_SIZE ];
+        _mm_storeu_si128( reinterpret_cast<__m128i*>( key_stream ), blocks[ i ] );
+        for( int j = 0; pos < data_size; j++, pos++ )
+          data[ pos ] ^= key_stream[ j ];
+      }
+    }
+    block_index += STREAM_PARALLEL_BLOCKS;
+  }
+
+  memset( rk_bytes, 0, sizeof( rk_bytes ) );
+}
+#endif
+
+static QByteArray hmacHash( const QByteArray& key, const char* data_1, int size_1, const char* data_2, int size_2 )
+{
+#if QT_VERSION >= 0x050000
+  QCryptographicHash::Algorithm hash_algorithm = QCryptographicHash::Sha256;
+#else
+  // Never used in the frames: Qt4 datastream version does not allow the security level 5
+  QCryptographicHash::Algorithm hash_algorithm = QCryptographicHash::Sha1;
+#endif
+  const int hash_block_size = 64;
+  QByteArray hmac_key = key.size() > hash_block_size ? QCryptographicHash::hash( key, hash_algorithm ) : key;
+  hmac_key = hmac_key.leftJustified( hash_block_size, '\0' );
+  QByteArray inner_pad( hash_block_size, 0x36 );
+  QByteArray outer_pad( hash_block_size, 0x5c );
+  for( int i = 0; i < hash_block_size; i++ )
+  {
+    inner_pad[ i ] = static_cast<char>( inner_pad.at( i ) ^ hmac_key.at( i ) );
+    outer_pad[ i ] = static_cast<char>( outer_pad.at( i ) ^ hmac_key.at( i ) );
+  }
+
+  QCryptographicHash inner_hash( hash_algorithm );
+  inner_hash.addData( inner_pad );
+  if( size_1 > 0 )
+    inner_hash.addData( data_1, size_1 );
+  if( size_2 > 0 )
+    inner_hash.addData( data_2, size_2 );
+
+  QCryptographicHash outer_hash( hash_algorithm );
+  outer_hash.addData( outer_pad );
+  outer_hash.addData( inner_hash.result() );
+  return outer_hash.result();
+}
+
+static QByteArray deriveKey( const unsigned char* key_data, const char* key_label )
+{
+  QByteArray master_key( reinterpret_cast<const char*>( key_data ), KEYLENGTH(ENCRYPTION_KEYBITS) );
+  QByteArray derived_key = hmacHash( master_key, key_label, static_cast<int>( qstrlen( key_label ) ), Q_NULLPTR, 0 );
+  master_key.fill( '\0' );
+  return derived_key;
+}
+
+
+CipherContext::CipherContext()
+  : m_cipherKey(), m_protocolVersion( -1 ), m_isValid( false ), m_encryptRounds( 0 ), m_decryptRounds( 0 ),
+    m_useAuthenticatedEncryption( false ), m_streamRounds( 0 ), m_sendMacKey(), m_receiveMacKey(), m_sendCounter( 0 ), m_receiveCounter( 0 )
+{
+  memset( m_keyData, 0, sizeof( m_keyData ) );
+  memset( m_encryptRoundKeys, 0, sizeof( m_encryptRoundKeys ) );
+  memset( m_decryptRoundKeys, 0, sizeof( m_decryptRoundKeys ) );
+  memset( m_sendRoundKeys, 0, sizeof( m_sendRoundKeys ) );
+  memset( m_receiveRoundKeys, 0, sizeof( m_receiveRoundKeys ) );
+}
+
+bool CipherContext::hasHardwareAcceleration()
+{
+#ifdef CIPHER_CONTEXT_USE_AESNI
+  return CPU_HAS_AES_INSTRUCTIONS;
+#else
+  return false;
+#endif
+}
+
+void CipherContext::setup( const QByteArray& cipher_key, int proto_version, const unsigned char* key_data )
+{
+  clear();
+  m_cipherKey = cipher_key;
+  m_protocolVersion = proto_version;
+  if( cipher_key.isEmpty() || !key_data )
+    return;
+
+  memcpy( m_keyData, key_data, sizeof( m_keyData ) );
+  m_encryptRounds = rijndaelSetupEncrypt( m_encryptRoundKeys, key_data, ENCRYPTION_KEYBITS );
+  m_decryptRounds = rijndaelSetupDecrypt( m_decryptRoundKeys, key_data, ENCRYPTION_KEYBITS );
+  m_isValid = true;
+}
+
+void CipherContext::setupAuthenticatedEncryption( bool is_server_side )
+{
+  if( !m_isValid )
+    return;
+
+  QByteArray client_key = deriveKey( m_keyData, "BeeBEEP client to server key" );
+  QByteArray server_key = deriveKey( m_keyData, "BeeBEEP server to client key" );
+  QByteArray client_mac_key = deriveKey( m_keyData, "BeeBEEP client to server mac" );
+  QByteArray server_mac_key = deriveKey( m_keyData, "BeeBEEP server to client mac" );
+
+  const unsigned char* send_key = reinterpret_cast<const unsigned char*>( is_server_side ? server_key.constData() : client_key.constData() );
+  const unsigned char* receive_key = reinterpret_cast<const unsigned char*>( is_server_side ? client_key.constData() : server_key.constData() );
+  m_streamRounds = rijndaelSetupEncrypt( m_sendRoundKeys, send_key, ENCRYPTION_KEYBITS );
+  rijndaelSetupEncrypt( m_receiveRoundKeys, receive_key, ENCRYPTION_KEYBITS );
+  m_sendMacKey = is_server_side ? server_mac_key : client_mac_key;
+  m_receiveMacKey = is_server_side ? client_mac_key : server_mac_key;
+  m_sendCounter = 0;
+  m_receiveCounter = 0;
+  m_useAuthenticatedEncryption = true;
+
+  client_key.fill( '\0' );
+  server_key.fill( '\0' );
+}
+
+void CipherContext::clear()
+{
+  m_cipherKey = QByteArray();
+  m_protocolVersion = -1;
+  m_isValid = false;
+  m_encryptRounds = 0;
+  m_decryptRounds = 0;
+  memset( m_keyData, 0, sizeof( m_keyData ) );
+  memset( m_encryptRoundKeys, 0, sizeof( m_encryptRoundKeys ) );
+  memset( m_decryptRoundKeys, 0, sizeof( m_decryptRoundKeys ) );
+  m_useAuthenticatedEncryption = false;
+  m_streamRounds = 0;
+  memset( m_sendRoundKeys, 0, sizeof( m_sendRoundKeys ) );
+  memset( m_receiveRoundKeys, 0, sizeof( m_receiveRoundKeys ) );
+  m_sendMacKey.fill( '\0' );
+  m_sendMacKey = QByteArray();
+  m_receiveMacKey.fill( '\0' );
+  m_receiveMacKey = QByteArray();
+  m_sendCounter = 0;
+  m_receiveCounter = 0;
+}
+
+void CipherContext::encryptInPlace( QByteArray* byte_array ) const
+{
+  int encrypted_size = byte_array->size() - (byte_array->size() % ENCRYPTED_DATA_BLOCK_SIZE);
+  if( encrypted_size <= 0 )
+    return;
+  unsigned char* data_block = reinterpret_cast<unsigned char*>( byte_array->data() );
+  for( int i = 0; i < encrypted_size; i += ENCRYPTED_DATA_BLOCK_SIZE )
+    rijndaelEncrypt( m_encryptRoundKeys, m_encryptRounds, data_block + i, data_block + i );
+}
+
+void CipherContext::decryptInPlace( QByteArray* byte_array ) const
+{
+  int decrypted_size = byte_array->size() - (byte_array->size() % ENCRYPTED_DATA_BLOCK_SIZE);
+  if( decrypted_size <= 0 )
+    return;
+  unsigned char* data_block = reinterpret_cast<unsigned char*>( byte_array->data() );
+  for( int i = 0; i < decrypted_size; i += ENCRYPTED_DATA_BLOCK_SIZE )
+    rijndaelDecrypt( m_decryptRoundKeys, m_decryptRounds, data_block + i, data_block + i );
+}
+
+QByteArray CipherContext::encrypt( const QByteArray& text_to_encrypt ) const
+{
+  if( text_to_encrypt.isEmpty() )
+    return QByteArray();
+
+  if( m_cipherKey.isEmpty() )
+    return text_to_encrypt.toBase64();
+
+  QByteArray encrypted_byte_array = text_to_encrypt;
+  encryptInPlace( &encrypted_byte_array );
+  return encrypted_byte_array;
+}
+
+QByteArray CipherContext::decrypt( const QByteArray& text_to_decrypt ) const
+{
+  if( text_to_decrypt.isEmpty() )
+    return QByteArray();
+
+  if( m_cipherKey.isEmpty() )
+    return QByteArray::fromBase64( text_to_decrypt );
+
+  QByteArray decrypted_byte_array = text_to_decrypt;
+  decryptInPlace( &decrypted_byte_array );
+  return decrypted_byte_array;
+}
+
+void CipherContext::xorKeyStream( const unsigned long* round_keys, quint64 frame_counter, unsigned char* data, int data_size ) const
+{
+  // Counter block: [ frame counter (64bit) ][ block index (64bit) ]
+  unsigned char counter_block[ ENCRYPTED_DATA_BLOCK_SIZE ];
+  qToBigEndian<quint64>( frame_counter, counter_block );
+  qToBigEndian<quint64>( 0, counter_block + FRAME_COUNTER_SIZE );
+
+#ifdef CIPHER_CONTEXT_USE_AESNI
+  if( CPU_HAS_AES_INSTRUCTIONS )
+  {
+    aesniXorKeyStream( round_keys, m_streamRounds, counter_block, data, data_size );
+    return;
+  }
+#endif
+
+  unsigned char key_stream[ ENCRYPTED_DATA_BLOCK_SIZE ];
+  quint64 block_index = 0;
+  for( int pos = 0; pos < data_size; pos += ENCRYPTED_DATA_BLOCK_SIZE )
+  {
+    qToBigEndian<quint64>( block_index++, counter_block + FRAME_COUNTER_SIZE );
+    rijndaelEncrypt( round_keys, m_streamRounds, counter_block, key_stream );
+    int block_size = qMin( ENCRYPTED_DATA_BLOCK_SIZE, data_size - pos );
+    for( int i = 0; i < block_size; i++ )
+      data[ pos + i ] ^= key_stream[ i ];
+  }
+  memset( key_stream, 0, sizeof( key_stream ) );
+}
+
+QByteArray CipherContext::authenticationTag( const QByteArray& mac_key, const char* frame_data, int frame_size ) const
+{
+  return hmacHash( mac_key, frame_data, frame_size, Q_NULLPTR, 0 ).left( AUTHENTICATION_TAG_SIZE );
+}
+
+QByteArray CipherContext::encryptFrame( const QByteArray& data_frame )
+{
+  if( !m_useAuthenticatedEncryption )
+    return encrypt( data_frame );
+
+  if( data_frame.isEmpty() )
+    return QByteArray();
+
+  QByteArray encrypted_frame;
+  encrypted_frame.reserve( FRAME_COUNTER_SIZE + data_frame.size() + AUTHENTICATION_TAG_SIZE );
+  encrypted_frame.resize( FRAME_COUNTER_SIZE );
+  qToBigEndian<quint64>( m_sendCounter, reinterpret_cast<unsigned char*>( encrypted_frame.data() ) );
+  encrypted_frame.append( data_frame );
+  xorKeyStream( m_sendRoundKeys, m_sendCounter, reinterpret_cast<unsigned char*>( encrypted_frame.data() ) + FRAME_COUNTER_SIZE, data_frame.size() );
+  encrypted_frame.append( authenticationTag( m_sendMacKey, encrypted_frame.constData(), encrypted_frame.size() ) );
+  m_sendCounter++;
+  return encrypted_frame;
+}
+
+QByteArray CipherContext::decryptFrame( const QByteArray& encrypted_frame )
+{
+  if( !m_useAuthenticatedEncryption )
+    return decrypt( encrypted_frame );
+
+  int data_size = encrypted_frame.size() - FRAME_COUNTER_SIZE - AUTHENTICATION_TAG_SIZE;
+  if( data_size <= 0 )
+  {
+    qWarning() << "CipherContext has received a frame too short:" << encrypted_frame.size() << "bytes";
+    return QByteArray();
+  }
+
+  quint64 frame_counter = qFromBigEndian<quint64>( reinterpret_cast<const unsigned char*>( encrypted_frame.constData() ) );
+  if( frame_counter != m_receiveCounter )
+  {
+    qWarning() << "CipherContext has received the frame" << frame_counter << "but it waits for the frame" << m_receiveCounter;
+    return QByteArray();
+  }
+
+  QByteArray expected_tag = authenticationTag( m_receiveMacKey, encrypted_frame.constData(), FRAME_COUNTER_SIZE + data_size );
+  const char* frame_tag = encrypted_frame.constData() + FRAME_COUNTER_SIZE + data_size;
+  char tag_difference = 0;
+  for( int i = 0; i < AUTHENTICATION_TAG_SIZE; i++ )
+    tag_difference |= static_cast<char>( expected_tag.at( i ) ^ frame_tag[ i ] );
+  if( tag_difference != 0 )
+  {
+    qWarning() << "CipherContext has received a frame with an invalid authentication tag";
+    return QByteArray();
+  }
+
+  QByteArray decrypted_frame = encrypted_frame.mid( FRAME_COUNTER_SIZE, data_size );
+  xorKeyStream( m_receiveRoundKeys, frame_counter, reinterpret_cast<unsigned char*>( decrypted_frame.data() ), data_size );
+  m_receiveCounter++;
+  return decrypted_frame;
+}
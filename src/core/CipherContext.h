@@ -0,0 +1,101 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_CIPHERCONTEXT_H
+#define BEEBEEP_CIPHERCONTEXT_H
+
+#include "Config.h"
+#include "Rijndael.h"
+
+
+/*
+  Keeps the expanded round keys of a cipher key, so a connection runs the
+  key schedule once and not for every message.
+
+  Up to security level 4 data are processed in place in ECB blocks of
+  ENCRYPTED_DATA_BLOCK_SIZE bytes; trailing bytes of an incomplete block
+  are left untouched (as in the previous implementation).
+
+  Security level 5 uses authenticated encryption (AES-256 in CTR mode and
+  HMAC-SHA256, encrypt-then-MAC) with a different key for every direction:
+    [ frame counter (64bit) ][ encrypted data ][ tag (16 bytes) ]
+  The counter of the received frames must be the expected one, so replayed
+  or reordered frames are refused. AES-NI is used at runtime if available.
+*/
+
+class CipherContext
+{
+public:
+  CipherContext();
+
+  void setup( const QByteArray& cipher_key, int proto_version, const unsigned char* key_data );
+  void setupAuthenticatedEncryption( bool is_server_side );
+  void clear();
+
+  inline bool isValid() const;
+  inline bool isSetupFor( const QByteArray& cipher_key, int proto_version ) const;
+  inline bool useAuthenticatedEncryption() const;
+
+  QByteArray encrypt( const QByteArray& ) const;
+  QByteArray decrypt( const QByteArray& ) const;
+  void encryptInPlace( QByteArray* ) const;
+  void decryptInPlace( QByteArray* ) const;
+
+  // Frames of a connection: authenticated encryption is used if it has been negotiated
+  QByteArray encryptFrame( const QByteArray& );
+  QByteArray decryptFrame( const QByteArray& ); // empty if the frame is not authentic
+
+  static bool hasHardwareAcceleration();
+
+protected:
+  void xorKeyStream( const unsigned long* round_keys, quint64 frame_counter, unsigned char* data, int data_size ) const;
+  QByteArray authenticationTag( const QByteArray& mac_key, const char* frame_data, int frame_size ) const;
+
+private:
+  QByteArray m_cipherKey;
+  int m_protocolVersion;
+  bool m_isValid;
+  unsigned char m_keyData[ KEYLENGTH(ENCRYPTION_KEYBITS) ];
+  unsigned long m_encryptRoundKeys[ RKLENGTH(ENCRYPTION_KEYBITS) ];
+  unsigned long m_decryptRoundKeys[ RKLENGTH(ENCRYPTION_KEYBITS) ];
+  int m_encryptRounds;
+  int m_decryptRounds;
+
+  bool m_useAuthenticatedEncryption;
+  unsigned long m_sendRoundKeys[ RKLENGTH(ENCRYPTION_KEYBITS) ];
+  unsigned long m_receiveRoundKeys[ RKLENGTH(ENCRYPTION_KEYBITS) ];
+  int m_streamRounds;
+  QByteArray m_sendMacKey;
+  QByteArray m_receiveMacKey;
+  quint64 m_sendCounter;
+  quint64 m_receiveCounter;
+
+};
+
+
+// Inline Functions
+inline bool CipherContext::isValid() const { return m_isValid; }
+inline bool CipherContext::isSetupFor( const QByteArray& cipher_key, int proto_version ) const { return m_protocolVersion == proto_version && m_cipherKey == cipher_key; }
+inline bool CipherContext::useAuthenticatedEncryption() const { return m_useAuthenticatedEncryption; }
+
+#endif // BEEBEEP_CIPHERCONTEXT_H
@@ -0,0 +1,170 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "CipherSessionCache.h"
+#include "Protocol.h"
+#include "Random.h"
+
+
+CipherSessionCache* CipherSessionCache::mp_instance = Q_NULLPTR;
+const int CIPHER_SESSION_TIMEOUT = 600; // seconds
+const int CIPHER_SESSION_MAX_SIZE = 256;
+const int CIPHER_SESSION_NONCE_SIZE = 16;
+
+CipherSession::CipherSession()
+  : m_id(), m_secret(), m_expiresAt(), m_networkAddress()
+{
+}
+
+CipherSession::CipherSession( const CipherSession& cs )
+{
+  (void)operator=( cs );
+}
+
+CipherSession& CipherSession::operator=( const CipherSession& cs )
+{
+  if( this != &cs )
+  {
+    m_id = cs.m_id;
+    m_secret = cs.m_secret;
+    m_expiresAt = cs.m_expiresAt;
+    m_networkAddress = cs.m_networkAddress;
+  }
+  return *this;
+}
+
+bool CipherSession::isExpired() const
+{
+  return !m_expiresAt.isValid() || m_expiresAt <= QDateTime::currentDateTime();
+}
+
+CipherSessionCache::CipherSessionCache()
+  : m_sessions(), m_sessionIds()
+{
+}
+
+static QByteArray sessionHash( const char* label, const QByteArray& cipher_key )
+{
+#if QT_VERSION >= 0x050000
+  QCryptographicHash ch( QCryptographicHash::Sha256 );
+#else
+  QCryptographicHash ch( QCryptographicHash::Sha1 );
+#endif
+  ch.addData( label );
+  ch.addData( cipher_key );
+  return ch.result().toHex();
+}
+
+void CipherSessionCache::addSession( const NetworkAddress& peer_listener_address, const QByteArray& cipher_key, const QDateTime& expires_at )
+{
+  if( cipher_key.isEmpty() || !peer_listener_address.isHostAddressValid() || !peer_listener_address.isHostPortValid() )
+    return;
+
+  removeExpiredSessions();
+  (void)takeSession( peer_listener_address );
+  if( m_sessions.size() >= CIPHER_SESSION_MAX_SIZE )
+  {
+    qWarning() << "Cipher session cache is full and the session with" << qPrintable( peer_listener_address.toString() ) << "is not saved";
+    return;
+  }
+
+  CipherSession cs;
+  cs.setId( QString::fromLatin1( sessionHash( "BeeBEEP-session-id", cipher_key ).left( 32 ) ) );
+  cs.setSecret( sessionHash( "BeeBEEP-session-secret", cipher_key ) );
+  cs.setExpiresAt( expires_at.isValid() ? expires_at : QDateTime::currentDateTime().addSecs( CIPHER_SESSION_TIMEOUT ) );
+  cs.setNetworkAddress( peer_listener_address );
+  if( cs.isExpired() )
+    return;
+
+  m_sessions.insert( cs.id(), cs );
+  m_sessionIds.insert( peer_listener_address.toString(), cs.id() );
+#ifdef BEEBEEP_DEBUG
+  qDebug() << "Cipher session with" << qPrintable( peer_listener_address.toString() ) << "expires at" << qPrintable( cs.expiresAt().toString( Qt::ISODate ) );
+#endif
+}
+
+CipherSession CipherSessionCache::takeSession( const NetworkAddress& peer_listener_address )
+{
+  QString session_id = m_sessionIds.value( peer_listener_address.toString() );
+  if( session_id.isEmpty() )
+    return CipherSession();
+  return takeSession( session_id, peer_listener_address );
+}
+
+CipherSession CipherSessionCache::takeSession( const QString& session_id, const NetworkAddress& peer_listener_address )
+{
+  QHash<QString, CipherSession>::iterator it = m_sessions.find( session_id );
+  if( it == m_sessions.end() )
+    return CipherSession();
+  if( !(it.value().networkAddress() == peer_listener_address) )
+  {
+    qWarning() << "Cipher session" << qPrintable( session_id ) << "of" << qPrintable( it.value().networkAddress().toString() )
+               << "is requested by" << qPrintable( peer_listener_address.toString() ) << "and it is not resumed";
+    return CipherSession();
+  }
+  CipherSession cs = it.value();
+  m_sessions.erase( it );
+  if( !cs.isValid() )
+    return CipherSession();
+  m_sessionIds.remove( cs.networkAddress().toString() );
+  return cs.isExpired() ? CipherSession() : cs;
+}
+
+void CipherSessionCache::removeExpiredSessions()
+{
+  QHash<QString, CipherSession>::iterator it = m_sessions.begin();
+  while( it != m_sessions.end() )
+  {
+    if( it.value().isExpired() )
+    {
+      m_sessionIds.remove( it.value().networkAddress().toString() );
+      it = m_sessions.erase( it );
+    }
+    else
+      ++it;
+  }
+}
+
+void CipherSessionCache::clear()
+{
+  m_sessions.clear();
+  m_sessionIds.clear();
+}
+
+QString CipherSessionCache::createNonce()
+{
+  QByteArray nonce( CIPHER_SESSION_NONCE_SIZE, '\0' );
+  for( int i = 0; i < CIPHER_SESSION_NONCE_SIZE; i++ )
+    nonce[ i ] = static_cast<char>( Random::number32( 0, 255 ) );
+  return QString::fromLatin1( nonce.toHex() );
+}
+
+QByteArray CipherSessionCache::createCipherKey( const CipherSession& cs, const QString& client_nonce, const QString& server_nonce, int datastream_version )
+{
+  if( !cs.isValid() || client_nonce.isEmpty() || server_nonce.isEmpty() )
+    return QByteArray();
+  QByteArray session_key = cs.secret();
+  session_key.append( client_nonce.toLatin1() );
+  session_key.append( server_nonce.toLatin1() );
+  return Protocol::instance().createCipherKey( session_key, datastream_version );
+}
@@ -0,0 +1,121 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_CIPHERSESSIONCACHE_H
+#define BEEBEEP_CIPHERSESSIONCACHE_H
+
+#include "NetworkAddress.h"
+
+
+/*
+  Keeps a short-lived secret for each peer which has completed a full
+  ECDH handshake. Both peers derive the same session id and secret from
+  the cipher key, so a reconnection can create a fresh cipher key from
+  the secret and two random nonces without a new ECDH computation.
+  Every session can be resumed only once and never after its expiry.
+*/
+
+class CipherSession
+{
+public:
+  CipherSession();
+  CipherSession( const CipherSession& );
+
+  CipherSession& operator=( const CipherSession& );
+
+  inline bool isValid() const;
+  inline const QString& id() const;
+  inline void setId( const QString& );
+  inline const QByteArray& secret() const;
+  inline void setSecret( const QByteArray& );
+  inline const QDateTime& expiresAt() const;
+  inline void setExpiresAt( const QDateTime& );
+  inline const NetworkAddress& networkAddress() const;
+  inline void setNetworkAddress( const NetworkAddress& );
+
+  bool isExpired() const;
+
+private:
+  QString m_id;
+  QByteArray m_secret;
+  QDateTime m_expiresAt;
+  NetworkAddress m_networkAddress;
+
+};
+
+
+class CipherSessionCache
+{
+// Singleton Object
+  static CipherSessionCache* mp_instance;
+
+public:
+  // A session created from a resumed one keeps the same expiry (never extended)
+  void addSession( const NetworkAddress& peer_listener_address, const QByteArray& cipher_key, const QDateTime& expires_at = QDateTime() );
+  CipherSession takeSession( const NetworkAddress& peer_listener_address );
+  // A session is resumed only by the peer which has created it
+  CipherSession takeSession( const QString& session_id, const NetworkAddress& peer_listener_address );
+  void clear();
+
+  static QString createNonce();
+  static QByteArray createCipherKey( const CipherSession&, const QString& client_nonce, const QString& server_nonce, int datastream_version );
+
+  static CipherSessionCache& instance()
+  {
+    if( !mp_instance )
+      mp_instance = new CipherSessionCache();
+    return *mp_instance;
+  }
+
+  static void close()
+  {
+    if( mp_instance )
+    {
+      delete mp_instance;
+      mp_instance = Q_NULLPTR;
+    }
+  }
+
+protected:
+  CipherSessionCache();
+  void removeExpiredSessions();
+
+private:
+  QHash<QString, CipherSession> m_sessions; // by id
+  QHash<QString, QString> m_sessionIds; // by peer listener address
+
+};
+
+
+// Inline Functions
+inline bool CipherSession::isValid() const { return !m_id.isEmpty() && !m_secret.isEmpty(); }
+inline const QString& CipherSession::id() const { return m_id; }
+inline void CipherSession::setId( const QString& new_value ) { m_id = new_value; }
+inline const QByteArray& CipherSession::secret() const { return m_secret; }
+inline void CipherSession::setSecret( const QByteArray& new_value ) { m_secret = new_value; }
+inline const QDateTime& CipherSession::expiresAt() const { return m_expiresAt; }
+inline void CipherSession::setExpiresAt( const QDateTime& new_value ) { m_expiresAt = new_value; }
+inline const NetworkAddress& CipherSession::networkAddress() const { return m_networkAddress; }
+inline void CipherSession::setNetworkAddress( const NetworkAddress& new_value ) { m_networkAddress = new_value; }
+
+#endif // BEEBEEP_CIPHERSESSIONCACHE_H
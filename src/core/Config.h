@@ -79,6 +79,11 @@ const qint32 DATA_BLOCK_SIZE_32_LIMIT = 2147483615;
 #define ENCRYPTED_DATA_BLOCK_SIZE 16
 #define ENCRYPTION_KEYBITS 256
 #define MAX_NUM_OF_LOOP_IN_CONNECTON_SOCKECT 40
+// Outgoing data are collected and written together in the next event loop (or immediately over this size)
+const int MAX_OUTGOING_DATA_BUFFER_SIZE = 65536;
+// Bulk messages (file lists, vcards, desktop images) wait in a queue until the socket has sent the previous data
+const int BULK_SEND_QUEUE_MAX_SIZE = 8388608;
+const int BULK_SEND_QUEUE_WATERMARK = 131072;
 
 // Protocol version steps
 const int SECURE_LEVEL_2_PROTO_VERSION = 60;
@@ -101,9 +106,16 @@ const int SECURE_LEVEL_4_PROTO_VERSION = 90;
 const int VCARD_ROOM_LOCATION_PROTO_VERSION = 91;
 const int RECEIVED_MESSAGE_PROTO_VERSION = 93;
 const int SOURCE_CODE_MESSAGE_PROTO_VERSION = 95;
+const int BINARY_MESSAGE_PROTO_VERSION = 96;
+const int SECURE_LEVEL_5_PROTO_VERSION = 97;
+const int HIVE_DIGEST_PROTO_VERSION = 98;
+const int FILE_TRANSFER_WINDOW_PROTO_VERSION = 99;
+const int FILE_TRANSFER_SEGMENTS_PROTO_VERSION = 100;
+const int FILE_TRANSFER_CHUNK_HASHES_PROTO_VERSION = 101;
 
 // Tick interval in ms
 const int TICK_INTERVAL = 1000;
+const int TIMER_WHEEL_RESOLUTION = 100;
 const int PING_INTERVAL_IDLE = 4700;
 const int PING_INTERVAL_TICK = 7;
 const int PONG_DEFAULT_TIMEOUT = 21000;
@@ -22,6 +22,7 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "Connection.h"
+#include "MessageDecoder.h"
 #include "Protocol.h"
 #include "Settings.h"
 
@@ -29,13 +30,132 @@
 
 
 Connection::Connection( QObject *parent )
-  : ConnectionSocket( parent )
+  : ConnectionSocket( parent ), m_bulkSendQueue(), m_bulkSendQueueSize( 0 ), mp_messageDecoder( Q_NULLPTR )
 {
   connect( this, SIGNAL( dataReceived( const QByteArray& ) ), this, SLOT( parseData( const QByteArray& ) ) );
   connect( this, SIGNAL( pingRequest() ), this, SLOT( sendPing() ) );
+  connect( this, SIGNAL( bytesWritten( qint64 ) ), this, SLOT( sendBulkQueue() ) );
 }
 
-bool Connection::sendMessage( const Message& m )
+Connection::~Connection()
+{
+  // The decoder may live in the network thread
+  if( mp_messageDecoder )
+    mp_messageDecoder->deleteLater();
+}
+
+void Connection::closeConnection()
+{
+  m_bulkSendQueue.clear();
+  m_bulkSendQueueSize = 0;
+  ConnectionSocket::closeConnection();
+}
+
+void Connection::abortConnection()
+{
+  m_bulkSendQueue.clear();
+  m_bulkSendQueueSize = 0;
+  ConnectionSocket::abortConnection();
+}
+
+Connection::SendPriority Connection::sendPriority( const Message& m ) const
+{
+  switch( m.type() )
+  {
+  case Message::Beep:
+  case Message::Hello:
+  case Message::Ping:
+  case Message::Pong:
+  case Message::System:
+  case Message::Test:
+    return Connection::ControlPriority;
+  case Message::User:
+    if( m.hasFlag( Message::UserVCard ) )
+      return Connection::BulkPriority;
+    else
+      return Connection::ControlPriority;
+  case Message::Share:
+  case Message::Folder:
+  case Message::ShareBox:
+  case Message::ShareDesktop:
+    return Connection::BulkPriority;
+  default:
+    return Connection::ChatPriority;
+  }
+}
+
+int Connection::supersededKey( const Message& m ) const
+{
+  // Only the latest snapshot is useful: an older one still in queue can be replaced.
+  // Hive messages carry different users and ShareDesktop frames are diffs: they are never replaced
+  switch( m.type() )
+  {
+  case Message::User:
+    if( m.hasFlag( Message::UserVCard ) )
+      return (static_cast<int>( m.type() ) << Message::NumFlags) | m.flags();
+    else
+      return 0; // i.e. the writing messages of different chats
+  case Message::Share:
+    return (static_cast<int>( m.type() ) << Message::NumFlags) | m.flags();
+  default:
+    return 0;
+  }
+}
+
+bool Connection::addToBulkSendQueue( const Message& m, const QByteArray& message_frame )
+{
+  int superseded_key = supersededKey( m );
+  if( superseded_key > 0 )
+  {
+    for( int i = 0; i < m_bulkSendQueue.size(); i++ )
+    {
+      if( m_bulkSendQueue.at( i ).first == superseded_key )
+      {
+#ifdef BEEBEEP_DEBUG
+        qDebug() << "Connection" << qPrintable( networkAddress().toString() ) << "replaces the queued message type" << m.type() << "with a newer one";
+#endif
+        m_bulkSendQueueSize += message_frame.size() - m_bulkSendQueue.at( i ).second.size();
+        m_bulkSendQueue[ i ].second = message_frame;
+        return true;
+      }
+    }
+  }
+
+  if( !m_bulkSendQueue.isEmpty() && (m_bulkSendQueueSize + message_frame.size()) > BULK_SEND_QUEUE_MAX_SIZE )
+  {
+    qWarning() << "Connection" << qPrintable( networkAddress().toString() ) << "drops message type" << m.type() << "because its send queue is full:"
+               << m_bulkSendQueueSize << "bytes";
+    return false;
+  }
+
+  m_bulkSendQueue.append( qMakePair( superseded_key, message_frame ) );
+  m_bulkSendQueueSize += message_frame.size();
+  return true;
+}
+
+bool Connection::isBulkSendQueueBusy() const
+{
+  return !m_bulkSendQueue.isEmpty() || bytesToSend() >= BULK_SEND_QUEUE_WATERMARK;
+}
+
+void Connection::sendBulkQueue()
+{
+  while( !m_bulkSendQueue.isEmpty() && bytesToSend() < BULK_SEND_QUEUE_WATERMARK )
+  {
+    QByteArray message_frame = m_bulkSendQueue.takeFirst().second;
+    m_bulkSendQueueSize -= message_frame.size();
+    if( !sendFrame( message_frame ) )
+    {
+      qWarning() << "Unable to send queued message with size" << message_frame.size() << "to user" << userId();
+      m_bulkSendQueue.clear();
+      m_bulkSendQueueSize = 0;
+      emit abortRequest();
+      return;
+    }
+  }
+}
+
+QByteArray Connection::messageFrame( const Message& m ) const
 {
   QByteArray message_data = Protocol::instance().fromMessage( m, protocolVersion() );
   if( message_data.size() > 524288 )
@@ -46,7 +166,26 @@ bool Connection::sendMessage( const Message& m )
     qDebug() << qPrintable( networkAddress().toString() ) << "is sending this message:" << message_data;
 #endif
 
-  if( !sendData( message_data ) )
+  return dataFrame( message_data );
+}
+
+bool Connection::sendMessage( const Message& m )
+{
+  return sendMessageFrame( m, messageFrame( m ) );
+}
+
+bool Connection::sendMessageFrame( const Message& m, const QByteArray& message_frame )
+{
+  // Control and chat messages are sent immediately, bulk ones wait until the previous data has been sent
+  if( sendPriority( m ) == Connection::BulkPriority && isBulkSendQueueBusy() )
+  {
+    if( !addToBulkSendQueue( m, message_frame ) )
+      return false;
+    sendBulkQueue();
+    return true;
+  }
+
+  if( !sendFrame( message_frame ) )
   {
     qWarning() << "Unable to send message type" << m.type() << "and size" << m.text().size() << "to user" << userId();
     return false;
@@ -55,6 +194,14 @@ bool Connection::sendMessage( const Message& m )
     return true;
 }
 
+void Connection::parseBlock( const QByteArray& block_data )
+{
+  if( mp_messageDecoder )
+    QMetaObject::invokeMethod( mp_messageDecoder, "decodeBlock", Qt::QueuedConnection, Q_ARG( QByteArray, block_data ) );
+  else
+    ConnectionSocket::parseBlock( block_data );
+}
+
 void Connection::parseData( const QByteArray& message_data )
 {
   if( message_data.size() > 524288 )
@@ -63,11 +210,24 @@ void Connection::parseData( const QByteArray& message_data )
   Message m = Protocol::instance().toMessage( message_data, protocolVersion() );
   if( !m.isValid() )
   {
-    qWarning() << "Connection from" << qPrintable( networkAddress().toString() ) << "has received an invalid message data";
-    emit abortRequest();
+    onInvalidDataDecoded();
     return;
   }
 
+  parseMessage( m );
+}
+
+void Connection::onInvalidDataDecoded()
+{
+  qWarning() << "Connection from" << qPrintable( networkAddress().toString() ) << "has received an invalid message data";
+  emit abortRequest();
+}
+
+void Connection::parseMessage( const Message& m )
+{
+  if( !isConnected() )
+    return;
+
   switch( m.type() )
   {
   case Message::Ping:
@@ -90,6 +250,14 @@ void Connection::parseData( const QByteArray& message_data )
 void Connection::setReadyForUse( VNumber user_id )
 {
   setUserId( user_id );
+  if( !mp_messageDecoder )
+  {
+    // Protocol version and keys do not change after HELLO: next blocks can be decoded out of the main thread
+    mp_messageDecoder = new MessageDecoder;
+    mp_messageDecoder->setup( cipherContext(), protocolVersion(), isEncrypted(), isCompressed() );
+    connect( mp_messageDecoder, SIGNAL( messageDecoded( const Message& ) ), this, SLOT( parseMessage( const Message& ) ), Qt::QueuedConnection );
+    connect( mp_messageDecoder, SIGNAL( invalidDataDecoded() ), this, SLOT( onInvalidDataDecoded() ), Qt::QueuedConnection );
+  }
 }
 
 void Connection::sendPing()
@@ -26,6 +26,7 @@
 
 #include "ConnectionSocket.h"
 class Message;
+class MessageDecoder;
 
 
 class Connection : public ConnectionSocket
@@ -33,23 +34,51 @@ class Connection : public ConnectionSocket
   Q_OBJECT
 
 public:
+  enum SendPriority { ControlPriority, ChatPriority, BulkPriority };
+
   explicit Connection( QObject *parent = Q_NULLPTR );
+  virtual ~Connection();
 
   bool sendMessage( const Message& );
+  QByteArray messageFrame( const Message& ) const;
+  bool sendMessageFrame( const Message&, const QByteArray& );
   void setReadyForUse( VNumber );
   inline bool isReadyForUse() const;
+  inline MessageDecoder* messageDecoder() const;
+
+  bool isBulkSendQueueBusy() const;
+  inline int bulkSendQueueSize() const;
+
+  virtual void closeConnection();
+  virtual void abortConnection();
 
 signals:
   void newMessage( VNumber, const Message& );
 
 protected slots:
   void parseData( const QByteArray& );
+  void parseMessage( const Message& );
+  void onInvalidDataDecoded();
   void sendPing();
   void sendPong();
+  void sendBulkQueue();
+
+protected:
+  void parseBlock( const QByteArray& );
+  SendPriority sendPriority( const Message& ) const;
+  int supersededKey( const Message& ) const;
+  bool addToBulkSendQueue( const Message&, const QByteArray& );
+
+private:
+  QList< QPair<int, QByteArray> > m_bulkSendQueue;
+  int m_bulkSendQueueSize;
+  MessageDecoder* mp_messageDecoder;
 
 };
 
 // Inline Functions
 inline bool Connection::isReadyForUse() const { return isHelloSent() && userId() != ID_INVALID; }
+inline int Connection::bulkSendQueueSize() const { return m_bulkSendQueueSize; }
+inline MessageDecoder* Connection::messageDecoder() const { return mp_messageDecoder; }
 
 #endif // BEEBEEP_CONNECTION_H
@@ -0,0 +1,252 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "ConnectionAdmission.h"
+#include "Hive.h"
+#include "Random.h"
+#include "Settings.h"
+#include "TimerWheel.h"
+
+
+const int HANDSHAKE_QUEUE_MAX_SIZE = 1024;
+const int HANDSHAKE_BACKOFF_MIN = 2000; // ms
+const int HANDSHAKE_BACKOFF_MAX = 300000; // ms
+const int HANDSHAKE_BACKOFF_MAX_SIZE = 4096;
+const int UNREACHABLE_HOST_TIMEOUT = 120000; // ms
+
+ConnectionAdmission::ConnectionAdmission( QObject* parent )
+  : QObject( parent ), m_clock(), m_tokens( 0.0 ), m_lastRefill( 0 ), m_outgoingHandshakes( 0 ),
+    m_incomingHandshakes( 0 ), m_handshakes(), m_queue(), m_dequeuedAddress(), m_queueTimerId( 0 ),
+    m_backoffs(), m_unreachableHosts()
+{
+  setObjectName( "ConnectionAdmission" );
+  m_clock.start();
+  m_tokens = qMax( 1, Settings::instance().handshakesPerSecond() );
+}
+
+void ConnectionAdmission::refillTokens()
+{
+  qint64 now = m_clock.elapsed();
+  int rate = qMax( 1, Settings::instance().handshakesPerSecond() );
+  m_tokens = qMin( static_cast<double>( rate ), m_tokens + (now - m_lastRefill) * rate / 1000.0 );
+  m_lastRefill = now;
+}
+
+bool ConnectionAdmission::isBackingOff( const NetworkAddress& na )
+{
+  qint64 now = m_clock.elapsed();
+  QHash<QString, qint64>::iterator it_host = m_unreachableHosts.find( na.hostAddress().toString() );
+  if( it_host != m_unreachableHosts.end() )
+  {
+    if( it_host.value() > now )
+      return true;
+    m_unreachableHosts.erase( it_host );
+  }
+
+  QHash<QString, Backoff>::const_iterator it = m_backoffs.constFind( na.toString() );
+  return it != m_backoffs.constEnd() && it.value().retryAt > now;
+}
+
+bool ConnectionAdmission::isOutgoingAllowed()
+{
+  if( m_outgoingHandshakes >= qMax( 1, Settings::instance().maxConcurrentHandshakes() ) )
+    return false;
+  refillTokens();
+  return m_tokens >= 1.0;
+}
+
+ConnectionAdmission::Result ConnectionAdmission::admitOutgoing( const NetworkAddress& na )
+{
+  if( isBackingOff( na ) )
+  {
+#ifdef BEEBEEP_DEBUG
+    qDebug() << "Connection admission refuses" << qPrintable( na.toString() ) << "because it is in backoff";
+#endif
+    return Refused;
+  }
+
+  if( (m_queue.isEmpty() || na == m_dequeuedAddress) && isOutgoingAllowed() )
+  {
+    m_tokens -= 1.0;
+    m_queue.removeOne( na );
+    return Admitted;
+  }
+
+  enqueue( na );
+  return Queued;
+}
+
+bool ConnectionAdmission::admitIncoming() const
+{
+  return m_incomingHandshakes < qMax( 1, Settings::instance().maxConcurrentHandshakes() );
+}
+
+void ConnectionAdmission::addHandshake( QObject* connection, const NetworkAddress& na, bool is_outgoing )
+{
+  if( !connection || m_handshakes.contains( connection ) )
+    return;
+
+  Handshake hs;
+  hs.networkAddress = na;
+  hs.isOutgoing = is_outgoing;
+  hs.startedAt = m_clock.elapsed();
+  m_handshakes.insert( connection, hs );
+  if( is_outgoing )
+    m_outgoingHandshakes++;
+  else
+    m_incomingHandshakes++;
+}
+
+void ConnectionAdmission::handshakeCompleted( QObject* connection )
+{
+  QHash<QObject*, Handshake>::iterator it = m_handshakes.find( connection );
+  if( it == m_handshakes.end() )
+    return;
+
+  if( it.value().isOutgoing )
+  {
+    m_outgoingHandshakes--;
+    m_backoffs.remove( it.value().networkAddress.toString() );
+    if( Settings::instance().useHive() )
+      Hive::instance().setPeerHandshakeCompleted( it.value().networkAddress, static_cast<int>( m_clock.elapsed() - it.value().startedAt ) );
+  }
+  else
+    m_incomingHandshakes--;
+  m_unreachableHosts.remove( it.value().networkAddress.hostAddress().toString() );
+  m_handshakes.erase( it );
+
+  if( !m_queue.isEmpty() )
+    scheduleQueue( 0 );
+}
+
+void ConnectionAdmission::handshakeFailed( QObject* connection, bool host_unreachable )
+{
+  QHash<QObject*, Handshake>::iterator it = m_handshakes.find( connection );
+  if( it == m_handshakes.end() )
+    return;
+
+  if( it.value().isOutgoing )
+  {
+    m_outgoingHandshakes--;
+    const NetworkAddress& na = it.value().networkAddress;
+    qint64 now = m_clock.elapsed();
+    if( m_backoffs.size() >= HANDSHAKE_BACKOFF_MAX_SIZE )
+      removeExpiredBackoffs();
+    Backoff& bo = m_backoffs[ na.toString() ];
+    bo.failures++;
+    int delay = HANDSHAKE_BACKOFF_MIN << qMin( bo.failures - 1, 10 );
+    delay = qMin( delay, HANDSHAKE_BACKOFF_MAX );
+    bo.retryAt = now + delay + Random::number32( 0, delay / 4 ); // jitter avoids synchronized retries
+    if( host_unreachable )
+      m_unreachableHosts.insert( na.hostAddress().toString(), now + UNREACHABLE_HOST_TIMEOUT );
+    if( Settings::instance().useHive() )
+      Hive::instance().setPeerHandshakeFailed( na );
+#ifdef BEEBEEP_DEBUG
+    qDebug() << "Connection admission delays" << qPrintable( na.toString() ) << "for" << (bo.retryAt - now) << "ms after" << bo.failures << "failures"
+             << (host_unreachable ? "(host unreachable)" : "");
+#endif
+  }
+  else
+    m_incomingHandshakes--;
+  m_handshakes.erase( it );
+
+  if( !m_queue.isEmpty() )
+    scheduleQueue( 0 );
+}
+
+void ConnectionAdmission::removeExpiredBackoffs()
+{
+  qint64 now = m_clock.elapsed();
+  QHash<QString, Backoff>::iterator it = m_backoffs.begin();
+  while( it != m_backoffs.end() )
+  {
+    if( it.value().retryAt + HANDSHAKE_BACKOFF_MAX < now )
+      it = m_backoffs.erase( it );
+    else
+      ++it;
+  }
+}
+
+void ConnectionAdmission::enqueue( const NetworkAddress& na )
+{
+  if( !m_queue.contains( na ) )
+  {
+    if( m_queue.size() >= HANDSHAKE_QUEUE_MAX_SIZE )
+    {
+      qWarning() << "Connection admission queue is full and" << qPrintable( na.toString() ) << "is skipped";
+      return;
+    }
+    m_queue.append( na );
+#ifdef BEEBEEP_DEBUG
+    qDebug() << "Connection admission queues" << qPrintable( na.toString() ) << "-" << m_queue.size() << "peers waiting";
+#endif
+  }
+
+  if( m_outgoingHandshakes < qMax( 1, Settings::instance().maxConcurrentHandshakes() ) )
+  {
+    refillTokens();
+    int rate = qMax( 1, Settings::instance().handshakesPerSecond() );
+    scheduleQueue( m_tokens >= 1.0 ? 0 : static_cast<int>( (1.0 - m_tokens) * 1000.0 / rate ) + 1 );
+  }
+  // else the queue is processed when a handshake ends
+}
+
+void ConnectionAdmission::scheduleQueue( int msecs )
+{
+  if( m_queueTimerId > 0 )
+    return;
+  m_queueTimerId = TimerWheel::instance().schedule( msecs, this, "processQueue" );
+}
+
+void ConnectionAdmission::processQueue()
+{
+  m_queueTimerId = 0;
+  while( !m_queue.isEmpty() && isOutgoingAllowed() )
+  {
+    // The address is checked again by the core: its peer could be connected in the meantime
+    m_dequeuedAddress = m_queue.takeFirst();
+    emit outgoingAdmitted( m_dequeuedAddress.hostAddress(), m_dequeuedAddress.hostPort() );
+    m_dequeuedAddress = NetworkAddress();
+  }
+
+  if( !m_queue.isEmpty() && m_outgoingHandshakes < qMax( 1, Settings::instance().maxConcurrentHandshakes() ) )
+  {
+    int rate = qMax( 1, Settings::instance().handshakesPerSecond() );
+    scheduleQueue( static_cast<int>( (1.0 - m_tokens) * 1000.0 / rate ) + 1 );
+  }
+}
+
+void ConnectionAdmission::clear()
+{
+  if( m_queueTimerId > 0 )
+  {
+    TimerWheel::instance().cancel( m_queueTimerId );
+    m_queueTimerId = 0;
+  }
+  m_queue.clear();
+  m_handshakes.clear();
+  m_outgoingHandshakes = 0;
+  m_incomingHandshakes = 0;
+  m_backoffs.clear();
+  m_unreachableHosts.clear();
+}
@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_CONNECTIONADMISSION_H
+#define BEEBEEP_CONNECTIONADMISSION_H
+
+#include "NetworkAddress.h"
+
+
+/*
+  Admission control for the connection handshakes. Outgoing connections
+  are paced by a token bucket and limited in number, like the incoming
+  ones: the exceeding peers wait in a queue and are released when a
+  handshake ends. An address which fails the handshake is retried with
+  an exponential backoff and an unreachable host is ignored for a while.
+*/
+
+class ConnectionAdmission : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum Result { Admitted, Queued, Refused };
+
+  explicit ConnectionAdmission( QObject* );
+
+  Result admitOutgoing( const NetworkAddress& );
+  bool admitIncoming() const;
+
+  void addHandshake( QObject* connection, const NetworkAddress&, bool is_outgoing );
+  void handshakeCompleted( QObject* connection );
+  void handshakeFailed( QObject* connection, bool host_unreachable );
+
+  void clear();
+
+  inline int handshakes() const;
+  inline int queueSize() const;
+
+signals:
+  void outgoingAdmitted( const QHostAddress&, int );
+
+protected slots:
+  void processQueue();
+
+protected:
+  struct Handshake
+  {
+    Handshake() : networkAddress(), isOutgoing( false ), startedAt( 0 ) {}
+    NetworkAddress networkAddress;
+    bool isOutgoing;
+    qint64 startedAt;
+  };
+
+  struct Backoff
+  {
+    Backoff() : failures( 0 ), retryAt( 0 ) {}
+    int failures;
+    qint64 retryAt;
+  };
+
+  void refillTokens();
+  bool isBackingOff( const NetworkAddress& );
+  bool isOutgoingAllowed();
+  void enqueue( const NetworkAddress& );
+  void scheduleQueue( int msecs );
+  void removeExpiredBackoffs();
+
+private:
+  QElapsedTimer m_clock;
+  double m_tokens;
+  qint64 m_lastRefill;
+  int m_outgoingHandshakes;
+  int m_incomingHandshakes;
+  QHash<QObject*, Handshake> m_handshakes;
+  QList<NetworkAddress> m_queue;
+  NetworkAddress m_dequeuedAddress;
+  int m_queueTimerId;
+  QHash<QString, Backoff> m_backoffs; // by network address
+  QHash<QString, qint64> m_unreachableHosts; // by host address, expiry time
+
+};
+
+
+// Inline Functions
+inline int ConnectionAdmission::handshakes() const { return m_handshakes.size(); }
+inline int ConnectionAdmission::queueSize() const { return m_queue.size(); }
+
+#endif // BEEBEEP_CONNECTIONADMISSION_H
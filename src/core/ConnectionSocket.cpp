@@ -21,20 +21,28 @@
 //
 //////////////////////////////////////////////////////////////////////
 
+#include "BeeApplication.h"
+#include "CipherSessionCache.h"
 #include "ConnectionSocket.h"
+#include "ECDHKeyPool.h"
+#include "KeyExchangeJob.h"
+#include "MessageDecoder.h"
 #include "NetworkManager.h"
 #include "Protocol.h"
 #include "Settings.h"
+#include "TimerWheel.h"
 
 #undef CONNECTION_SOCKET_IO_DEBUG
 #undef CONNECTION_SOCKET_IO_DEBUG_VERBOSE
 
 
 ConnectionSocket::ConnectionSocket( QObject* parent )
-  : QTcpSocket( parent ), m_blockSize( 0 ), m_isHelloSent( false ), m_userId( ID_INVALID ), m_protocolVersion( 1 ),
-    m_publicKey1(), m_publicKey2(), m_ecdhKeys(), m_cipherKey(), m_networkAddress(), m_latestActivityDateTime(),
-    m_checkConnectionTimeout( false ), m_tickCounter( 0 ), m_isAborted( false ), m_datastreamVersion( 0 ),
-    m_isTestConnection( false ), m_serverPort( 0 ), m_isEncrypted( true ), m_isCompressed( false )
+  : QTcpSocket( parent ), m_blockReader(), m_isHelloSent( false ), m_userId( ID_INVALID ), m_protocolVersion( 1 ),
+    m_publicKey1(), m_publicKey2(), m_ecdhKeys(), m_cipherKey(), m_cipherContext(), m_networkAddress(), m_latestActivityDateTime(),
+    m_checkConnectionTimeout( false ), m_pingTimerId( 0 ), m_connectionTimeoutTimerId( 0 ), m_isAborted( false ), m_isWaitingFirstData( false ), m_datastreamVersion( 0 ),
+    m_isTestConnection( false ), m_serverPort( 0 ), m_isEncrypted( true ), m_isCompressed( false ),
+    m_outgoingData(), m_isOutgoingDataScheduled( false ), mp_keyExchangeJob( Q_NULLPTR ), m_helloData(), m_pendingBlocks(),
+    m_cipherSession(), m_sessionClientNonce(), m_sessionServerNonce(), m_peerListenerAddress()
 {
   if( Settings::instance().useKeepAliveOptionInSocket() )
     setSocketOption( QAbstractSocket::KeepAliveOption, 1 );
@@ -56,15 +64,16 @@ ConnectionSocket::ConnectionSocket( QObject* parent )
 void ConnectionSocket::initSocket( qintptr socket_descriptor, quint16 server_port )
 {
   m_isAborted = false;
+  m_isWaitingFirstData = true;
   setSocketDescriptor( socket_descriptor );
   m_networkAddress.setHostAddress( peerAddress() );
   m_networkAddress.setHostPort( peerPort() );
   m_serverPort = server_port;
-  m_tickCounter = 0;
+  m_blockReader.reset();
   m_checkConnectionTimeout = false;
   m_isEncrypted = true;
   m_isCompressed = false;
-  m_ecdhKeys.create();
+  m_ecdhKeys = ECDHKeyPool::instance().takeKeys();
 #ifdef BEEBEEP_DEBUG
   qDebug() << "Connection socket initializes peer with network address" << qPrintable( m_networkAddress.toString() ) << "and server port" << m_serverPort;
 #endif
@@ -73,22 +82,29 @@ void ConnectionSocket::initSocket( qintptr socket_descriptor, quint16 server_por
 void ConnectionSocket::connectToNetworkAddress( const NetworkAddress& network_address )
 {
   m_isAborted = false;
+  m_isWaitingFirstData = false;
   m_networkAddress = network_address;
-  m_tickCounter = 0;
+  m_blockReader.reset();
   m_checkConnectionTimeout = true;
   m_serverPort = 0;
   m_isEncrypted = true;
   m_isCompressed = false;
-  m_ecdhKeys.create();
+  m_ecdhKeys = ECDHKeyPool::instance().takeKeys();
   connectToHost( network_address.hostAddress(), network_address.hostPort() );
 }
 
 void ConnectionSocket::abortConnection()
 {
+  if( isConnected() )
+    writeOutgoingData();
+  m_outgoingData.clear();
   m_isAborted = true;
   m_userId = ID_INVALID;
   m_ecdhKeys.reset();
   m_cipherKey = QByteArray();
+  m_cipherContext.clear();
+  clearKeyExchange();
+  stopTimers();
   abort();
 }
 
@@ -99,12 +115,55 @@ void ConnectionSocket::closeConnection()
     flushAll();
     close();
   }
+  m_outgoingData.clear();
   m_ecdhKeys.reset();
   m_cipherKey = QByteArray();
+  m_cipherContext.clear();
+  clearKeyExchange();
+  stopTimers();
   m_userId = ID_INVALID;
   m_isAborted = true;
 }
 
+void ConnectionSocket::startTimers()
+{
+  stopTimers();
+  m_pingTimerId = TimerWheel::instance().schedule( PING_INTERVAL_TICK * TICK_INTERVAL, this, "onPingTimeout", true );
+  if( m_checkConnectionTimeout )
+    m_connectionTimeoutTimerId = TimerWheel::instance().schedule( Settings::instance().tickIntervalConnectionTimeout() * TICK_INTERVAL, this, "onConnectionTimeout" );
+}
+
+void ConnectionSocket::stopTimers()
+{
+  if( m_pingTimerId > 0 )
+  {
+    TimerWheel::instance().cancel( m_pingTimerId );
+    m_pingTimerId = 0;
+  }
+
+  if( m_connectionTimeoutTimerId > 0 )
+  {
+    TimerWheel::instance().cancel( m_connectionTimeoutTimerId );
+    m_connectionTimeoutTimerId = 0;
+  }
+}
+
+void ConnectionSocket::clearKeyExchange()
+{
+  // The result of a key exchange job still running is ignored
+  mp_keyExchangeJob = Q_NULLPTR;
+  m_helloData = QByteArray();
+  m_pendingBlocks.clear();
+  clearCipherSession();
+}
+
+void ConnectionSocket::clearCipherSession()
+{
+  m_cipherSession = CipherSession();
+  m_sessionClientNonce = QString();
+  m_sessionServerNonce = QString();
+}
+
 void ConnectionSocket::useCompression( bool compression_enabled )
 {
   m_isCompressed = compression_enabled;
@@ -127,6 +186,24 @@ void ConnectionSocket::useEncryption( bool encryption_enabled )
   }
 }
 
+CipherContext& ConnectionSocket::cipherContext()
+{
+  // Round keys are expanded again only if the key or the protocol version changes
+  if( !m_cipherContext.isSetupFor( cipherKey(), m_protocolVersion ) )
+  {
+    Protocol::instance().setupCipherContext( &m_cipherContext, cipherKey(), m_protocolVersion );
+    if( useSecureLevel5() )
+      m_cipherContext.setupAuthenticatedEncryption( isServerSocket() );
+  }
+  return m_cipherContext;
+}
+
+bool ConnectionSocket::useSecureLevel5() const
+{
+  // Authenticated encryption needs SHA-256 (datastream 13 is Qt 5.0)
+  return isKeysHandshakeCompleted() && m_protocolVersion >= SECURE_LEVEL_5_PROTO_VERSION && m_datastreamVersion >= 13;
+}
+
 const QByteArray& ConnectionSocket::cipherKey() const
 {
   return m_cipherKey.isEmpty() ? Settings::instance().password() : m_cipherKey;
@@ -138,9 +215,8 @@ qint64 ConnectionSocket::readBlock()
     return 0;
 
   m_latestActivityDateTime = QDateTime::currentDateTime();
-  qint64 bytes_available = bytesAvailable();
 
-  if( bytes_available == 0 )
+  if( bytesAvailable() == 0 )
   {
 #ifdef BEEBEEP_DEBUG
     qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "is empty... wait for more bytes";
@@ -148,118 +224,70 @@ qint64 ConnectionSocket::readBlock()
     return 0;
   }
 
-  // QByteArray
-  // If the byte array is null: 0xFFFFFFFF (quint32)
-  // Otherwise: the array size (quint32) followed by the array bytes, i.e. size bytes
-  QDataStream data_stream( this );
-  data_stream.setByteOrder( QDataStream::BigEndian );
-
-  if( m_datastreamVersion > 0 )
-  {
-    data_stream.setVersion( m_datastreamVersion );
-  }
-  else
+  if( m_isWaitingFirstData )
   {
-    if( m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION )
-      data_stream.setVersion( DATASTREAM_VERSION_2 );
-    else
-      data_stream.setVersion( DATASTREAM_VERSION_1 );
+    // The peer is accepted when it sends something: probes of the network scanners close without data
+    m_isWaitingFirstData = false;
+    emit firstDataReceived();
+    if( m_isAborted )
+      return 0;
   }
 
-#ifdef BEEBEEP_DEBUG
-  if( isConnecting() )
-    qDebug() << "Connection" << qPrintable( m_networkAddress.toString() ) << "uses datastream version:" << data_stream.version();
-#endif
+  // All the complete blocks already arrived are read in a single pass (the protocol version can change after HELLO)
+  qint64 bytes_read = 0;
+  QByteArray byte_array_read;
+  DataBlockReader::ReadResult read_result;
 
-  if( m_blockSize == 0 )
+  while( !m_isAborted )
   {
-    if( m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION )
+    read_result = m_blockReader.readBlock( this, m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION, &byte_array_read );
+
+    if( read_result == DataBlockReader::WaitingForData )
     {
-      if( static_cast<unsigned long>(bytes_available) < sizeof(DATA_BLOCK_SIZE_32) )
-      {
 #ifdef BEEBEEP_DEBUG
-        qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "has only" << bytes_available << "bytes... wait for more";
+      if( m_blockReader.isWaitingForBlockData() )
+        qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "has" << bytesAvailable() << "and wait for"
+                 << (m_blockReader.blockSize()-bytesAvailable()) << "more bytes, total" << m_blockReader.blockSize();
 #endif
-        return 0;
-      }
-      DATA_BLOCK_SIZE_32 block_size_32;
-      data_stream >> block_size_32;
-      m_blockSize = block_size_32 - sizeof(DATA_BLOCK_SIZE_32); // bytearray serialize format must be 32 bytes
+      break;
     }
-    else
+
+    if( read_result == DataBlockReader::InvalidBlock )
     {
-      if( static_cast<unsigned long>(bytes_available) < sizeof(DATA_BLOCK_SIZE_16) )
-      {
-#ifdef BEEBEEP_DEBUG
-        qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "has only" << bytes_available << "bytes... wait for more";
-#endif
-        return 0;
-      }
-      DATA_BLOCK_SIZE_16 block_size_16;
-      data_stream >> block_size_16;
-      m_blockSize = block_size_16 - sizeof(DATA_BLOCK_SIZE_32); // bytearray serialize format must be 32 bytes (not 16!!!)
+      qWarning() << "ConnectionSocket read an invalid block from" << qPrintable( m_networkAddress.toString() );
+      emit abortRequest();
+      break;
     }
-  }
 
 #if defined( CONNECTION_SOCKET_IO_DEBUG )
-  qDebug() << "ConnectionSocket read from" << qPrintable( m_networkAddress.toString() ) << "the block size:" << m_blockSize;
+    qDebug() << "ConnectionSocket read from" << qPrintable( m_networkAddress.toString() ) << "the block size:" << byte_array_read.size();
 #endif
 
-  if( bytes_available < m_blockSize )
-  {
-#ifdef BEEBEEP_DEBUG
-    qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "has" << bytes_available << "and wait for" << (m_blockSize-bytes_available) << "more bytes, total" << m_blockSize;
-#endif
-    return 0;
-  }
-
-  QByteArray byte_array_read;
-#if QT_VERSION >= 0x050700
-  data_stream.startTransaction();
-#endif
-  data_stream >> byte_array_read;
-
-#if QT_VERSION >= 0x050700
-  if( !data_stream.commitTransaction() )
-  {
-    data_stream.rollbackTransaction();
-#ifdef BEEBEEP_DEBUG
-    qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "cannot complete transaction and unable to read" << bytes_available;
-#endif
-    return 0;
-  }
-#endif
+    if( !m_blockReader.lastBlockHasValidSize() )
+      qWarning() << "ConnectionSocket read an invalid block size from" << qPrintable( m_networkAddress.toString() ) << ":"
+                 << byte_array_read.size() << "bytes read and a different size aspected";
 
-  if( byte_array_read.size() < 1 )
-  {
+    if( byte_array_read.isEmpty() )
+    {
 #ifdef BEEBEEP_DEBUG
-    qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "has" << bytes_available << "but it is busy and read 0 bytes";
+      qDebug() << "ConnectionSocket from" << qPrintable( m_networkAddress.toString() ) << "has read an empty block";
 #endif
-    return 0;
-  }
-
-  unsigned int byte_array_read_size = static_cast<unsigned int>( byte_array_read.size() );
+      continue;
+    }
 
-  if( byte_array_read_size != m_blockSize )
-  {
-    qWarning() << "ConnectionSocket read an invalid block size from" << qPrintable( m_networkAddress.toString() ) << ":"
-               << byte_array_read_size << "bytes read and" << m_blockSize << "bytes aspected";
+    bytes_read += byte_array_read.size();
+    if( isKeyExchangePending() )
+      m_pendingBlocks.append( byte_array_read ); // they are encrypted with the new cipher key
+    else
+      parseBlock( byte_array_read );
   }
 
-  m_blockSize = 0;
-  QByteArray decrypted_byte_array;
-
-  if( isEncrypted() )
-    decrypted_byte_array = Protocol::instance().decryptByteArray( byte_array_read, cipherKey(), m_protocolVersion );
-  else
-    decrypted_byte_array = byte_array_read;
+  return bytes_read;
+}
 
-  if( isCompressed() )
-  {
-    QByteArray uncompressed_byte_array = qUncompress( decrypted_byte_array );
-    if( !uncompressed_byte_array.isEmpty() )
-      decrypted_byte_array = uncompressed_byte_array;
-  }
+void ConnectionSocket::parseBlock( const QByteArray& byte_array_read )
+{
+  QByteArray decrypted_byte_array = MessageDecoder::decodeData( byte_array_read, &cipherContext(), isEncrypted(), isCompressed() );
 
 #if defined( CONNECTION_SOCKET_IO_DEBUG_VERBOSE )
   qDebug() << "ConnectionSocket reads from" << qPrintable( m_networkAddress.toString() ) << "the byte array:" << decrypted_byte_array;
@@ -268,23 +296,25 @@ qint64 ConnectionSocket::readBlock()
   if( m_userId == ID_INVALID )
   {
     m_checkConnectionTimeout = false;
+    if( m_connectionTimeoutTimerId > 0 )
+    {
+      TimerWheel::instance().cancel( m_connectionTimeoutTimerId );
+      m_connectionTimeoutTimerId = 0;
+    }
     checkHelloMessage( decrypted_byte_array );
   }
   else
     emit dataReceived( decrypted_byte_array );
-
-  return byte_array_read_size;
 }
 
 void ConnectionSocket::flushAll()
 {
-  int prevent_loop = 0;
-  while( bytesAvailable() && prevent_loop < (MAX_NUM_OF_LOOP_IN_CONNECTON_SOCKECT * 10) )
-  {
-    prevent_loop++;
+  if( bytesAvailable() )
     readBlock();
-  }
-  flush();
+  if( !m_outgoingData.isEmpty() )
+    writeOutgoingData();
+  else
+    flush();
 }
 
 QByteArray ConnectionSocket::serializeData( const QByteArray& bytes_to_send )
@@ -345,34 +375,65 @@ void ConnectionSocket::onBytesWritten( qint64 bytes_written )
     m_latestActivityDateTime = QDateTime::currentDateTime();
 }
 
-bool ConnectionSocket::sendData( const QByteArray& byte_array )
+bool ConnectionSocket::sendData( const QByteArray& byte_array, bool write_immediately )
 {
 #if defined( CONNECTION_SOCKET_IO_DEBUG_VERBOSE )
   qDebug() << "ConnectionSocket is sending to" << qPrintable( m_networkAddress.toString() ) << "the following data:" << byte_array;
 #endif
-  QByteArray byte_array_to_send;
+  return sendFrame( dataFrame( byte_array ), write_immediately );
+}
 
-  if( isCompressed() )
-  {
-    byte_array_to_send = qCompress( byte_array );
+QByteArray ConnectionSocket::dataFrame( const QByteArray& byte_array ) const
+{
+  if( !isCompressed() )
+    return byte_array;
+
+  QByteArray compressed_byte_array = qCompress( byte_array );
 #ifdef CONNECTION_SOCKET_IO_DEBUG_VERBOSE
-    qDebug() << "ConnectionSocket compress data to sent from" << byte_array.size() << "to" << byte_array_to_send.size() << "bytes";
+  qDebug() << "ConnectionSocket compress data to sent from" << byte_array.size() << "to" << compressed_byte_array.size() << "bytes";
 #endif
-    while( byte_array_to_send.size() % ENCRYPTED_DATA_BLOCK_SIZE )
-      byte_array_to_send.append( ' ' );
-  }
-  else
-    byte_array_to_send = byte_array;
+  while( compressed_byte_array.size() % ENCRYPTED_DATA_BLOCK_SIZE )
+    compressed_byte_array.append( ' ' );
+  return compressed_byte_array;
+}
 
+bool ConnectionSocket::sendFrame( const QByteArray& data_frame, bool write_immediately )
+{
+  QByteArray data_serialized;
   if( isEncrypted() )
-    byte_array_to_send = Protocol::instance().encryptByteArray( byte_array_to_send, cipherKey(), m_protocolVersion );
+    data_serialized = serializeData( cipherContext().encryptFrame( data_frame ) );
+  else
+    data_serialized = serializeData( data_frame );
 
-  QByteArray data_serialized = serializeData( byte_array_to_send );
+  // Data are collected and written together at the end of this event loop (it saves syscalls and packets)
+  if( m_outgoingData.isEmpty() )
+    m_outgoingData = data_serialized;
+  else
+    m_outgoingData.append( data_serialized );
+
+  if( write_immediately || m_outgoingData.size() >= MAX_OUTGOING_DATA_BUFFER_SIZE )
+    return writeOutgoingData();
+
+  if( !m_isOutgoingDataScheduled )
+  {
+    m_isOutgoingDataScheduled = true;
+    QTimer::singleShot( 0, this, SLOT( onOutgoingDataTimeout() ) );
+  }
+  return true;
+}
+
+bool ConnectionSocket::writeOutgoingData()
+{
+  if( m_outgoingData.isEmpty() )
+    return true;
+
+  QByteArray data_to_write = m_outgoingData;
+  m_outgoingData.clear();
 
-  if( write( data_serialized ) == data_serialized.size() )
+  if( write( data_to_write ) == data_to_write.size() )
   {
 #ifdef CONNECTION_SOCKET_IO_DEBUG
-    qDebug() << "ConnectionSocket sends" << data_serialized.size() << "bytes to" << qPrintable( m_networkAddress.toString() );
+    qDebug() << "ConnectionSocket sends" << data_to_write.size() << "bytes to" << qPrintable( m_networkAddress.toString() );
 #endif
     flush();
     return true;
@@ -384,11 +445,21 @@ bool ConnectionSocket::sendData( const QByteArray& byte_array )
   }
 }
 
+void ConnectionSocket::onOutgoingDataTimeout()
+{
+  m_isOutgoingDataScheduled = false;
+  if( m_isAborted || m_outgoingData.isEmpty() )
+    return;
+
+  if( !writeOutgoingData() )
+    emit abortRequest();
+}
+
 void ConnectionSocket::sendQuestionHello()
 {
   if( m_isTestConnection )
   {
-    if( sendData( Protocol::instance().testQuestionMessage( m_networkAddress ) ) )
+    if( sendData( Protocol::instance().testQuestionMessage( m_networkAddress ), true ) )
       qDebug() << "Connection TEST request sent to" << qPrintable( m_networkAddress.toString() );
   }
   else
@@ -397,8 +468,19 @@ void ConnectionSocket::sendQuestionHello()
 #ifdef CONNECTION_SOCKET_IO_DEBUG
     qDebug() << "ConnectionSocket is sending pkey1 with shared-key:" << qPrintable( m_publicKey1 );
 #endif
+    QString session_resumption = "";
+    if( !Settings::instance().disableConnectionSocketEncryption() && Settings::instance().useConnectionSessionResumption() )
+    {
+      m_cipherSession = CipherSessionCache::instance().takeSession( m_networkAddress );
+      if( m_cipherSession.isValid() )
+      {
+        m_sessionClientNonce = CipherSessionCache::createNonce();
+        session_resumption = Protocol::instance().sessionResumption( m_cipherSession.id(), m_sessionClientNonce );
+      }
+    }
+
     if( sendData( Protocol::instance().helloMessage( m_publicKey1, !Settings::instance().disableConnectionSocketEncryption(),
-                                                                   !Settings::instance().disableConnectionSocketDataCompression() ) ) )
+                                                     !Settings::instance().disableConnectionSocketDataCompression(), session_resumption ), true ) )
     {
 #ifdef BEEBEEP_DEBUG
       qDebug() << "ConnectionSocket sent question HELLO to" << qPrintable( m_networkAddress.toString() );
@@ -413,13 +495,13 @@ void ConnectionSocket::sendQuestionHello()
   }
 }
 
-void ConnectionSocket::sendAnswerHello( bool encryption_enabled, bool compression_enabled )
+void ConnectionSocket::sendAnswerHello( bool encryption_enabled, bool compression_enabled, const QString& session_resumption )
 {
   m_publicKey2 = m_ecdhKeys.publicKey();
 #ifdef CONNECTION_SOCKET_IO_DEBUG
   qDebug() << "ConnectionSocket is sending pkey2 with shared-key:" << qPrintable( m_publicKey2 );
 #endif
-  if( sendData( Protocol::instance().helloMessage( m_publicKey2, encryption_enabled, compression_enabled ) ) )
+  if( sendData( Protocol::instance().helloMessage( m_publicKey2, encryption_enabled, compression_enabled, session_resumption ), true ) )
   {
 #ifdef BEEBEEP_DEBUG
     qDebug() << "ConnectionSocket sent answer HELLO to" << qPrintable( m_networkAddress.toString() );
@@ -506,7 +588,7 @@ void ConnectionSocket::checkHelloMessage( const QByteArray& array_data )
   bool use_compression = m.hasFlag( Message::Compressed ) && !Settings::instance().disableConnectionSocketDataCompression();
 
   if( !isHelloSent() )
-    sendAnswerHello( use_encryption, use_compression );
+    sendAnswerHello( use_encryption, use_compression, acceptCipherSession( m, use_encryption ) );
 
   // After sending HELLO to ensure low protocol version compatibility
   m_protocolVersion = Protocol::instance().protocolVersion( m );
@@ -540,7 +622,17 @@ void ConnectionSocket::checkHelloMessage( const QByteArray& array_data )
 
   if( isEncrypted() )
   {
-    if( m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION )
+    if( isServerSocket() )
+      m_peerListenerAddress = NetworkAddress( m_networkAddress.hostAddress(), Protocol::instance().listenerPort( m ) );
+    else
+      m_peerListenerAddress = m_networkAddress;
+
+    if( resumeCipherSession( m ) )
+    {
+      qDebug() << "ConnectionSocket has resumed the cipher session with" << qPrintable( m_networkAddress.toString() );
+      logEncryptionLevel();
+    }
+    else if( m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION )
     {
       QString public_key = Protocol::instance().publicKey( m );
       if( !public_key.isEmpty() )
@@ -551,17 +643,14 @@ void ConnectionSocket::checkHelloMessage( const QByteArray& array_data )
           emit abortRequest();
           return;
         }
-        else
+        else if( isKeyExchangePending() )
         {
-          if( m_protocolVersion < SECURE_LEVEL_2_PROTO_VERSION )
-            qWarning() << "Old encryption level 1 (last one is 4) is activated with" << qPrintable( m_networkAddress.toString() );
-          else if( m_protocolVersion < SECURE_LEVEL_3_PROTO_VERSION )
-            qWarning() << "Old encryption level 2 (last one is 4) is activated with" << qPrintable( m_networkAddress.toString() );
-          else if( m_protocolVersion < SECURE_LEVEL_4_PROTO_VERSION )
-            qWarning() << "Old encryption level 3 (last one is 4) is activated with" << qPrintable( m_networkAddress.toString() );
-          else
-            qDebug() << "Encryption level 4 is activated with" << qPrintable( m_networkAddress.toString() );
+          // The handshake continues in onCipherKeyCreated() when the shared key is ready
+          m_helloData = array_data;
+          return;
         }
+        else
+          logEncryptionLevel();
       }
     }
     else
@@ -576,6 +665,108 @@ void ConnectionSocket::checkHelloMessage( const QByteArray& array_data )
   emit authenticationRequested( array_data );
 }
 
+void ConnectionSocket::logEncryptionLevel() const
+{
+  if( m_protocolVersion < SECURE_LEVEL_2_PROTO_VERSION )
+    qWarning() << "Old encryption level 1 (last one is 5) is activated with" << qPrintable( m_networkAddress.toString() );
+  else if( m_protocolVersion < SECURE_LEVEL_3_PROTO_VERSION )
+    qWarning() << "Old encryption level 2 (last one is 5) is activated with" << qPrintable( m_networkAddress.toString() );
+  else if( m_protocolVersion < SECURE_LEVEL_4_PROTO_VERSION )
+    qWarning() << "Old encryption level 3 (last one is 5) is activated with" << qPrintable( m_networkAddress.toString() );
+  else if( !useSecureLevel5() )
+    qDebug() << "Encryption level 4 is activated with" << qPrintable( m_networkAddress.toString() );
+  else
+    qDebug() << "Encryption level 5 is activated with" << qPrintable( m_networkAddress.toString() )
+             << (CipherContext::hasHardwareAcceleration() ? "(hardware accelerated)" : "");
+}
+
+QString ConnectionSocket::acceptCipherSession( const Message& m, bool encryption_enabled )
+{
+  QString session_id, client_nonce;
+  if( !encryption_enabled || !Settings::instance().useConnectionSessionResumption() || !Protocol::instance().sessionResumption( m, &session_id, &client_nonce ) )
+    return QString( "" );
+
+  // The session must be created with the same peer: its listener port is in HELLO
+  NetworkAddress peer_listener_address( m_networkAddress.hostAddress(), Protocol::instance().listenerPort( m ) );
+  m_cipherSession = CipherSessionCache::instance().takeSession( session_id, peer_listener_address );
+  if( !m_cipherSession.isValid() )
+  {
+    qDebug() << "ConnectionSocket has not a valid cipher session to resume with" << qPrintable( m_networkAddress.toString() ) << "and starts a full handshake";
+    return QString( "" );
+  }
+
+  m_sessionClientNonce = client_nonce;
+  m_sessionServerNonce = CipherSessionCache::createNonce();
+  return Protocol::instance().sessionResumption( m_cipherSession.id(), m_sessionServerNonce );
+}
+
+bool ConnectionSocket::resumeCipherSession( const Message& m )
+{
+  if( !m_cipherSession.isValid() )
+    return false;
+
+  if( !isServerSocket() )
+  {
+    QString session_id, server_nonce;
+    if( !Protocol::instance().sessionResumption( m, &session_id, &server_nonce ) || session_id != m_cipherSession.id() )
+    {
+      qDebug() << "ConnectionSocket has not resumed the cipher session with" << qPrintable( m_networkAddress.toString() ) << "and starts a full handshake";
+      clearCipherSession();
+      return false;
+    }
+    m_sessionServerNonce = server_nonce;
+  }
+
+  // The new session keeps the expiry of the one created by the full handshake
+  QDateTime session_expires_at = m_cipherSession.expiresAt();
+  m_cipherKey = CipherSessionCache::createCipherKey( m_cipherSession, m_sessionClientNonce, m_sessionServerNonce, m_datastreamVersion );
+  clearCipherSession();
+  if( m_cipherKey.isEmpty() )
+    return false;
+
+  m_ecdhKeys.reset();
+  m_publicKey1 = QByteArray();
+  m_publicKey2 = QByteArray();
+  CipherSessionCache::instance().addSession( m_peerListenerAddress, m_cipherKey, session_expires_at );
+  return true;
+}
+
+void ConnectionSocket::onCipherKeyCreated( const QByteArray& cipher_key )
+{
+  if( !mp_keyExchangeJob || sender() != mp_keyExchangeJob )
+    return;
+
+  QByteArray hello_data = m_helloData;
+  QList<QByteArray> pending_blocks = m_pendingBlocks;
+  clearKeyExchange();
+
+  if( m_isAborted )
+    return;
+
+  if( cipher_key.isEmpty() )
+  {
+    qWarning() << "Encryption handshake error. Unable to generate ECDH shared key with" << qPrintable( m_networkAddress.toString() );
+    emit abortRequest();
+    return;
+  }
+
+  m_cipherKey = cipher_key;
+  if( Settings::instance().useConnectionSessionResumption() )
+    CipherSessionCache::instance().addSession( m_peerListenerAddress, m_cipherKey );
+  logEncryptionLevel();
+#ifdef BEEBEEP_DEBUG
+  qDebug() << "ConnectionSocket request an authentication for" << qPrintable( m_networkAddress.toString() );
+#endif
+  emit authenticationRequested( hello_data );
+
+  foreach( QByteArray block_data, pending_blocks )
+  {
+    if( m_isAborted )
+      break;
+    parseBlock( block_data );
+  }
+}
+
 bool ConnectionSocket::createCipherKey( const QString& other_public_key )
 {
   if( m_publicKey1.isEmpty() )
@@ -605,15 +796,17 @@ bool ConnectionSocket::createCipherKey( const QString& other_public_key )
   qDebug() << "Encryption handshake completed with" << qPrintable( m_networkAddress.toString() );
 #endif
 
+  m_cipherKey = QByteArray();
   if( m_protocolVersion >= SECURE_LEVEL_4_PROTO_VERSION || Settings::instance().isConnectionKeyExchangeOnlyECDH() )
   {
-    if( !m_ecdhKeys.generateSharedKey( other_public_key ) )
-    {
-      qWarning() << "Encryption handshake error. Unable to generate ECDH shared key with" << qPrintable( m_networkAddress.toString() );
-      m_cipherKey = QByteArray();
-    }
-    else
-      m_cipherKey = Protocol::instance().createCipherKey( m_ecdhKeys.sharedKey(), m_datastreamVersion );
+    // ECDH shared key is computed in the network thread and it is received in onCipherKeyCreated()
+    KeyExchangeJob* key_exchange_job = new KeyExchangeJob;
+    key_exchange_job->setup( m_ecdhKeys, other_public_key, m_datastreamVersion );
+    connect( key_exchange_job, SIGNAL( cipherKeyCreated( const QByteArray& ) ), this, SLOT( onCipherKeyCreated( const QByteArray& ) ) );
+    mp_keyExchangeJob = key_exchange_job;
+    if( beeApp )
+      beeApp->addNetworkJob( key_exchange_job );
+    QMetaObject::invokeMethod( key_exchange_job, "createCipherKey", Qt::QueuedConnection );
   }
   else
     m_cipherKey = Protocol::instance().createCipherKey( m_publicKey1, m_publicKey2, m_datastreamVersion );
@@ -621,7 +814,7 @@ bool ConnectionSocket::createCipherKey( const QString& other_public_key )
   m_ecdhKeys.reset();
   m_publicKey1 = QByteArray();
   m_publicKey2 = QByteArray();
-  return !m_cipherKey.isEmpty();
+  return isKeyExchangePending() || !m_cipherKey.isEmpty();
 }
 
 int ConnectionSocket::fileTransferBufferSize() const
@@ -629,10 +822,11 @@ int ConnectionSocket::fileTransferBufferSize() const
   return m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION ? Settings::instance().fileTransferBufferSize() : qMin( static_cast<int>(65456), Settings::instance().fileTransferBufferSize() );
 }
 
-bool ConnectionSocket::checkConnectionTimeout( int ticks )
+void ConnectionSocket::onConnectionTimeout()
 {
-  if( ticks < Settings::instance().tickIntervalConnectionTimeout() )
-    return false;
+  m_connectionTimeoutTimerId = 0;
+  if( m_isAborted || !m_checkConnectionTimeout )
+    return;
 
   if( m_isTestConnection )
   {
@@ -640,10 +834,9 @@ bool ConnectionSocket::checkConnectionTimeout( int ticks )
     emit connectionTestCompleted( QObject::tr( "The connection to %1 was not successful." ).arg( m_networkAddress.toString() ) );
   }
   else
-    qDebug() << "Connection timeout for" << qPrintable( m_networkAddress.toString() ) << ":" << ticks << "ticks";
+    qDebug() << "Connection timeout for" << qPrintable( m_networkAddress.toString() ) << ":" << Settings::instance().tickIntervalConnectionTimeout() << "ticks";
   disconnectFromHost();
   emit disconnected();
-  return true;
 }
 
 int ConnectionSocket::activityIdle() const
@@ -669,31 +862,15 @@ int ConnectionSocket::activityIdle() const
     return 2147483647;
 }
 
-void ConnectionSocket::onTickEvent( int  )
+void ConnectionSocket::onPingTimeout()
 {
-  if( m_isAborted )
-    return;
-
-  m_tickCounter++;
-
-  if( m_checkConnectionTimeout && checkConnectionTimeout( m_tickCounter ) )
-    return;
-
-  if( isConnecting() )
+  if( m_isAborted || isConnecting() )
     return;
 
-  if( m_tickCounter > 31536000 )
-  {
-    // 1 year is passed ... it is time to close!
-    qWarning() << "A year in uptime is passed. It is time to close and restart connection" << qPrintable( m_networkAddress.toString() );
-    emit abortRequest();
-    return;
-  }
-
   qint64 bytes_available = bytesAvailable();
   if( bytes_available > 0 )
   {
-    if( m_blockSize == 0 || bytes_available >= m_blockSize )
+    if( m_blockReader.isBlockAvailable( bytes_available, m_protocolVersion > SECURE_LEVEL_2_PROTO_VERSION ) )
     {
 #ifdef BEEBEEP_DEBUG
       qDebug() << qPrintable( m_networkAddress.toString() ) << "has" << bytes_available << "bytes available: read forced";
@@ -703,8 +880,7 @@ void ConnectionSocket::onTickEvent( int  )
     }
   }
 
-  if( m_tickCounter % PING_INTERVAL_TICK == 0 )
-    emit pingRequest();
+  emit pingRequest();
 }
 
 bool ConnectionSocket::checkTestMessage( const Message& m )
@@ -744,13 +920,13 @@ bool ConnectionSocket::checkTestMessage( const Message& m )
       else
         answer_msg += QObject::tr( "The connection to port %1 was successful." ).arg( tested_na.hostPort() );
 
-      if( sendData( Protocol::instance().testAnswerMessage( tested_na, true, answer_msg ) ) )
+      if( sendData( Protocol::instance().testAnswerMessage( tested_na, true, answer_msg ), true ) )
         qDebug() << "Connection TEST from" << qPrintable( m_networkAddress.toString() ) << "successfully completed";
     }
     else
     {
       qDebug() << "Connection TEST from" << qPrintable( m_networkAddress.toString() ) << "refused";
-      sendData( Protocol::instance().testAnswerMessage( tested_na, false, QObject::tr( "Unable to complete the test with an invalid network address.") ) );
+      sendData( Protocol::instance().testAnswerMessage( tested_na, false, QObject::tr( "Unable to complete the test with an invalid network address.") ), true );
     }
   }
   else if( Protocol::instance().isTestAnswerMessage( m ) )
@@ -24,6 +24,9 @@
 #ifndef BEEBEEP_CONNECTIONSOCKET_H
 #define BEEBEEP_CONNECTIONSOCKET_H
 
+#include "CipherContext.h"
+#include "CipherSessionCache.h"
+#include "DataBlockReader.h"
 #include "ECDH.h"
 #include "NetworkAddress.h"
 
@@ -40,7 +43,11 @@ public:
   void connectToNetworkAddress( const NetworkAddress& );
   void initSocket( qintptr, quint16 server_port );
 
-  bool sendData( const QByteArray& );
+  bool sendData( const QByteArray&, bool write_immediately = false );
+  // A frame is the data after compression: it is the same for all the connections with the same frameKey()
+  QByteArray dataFrame( const QByteArray& ) const;
+  bool sendFrame( const QByteArray&, bool write_immediately = false );
+  inline int frameKey() const;
 
   void flushAll();
   virtual void closeConnection();
@@ -51,6 +58,7 @@ public:
 
   inline int protocolVersion() const;
   int fileTransferBufferSize() const;
+  inline qint64 bytesToSend() const;
 
   inline bool isConnected() const;
   inline bool isConnecting() const;
@@ -59,7 +67,8 @@ public:
   int activityIdle() const; // ms idle
   inline const NetworkAddress& networkAddress() const;
 
-  void onTickEvent( int );
+  void startTimers();
+  void stopTimers();
 
   inline bool isTestConnection() const;
   inline void setTestConnection( bool );
@@ -74,21 +83,35 @@ signals:
   void abortRequest();
   void pingRequest();
   void connectionTestCompleted( const QString& );
+  void firstDataReceived();
 
 protected slots:
   qint64 readBlock();
   void sendQuestionHello();
   void onBytesWritten( qint64 );
+  void onOutgoingDataTimeout();
+  void onCipherKeyCreated( const QByteArray& );
+  void onPingTimeout();
+  void onConnectionTimeout();
 
 protected:
   inline bool isHelloSent() const;
-  void sendAnswerHello( bool encryption_enabled, bool compression_enabled );
+  void sendAnswerHello( bool encryption_enabled, bool compression_enabled, const QString& session_resumption );
   void checkHelloMessage( const QByteArray& );
+  virtual void parseBlock( const QByteArray& );
   QByteArray serializeData( const QByteArray& );
+  bool writeOutgoingData();
   const QByteArray& cipherKey() const;
+  CipherContext& cipherContext();
+  bool useSecureLevel5() const;
   bool createCipherKey( const QString& other_public_key );
+  inline bool isKeyExchangePending() const;
+  void clearKeyExchange();
+  void logEncryptionLevel() const;
+  QString acceptCipherSession( const Message&, bool encryption_enabled );
+  bool resumeCipherSession( const Message& );
+  void clearCipherSession();
 
-  bool checkConnectionTimeout( int );
   bool checkTestMessage( const Message& );
 
   inline bool isKeysHandshakeCompleted() const;
@@ -96,8 +119,7 @@ protected:
   void useCompression( bool );
 
 private:
-  // max block size contains lowers
-  DATA_BLOCK_SIZE_32 m_blockSize;
+  DataBlockReader m_blockReader;
   bool m_isHelloSent;
   VNumber m_userId;
   int m_protocolVersion;
@@ -105,13 +127,16 @@ private:
   QString m_publicKey2;
   ECDH::Keys m_ecdhKeys;
   QByteArray m_cipherKey;
+  CipherContext m_cipherContext;
 
   NetworkAddress m_networkAddress;
 
   QDateTime m_latestActivityDateTime;
   bool m_checkConnectionTimeout;
-  int m_tickCounter;
+  int m_pingTimerId;
+  int m_connectionTimeoutTimerId;
   bool m_isAborted;
+  bool m_isWaitingFirstData;
 
   int m_datastreamVersion;
   int m_pingByteArraySize;
@@ -123,6 +148,18 @@ private:
   bool m_isEncrypted;
   bool m_isCompressed;
 
+  QByteArray m_outgoingData;
+  bool m_isOutgoingDataScheduled;
+
+  QObject* mp_keyExchangeJob;
+  QByteArray m_helloData;
+  QList<QByteArray> m_pendingBlocks;
+
+  CipherSession m_cipherSession;
+  QString m_sessionClientNonce;
+  QString m_sessionServerNonce;
+  NetworkAddress m_peerListenerAddress;
+
 };
 
 
@@ -141,5 +178,8 @@ inline bool ConnectionSocket::isKeysHandshakeCompleted() const { return !m_ciphe
 inline bool ConnectionSocket::isEncrypted() const { return m_isEncrypted; }
 inline bool ConnectionSocket::isCompressed() const { return m_isCompressed; }
 inline bool ConnectionSocket::isHelloSent() const { return m_isHelloSent; }
+inline int ConnectionSocket::frameKey() const { return (m_protocolVersion << 1) | (m_isCompressed ? 1 : 0); }
+inline qint64 ConnectionSocket::bytesToSend() const { return bytesToWrite() + m_outgoingData.size(); }
+inline bool ConnectionSocket::isKeyExchangePending() const { return mp_keyExchangeJob != Q_NULLPTR; }
 
 #endif // BEEBEEP_CONNECTIONSOCKET_H
@@ -24,14 +24,17 @@
 #include "BeeApplication.h"
 #include "BeeUtils.h"
 #include "Connection.h"
+#include "ConnectionAdmission.h"
 #include "Core.h"
 #include "Broadcaster.h"
+#include "ECDHKeyPool.h"
 #include "FileShare.h"
 #include "IconManager.h"
 #include "Settings.h"
 #include "MessageManager.h"
 #include "NetworkManager.h"
 #include "Protocol.h"
+#include "TimerWheel.h"
 #include "UserManager.h"
 #include "Updater.h"
 #include "GAnalytics.h"
@@ -49,14 +52,16 @@ Core *Core::mp_instance = Q_NULLPTR;
 
 
 Core::Core( QObject* parent )
- : QObject( parent ), m_connections()
+ : QObject( parent ), m_connections(), m_broadcastTimerId( 0 ), m_autoSaveTimerId( 0 ), m_userMessagesTimerId( 0 )
 {
   mp_instance = this;
   setObjectName( "BeeCore" );
   qRegisterMetaType<VNumber>( "VNumber" );
+  qRegisterMetaType<Message>( "Message" );
 
   mp_listener = new Listener( this );
   mp_broadcaster = new Broadcaster( this );
+  mp_connectionAdmission = new ConnectionAdmission( this );
   mp_fileTransfer = new FileTransfer( this );
   m_shareListToBuild = 0;
 
@@ -77,6 +82,7 @@ Core::Core( QObject* parent )
 #endif
 
   connect( mp_broadcaster, SIGNAL( newPeerFound( const QHostAddress&, int ) ), this, SLOT( newPeerFound( const QHostAddress&, int ) ) );
+  connect( mp_connectionAdmission, SIGNAL( outgoingAdmitted( const QHostAddress&, int ) ), this, SLOT( newPeerFound( const QHostAddress&, int ) ) );
   connect( mp_listener, SIGNAL( newConnection( qintptr ) ), this, SLOT( checkNewConnection( qintptr ) ) );
   connect( mp_fileTransfer, SIGNAL( listening() ), this, SLOT( onFileTransferServerListening() ) );
   connect( mp_fileTransfer, SIGNAL( progress( VNumber, VNumber, const FileInfo&, FileSizeType, qint64 ) ), this, SLOT( checkFileTransferProgress( VNumber, VNumber, const FileInfo&, FileSizeType, qint64 ) ) );
@@ -98,6 +104,7 @@ void Core::init()
 #ifdef BEEBEEP_USE_VOICE_CHAT
   voicePlayer()->init();
 #endif
+  scheduleNetworkCheck();
 }
 
 QHostAddress Core::multicastGroupAddress() const
@@ -234,6 +241,7 @@ bool Core::start()
 
   qDebug() << "Listener binds" << qPrintable( mp_listener->serverAddress().toString() ) << mp_listener->serverPort();
   Settings::instance().setLocalUserHost( NetworkManager::instance().localHostAddress(), mp_listener->serverPort() );
+  ECDHKeyPool::instance().scheduleFill();
 
 #ifdef BEEBEEP_DEBUG
   qDebug() << "Network password used:" << Settings::instance().passwordBeforeHash();
@@ -335,6 +343,9 @@ bool Core::start()
   QTimer::singleShot( 12000, this, SLOT( startDnsMulticasting() ) );
 #endif
 
+  if( Settings::instance().tickIntervalChatAutoSave() > 0 )
+    m_autoSaveTimerId = TimerWheel::instance().schedule( Settings::instance().tickIntervalChatAutoSave() * TICK_INTERVAL, this, "autoSaveChatMessages", true );
+
   emit connected();
   return true;
 }
@@ -391,6 +402,12 @@ void Core::stop()
 {
   qDebug() << "Stopping network core...";
   UserManager::instance().clearNewConnectedUserIdList();
+  TimerWheel::instance().cancel( m_broadcastTimerId );
+  m_broadcastTimerId = 0;
+  TimerWheel::instance().cancel( m_autoSaveTimerId );
+  m_autoSaveTimerId = 0;
+  TimerWheel::instance().cancel( m_userMessagesTimerId );
+  m_userMessagesTimerId = 0;
   mp_broadcaster->stopBroadcasting();
 
 #ifdef BEEBEEP_USE_MULTICAST_DNS
@@ -410,6 +427,7 @@ void Core::stop()
     closeConnection( c );
 
   m_connections.clear();
+  mp_connectionAdmission->clear();
   checkSavingPaths();
   saveUsersAndGroups();
   MessageManager::instance().saveMessages( true );
@@ -517,6 +535,13 @@ void Core::sendBroadcastMessage()
                                                                            Settings::instance().programName() ), DispatchToChat, ChatMessage::Connection, false );
   showMessage( tr( "Searching users" ), 3000 );
   mp_broadcaster->sendBroadcast();
+
+  // The next round is counted from the latest one also if it is requested by the user
+  TimerWheel::instance().cancel( m_broadcastTimerId );
+  if( Settings::instance().tickIntervalBroadcasting() > 0 )
+    m_broadcastTimerId = TimerWheel::instance().schedule( Settings::instance().tickIntervalBroadcasting() * TICK_INTERVAL, this, "sendBroadcastMessage" );
+  else
+    m_broadcastTimerId = 0;
 }
 
 bool Core::isConnected() const
@@ -662,60 +687,76 @@ void Core::onPostUsageStatisticsJobCompleted()
   ga->deleteLater();
 }
 
-void Core::onTickEvent( int ticks )
+void Core::scheduleUserMessagesCheck()
 {
-  if( isConnected() )
+  if( m_userMessagesTimerId > 0 && TimerWheel::instance().isScheduled( m_userMessagesTimerId ) )
+    return;
+  m_userMessagesTimerId = TimerWheel::instance().schedule( TICK_INTERVAL, this, "checkUserMessages" );
+}
+
+void Core::scheduleNetworkCheck()
+{
+  // Interval is read every time because it can be changed while the application is running
+  if( Settings::instance().tickIntervalCheckNetwork() > 0 )
+    (void)TimerWheel::instance().schedule( Settings::instance().tickIntervalCheckNetwork() * TICK_INTERVAL, this, "onCheckNetworkTimeout" );
+}
+
+void Core::checkUserMessages()
+{
+  m_userMessagesTimerId = 0;
+  if( !isConnected() )
+    return;
+
+  bool has_more_messages_to_send = false;
+  if( UserManager::instance().hasNewConnectedUsers() )
   {
-    if( UserManager::instance().hasNewConnectedUsers() )
+    QList<User> new_connected_users = UserManager::instance().newConnectedUserList().toList();
+    int user_count = 0;
+    foreach( User u, new_connected_users )
     {
-      QList<User> new_connected_users = UserManager::instance().newConnectedUserList().toList();
-      int user_count = 0;
-      foreach( User u, new_connected_users )
-      {
-        user_count++;
-        if( user_count > qMax( 5, Settings::instance().maxUsersToConnectInATick() ) )
-          break;
-        int group_chats = checkGroupChatAfterUserReconnect( u );
-        int offline_messages = checkOfflineMessagesForUser( u, true );
-        if( Settings::instance().useHive() )
-          sendLocalConnectedUsersTo( u );
-        UserManager::instance().removeNewConnectedUserId( u.id() );
-        if( group_chats > 0 || offline_messages > 0 )
-          qDebug() << "You have sent to" << qPrintable( u.path() ) << group_chats << "group chats and" << offline_messages << "offline messages";
-      }
+      user_count++;
+      if( user_count > qMax( 5, Settings::instance().maxUsersToConnectInATick() ) )
+        break;
+      int group_chats = checkGroupChatAfterUserReconnect( u );
+      int offline_messages = checkOfflineMessagesForUser( u, true );
+      if( Settings::instance().useHive() )
+        sendLocalConnectedUsersTo( u );
+      UserManager::instance().removeNewConnectedUserId( u.id() );
+      if( group_chats > 0 || offline_messages > 0 )
+        qDebug() << "You have sent to" << qPrintable( u.path() ) << group_chats << "group chats and" << offline_messages << "offline messages";
     }
-    else
+    has_more_messages_to_send = true;
+  }
+  else
+  {
+    VNumber user_id = MessageManager::instance().nextUserWithUnsentMessages();
+    if( user_id != ID_INVALID )
     {
-      VNumber user_id = MessageManager::instance().nextUserWithUnsentMessages();
-      if( user_id != ID_INVALID )
+      User u = UserManager::instance().findUser( user_id );
+      if( u.isValid() && u.isStatusConnected() )
       {
-        User u = UserManager::instance().findUser( user_id );
-        if( u.isValid() && u.isStatusConnected() )
+        int offline_messages = checkOfflineMessagesForUser( u, false );
+        if( offline_messages > 0 )
         {
-          int offline_messages = checkOfflineMessagesForUser( u, false );
-          if( offline_messages > 0 )
-            qDebug() << "You have sent to" << qPrintable( u.path() ) << offline_messages << "offline messages";
+          qDebug() << "You have sent to" << qPrintable( u.path() ) << offline_messages << "offline messages";
+          has_more_messages_to_send = true;
         }
       }
     }
+  }
 
-    mp_broadcaster->onTickEvent( ticks );
-
-    if( Settings::instance().tickIntervalBroadcasting() > 0 && (ticks % Settings::instance().tickIntervalBroadcasting() == 0) )
-      sendBroadcastMessage();
-
-    foreach( Connection* c, m_connections )
-      c->onTickEvent( ticks );
-
-    if( mp_fileTransfer->isActive() )
-      mp_fileTransfer->onTickEvent( ticks );
+  // Nothing is scheduled when there are not messages to send
+  if( has_more_messages_to_send )
+    scheduleUserMessagesCheck();
+}
 
-    if( Bee::isTimeToCheck( ticks, Settings::instance().tickIntervalChatAutoSave() ) )
-      QMetaObject::invokeMethod( this, "autoSaveChatMessages", Qt::QueuedConnection );
-  }
+void Core::onCheckNetworkTimeout()
+{
+  scheduleNetworkCheck();
+  if( beeApp && beeApp->isInSleepMode() )
+    return;
 
-  if( Bee::isTimeToCheck( ticks, Settings::instance().tickIntervalCheckNetwork() ) )
-    QMetaObject::invokeMethod( this, "checkNetworkInterface", Qt::QueuedConnection );
+  checkNetworkInterface();
 
   if( Protocol::instance().currentId() >= Protocol::instance().maxId() )
   {
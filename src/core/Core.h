@@ -28,6 +28,7 @@
 #include "Listener.h"
 #include "FileTransfer.h"
 class Broadcaster;
+class ConnectionAdmission;
 class Group;
 class UserList;
 class UserRecord;
@@ -179,7 +180,6 @@ public slots:
   void checkNetworkInterface();
   void checkNewVersion();
   void postUsageStatistics();
-  void onTickEvent( int );
 #ifdef BEEBEEP_USE_MULTICAST_DNS
   void startDnsMulticasting();
   void stopDnsMulticasting();
@@ -211,6 +211,8 @@ protected slots:
   bool restartConnection();
   void onUpdaterJobCompleted();
   void onPostUsageStatisticsJobCompleted();
+  void checkUserMessages();
+  void onCheckNetworkTimeout();
 #ifdef BEEBEEP_USE_MULTICAST_DNS
   void onMulticastDnsServiceRegistered();
 #endif
@@ -220,6 +222,8 @@ protected slots:
 
   /* CoreConnection */
   void checkNewConnection( qintptr );
+  void admitNewConnection();
+  void dropNewConnection();
   void newPeerFound( const QHostAddress&, int );
   void setConnectionError( QAbstractSocket::SocketError );
   void setConnectionClosed();
@@ -249,6 +253,8 @@ protected:
   void loadUsersAndGroups();
   void createLocalShareMessage();
   void showMessage( const QString&, int ms_to_show );
+  void scheduleUserMessagesCheck();
+  void scheduleNetworkCheck();
 
   /* CoreConnection */
   Connection* connection( VNumber user_id ) const;
@@ -282,13 +288,14 @@ protected:
   void sendLocalUserStatus();
   void addGroup( const Group& );
   void sendLocalConnectedUsersTo( const User& );
+  QList<NetworkAddress> hiveNetworkAddresses( const User& peer_user ) const;
   bool isUserConnected( const NetworkAddress& ) const; // to prevent multiple connections in Core::newPeerFound(...)
   void removeInactiveUsers();
   void sendVCardToAllConnectedUsers();
 
   /* CoreChat */
   void createDefaultChat();
-  bool sendMessageToLocalNetwork( const User& to_user, const Message& );
+  bool sendMessageToLocalNetwork( const User& to_user, const Message&, QHash<int, QByteArray>* message_frames = Q_NULLPTR );
   void sendGroupChatRequestMessage( const Chat&, const UserList&, const User& );
   void sendRefuseMessageToGroupChat( const Chat& );
   int checkGroupChatAfterUserReconnect( const User& );
@@ -324,8 +331,12 @@ private:
   QList<Connection*> m_connections;
   Listener* mp_listener;
   Broadcaster* mp_broadcaster;
+  ConnectionAdmission* mp_connectionAdmission;
   FileTransfer* mp_fileTransfer;
   int m_shareListToBuild;
+  int m_broadcastTimerId;
+  int m_autoSaveTimerId;
+  int m_userMessagesTimerId;
 #ifdef BEEBEEP_USE_MULTICAST_DNS
   MDnsManager* mp_mDns;
 #endif
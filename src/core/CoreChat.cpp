@@ -584,12 +584,13 @@ int Core::sendMessageToChat( const Chat& c, const Message& m )
   int messages_sent = 0;
   UserList user_list = c.id() == ID_DEFAULT_CHAT ? UserManager::instance().userList() : UserManager::instance().userList().fromUsersId( c.usersId() );
   QStringList offline_users;
+  QHash<int, QByteArray> message_frames; // the message is serialized and compressed once for each protocol version
   foreach( User u, user_list.toList() )
   {
     if( u.isLocal() )
       continue;
 
-    if( m.isDelayed() || !sendMessageToLocalNetwork( u, m ) )
+    if( m.isDelayed() || !sendMessageToLocalNetwork( u, m, &message_frames ) )
     {
       MessageManager::instance().addMessageToSend( u.id(), c.id(), m );
       offline_users.append( Bee::userNameToShow( u, true ) );
@@ -604,6 +605,7 @@ int Core::sendMessageToChat( const Chat& c, const Message& m )
 
   if( !offline_users.isEmpty() )
   {
+    scheduleUserMessagesCheck(); // delayed messages to connected users
     QString sys_msg;
     if( m.hasFlag( Message::VoiceMessage ) )
       sys_msg = tr( "The voice message will be delivered to %1." );
@@ -711,7 +713,7 @@ void Core::sendRefuseMessageToGroupChat( const Chat& group_chat )
   }
 }
 
-bool Core::sendMessageToLocalNetwork( const User& to_user, const Message& m )
+bool Core::sendMessageToLocalNetwork( const User& to_user, const Message& m, QHash<int, QByteArray>* message_frames )
 {
   Connection* c = connection( to_user.id() );
   if( !c )
@@ -721,7 +723,13 @@ bool Core::sendMessageToLocalNetwork( const User& to_user, const Message& m )
     return false;
   }
 
-  return c->sendMessage( m );
+  if( !message_frames )
+    return c->sendMessage( m );
+
+  QHash<int, QByteArray>::const_iterator it = message_frames->constFind( c->frameKey() );
+  if( it == message_frames->constEnd() )
+    it = message_frames->insert( c->frameKey(), c->messageFrame( m ) );
+  return c->sendMessageFrame( m, it.value() );
 }
 
 void Core::buildSavedChatList()
@@ -1158,6 +1166,7 @@ bool Core::sendHelpMessage()
         MessageManager::instance().addMessageToSend( c->userId(), ID_INVALID, m );
     }
   }
+  scheduleUserMessagesCheck();
 
   if( users_contacted > 0 )
   {
@@ -22,16 +22,19 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "Avatar.h"
+#include "BeeApplication.h"
 #include "BeeUtils.h"
 #include "Broadcaster.h"
 #include "ChatManager.h"
 #include "ColorManager.h"
 #include "Connection.h"
+#include "ConnectionAdmission.h"
 #include "Core.h"
 #include "FileShare.h"
 #include "FirewallManager.h"
 #include "Hive.h"
 #include "IconManager.h"
+#include "MessageDecoder.h"
 #include "NetworkManager.h"
 #include "Protocol.h"
 #include "Settings.h"
@@ -127,28 +130,69 @@ void Core::newPeerFound( const QHostAddress& sender_ip, int sender_port )
     return;
   }
 
+  ConnectionAdmission::Result admission_result = mp_connectionAdmission->admitOutgoing( na );
+  if( admission_result != ConnectionAdmission::Admitted )
+  {
+#ifdef BEEBEEP_DEBUG
+    qDebug() << "New peer found" << qPrintable( sender_ip.toString() ) << sender_port << (admission_result == ConnectionAdmission::Queued ? "is queued" : "is refused") << "by connection admission";
+#endif
+    return;
+  }
+
   qDebug() << "Connecting to new peer found" << qPrintable( sender_ip.toString() ) << sender_port;
 
   Connection *c = createConnection();
+  mp_connectionAdmission->addHandshake( c, na, true );
   setupNewConnection( c );
   c->connectToNetworkAddress( na );
+  c->startTimers();
 }
 
 void Core::checkNewConnection( qintptr socket_descriptor )
 {
   Connection *c = createConnection();
   c->initSocket( socket_descriptor, mp_listener->serverPort() );
+  c->startTimers();
+  // Network scanners connect and close without data: they are neither logged nor admitted
+  connect( c, SIGNAL( firstDataReceived() ), this, SLOT( admitNewConnection() ) );
+  connect( c, SIGNAL( error( QAbstractSocket::SocketError ) ), this, SLOT( dropNewConnection() ) );
+  connect( c, SIGNAL( disconnected() ), this, SLOT( dropNewConnection() ) );
+  connect( c, SIGNAL( abortRequest() ), this, SLOT( dropNewConnection() ) );
+}
+
+void Core::dropNewConnection()
+{
+  Connection* c = qobject_cast<Connection*>( sender() );
+  if( !c )
+    return;
+#ifdef BEEBEEP_DEBUG
+  qDebug() << "Connection to port" << mp_listener->serverPort() << "from" << qPrintable( c->networkAddress().toString() ) << "is closed without data";
+#endif
+  closeConnection( c );
+}
+
+void Core::admitNewConnection()
+{
+  Connection* c = qobject_cast<Connection*>( sender() );
+  if( !c )
+    return;
+  c->disconnect( this );
   qDebug() << "New connection to port" << mp_listener->serverPort() << "from" << qPrintable( c->networkAddress().toString() );
-  if( NetworkManager::instance().isHostAddressAllowed( c->networkAddress().hostAddress() ) )
+  if( !NetworkManager::instance().isHostAddressAllowed( c->networkAddress().hostAddress() ) )
   {
-    qDebug() << "New connection to port" << mp_listener->serverPort() << "from" << qPrintable( c->networkAddress().toString() );
-    setupNewConnection( c );
+    qWarning() << "New connection to port" << mp_listener->serverPort() << "from" << qPrintable( c->networkAddress().toString() ) << "is not allowed by file HOSTS";
+    closeConnection( c );
   }
-  else
+  else if( !mp_connectionAdmission->admitIncoming() )
   {
-    qWarning() << "New connection to port" << mp_listener->serverPort() << "from" << qPrintable( c->networkAddress().toString() ) << "is not allowed by file HOSTS";
+    qWarning() << "New connection to port" << mp_listener->serverPort() << "from" << qPrintable( c->networkAddress().toString() ) << "is refused: too many handshakes in progress";
     closeConnection( c );
   }
+  else
+  {
+    mp_connectionAdmission->addHandshake( c, c->networkAddress(), false );
+    setupNewConnection( c );
+  }
 }
 
 void Core::setupNewConnection( Connection *c )
@@ -169,6 +213,8 @@ void Core::addConnectionReadyForUse( Connection* c, const User& u )
   qDebug() << "Connection from" << qPrintable( c->networkAddress().toString() ) << "is ready for use by" << qPrintable( u.path() );
 #endif
   c->setReadyForUse( u.id() );
+  if( beeApp && c->messageDecoder() )
+    beeApp->addNetworkJob( c->messageDecoder() );
   connect( c, SIGNAL( newMessage( VNumber, const Message& ) ), this, SLOT( parseMessage( VNumber, const Message& ) ) );
 }
 
@@ -178,6 +224,8 @@ void Core::setConnectionError( QAbstractSocket::SocketError se )
   if( c )
   {
     qWarning() << "Connection from" << qPrintable( c->networkAddress().toString() ) << "has an error:" << c->errorString() << "-" << static_cast<int>(se);
+    mp_connectionAdmission->handshakeFailed( c, c->isConnecting() || se == QAbstractSocket::HostNotFoundError
+                                                || se == QAbstractSocket::NetworkError || se == QAbstractSocket::SocketTimeoutError );
     closeConnection( c );
   }
   else
@@ -198,6 +246,8 @@ void Core::closeConnection( Connection *c )
   if( !m_connections.removeOne( c ) )
     return;
 
+  mp_connectionAdmission->handshakeFailed( c, c->isConnecting() );
+
   if( c->userId() != ID_INVALID )
   {
     User u = UserManager::instance().findUser( c->userId() );
@@ -248,6 +298,8 @@ void Core::checkUserAuthentication( const QByteArray& auth_byte_array )
     return;
   }
 
+  mp_connectionAdmission->handshakeCompleted( c );
+
   Message m = Protocol::instance().toMessage( auth_byte_array, c->protocolVersion() );
   if( !m.isValid() )
   {
@@ -386,6 +438,8 @@ void Core::checkUserAuthentication( const QByteArray& auth_byte_array )
   u.setProtocolVersion( c->protocolVersion() );
   u.setLastConnection( QDateTime::currentDateTime() );
   UserManager::instance().setUser( u );
+  if( Settings::instance().useHive() )
+    Hive::instance().setPeerSeen( u.networkAddress() );
 
 #ifdef BEEBEEP_DEBUG
   qDebug() << "User" << qPrintable( u.path() ) << "added with id" << u.id() << "and color" << qPrintable( u.color() );
@@ -453,6 +507,7 @@ void Core::checkUserAuthentication( const QByteArray& auth_byte_array )
   }
 
   UserManager::instance().addNewConnectedUserId( u.id() );
+  scheduleUserMessagesCheck();
 }
 
 int Core::connectedUsers() const
@@ -480,6 +535,7 @@ void Core::checkConnectionPorts()
     Connection *c = createConnection();
     setupNewConnection( c );
     c->connectToNetworkAddress( na );
+    c->startTimers();
   }
 }
 
@@ -551,6 +551,7 @@ void Core::sendFileShareListToAll()
     else
       MessageManager::instance().addMessageToSend( c->userId(), ID_INVALID, share_list_message );
   }
+  scheduleUserMessagesCheck();
 }
 
 void Core::addPathToShare( const QString& share_path )
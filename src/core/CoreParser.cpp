@@ -576,6 +576,43 @@ void Core::parseHiveMessage( const User& u, const Message& m )
     if( hive_users_added > 0 )
       mp_broadcaster->updateUsersFromHive();
   }
+  else if( m.hasFlag( Message::Request ) )
+  {
+    QList<quint32> remote_digest = Protocol::instance().digestFromHiveMessage( m );
+    if( remote_digest.isEmpty() )
+    {
+      qWarning() << "Invalid hive digest arrived from user" << qPrintable( u.path() );
+      return;
+    }
+
+    QList<NetworkAddress> hive_network_addresses = hiveNetworkAddresses( u );
+    QList<quint32> local_digest = Hive::digest( hive_network_addresses );
+    bool all_buckets_differ = remote_digest.size() != local_digest.size();
+    QList<UserRecord> user_record_list;
+    UserRecord ur;
+    foreach( NetworkAddress na, hive_network_addresses )
+    {
+      int bucket = Hive::digestBucket( na );
+      if( all_buckets_differ || remote_digest.at( bucket ) != local_digest.at( bucket ) )
+      {
+        ur.setNetworkAddress( na );
+        user_record_list.append( ur );
+      }
+    }
+
+    if( user_record_list.isEmpty() )
+    {
+#ifdef BEEBEEP_DEBUG
+      qDebug() << "Hive digest arrived from" << qPrintable( u.path() ) << "is equal to the local one";
+#endif
+      return;
+    }
+
+    if( sendMessageToLocalNetwork( u, Protocol::instance().userRecordListToHiveMessage( user_record_list ) ) )
+      qDebug() << "Hive protocol sends" << user_record_list.size() << "of" << hive_network_addresses.size() << "users missing in the digest of" << qPrintable( u.path() );
+    else
+      qWarning() << "Hive protocol is unable to send" << user_record_list.size() << "users to" << qPrintable( u.path() );
+  }
   else
     qWarning() << "Invalid flag found in hive message from user" << qPrintable( u.path() );
 }
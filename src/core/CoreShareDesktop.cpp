@@ -163,6 +163,14 @@ void Core::onShareDesktopImageAvailable( const ShareDesktopData& sdd )
       Connection* c = connection( user_id );
       if( c && c->isConnected() )
       {
+        if( c->isBulkSendQueueBusy() )
+        {
+#ifdef BEEBEEP_DEBUG
+          qDebug() << "Share desktop skips image for user" << user_id << "because the connection is still sending data";
+#endif
+          continue;
+        }
+
         if( c->sendMessage( m ) )
         {
 #ifdef BEEBEEP_DEBUG
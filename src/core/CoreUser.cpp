@@ -25,6 +25,7 @@
 #include "ChatManager.h"
 #include "Connection.h"
 #include "Core.h"
+#include "Hive.h"
 #include "IconManager.h"
 #include "MessageManager.h"
 #include "Protocol.h"
@@ -436,7 +437,17 @@ void Core::sendLocalConnectedUsersTo( const User& to_user )
   QList<UserRecord> user_record_list;
   UserRecord ur;
 
-  if( to_user.protocolVersion() >= HIVE_PROTO_VERSION )
+  if( to_user.protocolVersion() >= HIVE_DIGEST_PROTO_VERSION )
+  {
+    // Only the digest: the new user answers with the users missing in the buckets which differ and we do the same
+    QList<NetworkAddress> hive_network_addresses = hiveNetworkAddresses( to_user );
+    msg_to_send = Protocol::instance().hiveDigestMessage( Hive::digest( hive_network_addresses ) );
+    if( sendMessageToLocalNetwork( to_user, msg_to_send ) )
+      qDebug() << "Hive protocol sends digest of" << hive_network_addresses.size() << "users to" << qPrintable( to_user.path() );
+    else
+      qWarning() << "Hive protocol is unable to send digest to" << qPrintable( to_user.path() );
+  }
+  else if( to_user.protocolVersion() >= HIVE_PROTO_VERSION )
   {
     foreach( User u, UserManager::instance().userList().toList() )
     {
@@ -475,6 +486,23 @@ void Core::sendLocalConnectedUsersTo( const User& to_user )
   }
 }
 
+QList<NetworkAddress> Core::hiveNetworkAddresses( const User& peer_user ) const
+{
+  // The connected users without the two ends of the connection: each side can see the addresses
+  // of the ends differently (more interfaces, NAT) and they would make the digests differ
+  QList<NetworkAddress> network_addresses;
+  foreach( User u, UserManager::instance().userList().toList() )
+  {
+    if( u.isLocal() || u.id() == peer_user.id() || u.networkAddress() == peer_user.networkAddress() )
+      continue;
+    if( u.networkAddress() == Settings::instance().localUser().networkAddress() )
+      continue;
+    if( isUserConnected( u.id() ) )
+      network_addresses.append( u.networkAddress() );
+  }
+  return network_addresses;
+}
+
 void Core::changeUserColor( VNumber user_id, const QString& user_color )
 {
   User u = UserManager::instance().findUser( user_id );
@@ -541,6 +569,7 @@ void Core::sendVCardToAllConnectedUsers()
     else
       MessageManager::instance().addMessageToSend( c->userId(), ID_INVALID, m );
   }
+  scheduleUserMessagesCheck();
 }
 
 bool Core::hasHelper() const
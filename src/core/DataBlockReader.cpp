@@ -0,0 +1,98 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "DataBlockReader.h"
+
+
+DataBlockReader::DataBlockReader()
+  : m_blockSize( 0 ), m_lastBlockHasValidSize( true )
+{
+}
+
+void DataBlockReader::reset()
+{
+  m_blockSize = 0;
+  m_lastBlockHasValidSize = true;
+}
+
+bool DataBlockReader::isBlockAvailable( qint64 bytes_available, bool use_32bit_header ) const
+{
+  if( m_blockSize > 0 )
+    return bytes_available >= m_blockSize;
+  else
+    return bytes_available >= static_cast<qint64>( use_32bit_header ? sizeof(DATA_BLOCK_SIZE_32) : sizeof(DATA_BLOCK_SIZE_16) );
+}
+
+DataBlockReader::ReadResult DataBlockReader::readBlock( QIODevice* device, bool use_32bit_header, QByteArray* block_data )
+{
+  uchar size_buffer[ sizeof(quint32) ];
+
+  if( m_blockSize == 0 )
+  {
+    qint64 header_size = static_cast<qint64>( use_32bit_header ? sizeof(DATA_BLOCK_SIZE_32) : sizeof(DATA_BLOCK_SIZE_16) );
+    if( device->bytesAvailable() < header_size )
+      return WaitingForData;
+
+    if( device->read( reinterpret_cast<char*>( size_buffer ), header_size ) != header_size )
+      return InvalidBlock;
+
+    if( use_32bit_header )
+      m_blockSize = static_cast<qint64>( qFromBigEndian<DATA_BLOCK_SIZE_32>( size_buffer ) );
+    else
+      m_blockSize = static_cast<qint64>( qFromBigEndian<DATA_BLOCK_SIZE_16>( size_buffer ) );
+
+    // QByteArray serialize format needs always its 32 bit size (also with 16 bit header)
+    if( m_blockSize < static_cast<qint64>( sizeof(quint32) ) )
+    {
+      m_blockSize = 0;
+      return InvalidBlock;
+    }
+  }
+
+  if( device->bytesAvailable() < m_blockSize )
+    return WaitingForData;
+
+  qint64 data_size = m_blockSize - static_cast<qint64>( sizeof(quint32) );
+  m_blockSize = 0;
+
+  if( device->read( reinterpret_cast<char*>( size_buffer ), sizeof(quint32) ) != static_cast<qint64>( sizeof(quint32) ) )
+    return InvalidBlock;
+
+  // QByteArray
+  // If the byte array is null: 0xFFFFFFFF (quint32)
+  // Otherwise: the array size (quint32) followed by the array bytes, i.e. size bytes
+  quint32 data_size_declared = qFromBigEndian<quint32>( size_buffer );
+  if( data_size_declared == 0xFFFFFFFF )
+    data_size_declared = 0;
+
+  // The data is read directly from the device buffer to the output byte array
+  block_data->resize( static_cast<int>( data_size ) );
+  if( data_size > 0 && device->read( block_data->data(), data_size ) != data_size )
+    return InvalidBlock;
+
+  m_lastBlockHasValidSize = static_cast<qint64>( data_size_declared ) == data_size;
+  if( static_cast<qint64>( data_size_declared ) < data_size )
+    block_data->truncate( static_cast<int>( data_size_declared ) );
+
+  return BlockRead;
+}
@@ -0,0 +1,65 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_DATABLOCKREADER_H
+#define BEEBEEP_DATABLOCKREADER_H
+
+#include "Config.h"
+
+
+/*
+  Reads the length-prefixed data blocks of a connection:
+    [ header: block size (16 or 32 bit) ][ QByteArray size (32 bit) ][ data ]
+  The block size in header counts all the bytes after it. The reader keeps
+  the header of an incomplete block, so it can be called again later when
+  the remaining bytes have been arrived.
+*/
+
+class DataBlockReader
+{
+public:
+  enum ReadResult { WaitingForData, BlockRead, InvalidBlock };
+
+  DataBlockReader();
+
+  void reset();
+  ReadResult readBlock( QIODevice*, bool use_32bit_header, QByteArray* block_data );
+
+  inline bool isWaitingForBlockData() const;
+  inline qint64 blockSize() const;
+  inline bool lastBlockHasValidSize() const;
+  bool isBlockAvailable( qint64 bytes_available, bool use_32bit_header ) const;
+
+private:
+  qint64 m_blockSize;
+  bool m_lastBlockHasValidSize;
+
+};
+
+
+// Inline Functions
+inline bool DataBlockReader::isWaitingForBlockData() const { return m_blockSize > 0; }
+inline qint64 DataBlockReader::blockSize() const { return m_blockSize; }
+inline bool DataBlockReader::lastBlockHasValidSize() const { return m_lastBlockHasValidSize; }
+
+#endif // BEEBEEP_DATABLOCKREADER_H
@@ -0,0 +1,109 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "BeeApplication.h"
+#include "ECDHKeyPool.h"
+#include "KeyExchangeJob.h"
+
+
+ECDHKeyPool* ECDHKeyPool::mp_instance = Q_NULLPTR;
+const int ECDH_KEY_POOL_SIZE = 8;
+
+#if QT_VERSION <= 0x050909
+static QThreadStorage<bool> random_is_initialized;
+#endif
+
+ECDHKeyPool::ECDHKeyPool()
+  : m_mutex(), m_keys(), m_isFillScheduled( false )
+{
+}
+
+ECDH::Keys ECDHKeyPool::takeKeys()
+{
+  ECDH::Keys keys;
+  bool pool_is_empty = true;
+  {
+    QMutexLocker mutex_locker( &m_mutex );
+    if( !m_keys.isEmpty() )
+    {
+      keys = m_keys.takeFirst();
+      pool_is_empty = false;
+    }
+  }
+
+  if( pool_is_empty )
+  {
+#ifdef BEEBEEP_DEBUG
+    qDebug() << "ECDH key pool is empty: keys are created in the current thread";
+#endif
+    keys.create();
+  }
+
+  scheduleFill();
+  return keys;
+}
+
+void ECDHKeyPool::scheduleFill()
+{
+  {
+    QMutexLocker mutex_locker( &m_mutex );
+    if( m_isFillScheduled || m_keys.size() >= ECDH_KEY_POOL_SIZE )
+      return;
+    m_isFillScheduled = true;
+  }
+
+  KeyExchangeJob* key_exchange_job = new KeyExchangeJob;
+  if( beeApp )
+    beeApp->addNetworkJob( key_exchange_job );
+  QMetaObject::invokeMethod( key_exchange_job, "fillKeyPool", Qt::QueuedConnection );
+}
+
+void ECDHKeyPool::fill()
+{
+#if QT_VERSION <= 0x050909
+  // qrand() has a seed for each thread
+  if( !random_is_initialized.hasLocalData() )
+  {
+    qsrand( static_cast<uint>( QDateTime::currentMSecsSinceEpoch() ) ^ static_cast<uint>( reinterpret_cast<quintptr>( QThread::currentThreadId() ) ) );
+    random_is_initialized.setLocalData( true );
+  }
+#endif
+
+  forever
+  {
+    {
+      QMutexLocker mutex_locker( &m_mutex );
+      if( m_keys.size() >= ECDH_KEY_POOL_SIZE )
+      {
+        m_isFillScheduled = false;
+        return;
+      }
+    }
+
+    ECDH::Keys keys;
+    keys.create();
+
+    QMutexLocker mutex_locker( &m_mutex );
+    m_keys.append( keys );
+  }
+}
@@ -0,0 +1,72 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_ECDHKEYPOOL_H
+#define BEEBEEP_ECDHKEYPOOL_H
+
+#include "ECDH.h"
+
+
+/*
+  Keeps a few ECDH key pairs ready for the connection handshakes. The
+  pool is filled by a KeyExchangeJob in the network thread, so a lot
+  of simultaneous connections do not block the event loop.
+*/
+
+class ECDHKeyPool
+{
+// Singleton Object
+  static ECDHKeyPool* mp_instance;
+
+public:
+  ECDH::Keys takeKeys(); // created now if the pool is empty
+  void scheduleFill();
+  void fill();
+
+  static ECDHKeyPool& instance()
+  {
+    if( !mp_instance )
+      mp_instance = new ECDHKeyPool();
+    return *mp_instance;
+  }
+
+  static void close()
+  {
+    if( mp_instance )
+    {
+      delete mp_instance;
+      mp_instance = Q_NULLPTR;
+    }
+  }
+
+protected:
+  ECDHKeyPool();
+
+private:
+  QMutex m_mutex;
+  QList<ECDH::Keys> m_keys;
+  bool m_isFillScheduled;
+
+};
+
+#endif // BEEBEEP_ECDHKEYPOOL_H
@@ -0,0 +1,223 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "FileChunkMap.h"
+
+
+const FileSizeType FILE_CHUNK_SIZE = 1048576;
+const quint32 FILE_CHUNK_MAP_MAGIC = 0xBEEC4A11;
+const int FILE_CHUNK_HASH_SIZE = 8;
+
+
+FileChunkMap::FileChunkMap( const QString& map_file_path, FileSizeType file_size )
+  : m_mapFilePath( map_file_path ), m_fileSize( file_size ), m_completed(), m_assigned(), m_chunksCompleted( 0 )
+{
+  int num_chunks = chunksInFile( file_size );
+  m_completed.resize( num_chunks );
+  m_assigned.resize( num_chunks );
+}
+
+FileSizeType FileChunkMap::chunkSize()
+{
+  return FILE_CHUNK_SIZE;
+}
+
+int FileChunkMap::chunksInFile( FileSizeType file_size )
+{
+  return static_cast<int>( (file_size + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE );
+}
+
+int FileChunkMap::chunkHashSize()
+{
+  return FILE_CHUNK_HASH_SIZE;
+}
+
+QByteArray FileChunkMap::chunkHash( const QByteArray& chunk_data )
+{
+  // MD5 is the fastest hash of Qt: it detects the corrupted data, the connection is already authenticated
+  return QCryptographicHash::hash( chunk_data, QCryptographicHash::Md5 ).left( FILE_CHUNK_HASH_SIZE );
+}
+
+QString FileChunkMap::contentHash( const QByteArray& chunk_hashes )
+{
+  return QString::fromLatin1( QCryptographicHash::hash( chunk_hashes, QCryptographicHash::Md5 ).toHex() );
+}
+
+FileSizeType FileChunkMap::chunkStart( int chunk_index ) const
+{
+  return static_cast<FileSizeType>( chunk_index ) * FILE_CHUNK_SIZE;
+}
+
+FileSizeType FileChunkMap::chunkEnd( int chunk_index ) const
+{
+  return qMin( chunkStart( chunk_index + 1 ), m_fileSize );
+}
+
+bool FileChunkMap::load()
+{
+  QFile file( m_mapFilePath );
+  if( !file.open( QIODevice::ReadOnly ) )
+    return false;
+
+  QDataStream data_stream( &file );
+  data_stream.setVersion( DATASTREAM_VERSION_1 );
+  quint32 magic_number = 0;
+  qint64 file_size = 0;
+  qint64 chunk_size = 0;
+  QBitArray completed;
+  data_stream >> magic_number >> file_size >> chunk_size >> completed;
+  file.close();
+
+  if( data_stream.status() != QDataStream::Ok || magic_number != FILE_CHUNK_MAP_MAGIC || file_size != m_fileSize
+      || chunk_size != FILE_CHUNK_SIZE || completed.size() != chunks() )
+  {
+    qWarning() << "File chunk map" << qPrintable( m_mapFilePath ) << "is not valid for a file of" << m_fileSize << "bytes";
+    return false;
+  }
+
+  m_completed = completed;
+  m_assigned.fill( false );
+  m_chunksCompleted = m_completed.count( true );
+  return true;
+}
+
+bool FileChunkMap::save() const
+{
+  QFile file( m_mapFilePath );
+  if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate ) )
+  {
+    qWarning() << "Unable to save the file chunk map" << qPrintable( m_mapFilePath );
+    return false;
+  }
+
+  QDataStream data_stream( &file );
+  data_stream.setVersion( DATASTREAM_VERSION_1 );
+  data_stream << FILE_CHUNK_MAP_MAGIC << static_cast<qint64>( m_fileSize ) << static_cast<qint64>( FILE_CHUNK_SIZE ) << m_completed;
+  file.close();
+  return data_stream.status() == QDataStream::Ok;
+}
+
+void FileChunkMap::remove() const
+{
+  if( QFile::exists( m_mapFilePath ) && !QFile::remove( m_mapFilePath ) )
+    qWarning() << "Unable to remove the file chunk map" << qPrintable( m_mapFilePath );
+}
+
+FileSizeType FileChunkMap::bytesCompleted() const
+{
+  if( isCompleted() )
+    return m_fileSize;
+  FileSizeType bytes_completed = static_cast<FileSizeType>( m_chunksCompleted ) * FILE_CHUNK_SIZE;
+  if( chunks() > 0 && m_completed.testBit( chunks() - 1 ) )
+    bytes_completed -= chunkStart( chunks() ) - m_fileSize; // the last chunk is shorter
+  return bytes_completed;
+}
+
+FileSizeType FileChunkMap::firstMissingPosition() const
+{
+  for( int i = 0; i < chunks(); i++ )
+  {
+    if( !m_completed.testBit( i ) )
+      return chunkStart( i );
+  }
+  return m_fileSize;
+}
+
+bool FileChunkMap::hasChunksToAssign() const
+{
+  for( int i = 0; i < chunks(); i++ )
+  {
+    if( !m_completed.testBit( i ) && !m_assigned.testBit( i ) )
+      return true;
+  }
+  return false;
+}
+
+FileSizeType FileChunkMap::bytesToAssign() const
+{
+  FileSizeType bytes_to_assign = 0;
+  for( int i = 0; i < chunks(); i++ )
+  {
+    if( !m_completed.testBit( i ) && !m_assigned.testBit( i ) )
+      bytes_to_assign += chunkEnd( i ) - chunkStart( i );
+  }
+  return bytes_to_assign;
+}
+
+int FileChunkMap::setCompleted( FileSizeType from_position, FileSizeType to_position )
+{
+  // Only the chunks inside the range: the others are partially written
+  int chunks_completed = 0;
+  int first_chunk = static_cast<int>( (from_position + FILE_CHUNK_SIZE - 1) / FILE_CHUNK_SIZE );
+  for( int i = first_chunk; i < chunks() && chunkEnd( i ) <= to_position; i++ )
+  {
+    if( !m_completed.testBit( i ) )
+    {
+      m_completed.setBit( i );
+      m_chunksCompleted++;
+      chunks_completed++;
+    }
+  }
+  return chunks_completed;
+}
+
+void FileChunkMap::setMissing( int chunk_index )
+{
+  if( chunk_index < 0 || chunk_index >= chunks() )
+    return;
+  if( m_completed.testBit( chunk_index ) )
+  {
+    m_completed.clearBit( chunk_index );
+    m_chunksCompleted--;
+  }
+  m_assigned.clearBit( chunk_index );
+}
+
+bool FileChunkMap::takeRange( FileSizeType max_range_size, FileSizeType* from_position, FileSizeType* to_position )
+{
+  // The first run of chunks neither completed nor assigned
+  int first_chunk = 0;
+  while( first_chunk < chunks() && (m_completed.testBit( first_chunk ) || m_assigned.testBit( first_chunk )) )
+    first_chunk++;
+  if( first_chunk >= chunks() )
+    return false;
+
+  int last_chunk = first_chunk;
+  m_assigned.setBit( first_chunk );
+  while( last_chunk + 1 < chunks() && !m_completed.testBit( last_chunk + 1 ) && !m_assigned.testBit( last_chunk + 1 )
+         && chunkEnd( last_chunk + 1 ) - chunkStart( first_chunk ) <= max_range_size )
+  {
+    last_chunk++;
+    m_assigned.setBit( last_chunk );
+  }
+
+  *from_position = chunkStart( first_chunk );
+  *to_position = chunkEnd( last_chunk );
+  return true;
+}
+
+void FileChunkMap::releaseRange( FileSizeType from_position, FileSizeType to_position )
+{
+  for( int i = static_cast<int>( from_position / FILE_CHUNK_SIZE ); i < chunks() && chunkStart( i ) < to_position; i++ )
+    m_assigned.clearBit( i );
+}
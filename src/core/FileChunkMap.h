@@ -0,0 +1,89 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_FILECHUNKMAP_H
+#define BEEBEEP_FILECHUNKMAP_H
+
+#include "Config.h"
+
+
+/*
+  Map of the chunks of a file downloaded in segments. The chunks arrive
+  out of order from more connections, so the map records which of them
+  are written in the partially downloaded file and which are assigned to
+  a connection. It is saved next to the file to resume the download.
+*/
+
+class FileChunkMap
+{
+public:
+  FileChunkMap( const QString& map_file_path, FileSizeType file_size );
+
+  bool load(); // false if the map is missing or it is of another file
+  bool save() const;
+  void remove() const;
+
+  inline const QString& mapFilePath() const;
+  inline FileSizeType fileSize() const;
+  FileSizeType bytesCompleted() const;
+  FileSizeType firstMissingPosition() const;
+  inline bool isCompleted() const;
+  inline bool isEmpty() const;
+  bool hasChunksToAssign() const;
+
+  inline int chunks() const;
+  int setCompleted( FileSizeType from_position, FileSizeType to_position ); // returns the chunks completed now
+  void setMissing( int chunk_index );
+  bool takeRange( FileSizeType max_range_size, FileSizeType* from_position, FileSizeType* to_position );
+  void releaseRange( FileSizeType from_position, FileSizeType to_position );
+  FileSizeType bytesToAssign() const;
+
+  static FileSizeType chunkSize();
+  static int chunksInFile( FileSizeType file_size );
+  // The content hashes: 8 bytes for each chunk and the hash of them for the whole file
+  static int chunkHashSize();
+  static QByteArray chunkHash( const QByteArray& chunk_data );
+  static QString contentHash( const QByteArray& chunk_hashes );
+
+protected:
+  FileSizeType chunkStart( int ) const;
+  FileSizeType chunkEnd( int ) const;
+
+private:
+  QString m_mapFilePath;
+  FileSizeType m_fileSize;
+  QBitArray m_completed;
+  QBitArray m_assigned;
+  int m_chunksCompleted;
+
+};
+
+
+// Inline Functions
+inline const QString& FileChunkMap::mapFilePath() const { return m_mapFilePath; }
+inline FileSizeType FileChunkMap::fileSize() const { return m_fileSize; }
+inline int FileChunkMap::chunks() const { return m_completed.size(); }
+inline bool FileChunkMap::isCompleted() const { return m_chunksCompleted == chunks(); }
+inline bool FileChunkMap::isEmpty() const { return m_chunksCompleted == 0; }
+
+#endif // BEEBEEP_FILECHUNKMAP_H
@@ -27,18 +27,18 @@
 FileInfo::FileInfo()
   : m_transferType( FileInfo::Upload ), m_name( "" ), m_path( "" ), m_suffix( "" ),
     m_size( 0 ), m_shareFolder( "" ), m_isFolder( false ), m_networkAddress(),
-    m_password( "" ), m_id( ID_INVALID ), m_fileHash(), m_lastModified(),
+    m_password( "" ), m_id( ID_INVALID ), m_fileHash(), m_contentHash(), m_chunkHashes(), m_lastModified(),
     m_isInShareBox( false ), m_chatPrivateId( "" ), m_mimeType( "" ),
-    m_contentType( File ), m_startingPosition( 0 ), m_duration( -1 )
+    m_contentType( File ), m_startingPosition( 0 ), m_endingPosition( 0 ), m_duration( -1 )
 {
 }
 
 FileInfo::FileInfo( VNumber id, FileInfo::TransferType tt )
   : m_transferType( tt ), m_name( "" ), m_path( "" ), m_suffix( "" ),
     m_size( 0 ), m_shareFolder( "" ), m_isFolder( false ), m_networkAddress(),
-    m_password( "" ), m_id( id ), m_fileHash(), m_lastModified(),
+    m_password( "" ), m_id( id ), m_fileHash(), m_contentHash(), m_chunkHashes(), m_lastModified(),
     m_isInShareBox( false ), m_chatPrivateId( "" ), m_mimeType( "" ),
-    m_contentType( File ), m_startingPosition( 0 ), m_duration( -1 )
+    m_contentType( File ), m_startingPosition( 0 ), m_endingPosition( 0 ), m_duration( -1 )
 {
 }
 
@@ -57,12 +57,15 @@ FileInfo& FileInfo::operator=( const FileInfo& fi )
     m_password = fi.m_password;
     m_id =  fi.m_id;
     m_fileHash = fi.m_fileHash;
+    m_contentHash = fi.m_contentHash;
+    m_chunkHashes = fi.m_chunkHashes;
     m_lastModified = fi.m_lastModified;
     m_isInShareBox = fi.m_isInShareBox;
     m_chatPrivateId = fi.m_chatPrivateId;
     m_mimeType = fi.m_mimeType;
     m_contentType = fi.m_contentType;
     m_startingPosition = fi.m_startingPosition;
+    m_endingPosition = fi.m_endingPosition;
     m_duration = fi.m_duration;
   }
   return *this;
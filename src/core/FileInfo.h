@@ -71,6 +71,10 @@ public:
   inline void setId( VNumber );
   inline const QString& fileHash() const;
   inline void setFileHash( const QString& );
+  inline const QString& contentHash() const;
+  inline void setContentHash( const QString& );
+  inline const QByteArray& chunkHashes() const;
+  inline void setChunkHashes( const QByteArray& );
   inline const QDateTime& lastModified() const;
   inline void setLastModified( const QDateTime& );
   inline bool isInShareBox() const;
@@ -84,6 +88,8 @@ public:
   inline bool isVoiceMessage() const;
   inline void setStartingPosition( FileSizeType );
   inline FileSizeType startingPosition() const;
+  inline void setEndingPosition( FileSizeType ); // 0 is the end of the file
+  inline FileSizeType endingPosition() const;
   inline void setDuration( qint64 );
   inline qint64 duration() const;
 
@@ -99,12 +105,15 @@ private:
   QByteArray m_password;
   VNumber m_id;
   QString m_fileHash;
+  QString m_contentHash;
+  QByteArray m_chunkHashes;
   QDateTime m_lastModified;
   bool m_isInShareBox;
   QString m_chatPrivateId;
   QString m_mimeType;
   ContentType m_contentType;
   FileSizeType m_startingPosition;
+  FileSizeType m_endingPosition;
   qint64 m_duration;
 
 };
@@ -141,6 +150,10 @@ inline VNumber FileInfo::id() const { return m_id; }
 inline void FileInfo::setId( VNumber new_value ) { m_id = new_value; }
 inline const QString& FileInfo::fileHash() const { return m_fileHash; }
 inline void FileInfo::setFileHash( const QString& new_value ) { m_fileHash = new_value; }
+inline const QString& FileInfo::contentHash() const { return m_contentHash; }
+inline void FileInfo::setContentHash( const QString& new_value ) { m_contentHash = new_value; }
+inline const QByteArray& FileInfo::chunkHashes() const { return m_chunkHashes; }
+inline void FileInfo::setChunkHashes( const QByteArray& new_value ) { m_chunkHashes = new_value; }
 inline const QDateTime& FileInfo::lastModified() const { return m_lastModified; }
 inline void FileInfo::setLastModified( const QDateTime& new_value ) { m_lastModified = new_value; }
 inline bool FileInfo::isInShareBox() const { return m_isInShareBox; }
@@ -154,6 +167,8 @@ inline void FileInfo::setContentType( ContentType new_value ) { m_contentType =
 inline bool FileInfo::isVoiceMessage() const { return m_contentType == VoiceMessage; }
 inline void FileInfo::setStartingPosition( FileSizeType new_value ) { m_startingPosition = new_value > 0 ? new_value : 0; }
 inline FileSizeType FileInfo::startingPosition() const { return m_startingPosition; }
+inline void FileInfo::setEndingPosition( FileSizeType new_value ) { m_endingPosition = new_value > 0 ? new_value : 0; }
+inline FileSizeType FileInfo::endingPosition() const { return m_endingPosition; }
 inline void FileInfo::setDuration( qint64 new_value ) { m_duration = new_value; }
 inline qint64 FileInfo::duration() const { return m_duration; }
 
@@ -128,6 +128,19 @@ QList<FileInfo> FileShare::networkFolder( VNumber user_id, const QString& folder
   return folder_file_info;
 }
 
+QMap<VNumber, FileInfo> FileShare::networkFileSources( const QString& file_info_hash ) const
+{
+  QMap<VNumber, FileInfo> file_sources;
+  QMultiMap<VNumber, FileInfo>::const_iterator it = m_network.begin();
+  while( it != m_network.end() )
+  {
+    if( !it.value().isFolder() && it.value().fileHash() == file_info_hash )
+      file_sources.insert( it.key(), it.value() );
+    ++it;
+  }
+  return file_sources;
+}
+
 FileInfo FileShare::localFileInfo( VNumber file_info_id ) const
 {
   QMultiMap<QString, FileInfo>::const_iterator it = m_local.begin();
@@ -42,6 +42,7 @@ public:
   int removePath( const QString& );
   FileInfo networkFileInfo( VNumber user_id, VNumber file_info_id ) const;
   QList<FileInfo> networkFolder( VNumber user_id, const QString& ) const;
+  QMap<VNumber, FileInfo> networkFileSources( const QString& file_info_hash ) const; // user id and file shared with the same hash
   inline QList<FileInfo> fileSharedFromUser( VNumber ) const;
   FileInfo localFileInfo( VNumber file_info_id ) const;
   QList<FileInfo> localFolder( const QString& ) const;
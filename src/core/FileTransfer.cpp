@@ -21,6 +21,8 @@
 //
 //////////////////////////////////////////////////////////////////////
 
+#include "BeeApplication.h"
+#include "BuildFileHashes.h"
 #include "FileShare.h"
 #include "FileTransfer.h"
 #include "Random.h"
@@ -29,8 +31,11 @@
 #include "UserManager.h"
 
 
+const int FILE_TRANSFER_MAX_HASHED_FILES = 64;
+
+
 FileTransfer::FileTransfer( QObject *parent )
-  : QTcpServer( parent ), m_files(), m_peers()
+  : QTcpServer( parent ), m_files(), m_peers(), m_hashedFiles(), m_peersWaitingHashes()
 {
 }
 
@@ -322,13 +327,108 @@ void FileTransfer::checkUploadRequest( const FileInfo& file_info_to_check )
     return;
   }
 
-  if( Settings::instance().resumeFileTransfer() )
+  // A segment of the file is always uploaded from its starting position
+  if( Settings::instance().resumeFileTransfer() || file_info_to_check.endingPosition() > 0 )
     file_info.setStartingPosition( file_info_to_check.startingPosition() );
   else
     file_info.setStartingPosition( 0 );
+  file_info.setEndingPosition( file_info_to_check.endingPosition() );
+
+  if( upload_peer->useChunkHashes() && !setFileHashes( file_info ) )
+  {
+    // The file header waits for the content hashes of the file
+    buildFileHashes( upload_peer, file_info );
+    return;
+  }
+
   upload_peer->startUpload( file_info );
 }
 
+bool FileTransfer::setFileHashes( FileInfo& file_info ) const
+{
+  QFileInfo file_info_now_in_system( file_info.path() );
+  foreach( FileInfo hashed_file, m_hashedFiles )
+  {
+    if( hashed_file.path() == file_info.path() )
+    {
+      if( hashed_file.size() != file_info_now_in_system.size() || hashed_file.lastModified() != file_info_now_in_system.lastModified() )
+        return false;
+      file_info.setContentHash( hashed_file.contentHash() );
+      file_info.setChunkHashes( hashed_file.chunkHashes() );
+      return true;
+    }
+  }
+  return false;
+}
+
+void FileTransfer::buildFileHashes( FileTransferPeer* upload_peer, const FileInfo& file_info )
+{
+  upload_peer->waitFileHashes( file_info );
+  bool hashes_in_progress = m_peersWaitingHashes.contains( file_info.path() );
+  m_peersWaitingHashes.insert( file_info.path(), upload_peer->id() );
+  if( hashes_in_progress )
+    return;
+
+  qDebug() << "File Transfer builds the content hashes of the file" << qPrintable( file_info.path() );
+  BuildFileHashes* bfh = new BuildFileHashes;
+  bfh->setFilePath( file_info.path() );
+  connect( bfh, SIGNAL( hashesCompleted() ), this, SLOT( onFileHashesCompleted() ) );
+  if( beeApp )
+    beeApp->addJob( bfh );
+  QMetaObject::invokeMethod( bfh, "buildHashes", Qt::QueuedConnection );
+}
+
+void FileTransfer::onFileHashesCompleted()
+{
+  BuildFileHashes* bfh = qobject_cast<BuildFileHashes*>( sender() );
+  if( !bfh )
+  {
+    qWarning() << "File Transfer received a signal from invalid BuildFileHashes instance";
+    return;
+  }
+
+  if( beeApp )
+    beeApp->removeJob( bfh );
+
+  QList<FileInfo>::iterator it = m_hashedFiles.begin();
+  while( it != m_hashedFiles.end() )
+  {
+    if( (*it).path() == bfh->filePath() )
+      it = m_hashedFiles.erase( it );
+    else
+      ++it;
+  }
+
+  FileInfo hashed_file;
+  hashed_file.setPath( bfh->filePath() );
+  hashed_file.setSize( bfh->fileSize() );
+  hashed_file.setLastModified( bfh->lastModified() );
+  hashed_file.setContentHash( bfh->contentHash() );
+  hashed_file.setChunkHashes( bfh->chunkHashes() );
+  if( !hashed_file.contentHash().isEmpty() )
+  {
+    m_hashedFiles.append( hashed_file );
+    if( m_hashedFiles.size() > FILE_TRANSFER_MAX_HASHED_FILES )
+      m_hashedFiles.removeFirst();
+  }
+
+  QList<VNumber> peer_ids = m_peersWaitingHashes.values( bfh->filePath() );
+  m_peersWaitingHashes.remove( bfh->filePath() );
+  foreach( VNumber peer_id, peer_ids )
+  {
+    FileTransferPeer* upload_peer = peer( peer_id );
+    if( !upload_peer || !upload_peer->isActive() )
+      continue;
+    // Without the hashes the file is uploaded anyway and it is not verified
+    FileInfo file_info = upload_peer->fileInfo();
+    file_info.setContentHash( hashed_file.contentHash() );
+    file_info.setChunkHashes( hashed_file.chunkHashes() );
+    upload_peer->startUpload( file_info );
+  }
+
+  bfh->deleteLater();
+}
+
 void FileTransfer::downloadFile( VNumber from_user_id, const FileInfo& fi )
 {
   FileTransferPeer *download_peer = new FileTransferPeer( this );
@@ -463,12 +563,3 @@ void FileTransfer::startNewDownload()
 
   setupPeer( download_peer, 0 );
 }
-
-void FileTransfer::onTickEvent( int ticks )
-{
-  if( !isListening() )
-    return;
-
-  foreach( FileTransferPeer* transfer_peer, m_peers )
-    transfer_peer->onTickEvent( ticks );
-}
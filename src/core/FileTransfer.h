@@ -56,8 +56,6 @@ public:
 
   inline void clearFiles();
 
-  void onTickEvent( int );
-
 signals:
   void message( VNumber peer_id, VNumber user_id, const FileInfo&, const QString&, FileTransferPeer::TransferState );
   void progress( VNumber peer_id, VNumber user_id, const FileInfo&, FileSizeType, qint64 );
@@ -74,16 +72,21 @@ protected:
   FileInfo fileInfo( const QString& file_absolute_path, const QString chat_private_id ) const;
   FileTransferPeer* nextDownloadInQueue() const;
   int downloadsInQueue() const;
+  bool setFileHashes( FileInfo& ) const;
+  void buildFileHashes( FileTransferPeer*, const FileInfo& );
 
 protected slots:
   void startNewDownload();
   void checkUploadRequest( const FileInfo& );
   void deletePeer();
   void setupPeer( FileTransferPeer*, qintptr, quint16 server_port = 0 );
+  void onFileHashesCompleted();
 
 private:
   QList<FileInfo> m_files;
   QList<FileTransferPeer*> m_peers;
+  QList<FileInfo> m_hashedFiles; // content hashes of the files uploaded
+  QMultiHash<QString, VNumber> m_peersWaitingHashes;
 
 };
 
@@ -21,11 +21,24 @@
 //
 //////////////////////////////////////////////////////////////////////
 
+#include "BeeApplication.h"
+#include "BuildFileHashes.h"
+#include "FileChunkMap.h"
+#include "FileShare.h"
 #include "FileTransferPeer.h"
 #include "Protocol.h"
 #include "Settings.h"
+#include "TimerWheel.h"
+#include "UserManager.h"
 
 
+const FileSizeType FILE_TRANSFER_SEGMENTS_MIN_FILE_SIZE = 67108864;
+const int FILE_TRANSFER_SEGMENT_MAX_ERRORS = 3; // for each user
+const FileSizeType FILE_TRANSFER_SEGMENT_MIN_SPLIT_SIZE = 16777216;
+const int FILE_TRANSFER_SEGMENT_THROUGHPUT_SAMPLE_TIME = 1000; // ms
+const int FILE_CHUNK_MAP_SAVE_INTERVAL = 2000; // ms
+const int FILE_TRANSFER_MAX_VERIFICATIONS = 3;
+
 void FileTransferPeer::sendDownloadData()
 {
   if( m_state == FileTransferPeer::Transferring || m_state == FileTransferPeer::Pausing )
@@ -43,6 +56,13 @@ void FileTransferPeer::sendDownloadRequest()
     return;
   }
 
+  if( mp_mainPeer )
+  {
+    // The main peer has checked the file and assigned the range to the segment peer
+    sendDownloadRangeRequest();
+    return;
+  }
+
   bool skip_transfer = false;
   QFileInfo existing_file( m_fileInfo.path() );
   if( existing_file.exists() )
@@ -92,13 +112,36 @@ void FileTransferPeer::sendDownloadRequest()
     }
   }
 
+  if( !skip_transfer && canDownloadInSegments() && initChunkMap() )
+  {
+    assignSegmentRange( this );
+    sendDownloadRangeRequest();
+    if( m_state == FileTransferPeer::FileHeader )
+      checkSegments();
+    return;
+  }
+
   if( !skip_transfer && mp_socket->protocolVersion() >= FILE_TRANSFER_RESUME_PROTO_VERSION )
   {
     QFileInfo file_info( m_file.fileName() );
     if( file_info.exists() && Settings::instance().resumeFileTransfer() )
     {
-      m_fileInfo.setStartingPosition( file_info.size() );
-      m_bytesTransferred = file_info.size();
+      FileSizeType starting_position = file_info.size();
+      if( QFile::exists( chunkMapFilePath() ) )
+      {
+        // Partially downloaded in segments: only the first chunks are written in sequence
+        FileChunkMap chunk_map( chunkMapFilePath(), m_fileInfo.size() );
+        starting_position = chunk_map.load() ? qMin( chunk_map.firstMissingPosition(), file_info.size() ) : 0;
+        chunk_map.remove();
+        if( !m_file.resize( starting_position ) )
+        {
+          qWarning() << qPrintable( name() ) << "is unable to resize the partially downloaded file" << qPrintable( m_file.fileName() );
+          m_file.remove();
+          starting_position = 0;
+        }
+      }
+      m_fileInfo.setStartingPosition( starting_position );
+      m_bytesTransferred = starting_position;
     }
     else
       m_fileInfo.setStartingPosition( 0 );
@@ -123,7 +166,10 @@ void FileTransferPeer::sendDownloadRequest()
       setTransferringState();
     }
     else
+    {
       m_state = FileTransferPeer::FileHeader;
+      scheduleTransferTimeout( Settings::instance().fileTransferConfirmTimeout() );
+    }
   }
   else
     cancelTransfer();
@@ -163,11 +209,54 @@ void FileTransferPeer::checkDownloadData( const QByteArray& byte_array )
       return;
     }
 
+    if( file_header_message.type() == Message::Ping )
+    {
+      // The upload is still building the content hashes of the file
+      scheduleTransferTimeout( Settings::instance().fileTransferConfirmTimeout() );
+      return;
+    }
+
     FileInfo file_header = Protocol::instance().fileInfoFromMessage( file_header_message, mp_socket->protocolVersion() );
+    if( mp_chunkMap && (file_header.startingPosition() != m_fileInfo.startingPosition() || file_header.endingPosition() != m_fileInfo.endingPosition()
+                        || file_header.size() != mp_chunkMap->fileSize()) )
+    {
+      setError( tr( "invalid file segment" ) );
+      return;
+    }
+
+    if( mp_mainPeer && !file_header.contentHash().isEmpty() && !mp_mainPeer->m_fileInfo.contentHash().isEmpty()
+        && file_header.contentHash() != mp_mainPeer->m_fileInfo.contentHash() )
+    {
+      // Same name and size but another content: the source is not used for the other segments
+      mp_mainPeer->m_sourceErrors.insert( remoteUserId(), FILE_TRANSFER_SEGMENT_MAX_ERRORS );
+      setError( tr( "invalid file content" ) );
+      return;
+    }
+
+    if( !mp_mainPeer && !file_header.chunkHashes().isEmpty() )
+    {
+      if( file_header.chunkHashes().size() == FileChunkMap::chunksInFile( file_header.size() ) * FileChunkMap::chunkHashSize()
+          && FileChunkMap::contentHash( file_header.chunkHashes() ) == file_header.contentHash() )
+      {
+        m_fileInfo.setContentHash( file_header.contentHash() );
+        m_fileInfo.setChunkHashes( file_header.chunkHashes() );
+      }
+      else
+        qWarning() << qPrintable( name() ) << "has received invalid content hashes for the file" << m_fileInfo.name();
+    }
+
     if( m_bytesTransferred > 0 && file_header.startingPosition() != m_bytesTransferred )
       m_bytesTransferred = 0;
     m_totalBytesTransferred = m_bytesTransferred;
 
+    if( mp_chunkMap )
+    {
+      m_throughput = 0;
+      m_throughputBytes = 0;
+      m_throughputTimestamp = 0;
+      m_transferWindowTimer.start();
+    }
+
     m_fileInfo.setSize( file_header.size() );
     if( file_header.lastModified().isValid() )
       m_fileInfo.setLastModified( file_header.lastModified() );
@@ -183,35 +272,89 @@ void FileTransferPeer::checkDownloadData( const QByteArray& byte_array )
   }
 
   m_bytesTransferred = static_cast<FileSizeType>( byte_array.size() );
+  if( m_isSegmentShrunk && m_totalBytesTransferred + m_bytesTransferred > transferEndPosition() )
+    m_bytesTransferred = transferEndPosition() - m_totalBytesTransferred; // the rest is downloaded by another segment
   m_totalBytesTransferred += m_bytesTransferred;
 
-  sendTransferData(); // send to upload client that data is arrived
+  if( useTransferWindow() )
+  {
+    // One cumulative confirmation for all the data arrived in this event loop
+    if( !m_isConfirmationScheduled )
+    {
+      m_isConfirmationScheduled = true;
+      QMetaObject::invokeMethod( this, "sendScheduledDownloadDataConfirmation", Qt::QueuedConnection );
+    }
+  }
+  else
+    sendTransferData(); // send to upload client that data is arrived
 
   if( m_bytesTransferred > 0 )
   {
     if( !m_file.isOpen() )
     {
-      if( !m_file.open( QIODevice::WriteOnly | QIODevice::Append ) )
+      // The segments write in the same file out of order
+      if( !m_file.open( mp_chunkMap ? QIODevice::OpenMode( QIODevice::ReadWrite ) : (QIODevice::WriteOnly | QIODevice::Append) ) )
       {
         setError( tr( "Unable to open file %1" ).arg( m_file.fileName() ) );
         return;
       }
+
+      if( mp_chunkMap && !m_file.seek( m_totalBytesTransferred - m_bytesTransferred ) )
+      {
+        setError( tr( "Unable to seek %1 bytes in file %2" ).arg( m_totalBytesTransferred - m_bytesTransferred ).arg( m_file.fileName() ) );
+        return;
+      }
     }
 
-    if( m_file.write( byte_array ) != static_cast<int>( m_bytesTransferred ) )
+    if( m_file.write( byte_array.constData(), m_bytesTransferred ) != m_bytesTransferred )
     {
       setError( tr( "Unable to write in the file %1" ).arg( m_file.fileName() ) );
       return;
     }
 
-    showProgress();
+    if( mp_chunkMap )
+    {
+      updateSegmentThroughput( m_bytesTransferred );
+      updateChunkMap();
+    }
+    else
+      showProgress();
   }
 
-  if( m_totalBytesTransferred > m_fileInfo.size() )
-    setError( tr( "%1 bytes downloaded but the file size is only %2 bytes" ).arg( m_totalBytesTransferred ).arg( m_fileInfo.size() ) );
+  if( m_totalBytesTransferred > transferEndPosition() )
+    setError( tr( "%1 bytes downloaded but the file size is only %2 bytes" ).arg( m_totalBytesTransferred ).arg( transferEndPosition() ) );
 
-  if( m_totalBytesTransferred == m_fileInfo.size() )
-    setTransferCompleted();
+  if( m_totalBytesTransferred == transferEndPosition() )
+  {
+    if( m_isSegmentShrunk )
+    {
+      // The upload of the range given to another segment is paused
+      m_isConfirmationScheduled = false;
+      mp_socket->sendData( Protocol::instance().fileTransferBytesArrivedConfirmation( mp_socket->protocolVersion(), m_bytesTransferred, m_totalBytesTransferred, true ) );
+    }
+    else
+      sendScheduledDownloadDataConfirmation(); // the upload completes with the last confirmation
+    if( mp_chunkMap )
+    {
+      setSegmentCompleted();
+    }
+    else if( canVerifyDownloadedFile() )
+    {
+      closeTransferConnection();
+      verifyDownloadedFile();
+    }
+    else
+      setTransferCompleted();
+  }
+}
+
+void FileTransferPeer::sendScheduledDownloadDataConfirmation()
+{
+  if( !m_isConfirmationScheduled )
+    return;
+  m_isConfirmationScheduled = false;
+  if( m_state == FileTransferPeer::Transferring || m_state == FileTransferPeer::Pausing )
+    sendDownloadDataConfirmation();
 }
 
 QString FileTransferPeer::temporaryFilePath() const
@@ -219,10 +362,17 @@ QString FileTransferPeer::temporaryFilePath() const
   return QString( "%1/%2.%3" ).arg( Settings::instance().cacheFolder(), m_fileInfo.fileHash(), Settings::instance().partiallyDownloadedFileExtension() );
 }
 
+QString FileTransferPeer::chunkMapFilePath() const
+{
+  return QString( "%1.map" ).arg( m_file.fileName() );
+}
+
 bool FileTransferPeer::removePartiallyDownloadedFile()
 {
   if( !isDownload() || isTransferCompleted() )
     return false;
+  if( QFile::exists( chunkMapFilePath() ) && !QFile::remove( chunkMapFilePath() ) )
+    qWarning() << "Unable to remove the file chunk map" << qPrintable( chunkMapFilePath() );
   if( m_file.exists() && m_file.fileName().endsWith( QString( ".%1" ).arg( Settings::instance().partiallyDownloadedFileExtension() ) ) && m_file.remove() )
   {
 #ifdef BEEBEEP_DEBUG
@@ -233,3 +383,407 @@ bool FileTransferPeer::removePartiallyDownloadedFile()
   qWarning() << "Unable to remove partially downloaded file" << qPrintable( m_file.fileName() );
   return false;
 }
+
+bool FileTransferPeer::canDownloadInSegments() const
+{
+  return !mp_mainPeer && Settings::instance().fileTransferSegments() > 1 && m_fileInfo.size() >= FILE_TRANSFER_SEGMENTS_MIN_FILE_SIZE
+         && mp_socket->protocolVersion() >= FILE_TRANSFER_SEGMENTS_PROTO_VERSION;
+}
+
+bool FileTransferPeer::initChunkMap()
+{
+  FileChunkMap* chunk_map = new FileChunkMap( chunkMapFilePath(), m_fileInfo.size() );
+  QFileInfo file_info( m_file.fileName() );
+  if( file_info.exists() && Settings::instance().resumeFileTransfer() )
+  {
+    // Without a valid map the file has been partially downloaded in sequence
+    bool chunk_map_is_loaded = file_info.size() == m_fileInfo.size() && chunk_map->load();
+    if( !chunk_map_is_loaded && file_info.size() < m_fileInfo.size() )
+      chunk_map->setCompleted( 0, file_info.size() );
+  }
+
+  if( chunk_map->isCompleted() )
+  {
+    chunk_map->remove();
+    delete chunk_map;
+    return false;
+  }
+
+  if( !m_file.open( QIODevice::ReadWrite ) || !m_file.resize( m_fileInfo.size() ) )
+  {
+    qWarning() << qPrintable( name() ) << "is unable to allocate" << m_fileInfo.size() << "bytes for the file" << qPrintable( m_file.fileName() );
+    m_file.close();
+    delete chunk_map;
+    return false;
+  }
+  m_file.close();
+
+  mp_chunkMap = chunk_map;
+  mp_chunkMap->save();
+  m_chunkMapTimer.start();
+  m_isSegmentCompleted = false;
+  m_isSegmentShrunk = false;
+  m_sourceErrors.clear();
+  qDebug() << qPrintable( name() ) << "downloads the file" << m_fileInfo.name() << "in" << Settings::instance().fileTransferSegments()
+           << "segments with" << mp_chunkMap->bytesCompleted() << "bytes already downloaded";
+  return true;
+}
+
+bool FileTransferPeer::assignSegmentRange( FileTransferPeer* segment_peer )
+{
+  // The ranges shrink with the bytes to download so the last segments end together
+  FileSizeType range_size = qMax( FileChunkMap::chunkSize(), mp_chunkMap->bytesToAssign() / Settings::instance().fileTransferSegments() );
+  FileSizeType from_position = 0;
+  FileSizeType to_position = 0;
+  if( !mp_chunkMap->takeRange( range_size, &from_position, &to_position ) )
+    return false;
+  segment_peer->m_fileInfo.setStartingPosition( from_position );
+  segment_peer->m_fileInfo.setEndingPosition( to_position );
+  return true;
+}
+
+void FileTransferPeer::sendDownloadRangeRequest()
+{
+  m_bytesTransferred = m_fileInfo.startingPosition();
+  qDebug() << qPrintable( name() ) << "sending file request for" << m_fileInfo.name() << "with range" << m_fileInfo.startingPosition() << "-" << m_fileInfo.endingPosition();
+  if( mp_socket->sendData( Protocol::instance().fromMessage( Protocol::instance().fileInfoToMessage( m_fileInfo, mp_socket->protocolVersion() ), mp_socket->protocolVersion() ) ) )
+  {
+    m_state = FileTransferPeer::FileHeader;
+    scheduleTransferTimeout( Settings::instance().fileTransferConfirmTimeout() );
+  }
+  else
+    cancelTransfer();
+}
+
+void FileTransferPeer::updateSegmentThroughput( FileSizeType bytes_arrived )
+{
+  m_throughputBytes += bytes_arrived;
+  qint64 sample_time = m_transferWindowTimer.elapsed() - m_throughputTimestamp;
+  if( sample_time < FILE_TRANSFER_SEGMENT_THROUGHPUT_SAMPLE_TIME )
+    return;
+
+  qint64 throughput = m_throughputBytes * 1000 / sample_time;
+  m_throughput = m_throughput > 0 ? (3 * m_throughput + throughput) / 4 : throughput;
+  m_throughputBytes = 0;
+  m_throughputTimestamp += sample_time;
+}
+
+bool FileTransferPeer::splitSegmentRange( FileTransferPeer* segment_peer )
+{
+  // The segment which would finish last gives the second half of its remaining range to the new segment.
+  // The segments without a throughput sample have just started and they are not split
+  FileTransferPeer* slowest_peer = Q_NULLPTR;
+  FileSizeType max_bytes_to_download = 0;
+  qint64 max_time_to_download = 0;
+  QList<FileTransferPeer*> transfer_peers = m_segments;
+  if( !m_isSegmentCompleted )
+    transfer_peers.prepend( this );
+  foreach( FileTransferPeer* transfer_peer, transfer_peers )
+  {
+    if( transfer_peer->m_state != FileTransferPeer::Transferring || transfer_peer->m_throughput <= 0 )
+      continue;
+    FileSizeType bytes_to_download = transfer_peer->transferEndPosition() - transfer_peer->m_totalBytesTransferred;
+    if( bytes_to_download < FILE_TRANSFER_SEGMENT_MIN_SPLIT_SIZE )
+      continue;
+    qint64 time_to_download = bytes_to_download * 1000 / transfer_peer->m_throughput;
+    if( time_to_download > max_time_to_download )
+    {
+      slowest_peer = transfer_peer;
+      max_bytes_to_download = bytes_to_download;
+      max_time_to_download = time_to_download;
+    }
+  }
+
+  if( !slowest_peer )
+    return false;
+
+  FileSizeType split_position = slowest_peer->m_totalBytesTransferred + max_bytes_to_download / 2;
+  split_position += FileChunkMap::chunkSize() - 1;
+  split_position -= split_position % FileChunkMap::chunkSize();
+  if( split_position >= slowest_peer->transferEndPosition() )
+    return false;
+
+#ifdef BEEBEEP_DEBUG
+  qDebug() << qPrintable( name() ) << "splits the segment" << slowest_peer->m_fileInfo.startingPosition() << "-" << slowest_peer->transferEndPosition()
+           << "of user id" << slowest_peer->remoteUserId() << "at" << split_position << "(" << max_time_to_download << "ms to download at" << slowest_peer->m_throughput << "bytes/s)";
+#endif
+  segment_peer->m_fileInfo.setStartingPosition( split_position );
+  segment_peer->m_fileInfo.setEndingPosition( slowest_peer->transferEndPosition() );
+  slowest_peer->m_fileInfo.setEndingPosition( split_position );
+  slowest_peer->m_isSegmentShrunk = true;
+  return true;
+}
+
+QMap<VNumber, FileInfo> FileTransferPeer::segmentSources() const
+{
+  QMap<VNumber, FileInfo> file_sources = FileShare::instance().networkFileSources( m_fileInfo.fileHash() );
+  file_sources.insert( remoteUserId(), m_fileInfo );
+  QMap<VNumber, FileInfo>::iterator it = file_sources.begin();
+  while( it != file_sources.end() )
+  {
+    bool source_is_valid = it.value().size() == m_fileInfo.size() && m_sourceErrors.value( it.key(), 0 ) < FILE_TRANSFER_SEGMENT_MAX_ERRORS;
+    if( source_is_valid && it.key() != remoteUserId() )
+    {
+      User u = UserManager::instance().findUser( it.key() );
+      source_is_valid = u.isValid() && u.isStatusConnected() && u.protocolVersion() >= FILE_TRANSFER_SEGMENTS_PROTO_VERSION;
+    }
+
+    if( source_is_valid )
+      ++it;
+    else
+      it = file_sources.erase( it );
+  }
+  return file_sources;
+}
+
+int FileTransferPeer::segmentsFromUser( VNumber user_id ) const
+{
+  int num_segments = !m_isSegmentCompleted && remoteUserId() == user_id ? 1 : 0;
+  foreach( FileTransferPeer* segment_peer, m_segments )
+  {
+    if( segment_peer->remoteUserId() == user_id )
+      num_segments++;
+  }
+  return num_segments;
+}
+
+bool FileTransferPeer::startSegment( const QMap<VNumber, FileInfo>& file_sources )
+{
+  // The source with less connections
+  VNumber source_user_id = ID_INVALID;
+  int min_segments = 0;
+  QMap<VNumber, FileInfo>::const_iterator it = file_sources.constBegin();
+  while( it != file_sources.constEnd() )
+  {
+    int num_segments = segmentsFromUser( it.key() );
+    if( source_user_id == ID_INVALID || num_segments < min_segments )
+    {
+      source_user_id = it.key();
+      min_segments = num_segments;
+    }
+    ++it;
+  }
+
+  if( source_user_id == ID_INVALID )
+    return false;
+
+  FileTransferPeer* segment_peer = new FileTransferPeer( this );
+  segment_peer->setTransferType( FileInfo::Download );
+  segment_peer->setId( m_id );
+  // The main peer verifies the file: the segments do not send the content hashes in their requests
+  FileInfo segment_file_info = file_sources.value( source_user_id );
+  segment_file_info.setContentHash( "" );
+  segment_file_info.setChunkHashes( QByteArray() );
+  segment_peer->setFileInfo( FileInfo::Download, segment_file_info );
+  segment_peer->setRemoteUserId( source_user_id );
+  segment_peer->mp_chunkMap = mp_chunkMap;
+  segment_peer->mp_mainPeer = this;
+  if( !assignSegmentRange( segment_peer ) && !splitSegmentRange( segment_peer ) )
+  {
+    delete segment_peer;
+    return false;
+  }
+
+#ifdef BEEBEEP_DEBUG
+  qDebug() << qPrintable( name() ) << "starts a segment for the range" << segment_peer->m_fileInfo.startingPosition() << "-" << segment_peer->m_fileInfo.endingPosition()
+           << "from user id" << source_user_id;
+#endif
+  connect( segment_peer, SIGNAL( operationCompleted() ), this, SLOT( onSegmentFinished() ) );
+  m_segments.append( segment_peer );
+  segment_peer->startConnection();
+  return true;
+}
+
+void FileTransferPeer::checkSegments()
+{
+  if( mp_chunkMap->isCompleted() )
+  {
+    if( canVerifyDownloadedFile() )
+    {
+      verifyDownloadedFile();
+      return;
+    }
+    mp_chunkMap->remove();
+    setTransferCompleted();
+    return;
+  }
+
+  if( m_state != FileTransferPeer::FileHeader && m_state != FileTransferPeer::Transferring )
+    return;
+
+  // The main peer downloads a segment too until its range is completed
+  QMap<VNumber, FileInfo> file_sources = segmentSources();
+  int segments_to_start = qMax( Settings::instance().fileTransferSegments(), file_sources.size() ) - m_segments.size() - (m_isSegmentCompleted ? 0 : 1);
+  while( segments_to_start > 0 && startSegment( file_sources ) )
+    segments_to_start--;
+
+  if( m_isSegmentCompleted && m_segments.isEmpty() )
+    setError( tr( "Unable to download the file segments" ) );
+}
+
+void FileTransferPeer::onSegmentFinished()
+{
+  FileTransferPeer* segment_peer = qobject_cast<FileTransferPeer*>( sender() );
+  if( !segment_peer || !m_segments.removeOne( segment_peer ) )
+    return;
+  segment_peer->deleteLater();
+
+  if( !segment_peer->isTransferCompleted() )
+  {
+    // The chunks not completed are assigned again
+    mp_chunkMap->releaseRange( segment_peer->m_fileInfo.startingPosition(), segment_peer->transferEndPosition() );
+    int source_errors = m_sourceErrors.value( segment_peer->remoteUserId(), 0 ) + 1;
+    m_sourceErrors.insert( segment_peer->remoteUserId(), source_errors );
+    qWarning() << qPrintable( name() ) << "has lost the segment" << segment_peer->m_fileInfo.startingPosition() << "-" << segment_peer->transferEndPosition()
+               << "of the file" << m_fileInfo.name() << "from user id" << segment_peer->remoteUserId() << "(" << source_errors << "errors)";
+  }
+
+  checkSegments();
+}
+
+void FileTransferPeer::stopSegments()
+{
+  foreach( FileTransferPeer* segment_peer, m_segments )
+  {
+    segment_peer->disconnect( this );
+    if( m_state == FileTransferPeer::Paused )
+      segment_peer->pauseTransfer( true );
+    else
+      segment_peer->cancelTransfer();
+    segment_peer->deleteLater();
+  }
+  m_segments.clear();
+}
+
+void FileTransferPeer::setSegmentCompleted()
+{
+#ifdef BEEBEEP_DEBUG
+  qDebug() << qPrintable( name() ) << "has completed the segment" << m_fileInfo.startingPosition() << "-" << transferEndPosition() << "of the file" << m_fileInfo.name();
+#endif
+  if( mp_mainPeer )
+  {
+    m_state = FileTransferPeer::Completed;
+    closeAll();
+    emit operationCompleted();
+    return;
+  }
+
+  // The main peer waits for the other segments
+  closeTransferConnection();
+  checkSegments();
+}
+
+void FileTransferPeer::closeTransferConnection()
+{
+  // The main peer keeps its state until the file is completed
+  m_isSegmentCompleted = true;
+  TimerWheel::instance().cancel( m_transferTimerId );
+  m_transferTimerId = 0;
+  mp_socket->closeConnection();
+  if( m_file.isOpen() )
+  {
+    m_file.flush();
+    m_file.close();
+  }
+}
+
+void FileTransferPeer::updateChunkMap()
+{
+  // The data of a chunk are flushed before the chunk map is saved
+  if( mp_chunkMap->setCompleted( m_fileInfo.startingPosition(), m_totalBytesTransferred ) <= 0 )
+    return;
+  m_file.flush();
+
+  FileTransferPeer* main_peer = mp_mainPeer ? mp_mainPeer : this;
+  main_peer->showProgress();
+  if( main_peer->m_chunkMapTimer.elapsed() > FILE_CHUNK_MAP_SAVE_INTERVAL )
+  {
+    mp_chunkMap->save();
+    main_peer->m_chunkMapTimer.restart();
+  }
+}
+
+void FileTransferPeer::verifyDownloadedFile()
+{
+  if( mp_fileHashesJob )
+    return;
+
+  // All the chunks are verified: also the ones of a partially downloaded file resumed
+  qDebug() << qPrintable( name() ) << "verifies the content of the file" << m_fileInfo.name();
+  emit message( id(), remoteUserId(), m_fileInfo, tr( "Verifying the file" ), m_state );
+  BuildFileHashes* bfh = new BuildFileHashes;
+  bfh->setFilePath( m_file.fileName() );
+  connect( bfh, SIGNAL( hashesCompleted() ), this, SLOT( onDownloadedFileHashesCompleted() ) );
+  mp_fileHashesJob = bfh;
+  if( beeApp )
+    beeApp->addJob( bfh );
+  QMetaObject::invokeMethod( bfh, "buildHashes", Qt::QueuedConnection );
+}
+
+void FileTransferPeer::stopFileHashes()
+{
+  if( !mp_fileHashesJob )
+    return;
+  mp_fileHashesJob->disconnect( this );
+  if( beeApp )
+    beeApp->removeJob( mp_fileHashesJob );
+  mp_fileHashesJob->deleteLater();
+  mp_fileHashesJob = Q_NULLPTR;
+}
+
+void FileTransferPeer::onDownloadedFileHashesCompleted()
+{
+  BuildFileHashes* bfh = qobject_cast<BuildFileHashes*>( sender() );
+  if( !bfh || bfh != mp_fileHashesJob )
+    return;
+  QByteArray chunk_hashes = bfh->chunkHashes();
+  qint64 elapsed_time = bfh->elapsedTime();
+  stopFileHashes();
+
+  if( m_state != FileTransferPeer::Transferring )
+    return;
+
+  if( chunk_hashes.size() != m_fileInfo.chunkHashes().size() )
+  {
+    setError( tr( "Unable to verify the file %1" ).arg( m_file.fileName() ) );
+    return;
+  }
+
+  QList<int> corrupted_chunks;
+  int chunk_hash_size = FileChunkMap::chunkHashSize();
+  for( int i = 0; i * chunk_hash_size < chunk_hashes.size(); i++ )
+  {
+    if( chunk_hashes.mid( i * chunk_hash_size, chunk_hash_size ) != m_fileInfo.chunkHashes().mid( i * chunk_hash_size, chunk_hash_size ) )
+      corrupted_chunks.append( i );
+  }
+
+  if( corrupted_chunks.isEmpty() )
+  {
+    qDebug() << qPrintable( name() ) << "has verified the content of the file" << m_fileInfo.name() << "in" << elapsed_time << "ms";
+    if( mp_chunkMap )
+      mp_chunkMap->remove();
+    setTransferCompleted();
+    return;
+  }
+
+  m_fileVerifications++;
+  qWarning() << qPrintable( name() ) << "has found" << corrupted_chunks.size() << "corrupted chunks in the file" << m_fileInfo.name()
+             << "(" << m_fileVerifications << "verifications)";
+  if( m_fileVerifications >= FILE_TRANSFER_MAX_VERIFICATIONS )
+  {
+    setError( tr( "The file %1 is corrupted" ).arg( m_fileInfo.name() ) );
+    return;
+  }
+
+  // Only the corrupted chunks are downloaded again in segments
+  if( !mp_chunkMap )
+  {
+    mp_chunkMap = new FileChunkMap( chunkMapFilePath(), m_fileInfo.size() );
+    mp_chunkMap->setCompleted( 0, m_fileInfo.size() );
+    m_chunkMapTimer.start();
+  }
+  foreach( int chunk_index, corrupted_chunks )
+    mp_chunkMap->setMissing( chunk_index );
+  mp_chunkMap->save();
+  checkSegments();
+}
@@ -22,9 +22,11 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "BeeUtils.h"
+#include "FileChunkMap.h"
 #include "FileTransferPeer.h"
 #include "Protocol.h"
 #include "Settings.h"
+#include "TimerWheel.h"
 #include "UserManager.h"
 
 
@@ -33,7 +35,12 @@ FileTransferPeer::FileTransferPeer( QObject *parent )
     m_fileInfo( ID_INVALID, FileInfo::Upload ), m_file(), m_state( FileTransferPeer::Unknown ),
     m_bytesTransferred( 0 ), m_totalBytesTransferred( 0 ), mp_socket( Q_NULLPTR ),
     m_socketDescriptor( 0 ), m_remoteUserId( ID_INVALID ), m_serverPort( 0 ), m_startTimestamp(),
-    m_elapsedTime( 0 ), m_isSkipped( false )
+    m_elapsedTime( 0 ), m_isSkipped( false ), m_transferTimerId( 0 ), m_bytesSent( 0 ), m_transferWindow( 0 ),
+    m_chunksInFlight(), m_transferWindowTimer(), m_minRoundTripTime( -1 ), m_isConfirmationScheduled( false ),
+    m_chunkSize( 0 ), m_throughput( 0 ), m_throughputBytes( 0 ), m_throughputTimestamp( 0 ),
+    mp_chunkMap( Q_NULLPTR ), mp_mainPeer( Q_NULLPTR ), m_segments(), m_isSegmentCompleted( false ),
+    m_isSegmentShrunk( false ), m_sourceErrors(), m_chunkMapTimer(), m_isWaitingFileHashes( false ),
+    mp_fileHashesJob( Q_NULLPTR ), m_fileVerifications( 0 )
 {
   setObjectName( "FileTransferPeer" );
 #ifdef BEEBEEP_DEBUG
@@ -46,11 +53,21 @@ FileTransferPeer::FileTransferPeer( QObject *parent )
   connect( mp_socket, SIGNAL( abortRequest() ), this, SLOT( cancelTransfer() ) );
 }
 
+FileTransferPeer::~FileTransferPeer()
+{
+  stopFileHashes();
+  if( mp_chunkMap && !mp_mainPeer )
+    delete mp_chunkMap;
+}
+
 void FileTransferPeer::closeAll()
 {
 #ifdef BEEBEEP_DEBUG
   qDebug() << qPrintable( name() ) << "cleans up";
 #endif
+  TimerWheel::instance().cancel( m_transferTimerId );
+  m_transferTimerId = 0;
+
   if( mp_socket->isOpen() )
   {
 #ifdef BEEBEEP_DEBUG
@@ -68,8 +85,19 @@ void FileTransferPeer::closeAll()
     m_file.close();
   }
 
-  if( !isTransferCompleted() && isDownload() && m_file.exists() && m_state != FileTransferPeer::Paused && !Settings::instance().resumeFileTransfer() )
+  if( mp_chunkMap && !mp_mainPeer )
+    stopSegments();
+  stopFileHashes();
+
+  // The segment peers write in the file of the main peer
+  if( !isTransferCompleted() && isDownload() && !mp_mainPeer && m_file.exists() && m_state != FileTransferPeer::Paused && !Settings::instance().resumeFileTransfer() )
+  {
     m_file.remove();
+    if( mp_chunkMap )
+      mp_chunkMap->remove();
+  }
+  else if( !isTransferCompleted() && mp_chunkMap && !mp_mainPeer )
+    mp_chunkMap->save();
 
   computeElapsedTime();
 }
@@ -110,6 +138,7 @@ void FileTransferPeer::startConnection()
   m_elapsedTime = 0;
   m_startTimestamp = QDateTime();
   m_isSkipped = false;
+  m_isConfirmationScheduled = false;
 
   if( m_socketDescriptor > 0 )
   {
@@ -228,7 +257,7 @@ void FileTransferPeer::pauseTransfer( bool close_connection )
     return;
   if( m_state != FileTransferPeer::Completed && m_state != FileTransferPeer::Error && m_state != FileTransferPeer::Canceled )
   {
-    if( !close_connection )
+    if( !close_connection && !m_isSegmentCompleted )
     {
       qDebug() << qPrintable( name() ) << "is pausing the file transfer";
       m_state = FileTransferPeer::Pausing;
@@ -263,6 +292,7 @@ void FileTransferPeer::setTransferringState()
     return;
   m_startTimestamp = QDateTime::currentDateTime();
   m_state = FileTransferPeer::Transferring;
+  scheduleTransferTimeout( Settings::instance().pongTimeout() + TICK_INTERVAL );
   if( m_fileInfo.isValid() && remoteUserId() != ID_INVALID )
     emit message( id(), remoteUserId(), m_fileInfo, tr( "Starting transfer" ), m_state );
 }
@@ -270,7 +300,7 @@ void FileTransferPeer::setTransferringState()
 void FileTransferPeer::socketError( QAbstractSocket::SocketError )
 {
   // Make a check to remove the error after a transfer completed
-  if( m_state <= FileTransferPeer::Transferring )
+  if( m_state <= FileTransferPeer::Transferring && !m_isSegmentCompleted )
     setError( mp_socket->errorString() );
 }
 
@@ -286,7 +316,13 @@ void FileTransferPeer::setError( const QString& str_err )
 
 void FileTransferPeer::showProgress()
 {
-  if( m_totalBytesTransferred > 0 )
+  if( mp_chunkMap )
+  {
+    // The main peer shows the bytes downloaded by all the segments
+    computeElapsedTime();
+    emit progress( id(), remoteUserId(), m_fileInfo, mp_chunkMap->bytesCompleted(), m_elapsedTime );
+  }
+  else if( m_totalBytesTransferred > 0 )
   {
     computeElapsedTime();
     emit progress( id(), remoteUserId(), m_fileInfo, m_totalBytesTransferred, m_elapsedTime );
@@ -351,14 +387,40 @@ void FileTransferPeer::setUserAuthorized( VNumber user_id )
 void FileTransferPeer::connectionTimeout()
 {
   if( m_state <= FileTransferPeer::Request )
-    setError( tr( "Connection timeout" ) );
+  {
+    if( m_isWaitingFileHashes )
+      QTimer::singleShot( Settings::instance().fileTransferConfirmTimeout(), this, SLOT( connectionTimeout() ) );
+    else
+      setError( tr( "Connection timeout" ) );
+  }
 }
 
-void FileTransferPeer::onTickEvent( int )
+void FileTransferPeer::scheduleTransferTimeout( int msecs )
 {
+  TimerWheel::instance().cancel( m_transferTimerId );
+  m_transferTimerId = TimerWheel::instance().schedule( msecs, this, "onTransferTimeout" );
+}
+
+void FileTransferPeer::onTransferTimeout()
+{
+  m_transferTimerId = 0;
+  if( m_isWaitingFileHashes )
+  {
+    if( m_state == FileTransferPeer::Request )
+      sendFileHashesKeepAlive();
+    return;
+  }
+
+  if( m_state == FileTransferPeer::FileHeader && isDownload() )
+  {
+    setError( tr( "Connection timeout" ) );
+    return;
+  }
+
   if( m_state == FileTransferPeer::Transferring )
   {
-    if( mp_socket->activityIdle() > Settings::instance().pongTimeout() )
+    int activity_idle = mp_socket->activityIdle();
+    if( activity_idle > Settings::instance().pongTimeout() )
     {
       if( mp_socket->protocolVersion() >= FILE_TRANSFER_RESUME_PROTO_VERSION && Settings::instance().resumeFileTransfer() )
       {
@@ -372,6 +434,8 @@ void FileTransferPeer::onTickEvent( int )
       else
         setError( tr( "Transfer timeout" ) );
     }
+    else
+      scheduleTransferTimeout( Settings::instance().pongTimeout() - activity_idle + TICK_INTERVAL );
   }
 }
 
@@ -27,6 +27,8 @@
 #include "ConnectionSocket.h"
 #include "FileInfo.h"
 
+class FileChunkMap;
+
 
 class FileTransferPeer : public QObject
 {
@@ -36,6 +38,7 @@ public:
   enum TransferState { Unknown, Queue, Starting, Request, FileHeader, Transferring, Completed, Error, Canceled, Pausing, Paused };
 
   explicit FileTransferPeer( QObject *parent = Q_NULLPTR );
+  ~FileTransferPeer();
 
   inline QString name() const;
 
@@ -60,6 +63,8 @@ public:
   inline bool isActive() const;
   inline bool isTransferCompleted() const;
   void startUpload( const FileInfo& );
+  void waitFileHashes( const FileInfo& );
+  inline bool useChunkHashes() const;
   inline qint64 elapsedTime() const;
 
   bool canPauseTransfer() const;
@@ -68,8 +73,6 @@ public:
 
   static bool stateIsStopped( FileTransferPeer::TransferState );
 
-  void onTickEvent( int );
-
 signals:
   void message( VNumber peer_id, VNumber user_id, const FileInfo&, const QString&, FileTransferPeer::TransferState );
   void progress( VNumber peer_id, VNumber user_id, const FileInfo&, FileSizeType, qint64 );
@@ -86,7 +89,11 @@ protected slots:
   void socketError( QAbstractSocket::SocketError );
   void checkTransferData( const QByteArray& );
   void connectionTimeout();
+  void onTransferTimeout();
   void checkUserAuthentication( const QByteArray& );
+  void sendScheduledDownloadDataConfirmation();
+  void onSegmentFinished();
+  void onDownloadedFileHashesCompleted();
 
 protected:
   void setUserAuthorized( VNumber );
@@ -98,6 +105,9 @@ protected:
   void computeElapsedTime();
   void setTransferPaused();
   void setTransferringState();
+  void scheduleTransferTimeout( int msecs );
+  inline bool useTransferWindow() const;
+  inline FileSizeType transferEndPosition() const;
 
   /* FileTransferUpload */
   void sendUploadData();
@@ -105,6 +115,10 @@ protected:
   void checkUploadRequest( const QByteArray& );
   void checkUploading( const QByteArray& );
   void sendFileHeader();
+  void sendFileHashesKeepAlive();
+  void resetTransferWindow();
+  void checkTransferWindow( FileSizeType total_bytes_arrived, bool pause_transfer );
+  void adaptChunkSize( FileSizeType bytes_confirmed, qint64 round_trip_time );
 
   /* FileTransferDownload */
   void sendDownloadData();
@@ -112,6 +126,24 @@ protected:
   void sendDownloadRequest();
   void sendDownloadDataConfirmation();
   QString temporaryFilePath() const;
+  QString chunkMapFilePath() const;
+  bool canDownloadInSegments() const;
+  bool initChunkMap();
+  void sendDownloadRangeRequest();
+  QMap<VNumber, FileInfo> segmentSources() const;
+  int segmentsFromUser( VNumber ) const;
+  bool assignSegmentRange( FileTransferPeer* );
+  void updateSegmentThroughput( FileSizeType bytes_arrived );
+  bool splitSegmentRange( FileTransferPeer* );
+  bool startSegment( const QMap<VNumber, FileInfo>& );
+  void checkSegments();
+  void stopSegments();
+  void setSegmentCompleted();
+  void updateChunkMap();
+  void closeTransferConnection();
+  inline bool canVerifyDownloadedFile() const;
+  void verifyDownloadedFile();
+  void stopFileHashes();
 
 protected:
   FileInfo::TransferType m_transferType;
@@ -128,6 +160,33 @@ protected:
   QDateTime m_startTimestamp;
   qint64 m_elapsedTime;
   bool m_isSkipped;
+  int m_transferTimerId;
+
+  // Transfer window: the upload keeps more chunks in flight and the download confirms them cumulatively
+  FileSizeType m_bytesSent;
+  FileSizeType m_transferWindow;
+  QList< QPair<FileSizeType, qint64> > m_chunksInFlight; // end position in file, time sent
+  QElapsedTimer m_transferWindowTimer;
+  qint64 m_minRoundTripTime;
+  bool m_isConfirmationScheduled;
+  int m_chunkSize;
+  qint64 m_throughput; // bytes per second of the upload or of the download segment
+  FileSizeType m_throughputBytes;
+  qint64 m_throughputTimestamp;
+
+  // Segmented download: the main peer shares the chunk map with its segment peers
+  FileChunkMap* mp_chunkMap;
+  FileTransferPeer* mp_mainPeer;
+  QList<FileTransferPeer*> m_segments;
+  bool m_isSegmentCompleted;
+  bool m_isSegmentShrunk;
+  QHash<VNumber, int> m_sourceErrors; // the segments can be downloaded from all the users sharing the file
+  QElapsedTimer m_chunkMapTimer;
+
+  // Content hashes: the upload waits for them before the file header and the download verifies the file with them
+  bool m_isWaitingFileHashes;
+  QObject* mp_fileHashesJob;
+  int m_fileVerifications;
 
 };
 
@@ -149,5 +208,9 @@ inline void FileTransferPeer::setRemoteUserId( VNumber new_value ) { m_remoteUse
 inline VNumber FileTransferPeer::remoteUserId() const { return mp_socket->userId() != ID_INVALID ? mp_socket->userId() : m_remoteUserId; }
 inline qint64 FileTransferPeer::elapsedTime() const { return m_elapsedTime; }
 inline bool FileTransferPeer::isSkipped() const { return m_isSkipped; }
+inline bool FileTransferPeer::useTransferWindow() const { return mp_socket->protocolVersion() >= FILE_TRANSFER_WINDOW_PROTO_VERSION; }
+inline bool FileTransferPeer::useChunkHashes() const { return mp_socket->protocolVersion() >= FILE_TRANSFER_CHUNK_HASHES_PROTO_VERSION; }
+inline bool FileTransferPeer::canVerifyDownloadedFile() const { return !mp_mainPeer && !m_fileInfo.chunkHashes().isEmpty(); }
+inline FileSizeType FileTransferPeer::transferEndPosition() const { return m_fileInfo.endingPosition() > 0 && m_fileInfo.endingPosition() <= m_fileInfo.size() ? m_fileInfo.endingPosition() : m_fileInfo.size(); }
 
 #endif // BEEBEEP_FILETRANSFERSERVERPEER_H
@@ -27,6 +27,13 @@
 #include "Settings.h"
 
 
+const int FILE_TRANSFER_INITIAL_WINDOW_CHUNKS = 4;
+const FileSizeType FILE_TRANSFER_MAX_WINDOW_SIZE = 8388608;
+const int FILE_TRANSFER_WINDOW_RTT_TOLERANCE = 10; // ms
+const int FILE_TRANSFER_MIN_CHUNK_SIZE = 16384;
+const int FILE_TRANSFER_CHUNK_TIME = 50; // ms of data in a chunk
+const int FILE_TRANSFER_THROUGHPUT_SAMPLE_TIME = 200; // ms
+
 void FileTransferPeer::checkUploadData( const QByteArray& byte_array )
 {
   switch( m_state )
@@ -78,11 +85,36 @@ void FileTransferPeer::checkUploadRequest( const QByteArray& byte_array )
   emit fileUploadRequest( file_info );
 }
 
+void FileTransferPeer::waitFileHashes( const FileInfo& fi )
+{
+#ifdef BEEBEEP_DEBUG
+  qDebug() << qPrintable( name() ) << "waits for the content hashes of the file" << qPrintable( fi.path() );
+#endif
+  setFileInfo( FileInfo::Upload, fi );
+  m_isWaitingFileHashes = true;
+  // The download waits for the file header: the keep-alive messages re-arm its timeout
+  scheduleTransferTimeout( Settings::instance().fileTransferConfirmTimeout() / 3 );
+}
+
+void FileTransferPeer::sendFileHashesKeepAlive()
+{
+#ifdef BEEBEEP_DEBUG
+  qDebug() << qPrintable( name() ) << "is still building the content hashes of the file" << qPrintable( m_fileInfo.path() );
+#endif
+  if( !mp_socket->sendData( Protocol::instance().pingMessage() ) )
+  {
+    setError( tr( "unable to send file header" ) );
+    return;
+  }
+  scheduleTransferTimeout( Settings::instance().fileTransferConfirmTimeout() / 3 );
+}
+
 void FileTransferPeer::startUpload( const FileInfo& fi )
 {
+  m_isWaitingFileHashes = false;
   setTransferType( FileInfo::Upload );
   setFileInfo( FileInfo::Upload, fi );
-  qDebug() << qPrintable( name() ) << "starts uploading" << qPrintable( fi.path() ) << "from" << fi.startingPosition() << "to" << fi.size() << "bytes";
+  qDebug() << qPrintable( name() ) << "starts uploading" << qPrintable( fi.path() ) << "from" << fi.startingPosition() << "to" << transferEndPosition() << "bytes";
   if( mp_socket->protocolVersion() < FILE_TRANSFER_2_PROTO_VERSION )
   {
     qWarning() << qPrintable( name() ) << "using an old file upload protocol version" << mp_socket->protocolVersion();
@@ -116,6 +148,8 @@ void FileTransferPeer::sendFileHeader()
       m_bytesTransferred = m_fileInfo.startingPosition();
       m_isSkipped = m_bytesTransferred == m_fileInfo.size();
     }
+    if( m_fileInfo.endingPosition() <= m_fileInfo.startingPosition() || m_fileInfo.endingPosition() > m_fileInfo.size() )
+      m_fileInfo.setEndingPosition( 0 );
   }
   else
   {
@@ -123,6 +157,7 @@ void FileTransferPeer::sendFileHeader()
     return;
   }
 
+  resetTransferWindow();
   Message file_header_message = Protocol::instance().fileInfoToMessage( m_fileInfo, mp_socket->protocolVersion() );
   QByteArray file_header = Protocol::instance().fromMessage( file_header_message, mp_socket->protocolVersion() );
 
@@ -147,6 +182,10 @@ void FileTransferPeer::checkUploading( const QByteArray& byte_array )
   {
     setTransferPaused();
   }
+  else if( useTransferWindow() )
+  {
+    checkTransferWindow( total_bytes, pause_transfer );
+  }
   else if( bytes_arrived == m_bytesTransferred )
   {
 #ifdef BEEBEEP_DEBUG
@@ -158,9 +197,9 @@ void FileTransferPeer::checkUploading( const QByteArray& byte_array )
 
     if( total_bytes > 0 && m_totalBytesTransferred != total_bytes )
       setError( tr( "%1 bytes uploaded but the remote file size is %2 bytes" ).arg( m_totalBytesTransferred ).arg( total_bytes ) );
-    else if( m_totalBytesTransferred > m_fileInfo.size() )
-      setError( tr( "%1 bytes uploaded but the file size is only %2 bytes" ).arg( m_totalBytesTransferred ).arg( m_fileInfo.size() ) );
-    else if( m_totalBytesTransferred == m_fileInfo.size() )
+    else if( m_totalBytesTransferred > transferEndPosition() )
+      setError( tr( "%1 bytes uploaded but the file size is only %2 bytes" ).arg( m_totalBytesTransferred ).arg( transferEndPosition() ) );
+    else if( m_totalBytesTransferred == transferEndPosition() )
       setTransferCompleted();
     else if( pause_transfer )
       setTransferPaused();
@@ -171,6 +210,92 @@ void FileTransferPeer::checkUploading( const QByteArray& byte_array )
     setError( tr( "%1 bytes sent not confirmed (%2 bytes confirmed)").arg( m_bytesTransferred ).arg( bytes_arrived ) );
 }
 
+void FileTransferPeer::resetTransferWindow()
+{
+  m_bytesSent = m_bytesTransferred;
+  // Small chunks first: small files show their progress and the large ones grow the chunks with the throughput
+  m_chunkSize = useTransferWindow() ? qMin( FILE_TRANSFER_MIN_CHUNK_SIZE, Settings::instance().fileTransferMaxBufferSize() ) : mp_socket->fileTransferBufferSize();
+  m_transferWindow = static_cast<FileSizeType>( FILE_TRANSFER_INITIAL_WINDOW_CHUNKS ) * m_chunkSize;
+  m_chunksInFlight.clear();
+  m_minRoundTripTime = -1;
+  m_throughput = 0;
+  m_throughputBytes = 0;
+  m_throughputTimestamp = 0;
+  m_transferWindowTimer.start();
+}
+
+void FileTransferPeer::checkTransferWindow( FileSizeType total_bytes_arrived, bool pause_transfer )
+{
+  // Confirmations are cumulative: the total bytes arrived are in the file position of the data sent
+  if( total_bytes_arrived < m_totalBytesTransferred || total_bytes_arrived > m_bytesSent )
+  {
+    setError( tr( "%1 bytes sent not confirmed (%2 bytes confirmed)").arg( m_bytesSent ).arg( total_bytes_arrived ) );
+    return;
+  }
+
+  FileSizeType bytes_confirmed = total_bytes_arrived - m_totalBytesTransferred;
+  bool window_is_full = m_bytesSent - m_totalBytesTransferred >= m_transferWindow;
+  m_totalBytesTransferred = total_bytes_arrived;
+
+  qint64 round_trip_time = -1;
+  while( !m_chunksInFlight.isEmpty() && m_chunksInFlight.first().first <= total_bytes_arrived )
+    round_trip_time = m_transferWindowTimer.elapsed() - m_chunksInFlight.takeFirst().second;
+  if( round_trip_time >= 0 && (m_minRoundTripTime < 0 || round_trip_time < m_minRoundTripTime) )
+    m_minRoundTripTime = round_trip_time;
+
+  // The window grows until it covers the bandwidth-delay product: when the round trip time
+  // increases the data in flight are only waiting in the queues of the network
+  if( window_is_full && (round_trip_time < 0 || round_trip_time <= 2 * m_minRoundTripTime + FILE_TRANSFER_WINDOW_RTT_TOLERANCE) )
+  {
+    m_transferWindow = qMin( m_transferWindow + bytes_confirmed, FILE_TRANSFER_MAX_WINDOW_SIZE );
+#ifdef BEEBEEP_DEBUG
+    qDebug() << qPrintable( name() ) << "increases the transfer window to" << m_transferWindow << "bytes with round trip time" << round_trip_time << "ms";
+#endif
+  }
+
+  adaptChunkSize( bytes_confirmed, round_trip_time );
+  showProgress();
+
+  if( m_totalBytesTransferred > transferEndPosition() )
+    setError( tr( "%1 bytes uploaded but the file size is only %2 bytes" ).arg( m_totalBytesTransferred ).arg( transferEndPosition() ) );
+  else if( m_totalBytesTransferred == transferEndPosition() )
+    setTransferCompleted();
+  else if( pause_transfer )
+    setTransferPaused();
+  else
+    sendTransferData();
+}
+
+void FileTransferPeer::adaptChunkSize( FileSizeType bytes_confirmed, qint64 round_trip_time )
+{
+  m_throughputBytes += bytes_confirmed;
+  qint64 sample_time = m_transferWindowTimer.elapsed() - m_throughputTimestamp;
+  if( sample_time < FILE_TRANSFER_THROUGHPUT_SAMPLE_TIME )
+    return;
+
+  qint64 throughput = m_throughputBytes * 1000 / sample_time;
+  m_throughput = m_throughput > 0 ? (3 * m_throughput + throughput) / 4 : throughput;
+  m_throughputBytes = 0;
+  m_throughputTimestamp += sample_time;
+
+  // A chunk carries about FILE_TRANSFER_CHUNK_TIME ms of data and the window holds at least some of them
+  qint64 chunk_size = m_throughput * FILE_TRANSFER_CHUNK_TIME / 1000;
+  chunk_size = qMin( chunk_size, m_transferWindow / FILE_TRANSFER_INITIAL_WINDOW_CHUNKS );
+  if( round_trip_time > 2 * m_minRoundTripTime + FILE_TRANSFER_WINDOW_RTT_TOLERANCE )
+    chunk_size = qMin( chunk_size, static_cast<qint64>( m_chunkSize ) ); // the network is queueing: larger chunks only add latency
+  qint64 max_chunk_size = Settings::instance().fileTransferMaxBufferSize();
+  chunk_size = qBound( qMin( static_cast<qint64>( FILE_TRANSFER_MIN_CHUNK_SIZE ), max_chunk_size ), chunk_size, max_chunk_size );
+  chunk_size -= chunk_size % ENCRYPTED_DATA_BLOCK_SIZE;
+
+  if( chunk_size != m_chunkSize )
+  {
+#ifdef BEEBEEP_DEBUG
+    qDebug() << qPrintable( name() ) << "changes the chunk size from" << m_chunkSize << "to" << chunk_size << "bytes with throughput" << m_throughput << "bytes/s";
+#endif
+    m_chunkSize = static_cast<int>( chunk_size );
+  }
+}
+
 void FileTransferPeer::sendUploadData()
 {
   if( m_state == FileTransferPeer::Paused || m_state == FileTransferPeer::Pausing )
@@ -200,6 +325,23 @@ void FileTransferPeer::sendUploadData()
   if( m_file.atEnd() )
     return;
 
+  if( useTransferWindow() )
+  {
+    // A segment of a file ends before the end of the file
+    while( m_bytesSent < transferEndPosition() && m_bytesSent - m_totalBytesTransferred < m_transferWindow )
+    {
+      QByteArray byte_array = m_file.read( qMin( static_cast<FileSizeType>( m_chunkSize ), transferEndPosition() - m_bytesSent ) );
+      if( byte_array.isEmpty() || !mp_socket->sendData( byte_array ) )
+      {
+        setError( tr( "Unable to upload data" ) );
+        return;
+      }
+      m_bytesSent += byte_array.size();
+      m_chunksInFlight.append( qMakePair( m_bytesSent, m_transferWindowTimer.elapsed() ) );
+    }
+    return;
+  }
+
   QByteArray byte_array = m_file.read( mp_socket->fileTransferBufferSize() );
 
   if( mp_socket->sendData( byte_array ) )
@@ -25,17 +25,258 @@
 
 Hive* Hive::mp_instance = NULL;
 
+const int HIVE_MAX_SIZE = 4096;
+const int HIVE_PEER_EXPIRATION = 90; // days
+const int HIVE_RECENT_PEER_DAYS = 7;
+const int HIVE_MAX_HANDSHAKE_TIME = 10000; // ms
+const int HIVE_DIGEST_BUCKETS = 64;
+
 
 Hive::Hive()
- : m_networkAddresses()
+ : m_peers()
 {
 }
 
 bool Hive::addNetworkAddress( const NetworkAddress& na )
 {
-  if( m_networkAddresses.contains( na ) )
+  if( m_peers.contains( na ) )
+    return false;
+
+  if( m_peers.size() >= HIVE_MAX_SIZE )
     return false;
 
-  m_networkAddresses.append( na );
+  m_peers.insert( na, Peer() );
   return true;
 }
+
+Hive::Peer* Hive::seenPeer( const NetworkAddress& na )
+{
+  if( !na.isHostAddressValid() || !na.isHostPortValid() )
+    return NULL;
+
+  QHash<NetworkAddress, Peer>::iterator it = m_peers.find( na );
+  if( it == m_peers.end() )
+  {
+    // A peer just seen is worth more than the one with the lowest priority in a full store
+    if( m_peers.size() >= HIVE_MAX_SIZE )
+      removeLowestPriorityPeer();
+    it = m_peers.insert( na, Peer() );
+  }
+  it.value().lastSeen = QDateTime::currentDateTime();
+  return &(it.value());
+}
+
+void Hive::removeLowestPriorityPeer()
+{
+  QDateTime now = QDateTime::currentDateTime();
+  QHash<NetworkAddress, Peer>::iterator lowest_it = m_peers.end();
+  int lowest_priority = 0;
+  for( QHash<NetworkAddress, Peer>::iterator it = m_peers.begin(); it != m_peers.end(); ++it )
+  {
+    int peer_priority = priority( it.value(), now );
+    if( lowest_it == m_peers.end() || peer_priority < lowest_priority )
+    {
+      lowest_it = it;
+      lowest_priority = peer_priority;
+    }
+  }
+  if( lowest_it != m_peers.end() )
+    m_peers.erase( lowest_it );
+}
+
+void Hive::setPeerSeen( const NetworkAddress& na )
+{
+  (void)seenPeer( na );
+}
+
+void Hive::setPeerHandshakeCompleted( const NetworkAddress& na, int handshake_ms )
+{
+  Peer* p = seenPeer( na );
+  if( !p )
+    return;
+  p->handshakesCompleted++;
+  handshake_ms = qBound( 1, handshake_ms, HIVE_MAX_HANDSHAKE_TIME );
+  p->handshakeTime = p->handshakeTime > 0 ? (7 * p->handshakeTime + handshake_ms) / 8 : handshake_ms;
+}
+
+void Hive::setPeerHandshakeFailed( const NetworkAddress& na )
+{
+  // Only the known peers: the failures of the unknown addresses are not worth a record
+  QHash<NetworkAddress, Peer>::iterator it = m_peers.find( na );
+  if( it != m_peers.end() )
+    it.value().handshakesFailed++;
+}
+
+int Hive::priority( const Peer& p, const QDateTime& now ) const
+{
+  if( !p.lastSeen.isValid() )
+    return 0;
+
+  // Recently seen peers first, then the reliable ones and the fast ones
+  qint64 hours_since_seen = qMax( static_cast<qint64>( 0 ), static_cast<qint64>( p.lastSeen.secsTo( now ) ) / 3600 );
+  int recency = qMax( 1, static_cast<int>( HIVE_PEER_EXPIRATION * 24 - qMin( hours_since_seen, static_cast<qint64>( HIVE_PEER_EXPIRATION * 24 ) ) ) );
+  int handshakes = p.handshakesCompleted + p.handshakesFailed;
+  int success_rate = handshakes > 0 ? (100 * p.handshakesCompleted) / handshakes : 50;
+  int speed = p.handshakeTime > 0 ? (HIVE_MAX_HANDSHAKE_TIME - p.handshakeTime) / 100 : 0;
+  return recency * (success_rate + 1) + speed;
+}
+
+int Hive::peerPriority( const NetworkAddress& na ) const
+{
+  QHash<NetworkAddress, Peer>::const_iterator it = m_peers.constFind( na );
+  return it == m_peers.constEnd() ? 0 : priority( it.value(), QDateTime::currentDateTime() );
+}
+
+bool Hive::isPeerRecentlyActive( const NetworkAddress& na ) const
+{
+  QHash<NetworkAddress, Peer>::const_iterator it = m_peers.constFind( na );
+  return it != m_peers.constEnd() && it.value().lastSeen.isValid()
+      && it.value().lastSeen.daysTo( QDateTime::currentDateTime() ) <= HIVE_RECENT_PEER_DAYS;
+}
+
+static bool hivePeerPriorityGreaterThan( const QPair<int, NetworkAddress>& p1, const QPair<int, NetworkAddress>& p2 )
+{
+  return p1.first > p2.first;
+}
+
+QList<NetworkAddress> Hive::sortByPriority( const QList<NetworkAddress>& network_addresses ) const
+{
+  QDateTime now = QDateTime::currentDateTime();
+  QList< QPair<int, NetworkAddress> > peer_list;
+  foreach( NetworkAddress na, network_addresses )
+    peer_list.append( qMakePair( priority( m_peers.value( na ), now ), na ) );
+  qStableSort( peer_list.begin(), peer_list.end(), hivePeerPriorityGreaterThan );
+
+  QList<NetworkAddress> sorted_list;
+  for( QList< QPair<int, NetworkAddress> >::const_iterator it = peer_list.constBegin(); it != peer_list.constEnd(); ++it )
+    sorted_list.append( it->second );
+  return sorted_list;
+}
+
+QList<NetworkAddress> Hive::networkAddresses() const
+{
+  return sortByPriority( m_peers.keys() );
+}
+
+QList<NetworkAddress> Hive::recentNetworkAddresses() const
+{
+  QList<NetworkAddress> recent_list;
+  for( QHash<NetworkAddress, Peer>::const_iterator it = m_peers.constBegin(); it != m_peers.constEnd(); ++it )
+  {
+    if( isPeerRecentlyActive( it.key() ) )
+      recent_list.append( it.key() );
+  }
+  return sortByPriority( recent_list );
+}
+
+int Hive::load( const QString& file_path )
+{
+  QFile file( file_path );
+  if( !file.exists() )
+    return 0;
+
+  if( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+  {
+    qWarning() << "Hive cannot open the file" << qPrintable( file_path );
+    return 0;
+  }
+
+  QDateTime dt_expiration = QDateTime::currentDateTime().addDays( -HIVE_PEER_EXPIRATION );
+  QTextStream text_stream( &file );
+  int peers_loaded = 0;
+  while( !text_stream.atEnd() && m_peers.size() < HIVE_MAX_SIZE )
+  {
+    QStringList sl = text_stream.readLine().split( QLatin1Char( '\t' ) );
+    if( sl.size() < 5 )
+      continue;
+    NetworkAddress na = NetworkAddress::fromString( sl.at( 0 ) );
+    if( !na.isHostAddressValid() || !na.isHostPortValid() )
+      continue;
+    Peer p;
+    p.lastSeen = QDateTime::fromString( sl.at( 1 ), Qt::ISODate );
+    if( !p.lastSeen.isValid() || p.lastSeen < dt_expiration )
+      continue;
+    p.handshakesCompleted = qMax( 0, sl.at( 2 ).toInt() );
+    p.handshakesFailed = qMax( 0, sl.at( 3 ).toInt() );
+    p.handshakeTime = qBound( 0, sl.at( 4 ).toInt(), HIVE_MAX_HANDSHAKE_TIME );
+    m_peers.insert( na, p );
+    peers_loaded++;
+  }
+  file.close();
+  qDebug() << "Hive has loaded" << peers_loaded << "peers";
+  return peers_loaded;
+}
+
+bool Hive::save( const QString& file_path ) const
+{
+  // Only the peers seen at least once are saved: the addresses received by the Hive protocol are shared again at the next connection
+  QList<NetworkAddress> peer_list;
+  for( QHash<NetworkAddress, Peer>::const_iterator it = m_peers.constBegin(); it != m_peers.constEnd(); ++it )
+  {
+    if( it.value().lastSeen.isValid() )
+      peer_list.append( it.key() );
+  }
+
+  QFile file( file_path );
+  if( peer_list.isEmpty() )
+  {
+    if( file.exists() )
+      file.remove();
+    return true;
+  }
+
+  if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+  {
+    qWarning() << "Hive cannot save the file" << qPrintable( file_path );
+    return false;
+  }
+
+  QTextStream text_stream( &file );
+  foreach( NetworkAddress na, sortByPriority( peer_list ) )
+  {
+    Peer p = m_peers.value( na );
+    text_stream << na.toString() << QLatin1Char( '\t' ) << p.lastSeen.toString( Qt::ISODate ) << QLatin1Char( '\t' )
+                << p.handshakesCompleted << QLatin1Char( '\t' ) << p.handshakesFailed << QLatin1Char( '\t' ) << p.handshakeTime << QLatin1Char( '\n' );
+  }
+  file.close();
+  qDebug() << "Hive has saved" << peer_list.size() << "peers";
+  return true;
+}
+
+static quint32 hiveHash( const QByteArray& data, quint32 hash_value = 2166136261u )
+{
+  // FNV-1a: the digest has to be the same on every platform and Qt version
+  for( int i = 0; i < data.size(); i++ )
+  {
+    hash_value ^= static_cast<quint8>( data.at( i ) );
+    hash_value *= 16777619u;
+  }
+  return hash_value;
+}
+
+int Hive::digestBucket( const NetworkAddress& na )
+{
+  return static_cast<int>( hiveHash( na.toString().toLatin1() ) % HIVE_DIGEST_BUCKETS );
+}
+
+QList<quint32> Hive::digest( const QList<NetworkAddress>& network_addresses )
+{
+  QVector<QStringList> buckets( HIVE_DIGEST_BUCKETS );
+  foreach( NetworkAddress na, network_addresses )
+    buckets[ digestBucket( na ) ].append( na.toString() );
+
+  QList<quint32> digest_list;
+  for( int i = 0; i < HIVE_DIGEST_BUCKETS; i++ )
+  {
+    QStringList& sl = buckets[ i ];
+    if( sl.isEmpty() )
+    {
+      digest_list.append( 0 );
+      continue;
+    }
+    sl.sort();
+    sl.removeDuplicates();
+    digest_list.append( hiveHash( sl.join( QLatin1String( "\n" ) ).toLatin1() ) );
+  }
+  return digest_list;
+}
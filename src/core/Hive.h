@@ -28,6 +28,14 @@
 #include "NetworkEntry.h"
 
 
+/*
+  Store of the peers known by the Hive protocol and of the peers connected
+  in the past. Each listener address records when it was seen, how many
+  outgoing handshakes have completed or failed and the handshake time, so
+  the most relevant peers can be contacted first. The store is saved in
+  the data folder and loaded at startup.
+*/
+
 class Hive
 {
 // Singleton Object
@@ -35,7 +43,23 @@ class Hive
 
 public:
   bool addNetworkAddress( const NetworkAddress& );
-  inline const QList<NetworkAddress>& networkAddresses() const;
+  QList<NetworkAddress> networkAddresses() const; // sorted by priority
+  QList<NetworkAddress> recentNetworkAddresses() const; // seen in the latest days, sorted by priority
+  inline int size() const;
+
+  void setPeerSeen( const NetworkAddress& );
+  void setPeerHandshakeCompleted( const NetworkAddress&, int handshake_ms );
+  void setPeerHandshakeFailed( const NetworkAddress& );
+  int peerPriority( const NetworkAddress& ) const; // 0 for unknown peers
+  QList<NetworkAddress> sortByPriority( const QList<NetworkAddress>& ) const;
+  bool isPeerRecentlyActive( const NetworkAddress& ) const;
+
+  int load( const QString& file_path );
+  bool save( const QString& file_path ) const;
+
+  // Digest of a list of addresses: one hash for each bucket of addresses, so two peers exchange only the buckets which differ
+  static int digestBucket( const NetworkAddress& );
+  static QList<quint32> digest( const QList<NetworkAddress>& );
 
 
   static Hive& instance()
@@ -57,13 +81,26 @@ public:
 protected:
   Hive();
 
+  struct Peer
+  {
+    Peer() : lastSeen(), handshakesCompleted( 0 ), handshakesFailed( 0 ), handshakeTime( 0 ) {}
+    QDateTime lastSeen;
+    int handshakesCompleted;
+    int handshakesFailed;
+    int handshakeTime; // smoothed, ms
+  };
+
+  int priority( const Peer&, const QDateTime& now ) const;
+  Peer* seenPeer( const NetworkAddress& ); // inserted if unknown, also in a full store
+  void removeLowestPriorityPeer();
+
 private:
-  QList<NetworkAddress> m_networkAddresses;
+  QHash<NetworkAddress, Peer> m_peers;
 
 };
 
 
 // Inline Function
-inline const QList<NetworkAddress>& Hive::networkAddresses() const { return m_networkAddresses; }
+inline int Hive::size() const { return m_peers.size(); }
 
 #endif // BEEBEEP_HIVE_H
@@ -0,0 +1,59 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "ECDHKeyPool.h"
+#include "KeyExchangeJob.h"
+#include "Protocol.h"
+
+
+KeyExchangeJob::KeyExchangeJob( QObject* parent )
+  : QObject( parent ), m_keys(), m_otherPublicKey(), m_datastreamVersion( 0 )
+{
+  setObjectName( "KeyExchangeJob" );
+}
+
+void KeyExchangeJob::setup( const ECDH::Keys& ecdh_keys, const QString& other_public_key, int datastream_version )
+{
+  m_keys = ecdh_keys;
+  m_otherPublicKey = other_public_key;
+  m_datastreamVersion = datastream_version;
+}
+
+void KeyExchangeJob::createCipherKey()
+{
+  QByteArray cipher_key;
+  if( m_keys.generateSharedKey( m_otherPublicKey ) )
+    cipher_key = Protocol::instance().createCipherKey( m_keys.sharedKey(), m_datastreamVersion );
+  m_keys.reset();
+  emit cipherKeyCreated( cipher_key );
+
+  // Keys used by this handshake are replaced here and not in the GUI thread
+  ECDHKeyPool::instance().fill();
+  deleteLater();
+}
+
+void KeyExchangeJob::fillKeyPool()
+{
+  ECDHKeyPool::instance().fill();
+  deleteLater();
+}
@@ -21,37 +21,38 @@
 //
 //////////////////////////////////////////////////////////////////////
 
-#ifndef BEEBEEP_TICKMANAGER_H
-#define BEEBEEP_TICKMANAGER_H
+#ifndef BEEBEEP_KEYEXCHANGEJOB_H
+#define BEEBEEP_KEYEXCHANGEJOB_H
 
-#include "Config.h"
+#include "ECDH.h"
 
 
-class TickManager : public QObject
+/*
+  Computes the ECDH shared key (and the cipher key) of a connection
+  handshake out of the GUI thread. The job deletes itself when done.
+*/
+
+class KeyExchangeJob : public QObject
 {
   Q_OBJECT
 
 public:
-  explicit TickManager( QObject* parent = Q_NULLPTR );
-  ~TickManager();
-
-  bool isActive() const;
+  explicit KeyExchangeJob( QObject* parent = Q_NULLPTR );
 
-signals:
-  void tickEvent( int );
+  void setup( const ECDH::Keys&, const QString& other_public_key, int datastream_version );
 
 public slots:
-  void startTicks();
-  void stopTicks();
+  void createCipherKey();
+  void fillKeyPool();
 
-protected slots:
-  void onTimerTimeout();
+signals:
+  void cipherKeyCreated( const QByteArray& ); // empty if the public key is not valid
 
 private:
-  QTimer* mp_timer;
-  int m_ticks;
-  mutable QMutex m_mutex;
+  ECDH::Keys m_keys;
+  QString m_otherPublicKey;
+  int m_datastreamVersion;
 
 };
 
-#endif // BEEBEEP_TICKMANAGER_H
+#endif // BEEBEEP_KEYEXCHANGEJOB_H
@@ -100,4 +100,6 @@ inline bool Message::isDelayed() const { return hasFlag( Message::Delayed ); }
 inline void Message::setSourceCode() { addFlag( Message::SourceCode ); }
 inline bool Message::isSourceCode() const { return hasFlag( Message::SourceCode ); }
 
+Q_DECLARE_METATYPE( Message )
+
 #endif // BEEBEEP_MESSAGE_H
@@ -0,0 +1,74 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "MessageDecoder.h"
+#include "Protocol.h"
+#include "Settings.h"
+
+
+MessageDecoder::MessageDecoder( QObject* parent )
+  : QObject( parent ), m_cipherContext(), m_protocolVersion( 0 ), m_isEncrypted( false ), m_isCompressed( false ), m_warnInvalidFields( true )
+{
+  setObjectName( "BeeMessageDecoder" );
+}
+
+void MessageDecoder::setup( const CipherContext& cipher_context, int proto_version, bool is_encrypted, bool is_compressed )
+{
+  m_cipherContext = cipher_context;
+  m_protocolVersion = proto_version;
+  m_isEncrypted = is_encrypted;
+  m_isCompressed = is_compressed;
+  m_warnInvalidFields = !Settings::instance().disableConnectionSocketEncryption();
+}
+
+QByteArray MessageDecoder::decodeData( const QByteArray& block_data, CipherContext* cipher_context, bool is_encrypted, bool is_compressed )
+{
+  QByteArray decrypted_byte_array;
+
+  if( is_encrypted )
+    decrypted_byte_array = cipher_context->decryptFrame( block_data );
+  else
+    decrypted_byte_array = block_data;
+
+  if( is_compressed )
+  {
+    QByteArray uncompressed_byte_array = qUncompress( decrypted_byte_array );
+    if( !uncompressed_byte_array.isEmpty() )
+      decrypted_byte_array = uncompressed_byte_array;
+  }
+
+  return decrypted_byte_array;
+}
+
+void MessageDecoder::decodeBlock( const QByteArray& block_data )
+{
+  QByteArray message_data = decodeData( block_data, &m_cipherContext, m_isEncrypted, m_isCompressed );
+  if( message_data.size() > 524288 )
+    qWarning() << "Incoming message is VERY VERY BIG:" << message_data.size() << "bytes";
+
+  Message m = Protocol::instance().toMessage( message_data, m_protocolVersion, m_warnInvalidFields );
+  if( m.isValid() )
+    emit messageDecoded( m );
+  else
+    emit invalidDataDecoded();
+}
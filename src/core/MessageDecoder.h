@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_MESSAGEDECODER_H
+#define BEEBEEP_MESSAGEDECODER_H
+
+#include "CipherContext.h"
+#include "Message.h"
+
+
+/*
+  Decodes the data blocks of a connection ready for use (decryption,
+  decompression and message parsing) in the network thread. Blocks are
+  queued to it in the order they are read from the socket, so the
+  messages are signaled back to the connection in the same order.
+  Settings are not thread safe: the values needed are copied in setup().
+*/
+
+class MessageDecoder : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit MessageDecoder( QObject* parent = Q_NULLPTR );
+
+  void setup( const CipherContext&, int proto_version, bool is_encrypted, bool is_compressed );
+
+  static QByteArray decodeData( const QByteArray& block_data, CipherContext*, bool is_encrypted, bool is_compressed );
+
+public slots:
+  void decodeBlock( const QByteArray& );
+
+signals:
+  void messageDecoded( const Message& );
+  void invalidDataDecoded();
+
+private:
+  CipherContext m_cipherContext;
+  int m_protocolVersion;
+  bool m_isEncrypted;
+  bool m_isCompressed;
+  bool m_warnInvalidFields;
+
+};
+
+#endif // BEEBEEP_MESSAGEDECODER_H
@@ -50,6 +50,27 @@ NetworkAddress& NetworkAddress::operator=( const NetworkAddress& na )
   return *this;
 }
 
+uint qHash( const NetworkAddress& na )
+{
+  if( na.isIPv4Address() )
+    return qHash( (static_cast<quint64>( na.hostAddress().toIPv4Address() ) << 16) | na.hostPort() );
+
+  if( na.isIPv6Address() )
+  {
+    Q_IPV6ADDR ipv6 = na.hostAddress().toIPv6Address();
+    quint64 ipv6_high = 0;
+    quint64 ipv6_low = 0;
+    for( int i = 0; i < 8; i++ )
+    {
+      ipv6_high = (ipv6_high << 8) | ipv6[ i ];
+      ipv6_low = (ipv6_low << 8) | ipv6[ i + 8 ];
+    }
+    return qHash( ipv6_high ^ (ipv6_low * Q_UINT64_C( 0x9E3779B97F4A7C15 )) ^ na.hostPort() );
+  }
+
+  return na.hostPort();
+}
+
 bool NetworkAddress::isLinkLocal() const
 {
   if( isIPv6Address() )
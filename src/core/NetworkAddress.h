@@ -64,6 +64,9 @@ private:
 
 };
 
+// Address and port are packed in the hash key
+uint qHash( const NetworkAddress& );
+
 // Inline Functions
 inline bool NetworkAddress::operator==( const NetworkAddress& na ) const { return m_hostAddress == na.m_hostAddress && m_hostPort == na.m_hostPort; }
 inline bool NetworkAddress::isHostAddressValid() const { return !m_hostAddress.isNull(); }
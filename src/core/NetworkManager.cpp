@@ -459,6 +459,28 @@ QList<QHostAddress> NetworkManager::splitInIPv4HostAddresses( const QHostAddress
   return ha_list;
 }
 
+bool NetworkManager::isBroadcastAddress( const QHostAddress& host_address ) const
+{
+  if( host_address.protocol() != QAbstractSocket::IPv4Protocol )
+    return false;
+
+  quint32 ipv4 = host_address.toIPv4Address();
+  if( ipv4 == 0xFFFFFFFFu || (ipv4 & 0xF0000000u) == 0xE0000000u ) // limited broadcast or multicast group
+    return true;
+
+  foreach( NetworkEntry ne, m_networkEntries )
+  {
+    if( !ne.isIPv4Address() || ne.netmask().isNull() )
+      continue;
+    quint32 netmask = ne.netmask().toIPv4Address();
+    if( (ipv4 & netmask) == (ne.hostAddress().toIPv4Address() & netmask) )
+      return netmask != 0xFFFFFFFFu && (ipv4 | netmask) == 0xFFFFFFFFu; // all the host bits are set
+  }
+
+  // The prefix of a remote subnet is unknown: it is a broadcast address if it is the last one of a /24 (or wider) subnet
+  return (ipv4 & 0xFFu) == 0xFFu;
+}
+
 bool NetworkManager::isHostAddressAllowed( const QHostAddress& ha ) const
 {
   if( !Settings::instance().allowOnlyHostAddressesFromHostsIni() )
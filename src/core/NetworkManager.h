@@ -49,6 +49,7 @@ public:
   bool isLocalHostAddress( const QHostAddress& ) const;
   QList<QHostAddress> localBroadcastAddresses() const;
   inline bool isInLocalBroadcastAddresses( const QHostAddress& ) const;
+  bool isBroadcastAddress( const QHostAddress& ) const;
 
   bool isHostAddressAllowed( const QHostAddress& ) const;
 
@@ -0,0 +1,400 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "NetworkScanner.h"
+#include "Settings.h"
+#include "TimerWheel.h"
+
+
+const int NETWORK_SCANNER_MAX_PROBES = 128;
+const int NETWORK_SCANNER_MIN_PREFIX_LENGTH = 16;
+const int PROBE_INITIAL_TIMEOUT = 1000; // ms
+const int PROBE_MIN_TIMEOUT = 200; // ms
+const int PROBE_MAX_TIMEOUT = 3000; // ms
+const int NETWORK_SCANNER_CACHE_MAX_SIZE = 4096;
+const int NETWORK_SCANNER_CACHE_EXPIRATION = 30; // days
+
+NetworkProbe::NetworkProbe( const NetworkAddress& na, QObject* parent )
+  : QTcpSocket( parent ), m_networkAddress( na ), m_elapsedTimer(), m_timerId( 0 ), m_isFinished( false )
+{
+  setProxy( QNetworkProxy::NoProxy );
+  connect( this, SIGNAL( connected() ), this, SLOT( onConnected() ) );
+  connect( this, SIGNAL( error( QAbstractSocket::SocketError ) ), this, SLOT( onError( QAbstractSocket::SocketError ) ) );
+}
+
+NetworkProbe::~NetworkProbe()
+{
+  TimerWheel::instance().cancel( m_timerId );
+}
+
+void NetworkProbe::start( int timeout_ms )
+{
+  m_elapsedTimer.start();
+  m_timerId = TimerWheel::instance().schedule( timeout_ms, this, "onTimeout" );
+  connectToHost( m_networkAddress.hostAddress(), m_networkAddress.hostPort() );
+}
+
+void NetworkProbe::stop()
+{
+  m_isFinished = true;
+  TimerWheel::instance().cancel( m_timerId );
+  m_timerId = 0;
+  abort();
+}
+
+void NetworkProbe::onConnected()
+{
+  finish( Connected );
+}
+
+void NetworkProbe::onError( QAbstractSocket::SocketError se )
+{
+  // The host is alive when it refuses the connection
+  finish( se == QAbstractSocket::ConnectionRefusedError ? Refused : Failed );
+}
+
+void NetworkProbe::onTimeout()
+{
+  m_timerId = 0;
+  finish( TimedOut );
+}
+
+void NetworkProbe::finish( Result probe_result )
+{
+  if( m_isFinished )
+    return;
+  m_isFinished = true;
+  TimerWheel::instance().cancel( m_timerId );
+  m_timerId = 0;
+  abort();
+  emit probeFinished( static_cast<int>( probe_result ) );
+}
+
+
+NetworkScanner::NetworkScanner( QObject* parent )
+  : QObject( parent ), m_ranges(), m_priorityAddresses(), m_probedAddresses(), m_probes(), m_responsiveHosts(),
+    m_srtt( 0 ), m_rttVar( 0 ), m_hasRttSample( false ), m_scanTimerId( 0 ), m_hostsProbed( 0 ), m_hostsFound( 0 )
+{
+  setObjectName( "NetworkScanner" );
+}
+
+NetworkScanner::~NetworkScanner()
+{
+  stop();
+}
+
+bool NetworkScanner::addSubnet( const QHostAddress& subnet_address, int prefix_length, quint16 port )
+{
+  if( subnet_address.protocol() != QAbstractSocket::IPv4Protocol || port == 0 )
+    return false;
+
+  if( prefix_length < NETWORK_SCANNER_MIN_PREFIX_LENGTH || prefix_length > 32 )
+  {
+    qWarning() << "NetworkScanner cannot scan the subnet" << qPrintable( subnet_address.toString() ) << "with prefix length" << prefix_length;
+    return false;
+  }
+
+  quint32 netmask = prefix_length == 32 ? 0xFFFFFFFFu : ~(0xFFFFFFFFu >> prefix_length);
+  quint32 subnet_first = subnet_address.toIPv4Address() & netmask;
+  quint32 subnet_last = subnet_first | ~netmask;
+  SubnetRange sr;
+  sr.port = port;
+  if( prefix_length < 31 )
+  {
+    // Network and broadcast addresses are skipped
+    sr.next = subnet_first + 1;
+    sr.last = subnet_last - 1;
+  }
+  else
+  {
+    sr.next = subnet_first;
+    sr.last = subnet_last;
+  }
+
+  foreach( SubnetRange sr_in_progress, m_ranges )
+  {
+    if( sr_in_progress.port == port && sr_in_progress.last == sr.last )
+      return true; // already in progress
+  }
+
+  int cached_hosts = 0;
+  for( QHash<NetworkAddress, QDateTime>::const_iterator it = m_responsiveHosts.constBegin(); it != m_responsiveHosts.constEnd(); ++it )
+  {
+    if( it.key().hostPort() != port || !it.key().isIPv4Address() )
+      continue;
+    quint32 ipv4 = it.key().hostAddress().toIPv4Address();
+    if( ipv4 >= sr.next && ipv4 <= sr.last && !m_probedAddresses.contains( it.key() ) && !m_priorityAddresses.contains( it.key() ) )
+    {
+      m_priorityAddresses.append( it.key() );
+      cached_hosts++;
+    }
+  }
+
+  m_ranges.append( sr );
+  qDebug() << "NetworkScanner scans" << (sr.last - sr.next + 1) << "hosts of subnet" << qPrintable( QString( "%1/%2" ).arg( QHostAddress( subnet_first ).toString() ).arg( prefix_length ) )
+           << "to port" << port << "starting from" << cached_hosts << "hosts found in previous scans";
+  scheduleScan( 0 );
+  return true;
+}
+
+bool NetworkScanner::addBroadcastAddress( const NetworkAddress& na )
+{
+  if( !na.isIPv4Address() )
+    return false;
+
+  quint32 ipv4 = na.hostAddress().toIPv4Address();
+  int prefix_length;
+  if( (ipv4 & 0xFFFFu) == 0xFFFFu )
+    prefix_length = 16;
+  else if( (ipv4 & 0xFFu) == 0xFFu )
+    prefix_length = 24;
+  else
+    return false;
+
+  quint16 port = na.isHostPortValid() ? na.hostPort() : static_cast<quint16>( Settings::instance().defaultListenerPort() );
+  return addSubnet( na.hostAddress(), prefix_length, port );
+}
+
+bool NetworkScanner::takeNextAddress( NetworkAddress* na )
+{
+  while( !m_priorityAddresses.isEmpty() )
+  {
+    *na = m_priorityAddresses.takeFirst();
+    if( !m_probedAddresses.contains( *na ) )
+    {
+      m_probedAddresses.insert( *na );
+      return true;
+    }
+  }
+
+  while( !m_ranges.isEmpty() )
+  {
+    SubnetRange& sr = m_ranges.first();
+    if( sr.next > sr.last )
+    {
+      m_ranges.removeFirst();
+      continue;
+    }
+
+    *na = NetworkAddress( QHostAddress( sr.next ), sr.port );
+    if( sr.next == sr.last )
+      m_ranges.removeFirst();
+    else
+      sr.next++;
+
+    if( !m_probedAddresses.contains( *na ) )
+    {
+      m_probedAddresses.insert( *na );
+      return true;
+    }
+  }
+
+  return false;
+}
+
+int NetworkScanner::probeTimeout() const
+{
+  if( !m_hasRttSample )
+    return PROBE_INITIAL_TIMEOUT;
+  return qBound( PROBE_MIN_TIMEOUT, m_srtt + 4 * m_rttVar, PROBE_MAX_TIMEOUT );
+}
+
+void NetworkScanner::addRttSample( int rtt_ms )
+{
+  // Smoothed round trip time and its variation as in TCP (RFC 6298)
+  if( !m_hasRttSample )
+  {
+    m_srtt = rtt_ms;
+    m_rttVar = rtt_ms / 2;
+    m_hasRttSample = true;
+  }
+  else
+  {
+    m_rttVar = (3 * m_rttVar + qAbs( m_srtt - rtt_ms )) / 4;
+    m_srtt = (7 * m_srtt + rtt_ms) / 8;
+  }
+}
+
+void NetworkScanner::scheduleScan( int msecs )
+{
+  if( m_scanTimerId > 0 )
+    return;
+  m_scanTimerId = TimerWheel::instance().schedule( msecs, this, "scan" );
+}
+
+void NetworkScanner::scan()
+{
+  m_scanTimerId = 0;
+
+  // Pacing: about NETWORK_SCANNER_MAX_PROBES new probes for each round trip time
+  int rtt = m_hasRttSample ? m_srtt : PROBE_INITIAL_TIMEOUT;
+  int probes_to_start = qMax( 1, NETWORK_SCANNER_MAX_PROBES * TIMER_WHEEL_RESOLUTION / qMax( rtt, TIMER_WHEEL_RESOLUTION ) );
+  probes_to_start = qMin( probes_to_start, NETWORK_SCANNER_MAX_PROBES - m_probes.size() );
+  int timeout = probeTimeout();
+  NetworkAddress na;
+
+  while( probes_to_start > 0 && takeNextAddress( &na ) )
+  {
+    NetworkProbe* probe = new NetworkProbe( na, this );
+    connect( probe, SIGNAL( probeFinished( int ) ), this, SLOT( onProbeFinished( int ) ) );
+    m_probes.append( probe );
+    // Hosts found in the previous scans can be slower than the network average
+    probe->start( m_responsiveHosts.contains( na ) ? PROBE_MAX_TIMEOUT : timeout );
+    m_hostsProbed++;
+    probes_to_start--;
+  }
+
+  if( hasAddressesToProbe() )
+  {
+    if( m_probes.size() < NETWORK_SCANNER_MAX_PROBES )
+      scheduleScan( TIMER_WHEEL_RESOLUTION );
+    // else a new scan is scheduled when a probe finishes
+  }
+  else if( m_probes.isEmpty() )
+    finishScan();
+}
+
+void NetworkScanner::onProbeFinished( int probe_result )
+{
+  NetworkProbe* probe = qobject_cast<NetworkProbe*>( sender() );
+  if( !probe )
+    return;
+
+  m_probes.removeOne( probe );
+  NetworkAddress na = probe->networkAddress();
+  if( probe_result == NetworkProbe::Connected || probe_result == NetworkProbe::Refused )
+    addRttSample( static_cast<int>( probe->elapsed() ) );
+  probe->disconnect( this );
+  probe->deleteLater();
+
+  if( probe_result == NetworkProbe::Connected )
+  {
+#ifdef BEEBEEP_DEBUG
+    qDebug() << "NetworkScanner has found" << qPrintable( na.toString() ) << "- rtt" << m_srtt << "ms";
+#endif
+    m_responsiveHosts.insert( na, QDateTime::currentDateTime() );
+    m_hostsFound++;
+    emit hostFound( na );
+  }
+  else
+    m_responsiveHosts.remove( na );
+
+  if( hasAddressesToProbe() )
+    scheduleScan( 0 );
+  else if( m_probes.isEmpty() )
+    finishScan();
+}
+
+void NetworkScanner::finishScan()
+{
+  qDebug() << "NetworkScanner has probed" << m_hostsProbed << "hosts and has found" << m_hostsFound << "of them - rtt" << m_srtt << "ms and probe timeout" << probeTimeout() << "ms";
+  m_probedAddresses.clear();
+  emit finished();
+}
+
+void NetworkScanner::stop()
+{
+  TimerWheel::instance().cancel( m_scanTimerId );
+  m_scanTimerId = 0;
+  foreach( NetworkProbe* probe, m_probes )
+  {
+    probe->stop();
+    probe->deleteLater();
+  }
+  m_probes.clear();
+  m_ranges.clear();
+  m_priorityAddresses.clear();
+  m_probedAddresses.clear();
+}
+
+int NetworkScanner::loadCache( const QString& file_path )
+{
+  QFile file( file_path );
+  if( !file.exists() )
+    return 0;
+
+  if( !file.open( QIODevice::ReadOnly | QIODevice::Text ) )
+  {
+    qWarning() << "NetworkScanner cannot open the cache file" << qPrintable( file_path );
+    return 0;
+  }
+
+  QDateTime dt_expiration = QDateTime::currentDateTime().addDays( -NETWORK_SCANNER_CACHE_EXPIRATION );
+  QTextStream text_stream( &file );
+  int hosts_loaded = 0;
+  while( !text_stream.atEnd() )
+  {
+    QStringList sl = text_stream.readLine().split( QLatin1Char( '\t' ) );
+    if( sl.size() != 2 )
+      continue;
+    NetworkAddress na = NetworkAddress::fromString( sl.at( 0 ) );
+    QDateTime dt_found = QDateTime::fromString( sl.at( 1 ), Qt::ISODate );
+    if( !na.isHostAddressValid() || !na.isHostPortValid() || !dt_found.isValid() || dt_found < dt_expiration )
+      continue;
+    m_responsiveHosts.insert( na, dt_found );
+    hosts_loaded++;
+  }
+  file.close();
+  qDebug() << "NetworkScanner has loaded" << hosts_loaded << "hosts found in previous scans";
+  return hosts_loaded;
+}
+
+static bool networkScannerCacheLessThan( const QPair<NetworkAddress, QDateTime>& h1, const QPair<NetworkAddress, QDateTime>& h2 )
+{
+  return h1.second > h2.second;
+}
+
+bool NetworkScanner::saveCache( const QString& file_path ) const
+{
+  QList< QPair<NetworkAddress, QDateTime> > host_list;
+  for( QHash<NetworkAddress, QDateTime>::const_iterator it = m_responsiveHosts.constBegin(); it != m_responsiveHosts.constEnd(); ++it )
+    host_list.append( qMakePair( it.key(), it.value() ) );
+  qSort( host_list.begin(), host_list.end(), networkScannerCacheLessThan );
+
+  QFile file( file_path );
+  if( host_list.isEmpty() )
+  {
+    if( file.exists() )
+      file.remove();
+    return true;
+  }
+
+  if( !file.open( QIODevice::WriteOnly | QIODevice::Truncate | QIODevice::Text ) )
+  {
+    qWarning() << "NetworkScanner cannot save the cache file" << qPrintable( file_path );
+    return false;
+  }
+
+  QTextStream text_stream( &file );
+  int hosts_saved = 0;
+  for( QList< QPair<NetworkAddress, QDateTime> >::const_iterator it = host_list.constBegin(); it != host_list.constEnd() && hosts_saved < NETWORK_SCANNER_CACHE_MAX_SIZE; ++it )
+  {
+    text_stream << it->first.toString() << QLatin1Char( '\t' ) << it->second.toString( Qt::ISODate ) << QLatin1Char( '\n' );
+    hosts_saved++;
+  }
+  file.close();
+#ifdef BEEBEEP_DEBUG
+  qDebug() << "NetworkScanner has saved" << hosts_saved << "hosts in" << qPrintable( file_path );
+#endif
+  return true;
+}
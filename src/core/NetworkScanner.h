@@ -0,0 +1,146 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_NETWORKSCANNER_H
+#define BEEBEEP_NETWORKSCANNER_H
+
+#include "NetworkAddress.h"
+
+
+class NetworkProbe : public QTcpSocket
+{
+  Q_OBJECT
+
+public:
+  enum Result { Connected, Refused, TimedOut, Failed };
+
+  NetworkProbe( const NetworkAddress&, QObject* parent );
+  ~NetworkProbe();
+
+  void start( int timeout_ms );
+  void stop();
+
+  inline const NetworkAddress& networkAddress() const;
+  inline qint64 elapsed() const; // ms since start
+
+signals:
+  void probeFinished( int result );
+
+protected slots:
+  void onConnected();
+  void onError( QAbstractSocket::SocketError );
+  void onTimeout();
+
+protected:
+  void finish( Result );
+
+private:
+  NetworkAddress m_networkAddress;
+  QElapsedTimer m_elapsedTimer;
+  int m_timerId;
+  bool m_isFinished;
+
+};
+
+
+/*
+  Probes the hosts of IPv4 subnets with asynchronous TCP connections to
+  the listener port, so only the responsive ones reach the core. The
+  probes in progress are bounded and their timeout follows the measured
+  round trip time, which also paces the start of the new probes.
+  Responsive hosts are cached and probed first in the next scans.
+*/
+
+class NetworkScanner : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit NetworkScanner( QObject* parent = Q_NULLPTR );
+  ~NetworkScanner();
+
+  bool addSubnet( const QHostAddress& subnet_address, int prefix_length, quint16 port );
+  bool addBroadcastAddress( const NetworkAddress& ); // 192.168.1.255 is a /24, 10.1.255.255 is a /16
+  void stop();
+
+  inline bool isScanning() const;
+  inline int probesInProgress() const;
+  inline int hostsProbed() const;
+  inline int hostsFound() const;
+  inline int smoothedRtt() const; // ms
+
+  int loadCache( const QString& file_path );
+  bool saveCache( const QString& file_path ) const;
+  inline int cacheSize() const;
+
+signals:
+  void hostFound( const NetworkAddress& );
+  void finished();
+
+protected slots:
+  void scan();
+  void onProbeFinished( int );
+
+protected:
+  struct SubnetRange
+  {
+    quint32 next;
+    quint32 last;
+    quint16 port;
+  };
+
+  bool takeNextAddress( NetworkAddress* );
+  inline bool hasAddressesToProbe() const;
+  int probeTimeout() const;
+  void addRttSample( int rtt_ms );
+  void scheduleScan( int msecs );
+  void finishScan();
+
+private:
+  QList<SubnetRange> m_ranges;
+  QList<NetworkAddress> m_priorityAddresses; // responsive in the previous scans
+  QSet<NetworkAddress> m_probedAddresses;
+  QList<NetworkProbe*> m_probes;
+  QHash<NetworkAddress, QDateTime> m_responsiveHosts;
+  int m_srtt;
+  int m_rttVar;
+  bool m_hasRttSample;
+  int m_scanTimerId;
+  int m_hostsProbed;
+  int m_hostsFound;
+
+};
+
+
+// Inline Functions
+inline const NetworkAddress& NetworkProbe::networkAddress() const { return m_networkAddress; }
+inline qint64 NetworkProbe::elapsed() const { return m_elapsedTimer.elapsed(); }
+inline bool NetworkScanner::hasAddressesToProbe() const { return !m_priorityAddresses.isEmpty() || !m_ranges.isEmpty(); }
+inline bool NetworkScanner::isScanning() const { return hasAddressesToProbe() || !m_probes.isEmpty(); }
+inline int NetworkScanner::probesInProgress() const { return m_probes.size(); }
+inline int NetworkScanner::hostsProbed() const { return m_hostsProbed; }
+inline int NetworkScanner::hostsFound() const { return m_hostsFound; }
+inline int NetworkScanner::smoothedRtt() const { return m_srtt; }
+inline int NetworkScanner::cacheSize() const { return m_responsiveHosts.size(); }
+
+#endif // BEEBEEP_NETWORKSCANNER_H
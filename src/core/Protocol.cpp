@@ -37,9 +37,15 @@
 Protocol* Protocol::mp_instance = Q_NULLPTR;
 const QChar PROTOCOL_FIELD_SEPARATOR = QChar::ParagraphSeparator;  // 0x2029
 const QChar DATA_FIELD_SEPARATOR = QChar::LineSeparator; // 0x2028
+// Binary message: [ magic ][ codec version ][ type ] then fields as [ tag (8bit) ][ length (32bit) ][ value ] until end tag
+const uchar BINARY_MESSAGE_MAGIC = 0xBE; // text messages start with 'B' of their header
+const uchar BINARY_MESSAGE_CODEC_VERSION = 1;
+const int BINARY_MESSAGE_HEADER_SIZE = 3;
+const int BINARY_MESSAGE_FIELD_HEADER_SIZE = 5;
+enum BinaryMessageField { BinaryFieldEnd, BinaryFieldId, BinaryFieldFlags, BinaryFieldTimestamp, BinaryFieldData, BinaryFieldText };
 
 Protocol::Protocol()
-  : m_id( ID_START ), m_fileShareListMessage( Message::Share, ID_SHARE_MESSAGE, "" )
+  : m_id( ID_START ), m_fileShareListMessage( Message::Share, ID_SHARE_MESSAGE, "" ), m_textMessageTypes()
 {
   m_id += static_cast<VNumber>(Random::d100());
 #if QT_VERSION == 0x050603 && defined Q_OS_MAC
@@ -50,6 +56,22 @@ Protocol::Protocol()
   m_datastreamMaxVersion = ds.version();
 #endif
   qDebug() << "Protocol has detected latest datastream version:" << m_datastreamMaxVersion;
+
+  for( int i = Message::Beep; i < Message::NumTypes; i++ )
+  {
+    QString msg_header = messageHeader( static_cast<Message::Type>( i ) );
+    m_textMessageTypes.insert( textMessageHeaderKey( msg_header.constData(), msg_header.size() ), static_cast<Message::Type>( i ) );
+  }
+}
+
+quint64 Protocol::textMessageHeaderKey( const QChar* msg_header, int msg_header_size ) const
+{
+  // All the headers are "BEE-XXXX": the last four characters are enough
+  if( msg_header_size != 8 || msg_header[ 0 ] != QLatin1Char( 'B' ) || msg_header[ 1 ] != QLatin1Char( 'E' )
+      || msg_header[ 2 ] != QLatin1Char( 'E' ) || msg_header[ 3 ] != QLatin1Char( '-' ) )
+    return 0;
+  return (static_cast<quint64>( msg_header[ 4 ].unicode() ) << 48) | (static_cast<quint64>( msg_header[ 5 ].unicode() ) << 32)
+       | (static_cast<quint64>( msg_header[ 6 ].unicode() ) << 16) | static_cast<quint64>( msg_header[ 7 ].unicode() );
 }
 
 QString Protocol::messageHeader( Message::Type mt ) const
@@ -127,6 +149,13 @@ QByteArray Protocol::fromMessage( const Message& m, int proto_version ) const
 {
   if( !m.isValid() )
     return "";
+  if( proto_version >= BINARY_MESSAGE_PROTO_VERSION )
+    return binaryFromMessage( m );
+  return textFromMessage( m, proto_version );
+}
+
+QByteArray Protocol::textFromMessage( const Message& m, int proto_version ) const
+{
   QStringList sl;
   sl << messageHeader( m.type() );
   sl << QString::number( m.id() );
@@ -146,12 +175,25 @@ QByteArray Protocol::fromMessage( const Message& m, int proto_version ) const
 
 Message Protocol::toMessage( const QByteArray& byte_array_data, int proto_version ) const
 {
+  return toMessage( byte_array_data, proto_version, !Settings::instance().disableConnectionSocketEncryption() );
+}
+
+Message Protocol::toMessage( const QByteArray& byte_array_data, int proto_version, bool warn_invalid_fields ) const
+{
+  // Binary messages are recognized by their first byte: HELLO and broadcast are always text messages
+  if( isBinaryMessage( byte_array_data ) )
+    return binaryToMessage( byte_array_data );
+
   QString message_data = QString::fromUtf8( byte_array_data );
   Message m;
+  if( parseTextMessage( message_data, proto_version, &m ) )
+    return m;
+
+  // Slow path: it accepts all the formats of the previous versions and reports the errors
   QStringList sl = message_data.split( PROTOCOL_FIELD_SEPARATOR, QString::KeepEmptyParts );
   if( sl.size() < 7 )
   {
-    if( !Settings::instance().disableConnectionSocketEncryption() )
+    if( warn_invalid_fields )
       qWarning() << "Invalid number of fields in message:" << message_data.simplified();
     return m;
   }
@@ -227,6 +269,219 @@ Message Protocol::toMessage( const QByteArray& byte_array_data, int proto_versio
   return m;
 }
 
+static bool parseTextNumber( const QChar* number_chars, int number_size, int max_digits, quint64* number_value )
+{
+  if( number_size <= 0 || number_size > max_digits )
+    return false;
+  quint64 value = 0;
+  for( int i = 0; i < number_size; i++ )
+  {
+    ushort c = number_chars[ i ].unicode();
+    if( c < '0' || c > '9' )
+      return false;
+    value = value * 10 + (c - '0');
+  }
+  *number_value = value;
+  return true;
+}
+
+static bool parseTextTimestamp( const QChar* ts_chars, int ts_size, QDateTime* ts_value )
+{
+  // Fixed ISO format: yyyy-MM-ddThh:mm:ss with the optional Z of UTC
+  if( ts_size != 19 && !(ts_size == 20 && ts_chars[ 19 ] == QLatin1Char( 'Z' )) )
+    return false;
+  if( ts_chars[ 4 ] != QLatin1Char( '-' ) || ts_chars[ 7 ] != QLatin1Char( '-' ) || ts_chars[ 10 ] != QLatin1Char( 'T' )
+      || ts_chars[ 13 ] != QLatin1Char( ':' ) || ts_chars[ 16 ] != QLatin1Char( ':' ) )
+    return false;
+
+  quint64 year, month, day, hour, minute, second;
+  if( !parseTextNumber( ts_chars, 4, 4, &year ) || !parseTextNumber( ts_chars + 5, 2, 2, &month ) || !parseTextNumber( ts_chars + 8, 2, 2, &day )
+      || !parseTextNumber( ts_chars + 11, 2, 2, &hour ) || !parseTextNumber( ts_chars + 14, 2, 2, &minute ) || !parseTextNumber( ts_chars + 17, 2, 2, &second ) )
+    return false;
+
+  QDate ts_date( static_cast<int>( year ), static_cast<int>( month ), static_cast<int>( day ) );
+  QTime ts_time( static_cast<int>( hour ), static_cast<int>( minute ), static_cast<int>( second ) );
+  if( !ts_date.isValid() || !ts_time.isValid() )
+    return false;
+
+  *ts_value = QDateTime( ts_date, ts_time, ts_size == 20 ? Qt::UTC : Qt::LocalTime );
+  return true;
+}
+
+bool Protocol::parseTextMessage( const QString& message_data, int proto_version, Message* m ) const
+{
+  // Fast path: fields are read in place. Every unusual format is left to the slow path
+  const QChar* msg_chars = message_data.constData();
+  int field_start[ 6 ];
+  int field_size[ 6 ];
+  int pos = 0;
+  for( int i = 0; i < 6; i++ )
+  {
+    int separator_pos = message_data.indexOf( PROTOCOL_FIELD_SEPARATOR, pos );
+    if( separator_pos < 0 )
+      return false;
+    field_start[ i ] = pos;
+    field_size[ i ] = separator_pos - pos;
+    pos = separator_pos + 1;
+  }
+
+  Message::Type msg_type = m_textMessageTypes.value( textMessageHeaderKey( msg_chars + field_start[ 0 ], field_size[ 0 ] ), Message::Undefined );
+  if( msg_type == Message::Undefined )
+    return false;
+
+  quint64 msg_id, msg_size, msg_flags;
+  if( !parseTextNumber( msg_chars + field_start[ 1 ], field_size[ 1 ], 19, &msg_id ) || msg_id == ID_INVALID )
+    return false;
+  if( !parseTextNumber( msg_chars + field_start[ 2 ], field_size[ 2 ], 9, &msg_size ) )
+    return false;
+  if( !parseTextNumber( msg_chars + field_start[ 3 ], field_size[ 3 ], 9, &msg_flags ) )
+    return false;
+
+  QDateTime dt_timestamp;
+  if( !parseTextTimestamp( msg_chars + field_start[ 5 ], field_size[ 5 ], &dt_timestamp ) )
+    return false;
+  if( proto_version >= UTC_TIMESTAMP_PROTO_VERSION )
+    dt_timestamp.setTimeSpec( Qt::UTC );
+
+  m->setType( msg_type );
+  m->setId( static_cast<VNumber>( msg_id ) );
+  m->setFlags( static_cast<int>( msg_flags ) );
+  m->setData( message_data.mid( field_start[ 4 ], field_size[ 4 ] ) );
+  m->setTimestamp( dt_timestamp.toLocalTime() );
+  int msg_txt_size = qMin( static_cast<int>( msg_size ), message_data.size() - pos ); // to prevent spaces added for encryption
+  m->setText( message_data.mid( pos, msg_txt_size ) );
+  return true;
+}
+
+static void appendBinaryField( QByteArray* byte_array, int field_tag, const char* field_value, int field_size )
+{
+  uchar field_header[ BINARY_MESSAGE_FIELD_HEADER_SIZE ];
+  field_header[ 0 ] = static_cast<uchar>( field_tag );
+  qToBigEndian<quint32>( static_cast<quint32>( field_size ), field_header + 1 );
+  byte_array->append( reinterpret_cast<const char*>( field_header ), BINARY_MESSAGE_FIELD_HEADER_SIZE );
+  if( field_size > 0 )
+    byte_array->append( field_value, field_size );
+}
+
+bool Protocol::isBinaryMessage( const QByteArray& byte_array_data ) const
+{
+  return byte_array_data.size() >= BINARY_MESSAGE_HEADER_SIZE && static_cast<uchar>( byte_array_data.at( 0 ) ) == BINARY_MESSAGE_MAGIC;
+}
+
+QByteArray Protocol::binaryFromMessage( const Message& m ) const
+{
+  QByteArray data_utf8 = m.data().toUtf8();
+  QByteArray text_utf8 = m.text().toUtf8();
+  int message_size = BINARY_MESSAGE_HEADER_SIZE + (BINARY_MESSAGE_FIELD_HEADER_SIZE * 6) + 8 + 4 + 8 + data_utf8.size() + text_utf8.size();
+
+  QByteArray byte_array;
+  byte_array.reserve( message_size + ENCRYPTED_DATA_BLOCK_SIZE );
+  byte_array.append( static_cast<char>( BINARY_MESSAGE_MAGIC ) );
+  byte_array.append( static_cast<char>( BINARY_MESSAGE_CODEC_VERSION ) );
+  byte_array.append( static_cast<char>( m.type() ) );
+
+  uchar value_buffer[ 8 ];
+  qToBigEndian<quint64>( static_cast<quint64>( m.id() ), value_buffer );
+  appendBinaryField( &byte_array, BinaryFieldId, reinterpret_cast<const char*>( value_buffer ), 8 );
+  qToBigEndian<quint32>( static_cast<quint32>( m.flags() ), value_buffer );
+  appendBinaryField( &byte_array, BinaryFieldFlags, reinterpret_cast<const char*>( value_buffer ), 4 );
+  qToBigEndian<qint64>( m.timestamp().toMSecsSinceEpoch(), value_buffer );
+  appendBinaryField( &byte_array, BinaryFieldTimestamp, reinterpret_cast<const char*>( value_buffer ), 8 );
+  if( !data_utf8.isEmpty() )
+    appendBinaryField( &byte_array, BinaryFieldData, data_utf8.constData(), data_utf8.size() );
+  if( !text_utf8.isEmpty() )
+    appendBinaryField( &byte_array, BinaryFieldText, text_utf8.constData(), text_utf8.size() );
+  appendBinaryField( &byte_array, BinaryFieldEnd, Q_NULLPTR, 0 );
+
+  // Padding is ignored after the end field
+  while( byte_array.size() % ENCRYPTED_DATA_BLOCK_SIZE )
+    byte_array.append( '\0' );
+  return byte_array;
+}
+
+Message Protocol::binaryToMessage( const QByteArray& byte_array_data ) const
+{
+  Message m;
+  const uchar* message_data = reinterpret_cast<const uchar*>( byte_array_data.constData() );
+  int message_size = byte_array_data.size();
+
+  if( message_data[ 1 ] != BINARY_MESSAGE_CODEC_VERSION )
+  {
+    qWarning() << "Invalid binary message codec version:" << static_cast<int>( message_data[ 1 ] );
+    return m;
+  }
+
+  int msg_type = static_cast<int>( message_data[ 2 ] );
+  if( msg_type <= Message::Undefined || msg_type >= Message::NumTypes )
+  {
+    qWarning() << "Invalid binary message type:" << msg_type;
+    return m;
+  }
+
+  VNumber msg_id = ID_INVALID;
+  qint64 msg_timestamp = -1;
+  bool end_found = false;
+  int pos = BINARY_MESSAGE_HEADER_SIZE;
+
+  while( pos + BINARY_MESSAGE_FIELD_HEADER_SIZE <= message_size )
+  {
+    int field_tag = static_cast<int>( message_data[ pos ] );
+    quint32 field_size = qFromBigEndian<quint32>( message_data + pos + 1 );
+    pos += BINARY_MESSAGE_FIELD_HEADER_SIZE;
+    if( field_size > static_cast<quint32>( message_size - pos ) )
+    {
+      qWarning() << "Invalid binary message field" << field_tag << "with size" << field_size;
+      return Message();
+    }
+
+    const uchar* field_value = message_data + pos;
+    int field_value_size = static_cast<int>( field_size );
+    pos += field_value_size;
+
+    switch( field_tag )
+    {
+    case BinaryFieldEnd:
+      end_found = true;
+      break;
+    case BinaryFieldId:
+      if( field_value_size == 8 )
+        msg_id = static_cast<VNumber>( qFromBigEndian<quint64>( field_value ) );
+      break;
+    case BinaryFieldFlags:
+      if( field_value_size == 4 )
+        m.setFlags( static_cast<int>( qFromBigEndian<quint32>( field_value ) ) );
+      break;
+    case BinaryFieldTimestamp:
+      if( field_value_size == 8 )
+        msg_timestamp = qFromBigEndian<qint64>( field_value );
+      break;
+    case BinaryFieldData:
+      m.setData( QString::fromUtf8( reinterpret_cast<const char*>( field_value ), field_value_size ) );
+      break;
+    case BinaryFieldText:
+      m.setText( QString::fromUtf8( reinterpret_cast<const char*>( field_value ), field_value_size ) );
+      break;
+    default:
+      // Unknown fields of newer codecs are skipped
+      break;
+    }
+
+    if( end_found )
+      break;
+  }
+
+  if( !end_found || msg_id == ID_INVALID || msg_timestamp < 0 )
+  {
+    qWarning() << "Invalid binary message (end:" << end_found << "- id:" << msg_id << "- timestamp:" << msg_timestamp << ")";
+    return Message();
+  }
+
+  m.setId( msg_id );
+  m.setTimestamp( QDateTime::fromMSecsSinceEpoch( msg_timestamp ) );
+  m.setType( static_cast<Message::Type>( msg_type ) );
+  return m;
+}
+
 QByteArray Protocol::testQuestionMessage( const NetworkAddress& na ) const
 {
   Message m( Message::Test, ID_TEST_MESSAGE, "?" );
@@ -321,6 +576,32 @@ QString Protocol::publicKey( const Message& m ) const
   return data_list.size() >= 6 ? data_list.at( 5 ) : QString();
 }
 
+quint16 Protocol::listenerPort( const Message& m ) const
+{
+  QStringList data_list = m.text().split( DATA_FIELD_SEPARATOR );
+  bool ok = false;
+  int listener_port = data_list.isEmpty() ? 0 : data_list.first().toInt( &ok );
+  return ok && listener_port > 0 && listener_port <= 65535 ? static_cast<quint16>( listener_port ) : 0;
+}
+
+bool Protocol::sessionResumption( const Message& m, QString* session_id, QString* session_nonce ) const
+{
+  QStringList data_list = m.text().split( DATA_FIELD_SEPARATOR );
+  if( data_list.size() < 16 )
+    return false;
+  QStringList sl = data_list.at( 15 ).split( ":" );
+  if( sl.size() != 2 || sl.first().isEmpty() || sl.last().isEmpty() )
+    return false;
+  *session_id = sl.first();
+  *session_nonce = sl.last();
+  return true;
+}
+
+QString Protocol::sessionResumption( const QString& session_id, const QString& session_nonce ) const
+{
+  return session_id.isEmpty() ? QString( "" ) : QString( "%1:%2" ).arg( session_id, session_nonce );
+}
+
 int Protocol::datastreamVersion( const Message& m ) const
 {
   QStringList data_list = m.text().split( DATA_FIELD_SEPARATOR );
@@ -337,7 +618,7 @@ int Protocol::datastreamVersion( const Message& m ) const
   return datastream_version;
 }
 
-QByteArray Protocol::helloMessage( const QString& public_key, bool encrypted_connection, bool data_compressed ) const
+QByteArray Protocol::helloMessage( const QString& public_key, bool encrypted_connection, bool data_compressed, const QString& session_resumption ) const
 {
   QStringList data_list;
   data_list << QString::number( Settings::instance().localUser().networkAddress().hostPort() );
@@ -361,6 +642,8 @@ QByteArray Protocol::helloMessage( const QString& public_key, bool encrypted_con
     data_list << QString( "" );
   data_list << Settings::instance().localUser().domainName();
   data_list << Settings::instance().localUser().localHostName();
+  if( !session_resumption.isEmpty() )
+    data_list << session_resumption;
   Message m( Message::Hello, static_cast<VNumber>(Settings::instance().protocolVersion()), data_list.join( DATA_FIELD_SEPARATOR ) );
   if( !encrypted_connection )
     m.addFlag( Message::EncryptionDisabled );
@@ -921,7 +1204,8 @@ QString Protocol::saveMessageRecord( const MessageRecord& mr ) const
   sl_chat << c.name();
   sl_chat << c.privateId();
   sl_root.append( Settings::instance().simpleEncrypt( sl_chat.join( DATA_FIELD_SEPARATOR ) ) );
-  QByteArray ba = fromMessage( mr.message(), Settings::instance().protocolVersion() );
+  // File beebeep.off keeps the text format: loadMessageRecord also accepts the binary one
+  QByteArray ba = mr.message().isValid() ? textFromMessage( mr.message(), Settings::instance().protocolVersion() ) : QByteArray();
   sl_root.append( QString::fromLatin1( ba.toBase64() ) );
   return sl_root.join( PROTOCOL_FIELD_SEPARATOR );
 }
@@ -1399,6 +1683,13 @@ Message Protocol::fileInfoToMessage( const FileInfo& fi, int proto_version )
   sl << QString::number( fi.contentType() );
   sl << QString::number( fi.startingPosition() );
   sl << QString::number( fi.duration() );
+  if( proto_version >= FILE_TRANSFER_SEGMENTS_PROTO_VERSION )
+    sl << QString::number( fi.endingPosition() );
+  if( proto_version >= FILE_TRANSFER_CHUNK_HASHES_PROTO_VERSION )
+  {
+    sl << fi.contentHash();
+    sl << QString::fromLatin1( fi.chunkHashes().toHex() );
+  }
   m.setData( sl.join( DATA_FIELD_SEPARATOR ) );
   m.addFlag( Message::Private );
   if( fi.contentType() == FileInfo::VoiceMessage )
@@ -1480,6 +1771,21 @@ FileInfo Protocol::fileInfoFromMessage( const Message& m, int proto_version )
       fi.setDuration( file_duration );
   }
 
+  if( !sl.isEmpty() && proto_version >= FILE_TRANSFER_SEGMENTS_PROTO_VERSION )
+  {
+    FileSizeType file_position = Bee::qVariantToFileSizeType( sl.takeFirst(), &ok );
+    if( ok && file_position > fi.startingPosition() && file_position <= fi.size() )
+      fi.setEndingPosition( file_position );
+    else
+      fi.setEndingPosition( 0 );
+  }
+
+  if( sl.size() >= 2 && proto_version >= FILE_TRANSFER_CHUNK_HASHES_PROTO_VERSION )
+  {
+    fi.setContentHash( sl.takeFirst() );
+    fi.setChunkHashes( QByteArray::fromHex( sl.takeFirst().toLatin1() ) );
+  }
+
   return fi;
 }
 
@@ -2250,6 +2556,34 @@ QList<UserRecord> Protocol::hiveMessageToUserRecordList( const Message& m ) cons
   return user_record_list;
 }
 
+Message Protocol::hiveDigestMessage( const QList<quint32>& digest_list )
+{
+  QStringList sl;
+  foreach( quint32 bucket_hash, digest_list )
+    sl.append( QString::number( bucket_hash, 16 ) );
+
+  Message m( Message::Hive, newId(), sl.join( DATA_FIELD_SEPARATOR ) );
+  m.addFlag( Message::Request );
+  return m;
+}
+
+QList<quint32> Protocol::digestFromHiveMessage( const Message& m ) const
+{
+  QList<quint32> digest_list;
+  if( m.type() != Message::Hive || !m.hasFlag( Message::Request ) )
+    return digest_list;
+
+  bool ok = false;
+  foreach( QString s, m.text().split( DATA_FIELD_SEPARATOR ) )
+  {
+    quint32 bucket_hash = s.toUInt( &ok, 16 );
+    if( !ok )
+      return QList<quint32>();
+    digest_list.append( bucket_hash );
+  }
+  return digest_list;
+}
+
 QString Protocol::saveChatRecord( const ChatRecord& cr ) const
 {
   QStringList sl;
@@ -2444,36 +2778,6 @@ QByteArray Protocol::createCipherKey( const QString& key_1, const QString& key_2
   return createCipherKey( sum_keys.toUtf8(), data_stream_version );
 }
 
-QList<QByteArray> Protocol::splitByteArray( const QByteArray& byte_array, int num_chars ) const
-{
-  QList<QByteArray> array_list;
-
-  if( byte_array.isEmpty() )
-    return array_list;
-
-  QByteArray tmp = "";
-
-  for( int i = 0; i < byte_array.size(); i++ )
-  {
-    tmp += byte_array.at( i );
-    if( tmp.size() == num_chars )
-    {
-      array_list.append( tmp );
-      tmp = "";
-    }
-  }
-
-  if( !tmp.isEmpty() )
-  {
-#ifdef BEEBEEP_DEBUG
-    qDebug() << "Protocol splits byte array in" << array_list.size() << "parts but some chars remains out:" << tmp;
-#endif
-    array_list.append( tmp );
-  }
-
-  return array_list;
-}
-
 void Protocol::hexToUnsignedChar( const QByteArray& hex_byte_array, unsigned char* out_string, unsigned int len_out_string ) const
 {
   // Thanks to Christophe David
@@ -2523,19 +2827,15 @@ void Protocol::hexToUnsignedChar( const QByteArray& hex_byte_array, unsigned cha
   }
 }
 
-QByteArray Protocol::encryptByteArray( const QByteArray& text_to_encrypt, const QByteArray& cipher_key, int proto_version ) const
+void Protocol::setupCipherContext( CipherContext* cipher_context, const QByteArray& cipher_key, int proto_version ) const
 {
-  unsigned long rk[ RKLENGTH(ENCRYPTION_KEYBITS) ];
-  unsigned char key[ KEYLENGTH(ENCRYPTION_KEYBITS) ];
-  unsigned int i;
-  int nrounds;
-
-  if( text_to_encrypt.isEmpty() )
-    return QByteArray();
-
   if( cipher_key.isEmpty() )
-    return text_to_encrypt.toBase64();
+  {
+    cipher_context->setup( cipher_key, proto_version, Q_NULLPTR );
+    return;
+  }
 
+  unsigned char key[ KEYLENGTH(ENCRYPTION_KEYBITS) ];
   if( proto_version < SECURE_LEVEL_3_PROTO_VERSION )
   {
     // What the hell...
@@ -2547,95 +2847,26 @@ QByteArray Protocol::encryptByteArray( const QByteArray& text_to_encrypt, const
     hexToUnsignedChar( cipher_key, key, KEYLENGTH(ENCRYPTION_KEYBITS) );
   }
 
-  nrounds = rijndaelSetupEncrypt( rk, key, ENCRYPTION_KEYBITS );
-
-  QList<QByteArray> byte_array_list = splitByteArray( text_to_encrypt, ENCRYPTED_DATA_BLOCK_SIZE );
-
-  unsigned char plaintext[ ENCRYPTED_DATA_BLOCK_SIZE ];
-  unsigned char ciphertext[ ENCRYPTED_DATA_BLOCK_SIZE ];
-
-  memset( ciphertext, 0, sizeof( ciphertext ) );
-  memset( plaintext, 0, sizeof( plaintext ) );
-
-  QByteArray encrypted_byte_array;
-
-  foreach( QByteArray ba, byte_array_list )
-  {
-    if( ba.size() == sizeof( plaintext ) )
-    {
-      for( i = 0; i < sizeof( plaintext ); i++ )
-        plaintext[ i ] = static_cast<unsigned char>( ba[ i ] );
-
-      rijndaelEncrypt( rk, nrounds, plaintext, ciphertext );
-
-      for( i = 0; i < sizeof( ciphertext ); i++ )
-        encrypted_byte_array.append( static_cast<char>( ciphertext[ i ] ) );
-
-      memset( ciphertext, 0, sizeof( ciphertext ) );
-      memset( plaintext, 0, sizeof( plaintext ) );
-    }
-    else
-      encrypted_byte_array += ba;
+  cipher_context->setup( cipher_key, proto_version, key );
+  memset( key, 0, sizeof( key ) );
+}
 
-  }
+QByteArray Protocol::encryptByteArray( const QByteArray& text_to_encrypt, const QByteArray& cipher_key, int proto_version ) const
+{
+  if( text_to_encrypt.isEmpty() )
+    return QByteArray();
 
-  return encrypted_byte_array;
+  CipherContext cipher_context;
+  setupCipherContext( &cipher_context, cipher_key, proto_version );
+  return cipher_context.encrypt( text_to_encrypt );
 }
 
 QByteArray Protocol::decryptByteArray( const QByteArray& text_to_decrypt, const QByteArray& cipher_key, int proto_version ) const
 {
-  unsigned long rk[RKLENGTH(ENCRYPTION_KEYBITS)];
-  unsigned char key[KEYLENGTH(ENCRYPTION_KEYBITS)];
-  unsigned int i;
-  int nrounds;
-
   if( text_to_decrypt.isEmpty() )
     return QByteArray();
 
-  if( cipher_key.isEmpty() )
-    return QByteArray::fromBase64( text_to_decrypt );
-
-  if( proto_version < SECURE_LEVEL_3_PROTO_VERSION )
-  {
-    // What the hell...
-    for( unsigned int i = 0; i < sizeof( key ); i++ )
-      key[ i ] = static_cast<unsigned int>(cipher_key.size()) < i ? static_cast<unsigned char>( cipher_key.at( static_cast<int>(i) ) ) : 0;
-  }
-  else
-  {
-    hexToUnsignedChar( cipher_key, key, KEYLENGTH(ENCRYPTION_KEYBITS) );
-  }
-
-  nrounds = rijndaelSetupDecrypt( rk, key, ENCRYPTION_KEYBITS );
-
-  QList<QByteArray> byte_array_list = splitByteArray( text_to_decrypt, ENCRYPTED_DATA_BLOCK_SIZE );
-
-  unsigned char plaintext[ ENCRYPTED_DATA_BLOCK_SIZE ];
-  unsigned char ciphertext[ ENCRYPTED_DATA_BLOCK_SIZE ];
-
-  memset( ciphertext, 0, sizeof( ciphertext ) );
-  memset( plaintext, 0, sizeof( plaintext ) );
-
-  QByteArray decrypted_byte_array;
-
-  foreach( QByteArray ba, byte_array_list )
-  {
-    if( ba.size() == sizeof( ciphertext ) )
-    {
-      for( i = 0; i < sizeof( ciphertext ); i++ )
-        ciphertext[ i ] = static_cast<unsigned char>( ba[ i ] );
-
-      rijndaelDecrypt( rk, nrounds, ciphertext, plaintext );
-
-      for( i = 0; i < sizeof( plaintext ); i++ )
-        decrypted_byte_array.append( static_cast<char>( plaintext[ i ] ) );
-
-      memset( ciphertext, 0, sizeof( ciphertext ) );
-      memset( plaintext, 0, sizeof( plaintext ) );
-    }
-    else
-      decrypted_byte_array += ba;
-  }
-
-  return decrypted_byte_array;
+  CipherContext cipher_context;
+  setupCipherContext( &cipher_context, cipher_key, proto_version );
+  return cipher_context.decrypt( text_to_decrypt );
 }
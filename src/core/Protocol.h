@@ -25,6 +25,7 @@
 #define BEEBEEP_PROTOCOL_H
 
 #include "Chat.h"
+#include "CipherContext.h"
 #include "ChatRecord.h"
 #include "FileInfo.h"
 #include "Group.h"
@@ -49,12 +50,13 @@ public:
   inline int messageMinimumSize() const;
   QByteArray fromMessage( const Message&, int proto_version ) const;
   Message toMessage( const QByteArray&, int proto_version ) const;
+  Message toMessage( const QByteArray&, int proto_version, bool warn_invalid_fields ) const;
 
   QByteArray pingMessage() const;
   QByteArray pongMessage() const;
   QByteArray broadcastMessage( const QHostAddress& ) const;
   QHostAddress hostAddressFromBroadcastMessage( const Message& ) const;
-  QByteArray helloMessage( const QString& public_key, bool encrypted_connection, bool data_compressed ) const;
+  QByteArray helloMessage( const QString& public_key, bool encrypted_connection, bool data_compressed, const QString& session_resumption = QString() ) const;
   QByteArray testQuestionMessage( const NetworkAddress& ) const;
   bool isTestQuestionMessage( const Message& ) const;
   QByteArray testAnswerMessage( const NetworkAddress&, bool test_is_accepted, const QString& answer_msg = "Ok" ) const;
@@ -125,6 +127,8 @@ public:
   UserStatusRecord loadUserStatusRecord( const QString& ) const;
   Message userRecordListToHiveMessage( const QList<UserRecord>& );
   QList<UserRecord> hiveMessageToUserRecordList( const Message& ) const;
+  Message hiveDigestMessage( const QList<quint32>& );
+  QList<quint32> digestFromHiveMessage( const Message& ) const;
 
   QString saveMessageRecord( const MessageRecord& ) const;
   MessageRecord loadMessageRecord( const QString& ) const;
@@ -161,9 +165,13 @@ public:
   ChatRecord loadChatRecord( const QString& ) const;
 
   QString publicKey( const Message& ) const;
+  quint16 listenerPort( const Message& ) const;
+  bool sessionResumption( const Message&, QString* session_id, QString* session_nonce ) const;
+  QString sessionResumption( const QString& session_id, const QString& session_nonce ) const;
   QByteArray createCipherKey( const QByteArray& shared_key, int data_stream_version ) const;
   QByteArray createCipherKey( const QString& key_1, const QString& key_2, int data_stream_version ) const;
 
+  void setupCipherContext( CipherContext*, const QByteArray& cipher_key, int proto_version ) const;
   QByteArray encryptByteArray( const QByteArray& text_to_encrypt, const QByteArray& cipher_key, int proto_version ) const;
   QByteArray decryptByteArray( const QByteArray& text_to_decrypt, const QByteArray& cipher_key, int proto_version ) const;
 
@@ -187,6 +195,12 @@ protected:
   Protocol();
   QString messageHeader( Message::Type ) const;
   Message::Type messageType( const QString& ) const;
+  quint64 textMessageHeaderKey( const QChar*, int ) const;
+  bool parseTextMessage( const QString&, int proto_version, Message* ) const;
+  QByteArray textFromMessage( const Message&, int proto_version ) const;
+  bool isBinaryMessage( const QByteArray& ) const;
+  QByteArray binaryFromMessage( const Message& ) const;
+  Message binaryToMessage( const QByteArray& ) const;
 
   QString pixmapToString( const QPixmap& ) const;
   QPixmap stringToPixmap( const QString& ) const;
@@ -195,13 +209,13 @@ protected:
   QByteArray generateECDHPublicKey( const QByteArray& private_key ) const;
   QByteArray generateECDHSharedCipherKey( const QByteArray& private_key, const QByteArray& other_public_key ) const;
 
-  QList<QByteArray> splitByteArray( const QByteArray&, int ) const;
   void hexToUnsignedChar( const QByteArray&, unsigned char* out_string, unsigned int len_out_string ) const;
 
 private:
   VNumber m_id;
   int m_datastreamMaxVersion;
   Message m_fileShareListMessage;
+  QHash<quint64, Message::Type> m_textMessageTypes;
 
 };
 
@@ -150,6 +150,7 @@ Settings::Settings()
 
   m_connectionKeyExchangeMethod = ConnectionKeyExchangeAuto;
   m_useKeepAliveOptionInSocket = false;
+  m_useConnectionSessionResumption = true;
 
   m_backupFolder = "";
   /* Default RC end */
@@ -207,6 +208,8 @@ Settings::Settings()
   m_previewFileDialogGeometry = "";
   m_previewFileDialogImageSize = 200;
   m_maxUsersToConnectInATick = 25;
+  m_maxConcurrentHandshakes = 32;
+  m_handshakesPerSecond = 16;
   m_showTextInModeRTL = false;
   m_showChatsInOneWindow = false;
   m_maxLogLines = 5000;
@@ -565,6 +568,7 @@ bool Settings::createDefaultRcFile()
     sets->setValue( "TickIntervalChatAutoSave", m_tickIntervalChatAutoSave );
     sets->setValue( "EnableReceivingHelpMessages", m_enableReceivingHelpMessages );
     sets->setValue( "UseKeepAliveOptionInSocket", m_useKeepAliveOptionInSocket );
+    sets->setValue( "UseConnectionSessionResumption", m_useConnectionSessionResumption );
     sets->endGroup();
     sets->sync();
     qDebug() << "RC default configuration file created in" << qPrintable( Bee::convertToNativeFolderSeparator( sets->fileName() ) );
@@ -630,6 +634,7 @@ void Settings::loadRcFile()
   m_preferredSubnets = sets->value( "PreferredSubnets", m_preferredSubnets ).toString();
   m_useIPv6 = sets->value( "UseIPv6", m_useIPv6 ).toBool();
   m_useKeepAliveOptionInSocket = sets->value( "UseKeepAliveOptionInSocket", m_useKeepAliveOptionInSocket ).toBool();
+  m_useConnectionSessionResumption = sets->value( "UseConnectionSessionResumption", m_useConnectionSessionResumption ).toBool();
   QString multicast_group_address = sets->value( "MulticastGroupAddress", "" ).toString();
   if( multicast_group_address.isEmpty() )
     m_multicastGroupAddress = QHostAddress();
@@ -1348,6 +1353,12 @@ void Settings::load()
   delete sets;
 }
 
+void Settings::loadDefaults()
+{
+  qDebug() << "Loading default settings";
+  loadCommonSettings( Q_NULLPTR );
+}
+
 
 void Settings::beginCommonGroup( QSettings* system_rc, QSettings* user_ini, const QString& group_name )
 {
@@ -1637,6 +1648,8 @@ void Settings::loadCommonSettings( QSettings* user_ini )
   m_useMulticastDns = commonValue( system_rc, user_ini, "UseMulticastDns", m_useMulticastDns ).toBool();
 #endif
   m_maxUsersToConnectInATick = commonValue( system_rc, user_ini, "MaxUsersToConnectInATick", m_maxUsersToConnectInATick ).toInt();
+  m_maxConcurrentHandshakes = qMax( 1, commonValue( system_rc, user_ini, "MaxConcurrentHandshakes", m_maxConcurrentHandshakes ).toInt() );
+  m_handshakesPerSecond = qMax( 1, commonValue( system_rc, user_ini, "HandshakesPerSecond", m_handshakesPerSecond ).toInt() );
   m_preventMultipleConnectionsFromSingleHostAddress = commonValue( system_rc, user_ini, "PreventMultipleConnectionsFromSingleHostAddress", m_preventMultipleConnectionsFromSingleHostAddress ).toBool();
   m_useHive = commonValue( system_rc, user_ini, "UseHiveProtocol", m_useHive ).toBool();
   m_disableSystemProxyForConnections = commonValue( system_rc, user_ini, "DisableSystemProxyForConnections", m_disableSystemProxyForConnections ).toBool();
@@ -1681,6 +1694,9 @@ void Settings::loadCommonSettings( QSettings* user_ini )
     m_fileTransferBufferSize -= mod_buffer_size;
   if( m_fileTransferBufferSize < 2048 )
     m_fileTransferBufferSize = 2048;
+  m_fileTransferMaxBufferSize = qMax( commonValue( system_rc, user_ini, "FileTransferMaxBufferSize", 1048576 ).toInt(), m_fileTransferBufferSize );
+  m_fileTransferMaxBufferSize -= m_fileTransferMaxBufferSize % ENCRYPTED_DATA_BLOCK_SIZE;
+  m_fileTransferSegments = qBound( 1, commonValue( system_rc, user_ini, "FileTransferSegments", 4 ).toInt(), 16 );
   bool automatic_file_name = commonValue( system_rc, user_ini, "SetAutomaticFileNameOnSave", m_useClassroomConfiguration ).toBool();
   if( automatic_file_name )
     m_onExistingFileAction = GenerateNewFileName;
@@ -2007,6 +2023,8 @@ void Settings::save()
   sets->setValue( "AcceptConnectionsOnlyFromWorkgroups", m_acceptConnectionsOnlyFromWorkgroups );
   sets->setValue( "Workgroups", m_localUser.workgroups() );
   sets->setValue( "MaxUsersToConnectInATick", m_maxUsersToConnectInATick );
+  sets->setValue( "MaxConcurrentHandshakes", m_maxConcurrentHandshakes );
+  sets->setValue( "HandshakesPerSecond", m_handshakesPerSecond );
   sets->setValue( "UseHiveProtocol", m_useHive );
   sets->setValue( "DisableSystemProxyForConnections", m_disableSystemProxyForConnections );
   sets->setValue( "UseDefaultMulticastGroupAddress", m_useDefaultMulticastGroupAddress );
@@ -2024,6 +2042,8 @@ void Settings::save()
   sets->setValue( "ResumeFileTransfer", m_resumeFileTransfer );
   sets->setValue( "FileTransferConfirmTimeout", m_fileTransferConfirmTimeout );
   sets->setValue( "FileTransferBufferSize", m_fileTransferBufferSize );
+  sets->setValue( "FileTransferMaxBufferSize", m_fileTransferMaxBufferSize );
+  sets->setValue( "FileTransferSegments", m_fileTransferSegments );
   sets->setValue( "MaxSimultaneousDownloads", m_maxSimultaneousDownloads );
   sets->setValue( "MaxQueuedDownloads", m_maxQueuedDownloads );
   sets->setValue( "ConfirmOnDownloadFile", m_confirmOnDownloadFile );
@@ -2430,6 +2450,16 @@ QString Settings::unsentMessagesFilePath() const
   return Bee::convertToNativeFolderSeparator( QString( "%1/%2" ).arg( dataFolder(), QLatin1String( "beebeep.off" ) ) );
 }
 
+QString Settings::networkScannerCacheFilePath() const
+{
+  return Bee::convertToNativeFolderSeparator( QString( "%1/%2" ).arg( dataFolder(), QLatin1String( "beebeep.scn" ) ) );
+}
+
+QString Settings::hiveFilePath() const
+{
+  return Bee::convertToNativeFolderSeparator( QString( "%1/%2" ).arg( dataFolder(), QLatin1String( "beebeep.hiv" ) ) );
+}
+
 QString Settings::defaultSettingsFilePath() const
 {
   return Bee::convertToNativeFolderSeparator( QString( "%1/%2" ).arg( dataFolder(), QLatin1String( "beebeep.ini" ) ) );
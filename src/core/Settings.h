@@ -150,6 +150,7 @@ public:
 
   inline bool useIPv6() const;
   inline bool useKeepAliveOptionInSocket() const;
+  inline bool useConnectionSessionResumption() const;
   QHostAddress hostAddressToListen();
   inline const QHostAddress& multicastGroupAddress() const;
   QHostAddress defaultMulticastGroupAddress() const;
@@ -162,13 +163,18 @@ public:
   inline int messageNotReceivedTimeout() const;
   inline int writingTimeout() const;
   inline int fileTransferConfirmTimeout() const;
+  inline void setFileTransferConfirmTimeout( int );
   inline int fileTransferBufferSize() const;
+  inline int fileTransferMaxBufferSize() const;
+  inline int fileTransferSegments() const;
   inline int trayMessageTimeout() const;
   inline int tickIntervalConnectionTimeout() const;
   inline int tickIntervalCheckIdle() const;
   inline int tickIntervalCheckNetwork() const;
   inline void setMaxUsersToConnectInATick( int );
   inline int maxUsersToConnectInATick() const;
+  inline int maxConcurrentHandshakes() const;
+  inline int handshakesPerSecond() const;
   inline void setTickIntervalBroadcasting( int );
   inline int tickIntervalBroadcasting() const;
   inline int delayContactUsers() const;
@@ -464,6 +470,8 @@ public:
   inline int chatMaxLineSaved() const;
   inline void setChatMaxLineSaved( int );
   QString unsentMessagesFilePath() const;
+  QString networkScannerCacheFilePath() const;
+  QString hiveFilePath() const;
   inline bool chatSaveUnsentMessages() const;
   inline void setChatSaveUnsentMessages( bool );
   inline bool chatSaveFileTransfers() const;
@@ -594,6 +602,7 @@ public:
   void loadRcFile();
   void clearNativeSettings();
   void load();
+  void loadDefaults(); // the common settings without the user ini file (i.e. the benchmarks)
   void save();
   inline const QDateTime& lastSave() const;
 
@@ -738,6 +747,7 @@ private:
   int m_userRecognitionMethod;
   bool m_useOnlyMulticast;
   bool m_useKeepAliveOptionInSocket;
+  bool m_useConnectionSessionResumption;
 
   bool m_canAddMembersToGroup;
   bool m_canRemoveMembersFromGroup;
@@ -775,12 +785,16 @@ private:
   int m_writingTimeout;
   int m_fileTransferConfirmTimeout;
   int m_fileTransferBufferSize;
+  int m_fileTransferMaxBufferSize;
+  int m_fileTransferSegments;
   int m_trayMessageTimeout;
   int m_userAwayTimeout;
   int m_tickIntervalConnectionTimeout;
   int m_tickIntervalCheckIdle;
   int m_tickIntervalCheckNetwork;
   int m_maxUsersToConnectInATick;
+  int m_maxConcurrentHandshakes;
+  int m_handshakesPerSecond;
   int m_tickIntervalBroadcasting;
   int m_delayContactUsers;
 
@@ -1050,12 +1064,17 @@ inline int Settings::pongTimeout() const { return m_pongTimeout; }
 inline int Settings::messageNotReceivedTimeout() const { return m_messageNotReceivedTimeout; }
 inline int Settings::writingTimeout() const { return m_writingTimeout; }
 inline int Settings::fileTransferConfirmTimeout() const { return m_fileTransferConfirmTimeout; }
+inline void Settings::setFileTransferConfirmTimeout( int new_value ) { m_fileTransferConfirmTimeout = qMax( new_value, 1000 ); }
 inline int Settings::fileTransferBufferSize() const { return m_fileTransferBufferSize; }
+inline int Settings::fileTransferMaxBufferSize() const { return m_fileTransferMaxBufferSize; }
+inline int Settings::fileTransferSegments() const { return m_fileTransferSegments; }
 inline int Settings::trayMessageTimeout() const  { return m_trayMessageTimeout; }
 inline int Settings::userAwayTimeout() const { return m_userAwayTimeout; }
 inline void Settings::setUserAwayTimeout( int new_value ) { m_userAwayTimeout = new_value; }
 inline void Settings::setMaxUsersToConnectInATick( int new_value ) { m_maxUsersToConnectInATick = new_value; }
 inline int Settings::maxUsersToConnectInATick() const { return m_maxUsersToConnectInATick; }
+inline int Settings::maxConcurrentHandshakes() const { return m_maxConcurrentHandshakes; }
+inline int Settings::handshakesPerSecond() const { return m_handshakesPerSecond; }
 inline int Settings::delayContactUsers() const { return m_delayContactUsers; }
 inline const QString& Settings::logPath() const { return m_logPath; }
 inline void Settings::setLogPath( const QString& new_value ) { m_logPath = new_value; }
@@ -1275,6 +1294,7 @@ inline void Settings::setUseDefaultMulticastGroupAddress( bool new_value ) { m_u
 inline bool Settings::useDefaultMulticastGroupAddress() const { return m_useDefaultMulticastGroupAddress; }
 inline bool Settings::useIPv6() const { return m_useIPv6; }
 inline bool Settings::useKeepAliveOptionInSocket() const { return m_useKeepAliveOptionInSocket; }
+inline bool Settings::useConnectionSessionResumption() const { return m_useConnectionSessionResumption; }
 inline const QHostAddress& Settings::multicastGroupAddress() const { return m_multicastGroupAddress; }
 inline void Settings::setIpMulticastTtl( int new_value ) { m_ipMulticastTtl = new_value; }
 inline int Settings::ipMulticastTtl() const { return m_ipMulticastTtl; }
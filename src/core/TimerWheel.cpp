@@ -0,0 +1,244 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#include "TimerWheel.h"
+
+
+TimerWheel* TimerWheel::mp_instance = Q_NULLPTR;
+
+TimerWheel::TimerWheel()
+  : QObject( Q_NULLPTR ), m_elapsedTimer(), mp_timer( Q_NULLPTR ), m_tick( 0 ), m_lastTimerId( 0 ),
+    m_entries(), m_isProcessing( false )
+{
+  setObjectName( "TimerWheel" );
+  m_elapsedTimer.start();
+  mp_timer = new QTimer( this );
+  mp_timer->setSingleShot( true );
+  connect( mp_timer, SIGNAL( timeout() ), this, SLOT( onTimerTimeout() ) );
+}
+
+TimerWheel::~TimerWheel()
+{
+  mp_timer->stop();
+#ifdef BEEBEEP_DEBUG
+  qDebug() << "TimerWheel closed with" << m_entries.size() << "timers scheduled";
+#endif
+}
+
+int TimerWheel::schedule( int msecs, QObject* receiver, const char* member, bool repeat )
+{
+  if( !receiver || !member )
+    return 0;
+
+  qint64 now = currentTick();
+  advanceTo( now );
+
+  do
+  {
+    m_lastTimerId++;
+    if( m_lastTimerId <= 0 )
+      m_lastTimerId = 1;
+  } while( m_entries.contains( m_lastTimerId ) );
+
+  qint64 ticks = qMax( Q_INT64_C( 1 ), (static_cast<qint64>( msecs ) + TIMER_WHEEL_RESOLUTION - 1) / TIMER_WHEEL_RESOLUTION );
+  Entry e;
+  e.receiver = receiver;
+  e.member = member;
+  e.expires = now + ticks;
+  e.interval = repeat ? ticks : 0;
+  m_entries.insert( m_lastTimerId, e );
+  addToSlot( m_lastTimerId );
+
+  if( !m_isProcessing )
+    updateTimer();
+  return m_lastTimerId;
+}
+
+void TimerWheel::cancel( int timer_id )
+{
+  QHash<int, Entry>::iterator it = m_entries.find( timer_id );
+  if( it == m_entries.end() )
+    return;
+
+  m_slots[ it.value().level ][ it.value().slot ].removeOne( timer_id );
+  m_entries.erase( it );
+
+  if( !m_isProcessing )
+    updateTimer();
+}
+
+void TimerWheel::addToSlot( int timer_id )
+{
+  Entry& e = m_entries[ timer_id ];
+  qint64 slot_expires = qMax( e.expires, m_tick );
+  qint64 delta = slot_expires - m_tick;
+  int level = 0;
+  while( level < NumLevels - 1 && delta >= (Q_INT64_C( 1 ) << (LevelBits * (level + 1))) )
+    level++;
+  if( delta >= (Q_INT64_C( 1 ) << (LevelBits * NumLevels)) )
+    slot_expires = m_tick + (Q_INT64_C( 1 ) << (LevelBits * NumLevels)) - 1; // it is added again when this slot expires
+
+  e.level = level;
+  e.slot = static_cast<int>( (slot_expires >> (LevelBits * level)) & (NumSlots - 1) );
+  m_slots[ e.level ][ e.slot ].append( timer_id );
+}
+
+void TimerWheel::cascade( int level, int slot )
+{
+  QList<int> timer_ids = m_slots[ level ][ slot ];
+  m_slots[ level ][ slot ].clear();
+  foreach( int timer_id, timer_ids )
+  {
+    if( m_entries.contains( timer_id ) )
+      addToSlot( timer_id );
+  }
+}
+
+qint64 TimerWheel::nextEventTick() const
+{
+  if( m_entries.isEmpty() )
+    return -1;
+
+  qint64 next_tick = -1;
+  for( int i = 0; i < NumSlots; i++ )
+  {
+    if( !m_slots[ 0 ][ (m_tick + i) & (NumSlots - 1) ].isEmpty() )
+    {
+      next_tick = m_tick + i;
+      break;
+    }
+  }
+
+  // Entries of the upper levels are moved in the lower ones when their slot boundary is reached
+  for( int level = 1; level < NumLevels; level++ )
+  {
+    int shift = LevelBits * level;
+    qint64 base = m_tick >> shift;
+    for( int i = 0; i <= NumSlots; i++ )
+    {
+      qint64 boundary_tick = (base + i) << shift;
+      if( boundary_tick < m_tick )
+        continue;
+      if( next_tick >= 0 && boundary_tick >= next_tick )
+        break;
+      if( !m_slots[ level ][ (base + i) & (NumSlots - 1) ].isEmpty() )
+      {
+        next_tick = boundary_tick;
+        break;
+      }
+    }
+  }
+
+  return next_tick;
+}
+
+void TimerWheel::advanceTo( qint64 tick )
+{
+  // Ticks without events can be skipped
+  if( tick <= m_tick )
+    return;
+  qint64 next_tick = nextEventTick();
+  if( next_tick < 0 || next_tick > tick )
+    m_tick = tick;
+}
+
+void TimerWheel::processTick( qint64 tick )
+{
+  m_tick = tick;
+  int index = static_cast<int>( tick & (NumSlots - 1) );
+  if( index == 0 )
+  {
+    for( int level = 1; level < NumLevels; level++ )
+    {
+      int level_index = static_cast<int>( (tick >> (LevelBits * level)) & (NumSlots - 1) );
+      cascade( level, level_index );
+      if( level_index != 0 )
+        break;
+    }
+  }
+
+  QList<int> timer_ids = m_slots[ 0 ][ index ];
+  m_slots[ 0 ][ index ].clear();
+  m_tick = tick + 1;
+
+  foreach( int timer_id, timer_ids )
+  {
+    QHash<int, Entry>::iterator it = m_entries.find( timer_id );
+    if( it == m_entries.end() )
+      continue; // canceled by a previous timer
+
+    if( it.value().expires > tick )
+    {
+      addToSlot( timer_id );
+      continue;
+    }
+
+    QPointer<QObject> receiver = it.value().receiver;
+    QByteArray member = it.value().member;
+    if( receiver.isNull() )
+    {
+      m_entries.erase( it );
+      continue;
+    }
+
+    if( it.value().interval > 0 )
+    {
+      it.value().expires = qMax( tick, currentTick() ) + it.value().interval;
+      addToSlot( timer_id );
+    }
+    else
+      m_entries.erase( it );
+
+    if( !QMetaObject::invokeMethod( receiver, member.constData() ) )
+      qWarning() << "TimerWheel is unable to invoke" << member.constData() << "in" << qPrintable( receiver->objectName() );
+  }
+}
+
+void TimerWheel::updateTimer()
+{
+  qint64 next_tick = nextEventTick();
+  if( next_tick < 0 )
+  {
+    mp_timer->stop();
+    return;
+  }
+
+  qint64 msecs = next_tick * TIMER_WHEEL_RESOLUTION - m_elapsedTimer.elapsed();
+  mp_timer->start( static_cast<int>( qBound( Q_INT64_C( 0 ), msecs, Q_INT64_C( 2147483647 ) ) ) );
+}
+
+void TimerWheel::onTimerTimeout()
+{
+  m_isProcessing = true;
+  qint64 now = currentTick();
+  forever
+  {
+    qint64 next_tick = nextEventTick();
+    if( next_tick < 0 || next_tick > now )
+      break;
+    processTick( next_tick );
+  }
+  advanceTo( now );
+  m_isProcessing = false;
+  updateTimer();
+}
@@ -0,0 +1,112 @@
+//////////////////////////////////////////////////////////////////////
+//
+// BeeBEEP Copyright (C) 2010-2021 Marco Mastroddi
+//
+// BeeBEEP is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published
+// by the Free Software Foundation, either version 3 of the License,
+// or (at your option) any later version.
+//
+// BeeBEEP is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// You should have received a copy of the GNU General Public License
+// along with BeeBEEP. If not, see <http://www.gnu.org/licenses/>.
+//
+// Author: Marco Mastroddi <marco.mastroddi(AT)gmail.com>
+//
+// $Id$
+//
+//////////////////////////////////////////////////////////////////////
+
+#ifndef BEEBEEP_TIMERWHEEL_H
+#define BEEBEEP_TIMERWHEEL_H
+
+#include "Config.h"
+
+
+/*
+  Hierarchical timer wheel used by the subsystems to schedule their own
+  deadlines (pings, connection timeouts, broadcast rounds, autosave,
+  icon blinking...). Only one single shot QTimer is armed at the next
+  deadline: the wakeups follow the deadlines scheduled, there is no
+  global tick. The receiver slot is invoked without arguments in the
+  main thread: the wheel must be used there.
+*/
+
+class TimerWheel : public QObject
+{
+  Q_OBJECT
+// Singleton Object
+  static TimerWheel* mp_instance;
+
+public:
+  int schedule( int msecs, QObject* receiver, const char* member, bool repeat = false ); // returns the timer id
+  void cancel( int timer_id );
+  inline bool isScheduled( int timer_id ) const;
+  inline int size() const;
+
+  static TimerWheel& instance()
+  {
+    if( !mp_instance )
+      mp_instance = new TimerWheel();
+    return *mp_instance;
+  }
+
+  static void close()
+  {
+    if( mp_instance )
+    {
+      delete mp_instance;
+      mp_instance = Q_NULLPTR;
+    }
+  }
+
+protected:
+  TimerWheel();
+  ~TimerWheel();
+
+  struct Entry
+  {
+    Entry() : receiver(), member(), expires( 0 ), interval( 0 ), level( 0 ), slot( 0 ) {}
+    QPointer<QObject> receiver;
+    QByteArray member;
+    qint64 expires;
+    qint64 interval;
+    int level;
+    int slot;
+  };
+
+  inline qint64 currentTick() const;
+  void addToSlot( int timer_id );
+  void cascade( int level, int slot );
+  qint64 nextEventTick() const;
+  void advanceTo( qint64 );
+  void processTick( qint64 );
+  void updateTimer();
+
+protected slots:
+  void onTimerTimeout();
+
+private:
+  enum { NumLevels = 4, LevelBits = 6, NumSlots = 1 << LevelBits };
+
+  QElapsedTimer m_elapsedTimer;
+  QTimer* mp_timer;
+  qint64 m_tick; // next tick to process
+  int m_lastTimerId;
+  QHash<int, Entry> m_entries;
+  QList<int> m_slots[ NumLevels ][ NumSlots ];
+  bool m_isProcessing;
+
+};
+
+
+// Inline Functions
+inline bool TimerWheel::isScheduled( int timer_id ) const { return m_entries.contains( timer_id ); }
+inline int TimerWheel::size() const { return m_entries.size(); }
+inline qint64 TimerWheel::currentTick() const { return m_elapsedTimer.elapsed() / TIMER_WHEEL_RESOLUTION; }
+
+#endif // BEEBEEP_TIMERWHEEL_H
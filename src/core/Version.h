@@ -44,7 +44,7 @@ const char BEEBEEP_GA_URL[] = "https://www.google-analytics.com/collect";
 const char BEEBEEP_GA_EVENT_VERSION[] = "1";
 const char HUNSPELL_VERSION[] = "1.7.0";
 const char BEEBEEP_VERSION[] = "5.8.5";
-const int BEEBEEP_PROTO_VERSION = 95;
+const int BEEBEEP_PROTO_VERSION = 101;
 const int BEEBEEP_SETTINGS_VERSION = 18;
 const int BEEBEEP_BUILD = 1545;
 
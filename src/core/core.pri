@@ -2,6 +2,7 @@
 INCLUDEPATH += $$PWD
 
 HEADERS += core/Broadcaster.h \
+  core/BuildFileHashes.h \
   core/BuildFileList.h \
   core/BuildFileShareList.h \
   core/BuildSavedChatList.h \
@@ -10,10 +11,16 @@ HEADERS += core/Broadcaster.h \
   core/ChatMessage.h \
   core/ChatMessageData.h \
   core/ChatRecord.h \
+  core/CipherContext.h \
+  core/CipherSessionCache.h \
   core/Config.h \
   core/Connection.h \
+  core/ConnectionAdmission.h \
   core/ConnectionSocket.h \
   core/Core.h \
+  core/DataBlockReader.h \
+  core/ECDHKeyPool.h \
+  core/FileChunkMap.h \
   core/FileInfo.h \
   core/FileShare.h \
   core/FileTransfer.h \
@@ -25,20 +32,23 @@ HEADERS += core/Broadcaster.h \
   core/Hive.h \
   core/Log.h \
   core/Job.h \
+  core/KeyExchangeJob.h \
   core/Listener.h \
   core/Message.h \
+  core/MessageDecoder.h \
   core/MessageManager.h \
   core/MessageRecord.h \
   core/NetworkAddress.h \
   core/NetworkEntry.h \
   core/NetworkManager.h \
+  core/NetworkScanner.h \
   core/PluginManager.h \
   core/Protocol.h \
   core/Random.h \
   core/Rijndael.h \
   core/SaveChatList.h \
   core/Settings.h \
-  core/TickManager.h \
+  core/TimerWheel.h \
   core/User.h \
   core/UserList.h \
   core/UserManager.h \
@@ -49,6 +59,7 @@ HEADERS += core/Broadcaster.h \
   core/RemoteControl.h
 
 SOURCES +=  core/Broadcaster.cpp \
+  core/BuildFileHashes.cpp \
   core/BuildFileList.cpp \
   core/BuildFileShareList.cpp \
   core/BuildSavedChatList.cpp \
@@ -57,7 +68,10 @@ SOURCES +=  core/Broadcaster.cpp \
   core/ChatMessage.cpp \
   core/ChatMessageData.cpp \
   core/ChatRecord.cpp \
+  core/CipherContext.cpp \
+  core/CipherSessionCache.cpp \
   core/Connection.cpp \
+  core/ConnectionAdmission.cpp \
   core/ConnectionSocket.cpp \
   core/Core.cpp \
   core/CoreChat.cpp \
@@ -66,6 +80,9 @@ SOURCES +=  core/Broadcaster.cpp \
   core/CoreFileTransfer.cpp \
   core/CoreParser.cpp \
   core/CoreUser.cpp \
+  core/DataBlockReader.cpp \
+  core/ECDHKeyPool.cpp \
+  core/FileChunkMap.cpp \
   core/FileInfo.cpp \
   core/FileShare.cpp \
   core/FileTransfer.cpp \
@@ -77,20 +94,23 @@ SOURCES +=  core/Broadcaster.cpp \
   core/HistoryManager.cpp \
   core/HistoryMessage.cpp \
   core/Hive.cpp \
+  core/KeyExchangeJob.cpp \
   core/Listener.cpp \
   core/Log.cpp \
   core/Message.cpp \
+  core/MessageDecoder.cpp \
   core/MessageManager.cpp \
   core/MessageRecord.cpp \
   core/NetworkAddress.cpp \
   core/NetworkEntry.cpp \
   core/NetworkManager.cpp \
+  core/NetworkScanner.cpp \
   core/PluginManager.cpp \
   core/Protocol.cpp \
   core/Rijndael.cpp \
   core/SaveChatList.cpp \
   core/Settings.cpp \
-  core/TickManager.cpp \
+  core/TimerWheel.cpp \
   core/User.cpp \
   core/UserList.cpp \
   core/UserManager.cpp \
@@ -22,7 +22,8 @@
 //////////////////////////////////////////////////////////////////////
 
 #include "BeeApplication.h"
-#include "TickManager.h"
+#include "Settings.h"
+#include "TimerWheel.h"
 #ifdef BEEBEEP_USE_VOICE_CHAT
 #include "VoicePlayer.h"
 #endif
@@ -82,8 +83,10 @@ BeeApplication::BeeApplication( int& argc, char** argv  )
   m_isDesktopLocked = false;
 
   mp_jobThread = new QThread();
+  mp_networkThread = new QThread();
   m_jobsInProgress = 0;
-  mp_tickManager = Q_NULLPTR;
+  m_idleCheckTimerId = 0;
+  m_uptimeCheckTimerId = 0;
   mp_sleepWatcher = Q_NULLPTR;
 
   m_defaultCss = styleSheet();
@@ -201,13 +204,13 @@ void BeeApplication::forceShutdown()
 
 void BeeApplication::init()
 {
-  qDebug() << "Starting background thread and tick timer";
+  qDebug() << "Starting background threads";
   mp_jobThread->start();
   mp_jobThread->setPriority( QThread::LowPriority );
-  mp_tickManager = new TickManager;
-  connect( mp_tickManager, SIGNAL( tickEvent( int ) ), this, SLOT( checkTicks( int ) ) );
-  addJob( mp_tickManager );
-  QMetaObject::invokeMethod( mp_tickManager, "startTicks", Qt::QueuedConnection );
+  mp_networkThread->start();
+  m_uptime.start();
+  scheduleUptimeCheck();
+  scheduleIdleCheck();
   qDebug() << "Network configuration manager is starting";
   QMetaObject::invokeMethod( mp_networkConfigurationManager, "updateConfigurations", Qt::QueuedConnection );
 }
@@ -219,8 +222,7 @@ void BeeApplication::forceSleep()
   qDebug() << "System goes to sleep...";
   m_isInSleepMode = true;
   emit sleepRequest();
-  if( mp_tickManager->isActive() )
-    QMetaObject::invokeMethod( mp_tickManager, "stopTicks", Qt::QueuedConnection );
+  cancelIdleCheck();
 }
 
 void BeeApplication::wakeFromSleep()
@@ -230,8 +232,7 @@ void BeeApplication::wakeFromSleep()
   qDebug() << "System wakes up from sleep...";
   m_isInSleepMode = false;
   emit wakeUpRequest();
-  if( !mp_tickManager->isActive() )
-    QMetaObject::invokeMethod( mp_tickManager, "startTicks", Qt::QueuedConnection );
+  scheduleIdleCheck();
 }
 
 void BeeApplication::setIdleTimeout( int new_value )
@@ -240,6 +241,7 @@ void BeeApplication::setIdleTimeout( int new_value )
   {
     qWarning() << "Unable to set idle timout to value:" << new_value;
     m_idleTimeout = 0;
+    cancelIdleCheck();
     return;
   }
 
@@ -253,6 +255,7 @@ void BeeApplication::setIdleTimeout( int new_value )
   else
     mp_xcbScreen = xcb_setup_roots_iterator( xcb_get_setup( mp_xcbConnection ) ).data;
 #endif
+  scheduleIdleCheck();
 }
 
 void BeeApplication::setIdle()
@@ -298,13 +301,9 @@ void BeeApplication::checkIdle()
 
 void BeeApplication::cleanUp()
 {
-  if( mp_tickManager )
-  {
-    QMetaObject::invokeMethod( mp_tickManager, "stopTicks", Qt::QueuedConnection );
-    removeJob( mp_tickManager );
-    mp_tickManager->deleteLater();
-    mp_tickManager = Q_NULLPTR;
-  }
+  cancelIdleCheck();
+  TimerWheel::instance().cancel( m_uptimeCheckTimerId );
+  m_uptimeCheckTimerId = 0;
 
 #if defined( Q_OS_LINUX ) && !defined( Q_OS_ANDROID )
   if( m_idleTimeout > 0 )
@@ -325,6 +324,10 @@ void BeeApplication::cleanUp()
 
   mp_jobThread->quit();
   mp_jobThread->deleteLater();
+
+  mp_networkThread->quit();
+  mp_networkThread->wait( 1000 );
+  mp_networkThread->deleteLater();
 }
 
 bool BeeApplication::isScreenSaverRunning()
@@ -455,6 +458,14 @@ void BeeApplication::addJob( QObject* obj )
 #endif
 }
 
+void BeeApplication::addNetworkJob( QObject* obj )
+{
+  obj->moveToThread( mp_networkThread );
+#ifdef BEEBEEP_DEBUG
+  qDebug() << qPrintable( obj->objectName() ) << "moved to network thread";
+#endif
+}
+
 #ifdef BEEBEEP_DEBUG
 void BeeApplication::removeJob( QObject* obj )
 #else
@@ -467,19 +478,48 @@ void BeeApplication::removeJob( QObject* )
 #endif
 }
 
-void BeeApplication::checkTicks( int ticks )
+void BeeApplication::scheduleIdleCheck()
+{
+  // Idle time is checked only if the user can go away automatically
+  if( m_idleTimeout <= 0 || m_isInSleepMode || m_idleCheckTimerId > 0 )
+    return;
+  m_idleCheckTimerId = TimerWheel::instance().schedule( Settings::instance().tickIntervalCheckIdle() * TICK_INTERVAL, this, "onIdleCheckTimeout" );
+}
+
+void BeeApplication::cancelIdleCheck()
 {
-  if( ticks > 31536000 )
+  if( m_idleCheckTimerId <= 0 )
+    return;
+  TimerWheel::instance().cancel( m_idleCheckTimerId );
+  m_idleCheckTimerId = 0;
+}
+
+void BeeApplication::onIdleCheckTimeout()
+{
+  m_idleCheckTimerId = 0;
+  checkIdle();
+  scheduleIdleCheck();
+}
+
+void BeeApplication::scheduleUptimeCheck()
+{
+  m_uptimeCheckTimerId = TimerWheel::instance().schedule( 86400000, this, "onUptimeCheckTimeout" ); // 1 day
+}
+
+void BeeApplication::onUptimeCheckTimeout()
+{
+  if( m_uptime.elapsed() > Q_INT64_C( 31536000000 ) )
   {
     // 1 year is passed ... it is time to close!
     qWarning() << "A year in uptime is passed. It is time to close and restart";
+    m_uptimeCheckTimerId = 0;
     QMetaObject::invokeMethod( this, "forceShutdown", Qt::QueuedConnection );
     return;
   }
-  else
-    emit tickEvent( ticks );
+  scheduleUptimeCheck();
 }
 
+
 #if !defined( Q_OS_WIN ) && !defined( Q_OS_MAC )
 void BeeApplication::addSleepWatcher()
 {}
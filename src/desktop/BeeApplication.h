@@ -25,7 +25,6 @@
 #define BEEBEEP_APPLICATION_H
 
 #include "Config.h"
-class TickManager;
 
 #ifdef Q_OS_LINUX
 struct xcb_connection_t;
@@ -54,6 +53,7 @@ public:
 
   void addJob( QObject* );
   void removeJob( QObject* );
+  void addNetworkJob( QObject* );
 
   void forceSleep();
   inline bool isInSleepMode() const;
@@ -74,7 +74,6 @@ signals:
   void enteringInIdle();
   void exitingFromIdle();
   void showUp();
-  void tickEvent( int );
   void shutdownRequest();
   void sleepRequest();
   void wakeUpRequest();
@@ -87,6 +86,9 @@ public slots:
   void resetPalette();
 
 protected:
+  void scheduleIdleCheck();
+  void cancelIdleCheck();
+  void scheduleUptimeCheck();
   bool notify( QObject* receiver, QEvent* event );
 
   int idleTimeFromSystem();
@@ -101,7 +103,8 @@ protected:
   void ignoreEvent( const QString& );
 
 protected slots:
-  void checkTicks( int );
+  void onIdleCheckTimeout();
+  void onUptimeCheckTimeout();
   void setIdle();
   void removeIdle();
   void slotConnectionEstablished();
@@ -121,6 +124,7 @@ private:
   QDateTime m_lastEventDateTime;
   bool m_isInIdle;
   QThread* mp_jobThread;
+  QThread* mp_networkThread;
   QLocalServer* mp_localServer;
   int m_jobsInProgress;
 
@@ -133,7 +137,9 @@ private:
   bool m_isInSleepMode;
   bool m_isDesktopLocked;
 
-  TickManager* mp_tickManager;
+  int m_idleCheckTimerId;
+  int m_uptimeCheckTimerId;
+  QElapsedTimer m_uptime;
 
 #ifdef Q_OS_WIN
   HWND m_mainWindowHandle;
@@ -76,6 +76,7 @@
 #include "Settings.h"
 #include "ShortcutManager.h"
 #include "SpellChecker.h"
+#include "TimerWheel.h"
 #include "UserManager.h"
 #ifdef BEEBEEP_USE_VOICE_CHAT
   #include "VoicePlayer.h"
@@ -118,6 +119,8 @@ GuiMain::GuiMain( QWidget *parent )
   m_userSelectOffline = false;
   m_prevActivatedState = true;
   m_coreIsConnecting = false;
+  m_blinkTicks = 0;
+  m_blinkTimerId = 0;
   m_changeTabToUserListOnFirstConnected = false;
 
   m_useFusionStyle = false;
@@ -2513,6 +2516,7 @@ void GuiMain::showAlertForMessage( const Chat& c, const ChatMessage& cm )
       msg = tr( "New message arrived" );
 
     mp_trayIcon->showNewMessageArrived( c.id(), msg, long_time_show );
+    scheduleBlinking();
   }
 }
 
@@ -2837,6 +2841,7 @@ bool GuiMain::askToDownloadFile( const User& u, const FileInfo& fi, const QStrin
         if( Settings::instance().raiseMainWindowOnNewMessageArrived() )
           raiseOnTop();
         mp_actViewNewMessage->setEnabled( true );
+        scheduleBlinking();
       }
       QString msg = tr( "Do you want to download %1 (%2) from %3?" ).arg( fi.name(), Bee::bytesToString( fi.size() ), Bee::userNameToShow( u, false ) );
       msg_result = QMessageBox::question( this, Settings::instance().programName(), msg, tr( "No" ), tr( "Yes" ), tr( "Yes, and don't ask anymore" ), 0, 0 );
@@ -3202,6 +3207,7 @@ void GuiMain::hideToTrayIcon()
     mp_trayIcon->setUnreadMessages( c.id(), c.unreadMessages() );
   else
     mp_trayIcon->setUnreadMessages( ID_INVALID, 0 );
+  scheduleBlinking();
   hide();
 }
 
@@ -4578,7 +4584,36 @@ void GuiMain::onNetworkInterfaceUp()
     QMetaObject::invokeMethod( this, "startCore", Qt::QueuedConnection );
 }
 
-void GuiMain::onTickEvent( int ticks )
+bool GuiMain::hasBlinkingItems() const
+{
+  if( mp_actViewNewMessage->isEnabled() || mp_trayIcon->iconStatusIsMessage() || beeCore->hasFileTransferInProgress() )
+    return true;
+  if( ChatManager::instance().firstChatWithUnreadMessages().isValid() )
+    return true;
+#ifdef BEEBEEP_USE_SHAREDESKTOP
+  // Viewers are closed when their images stop arriving
+  if( !m_desktops.isEmpty() || beeCore->shareDesktopIsActive( ID_INVALID ) )
+    return true;
+#endif
+  return false;
+}
+
+void GuiMain::scheduleBlinking()
+{
+  // Icons blink only while there is something to show: no timer runs when the application is quiet
+  if( m_blinkTimerId > 0 || beeApp->isInSleepMode() || !hasBlinkingItems() )
+    return;
+  m_blinkTimerId = TimerWheel::instance().schedule( TICK_INTERVAL, this, "onBlinkTimeout" );
+}
+
+void GuiMain::onBlinkTimeout()
+{
+  m_blinkTimerId = 0;
+  blinkItems( ++m_blinkTicks );
+  scheduleBlinking();
+}
+
+void GuiMain::blinkItems( int ticks )
 {
   int chat_tab_index = mp_tabMain->indexOf( mp_chatList );
   if( mp_actViewNewMessage->isEnabled() )
@@ -4596,8 +4631,6 @@ void GuiMain::onTickEvent( int ticks )
   mp_fileTransfer->onTickEvent( ticks );
   if( mp_fileSharing )
     mp_fileSharing->onTickEvent( ticks );
-  if( mp_networkTest )
-    mp_networkTest->onTickEvent( ticks );
 
   if( beeCore->hasFileTransferInProgress() )
     mp_actViewFileTransfer->setIcon( ticks % 2 == 0 ? IconManager::instance().icon( "file-transfer-progress.png" ) : IconManager::instance().icon( "file-transfer.png" ) );
@@ -4618,20 +4651,6 @@ void GuiMain::onTickEvent( int ticks )
   foreach( GuiShareDesktop* gsd, m_desktops )
     gsd->onTickEvent( ticks );
 #endif
-
-  if( beeApp->isInSleepMode() )
-    return;
-
-  if( !m_coreIsConnecting )
-  {
-    if( Bee::isTimeToCheck( ticks, Settings::instance().tickIntervalCheckIdle() ) )
-    {
-      if( beeApp->idleTimeout() > 0 )
-        QMetaObject::invokeMethod( beeApp, "checkIdle", Qt::QueuedConnection );
-    }
-
-    beeCore->onTickEvent( ticks );
-  }
 }
 
 void GuiMain::onChatReadByUser( const Chat& c, const User& u )
@@ -4679,6 +4698,7 @@ void GuiMain::updateNewMessageAction()
     mp_tabMain->setTabIcon( chat_tab_index, IconManager::instance().icon( "chat-list.png" ) );
     setWindowIcon( IconManager::instance().icon( "beebeep.png" )  );
   }
+  scheduleBlinking();
 }
 
 void GuiMain::saveGeometryAndState()
@@ -4791,6 +4811,7 @@ void GuiMain::onChangeSettingOnExistingFile( QAction* act )
 void GuiMain::onFileTransferProgress( VNumber peer_id, const User& u, const FileInfo& fi, FileSizeType bytes, qint64 elapsed_time )
 {
   mp_fileTransfer->setProgress( peer_id, u, fi, bytes, elapsed_time );
+  scheduleBlinking();
   if( Settings::instance().alwaysShowFileTransferProgress() )
   {
     if( !mp_dockFileTransfers->isVisible() )
@@ -4847,6 +4868,7 @@ void GuiMain::showBuzzFromUser( const User& u, VNumber chat_id )
     playBuzz();
 
   mp_trayIcon->showNewMessageArrived( chat_id, tr( "%1 is buzzing you!" ).arg( Bee::userNameToShow( u, false ) ), true );
+  scheduleBlinking();
 }
 
 void GuiMain::sendHelpMessage()
@@ -4871,6 +4893,7 @@ void GuiMain::showHelpRequestFromUser( const User& u, VNumber chat_id )
     playBuzz();
 
   mp_trayIcon->showNewMessageArrived( chat_id, tr( "%1 is asking for your help!" ).arg( Bee::userNameToShow( u, false ) ), true );
+  scheduleBlinking();
 }
 
 void GuiMain::showHelpAnswerFromUser( const User& u, VNumber chat_id )
@@ -4879,6 +4902,7 @@ void GuiMain::showHelpAnswerFromUser( const User& u, VNumber chat_id )
     playBuzz();
 
   mp_trayIcon->showNewMessageArrived( chat_id, tr( "%1 got your call for help." ).arg( Bee::userNameToShow( u, false ) ), true );
+  scheduleBlinking();
 }
 
 void GuiMain::showFileSharingWindow()
@@ -5279,6 +5303,7 @@ void GuiMain::onShareDesktopImageAvailable( const User& u, const QImage& img, co
   new_gui->updateImage( img, image_type, diff_color );
 
   m_desktops.append( new_gui );
+  scheduleBlinking();
 }
 
 void GuiMain::onShareDesktopCloseEvent( VNumber user_id )
@@ -5357,6 +5382,7 @@ void GuiMain::onShareDesktopUpdate( const User& u )
     if( fl_chat )
       fl_chat->guiChat()->updateActions( c, core_is_connected, connected_users, file_transfer_is_active );
   }
+  scheduleBlinking();
 }
 
 void GuiMain::sendScreenshotToChat( VNumber chat_id )
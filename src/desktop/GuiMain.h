@@ -76,7 +76,6 @@ public slots:
   void showMessage( const QString&, int );
   void showUp();
   void raiseOnTop();
-  void onTickEvent( int );
   void saveSession( QSessionManager& );
   void onWakeUpRequest();
   void onSleepRequest();
@@ -84,6 +83,7 @@ public slots:
   void loadStyle();
 
 private slots:
+  void onBlinkTimeout();
   void onCoreConnected();
   void onCoreDisconnected();
   void showAbout();
@@ -274,6 +274,9 @@ private:
   void updateShortcuts();
   void updateEmoticons();
   void updateNewMessageAction();
+  bool hasBlinkingItems() const;
+  void scheduleBlinking();
+  void blinkItems( int ticks );
   void updateTabTitles();
   QString tabToolTip( int );
   void showRestartConnectionAlertMessage();
@@ -398,6 +401,8 @@ private:
   bool m_prevActivatedState;
   int m_unreadActivities;
   bool m_coreIsConnecting;
+  int m_blinkTicks;
+  int m_blinkTimerId;
   bool m_changeTabToUserListOnFirstConnected;
 
 #ifdef BEEBEEP_USE_WEBENGINE
@@ -96,6 +96,7 @@ void GuiNetworkTest::startTest()
   m_connections.append( cs );
   addToReport( tr( "Connecting to %1" ).arg( na.toString() + QString( "..." ) ) );
   cs->connectToNetworkAddress( na );
+  cs->startTimers();
   QTimer::singleShot( 5000, this, SLOT( enableTestButton() ) );
 }
 
@@ -198,15 +199,6 @@ void GuiNetworkTest::closeEvent( QCloseEvent* e )
   QDialog::closeEvent( e );
 }
 
-void GuiNetworkTest::onTickEvent( int ticks )
-{
-  foreach( ConnectionSocket* cs, m_connections )
-  {
-    if( cs->isConnecting() || cs->isConnected() )
-      cs->onTickEvent( ticks );
-  }
-}
-
 void GuiNetworkTest::enableTestButton()
 {
   mp_pbTest->setEnabled( true );
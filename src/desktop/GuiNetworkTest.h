@@ -35,7 +35,6 @@ class GuiNetworkTest : public QDialog, private Ui::GuiNetworkTestDialog
 public:
   explicit GuiNetworkTest( QWidget *parent = Q_NULLPTR );
 
-  void onTickEvent( int );
   void updateSettings( const QString& file_transfer_port );
   void showUp();
 
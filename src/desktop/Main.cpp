@@ -25,9 +25,11 @@
 #include "AudioManager.h"
 #include "BeeApplication.h"
 #include "ChatManager.h"
+#include "CipherSessionCache.h"
 #include "RemoteControl.h"
 #include "ColorManager.h"
 #include "Core.h"
+#include "ECDHKeyPool.h"
 #include "EmoticonManager.h"
 #include "FileShare.h"
 #include "GuiConfig.h"
@@ -51,6 +53,7 @@
 #ifdef BEEBEEP_USE_HUNSPELL
   #include "SpellChecker.h"
 #endif
+#include "TimerWheel.h"
 
 
 bool SetTranslator( QTranslator* translator, QString language_folder, QString lang )
@@ -181,7 +184,8 @@ int main( int argc, char *argv[] )
   Settings::instance().setLocalUserHost( NetworkManager::instance().localHostAddress(), Settings::instance().localUser().networkAddress().hostPort() );
 
   /* Init Hive */
-  (void)Hive::instance();
+  if( Settings::instance().useHive() )
+    Hive::instance().load( Settings::instance().hiveFilePath() );
 
   /* Init Color Manager */
   (void)ColorManager::instance();
@@ -270,7 +274,6 @@ int main( int argc, char *argv[] )
   QObject::connect( &bee_app, SIGNAL( enteringInIdle() ), &mw, SLOT( setInIdle() ) );
   QObject::connect( &bee_app, SIGNAL( exitingFromIdle() ), &mw, SLOT( exitFromIdle() ) );
   QObject::connect( &bee_app, SIGNAL( showUp() ), &mw, SLOT( raiseOnTop() ) );
-  QObject::connect( &bee_app, SIGNAL( tickEvent( int ) ), &mw, SLOT( onTickEvent( int ) ) );
   QObject::connect( &bee_app, SIGNAL( commitDataRequest( QSessionManager& ) ), &mw, SLOT( saveSession( QSessionManager& ) ), Qt::DirectConnection );
   QObject::connect( &bee_app, SIGNAL( shutdownRequest() ), &mw, SLOT( forceShutdown() ), Qt::DirectConnection );
   QObject::connect( &bee_app, SIGNAL( sleepRequest() ), &mw, SLOT( onSleepRequest() ) );
@@ -294,6 +297,8 @@ int main( int argc, char *argv[] )
   Settings::instance().setFavoriteEmoticons( EmoticonManager::instance().saveFavoriteEmoticons() );
   Settings::instance().loadRcFile();
   Settings::instance().save();
+  if( Settings::instance().useHive() )
+    Hive::instance().save( Settings::instance().hiveFilePath() );
 
   /* CleanUp */
   bee_app.processEvents( QEventLoop::AllEvents, 2000 );
@@ -307,6 +312,8 @@ int main( int argc, char *argv[] )
   MessageManager::close();
   UserManager::close();
   Protocol::close();
+  ECDHKeyPool::close();
+  CipherSessionCache::close();
   PluginManager::close();
   Hive::close();
   NetworkManager::close();
@@ -321,6 +328,7 @@ int main( int argc, char *argv[] )
 #ifdef BEEBEEP_USE_HUNSPELL
   SpellChecker::close();
 #endif
+  TimerWheel::close();
   qDebug() << "Exit with code:" << iRet;
   Log::instance().closeFileStream();
   Log::instance().close();
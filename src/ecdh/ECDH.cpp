@@ -24,6 +24,20 @@
 #include "ECDH.h"
 #include "Random.h"
 
+#if !defined( BEEBEEP_DISABLE_PCLMUL )
+  #if defined( __GNUC__ ) && defined( __x86_64__ )
+    #define ECDH_USE_PCLMUL
+    #define ECDH_PCLMUL_TARGET __attribute__(( target( "pclmul,sse2" ) ))
+    #include <cpuid.h>
+    #include <wmmintrin.h>
+  #elif defined( _MSC_VER ) && defined( _M_X64 )
+    #define ECDH_USE_PCLMUL
+    #define ECDH_PCLMUL_TARGET
+    #include <intrin.h>
+    #include <wmmintrin.h>
+  #endif
+#endif
+
 /* margin for overhead needed in intermediate calculations */
 #define ECDH_BITVEC_MARGIN     3
 #define ECDH_BITVEC_NBITS      (ECDH_CURVE_DEGREE + ECDH_BITVEC_MARGIN)
@@ -61,8 +75,10 @@ typedef bitvec_t scalar_t;
  #if (ECDH_CURVE == ECDH_CURVE_NIST_K163)
   #define coeff_a  1
   #define cofactor 2
+  #define coeff_b_one 1
 /* NIST K-163 */
 const gf2elem_t polynomial = { 0x000000c9, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000008 };
+const int       polynomial_terms[] = { 7, 6, 3, 0 };
 const gf2elem_t coeff_b    = { 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 };
 const gf2elem_t base_x     = { 0x5c94eee8, 0xde4e6d5e, 0xaa07d793, 0x7bbc11ac, 0xfe13c053, 0x00000002 };
 const gf2elem_t base_y     = { 0xccdaa3d9, 0x0536d538, 0x321f2e80, 0x5d38ff58, 0x89070fb0, 0x00000002 };
@@ -72,8 +88,10 @@ const scalar_t  base_order = { 0x99f8a5ef, 0xa2e0cc0d, 0x00020108, 0x00000000, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_B163)
   #define coeff_a  1
   #define cofactor 2
+  #define coeff_b_one 0
 /* NIST B-163 */
 const gf2elem_t polynomial = { 0x000000c9, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000008 };
+const int       polynomial_terms[] = { 7, 6, 3, 0 };
 const gf2elem_t coeff_b    = { 0x4a3205fd, 0x512f7874, 0x1481eb10, 0xb8c953ca, 0x0a601907, 0x00000002 };
 const gf2elem_t base_x     = { 0xe8343e36, 0xd4994637, 0xa0991168, 0x86a2d57e, 0xf0eba162, 0x00000003 };
 const gf2elem_t base_y     = { 0x797324f1, 0xb11c5c0c, 0xa2cdd545, 0x71a0094f, 0xd51fbc6c, 0x00000000 };
@@ -83,8 +101,10 @@ const scalar_t  base_order = { 0xa4234c33, 0x77e70c12, 0x000292fe, 0x00000000, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_K233)
   #define coeff_a  0
   #define cofactor 4
+  #define coeff_b_one 1
 /* NIST K-233 */
 const gf2elem_t polynomial = { 0x00000001, 0x00000000, 0x00000400, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000200 };
+const int       polynomial_terms[] = { 74, 0 };
 const gf2elem_t coeff_b    = { 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 };
 const gf2elem_t base_x     = { 0xefad6126, 0x0a4c9d6e, 0x19c26bf5, 0x149563a4, 0x29f22ff4, 0x7e731af1, 0x32ba853a, 0x00000172 };
 const gf2elem_t base_y     = { 0x56fae6a3, 0x56e0c110, 0xf18aeb9b, 0x27a8cd9b, 0x555a67c4, 0x19b7f70f, 0x537dece8, 0x000001db };
@@ -94,8 +114,10 @@ const scalar_t  base_order = { 0xf173abdf, 0x6efb1ad5, 0xb915bcd4, 0x00069d5b, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_B233)
   #define coeff_a  1
   #define cofactor 2
+  #define coeff_b_one 0
 /* NIST B-233 */
 const gf2elem_t polynomial = { 0x00000001, 0x00000000, 0x00000400, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000200 };
+const int       polynomial_terms[] = { 74, 0 };
 const gf2elem_t coeff_b    = { 0x7d8f90ad, 0x81fe115f, 0x20e9ce42, 0x213b333b, 0x0923bb58, 0x332c7f8c, 0x647ede6c, 0x00000066 };
 const gf2elem_t base_x     = { 0x71fd558b, 0xf8f8eb73, 0x391f8b36, 0x5fef65bc, 0x39f1bb75, 0x8313bb21, 0xc9dfcbac, 0x000000fa };
 const gf2elem_t base_y     = { 0x01f81052, 0x36716f7e, 0xf867a7ca, 0xbf8a0bef, 0xe58528be, 0x03350678, 0x6a08a419, 0x00000100 };
@@ -105,8 +127,10 @@ const scalar_t  base_order = { 0x03cfe0d7, 0x22031d26, 0xe72f8a69, 0x0013e974, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_K283)
   #define coeff_a  0
   #define cofactor 4
+  #define coeff_b_one 1
 /* NIST K-283 */
 const gf2elem_t polynomial = { 0x000010a1, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x08000000 };
+const int       polynomial_terms[] = { 12, 7, 5, 0 };
 const gf2elem_t coeff_b    = { 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 };
 const gf2elem_t base_x     = { 0x58492836, 0xb0c2ac24, 0x16876913, 0x23c1567a, 0x53cd265f, 0x62f188e5, 0x3f1a3b81, 0x78ca4488, 0x0503213f };
 const gf2elem_t base_y     = { 0x77dd2259, 0x4e341161, 0xe4596236, 0xe8184698, 0xe87e45c0, 0x07e5426f, 0x8d90f95d, 0x0f1c9e31, 0x01ccda38 };
@@ -116,8 +140,10 @@ const scalar_t  base_order = { 0x1e163c61, 0x94451e06, 0x265dff7f, 0x2ed07577, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_B283)
   #define coeff_a  1
   #define cofactor 2
+  #define coeff_b_one 0
 /* NIST B-283 */
 const gf2elem_t polynomial = { 0x000010a1, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x08000000 };
+const int       polynomial_terms[] = { 12, 7, 5, 0 };
 const gf2elem_t coeff_b    = { 0x3b79a2f5, 0xf6263e31, 0xa581485a, 0x45309fa2, 0xca97fd76, 0x19a0303f, 0xa5a4af8a, 0xc8b8596d, 0x027b680a };
 const gf2elem_t base_x     = { 0x86b12053, 0xf8cdbecd, 0x80e2e198, 0x557eac9c, 0x2eed25b8, 0x70b0dfec, 0xe1934f8c, 0x8db7dd90, 0x05f93925 };
 const gf2elem_t base_y     = { 0xbe8112f4, 0x13f0df45, 0x826779c8, 0x350eddb0, 0x516ff702, 0xb20d02b4, 0xb98fe6d4, 0xfe24141c, 0x03676854 };
@@ -127,8 +153,10 @@ const scalar_t  base_order = { 0xefadb307, 0x5b042a7c, 0x938a9016, 0x399660fc, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_K409)
   #define coeff_a  0
   #define cofactor 4
+  #define coeff_b_one 1
 /* NIST K-409 */
 const gf2elem_t polynomial = { 0x00000001, 0x00000000, 0x00800000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x02000000 };
+const int       polynomial_terms[] = { 87, 0 };
 const gf2elem_t coeff_b    = { 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 };
 const gf2elem_t base_x     = { 0xe9023746, 0xb35540cf, 0xee222eb1, 0xb5aaaa62, 0xc460189e, 0xf9f67cc2, 0x27accfb8, 0xe307c84c, 0x0efd0987, 0x0f718421, 0xad3ab189, 0x658f49c1, 0x0060f05f };
 const gf2elem_t base_y     = { 0xd8e0286b, 0x5863ec48, 0xaa9ca27a, 0xe9c55215, 0xda5f6c42, 0xe9ea10e3, 0xe6325165, 0x918ea427, 0x3460782f, 0xbf04299c, 0xacba1dac, 0x0b7c4e42, 0x01e36905 };
@@ -138,8 +166,10 @@ const scalar_t  base_order = { 0xe01e5fcf, 0x4b5c83b8, 0xe3e7ca5b, 0x557d5ed3, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_B409)
   #define coeff_a  1
   #define cofactor 2
+  #define coeff_b_one 0
 /* NIST B-409 */
 const gf2elem_t polynomial = { 0x00000001, 0x00000000, 0x00800000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x02000000 };
+const int       polynomial_terms[] = { 87, 0 };
 const gf2elem_t coeff_b    = { 0x7b13545f, 0x4f50ae31, 0xd57a55aa, 0x72822f6c, 0xa9a197b2, 0xd6ac27c8, 0x4761fa99, 0xf1f3dd67, 0x7fd6422e, 0x3b7b476b, 0x5c4b9a75, 0xc8ee9feb, 0x0021a5c2 };
 const gf2elem_t base_x     = { 0xbb7996a7, 0x60794e54, 0x5603aeab, 0x8a118051, 0xdc255a86, 0x34e59703, 0xb01ffe5b, 0xf1771d4d, 0x441cde4a, 0x64756260, 0x496b0c60, 0xd088ddb3, 0x015d4860 };
 const gf2elem_t base_y     = { 0x0273c706, 0x81c364ba, 0xd2181b36, 0xdf4b4f40, 0x38514f1f, 0x5488d08f, 0x0158aa4f, 0xa7bd198d, 0x7636b9c5, 0x24ed106a, 0x2bbfa783, 0xab6be5f3, 0x0061b1cf };
@@ -149,8 +179,10 @@ const scalar_t  base_order = { 0xd9a21173, 0x8164cd37, 0x9e052f83, 0x5fa47c3c, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_K571)
   #define coeff_a  0
   #define cofactor 4
+  #define coeff_b_one 1
 /* NIST K-571 */
 const gf2elem_t polynomial = { 0x00000425, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x08000000 };
+const int       polynomial_terms[] = { 10, 5, 2, 0 };
 const gf2elem_t coeff_b    = { 0x00000001, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000 };
 const gf2elem_t base_x     = { 0xa01c8972, 0xe2945283, 0x4dca88c7, 0x988b4717, 0x494776fb, 0xbbd1ba39, 0xb4ceb08c, 0x47da304d, 0x93b205e6, 0x43709584, 0x01841ca4, 0x60248048, 0x0012d5d4, 0xac9ca297, 0xf8103fe4, 0x82189631, 0x59923fbc, 0x026eb7a8 };
 const gf2elem_t base_y     = { 0x3ef1c7a3, 0x01cd4c14, 0x591984f6, 0x320430c8, 0x7ba7af1b, 0xb620b01a, 0xf772aedc, 0x4fbebbb9, 0xac44aea7, 0x9d4979c0, 0x006d8a2c, 0xffc61efc, 0x9f307a54, 0x4dd58cec, 0x3bca9531, 0x4f4aeade, 0x7f4fbf37, 0x0349dc80 };
@@ -160,8 +192,10 @@ const scalar_t  base_order = { 0x637c1001, 0x5cfe778f, 0x1e91deb4, 0xe5d63938, 0
  #if (ECDH_CURVE == ECDH_CURVE_NIST_B571)
   #define coeff_a  1
   #define cofactor 2
+  #define coeff_b_one 0
 /* NIST B-571 */
 const gf2elem_t polynomial = { 0x00000425, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x00000000, 0x08000000 };
+const int       polynomial_terms[] = { 10, 5, 2, 0 };
 const gf2elem_t coeff_b    = { 0x2955727a, 0x7ffeff7f, 0x39baca0c, 0x520e4de7, 0x78ff12aa, 0x4afd185a, 0x56a66e29, 0x2be7ad67, 0x8efa5933, 0x84ffabbd, 0x4a9a18ad, 0xcd6ba8ce, 0xcb8ceff1, 0x5c6a97ff, 0xb7f3d62f, 0xde297117, 0x2221f295, 0x02f40e7e };
 const gf2elem_t base_x     = { 0x8eec2d19, 0xe1e7769c, 0xc850d927, 0x4abfa3b4, 0x8614f139, 0x99ae6003, 0x5b67fb14, 0xcdd711a3, 0xf4c0d293, 0xbde53950, 0xdb7b2abd, 0xa5f40fc8, 0x955fa80a, 0x0a93d1d2, 0x0d3cd775, 0x6c16c0d4, 0x34b85629, 0x0303001d };
 const gf2elem_t base_y     = { 0x1b8ac15b, 0x1a4827af, 0x6e23dd3c, 0x16e2f151, 0x0485c19b, 0xb3531d2f, 0x461bb2a8, 0x6291af8f, 0xbab08a57, 0x84423e43, 0x3921e8a6, 0x1980f853, 0x009cbbca, 0x8c6c27a6, 0xb73d69d7, 0x6dccfffe, 0x42da639b, 0x037bf273 };
@@ -193,14 +227,6 @@ static void bitvec_copy(bitvec_t x, const bitvec_t y)
   }
 }
 
-static void bitvec_swap(bitvec_t x, bitvec_t y)
-{
-  bitvec_t tmp;
-  bitvec_copy(tmp, x);
-  bitvec_copy(x, y);
-  bitvec_copy(y, tmp);
-}
-
 #if defined(CONST_TIME) && (CONST_TIME == 0)
 /* fast version of equality test */
 static int bitvec_equal(const bitvec_t x, const bitvec_t y)
@@ -294,41 +320,6 @@ static int bitvec_degree(const bitvec_t x)
   return i;
 }
 
-/* left-shift by 'count' digits */
-static void bitvec_lshift(bitvec_t x, const bitvec_t y, int nbits)
-{
-  int nwords = (nbits / 32);
-
-  /* Shift whole words first if nwords > 0 */
-  int i,j;
-  for (i = 0; i < nwords; ++i)
-  {
-    /* Zero-initialize from least-significant word until offset reached */
-    x[i] = 0;
-  }
-  j = 0;
-  /* Copy to x output */
-  while (i < ECDH_BITVEC_NWORDS)
-  {
-    x[i] = y[j];
-    i += 1;
-    j += 1;
-  }
-
-  /* Shift the rest if count was not multiple of bitsize of DTYPE */
-  nbits &= 31;
-  if (nbits != 0)
-  {
-    /* Left shift rest */
-    int i;
-    for (i = (ECDH_BITVEC_NWORDS - 1); i > 0; --i)
-    {
-      x[i]  = (x[i] << nbits) | (x[i - 1] >> (32 - nbits));
-    }
-    x[0] <<= nbits;
-  }
-}
-
 
 /*************************************************************************************************/
 /*
@@ -349,46 +340,6 @@ static void gf2field_set_one(gf2elem_t x)
   }
 }
 
-#if defined(CONST_TIME) && (CONST_TIME == 0)
-/* fastest check if x == 1 */
-static int gf2field_is_one(const gf2elem_t x)
-{
-  /* Check if first word == 1 */
-  if (x[0] != 1)
-  {
-    return 0;
-  }
-  /* ...and if rest of words == 0 */
-  int i;
-  for (i = 1; i < ECDH_BITVEC_NWORDS; ++i)
-  {
-    if (x[i] != 0)
-    {
-      break;
-    }
-  }
-  return (i == ECDH_BITVEC_NWORDS);
-}
-#else
-/* constant-time check */
-static int gf2field_is_one(const gf2elem_t x)
-{
-  int ret = 0;
-  /* Check if first word == 1 */
-  if (x[0] == 1)
-  {
-    ret = 1;
-  }
-  /* ...and if rest of words == 0 */
-  int i;
-  for (i = 1; i < ECDH_BITVEC_NWORDS; ++i)
-  {
-    ret &= (x[i] == 0);
-  }
-  return ret; //(i == ECDH_BITVEC_NWORDS);
-}
-#endif
-
 
 /* galois field(2^m) addition is modulo 2, so XOR is used instead - 'z := a + b' */
 static void gf2field_add(gf2elem_t z, const gf2elem_t x, const gf2elem_t y)
@@ -408,93 +359,274 @@ static void gf2field_inc(gf2elem_t x)
 }
 #endif
 
-/* field multiplication 'z := (x * y)' */
-static void gf2field_mul(gf2elem_t z, const gf2elem_t x, const gf2elem_t y)
+/* double-length product of two field elements, before the modular reduction */
+#define ECDH_PRODUCT_NWORDS    (2 * ECDH_BITVEC_NWORDS)
+
+/* 'x^2' of a byte: bits are interleaved with zeros */
+static const quint16 gf2_square_table[ 256 ] = {
+  0x0000, 0x0001, 0x0004, 0x0005, 0x0010, 0x0011, 0x0014, 0x0015,
+  0x0040, 0x0041, 0x0044, 0x0045, 0x0050, 0x0051, 0x0054, 0x0055,
+  0x0100, 0x0101, 0x0104, 0x0105, 0x0110, 0x0111, 0x0114, 0x0115,
+  0x0140, 0x0141, 0x0144, 0x0145, 0x0150, 0x0151, 0x0154, 0x0155,
+  0x0400, 0x0401, 0x0404, 0x0405, 0x0410, 0x0411, 0x0414, 0x0415,
+  0x0440, 0x0441, 0x0444, 0x0445, 0x0450, 0x0451, 0x0454, 0x0455,
+  0x0500, 0x0501, 0x0504, 0x0505, 0x0510, 0x0511, 0x0514, 0x0515,
+  0x0540, 0x0541, 0x0544, 0x0545, 0x0550, 0x0551, 0x0554, 0x0555,
+  0x1000, 0x1001, 0x1004, 0x1005, 0x1010, 0x1011, 0x1014, 0x1015,
+  0x1040, 0x1041, 0x1044, 0x1045, 0x1050, 0x1051, 0x1054, 0x1055,
+  0x1100, 0x1101, 0x1104, 0x1105, 0x1110, 0x1111, 0x1114, 0x1115,
+  0x1140, 0x1141, 0x1144, 0x1145, 0x1150, 0x1151, 0x1154, 0x1155,
+  0x1400, 0x1401, 0x1404, 0x1405, 0x1410, 0x1411, 0x1414, 0x1415,
+  0x1440, 0x1441, 0x1444, 0x1445, 0x1450, 0x1451, 0x1454, 0x1455,
+  0x1500, 0x1501, 0x1504, 0x1505, 0x1510, 0x1511, 0x1514, 0x1515,
+  0x1540, 0x1541, 0x1544, 0x1545, 0x1550, 0x1551, 0x1554, 0x1555,
+  0x4000, 0x4001, 0x4004, 0x4005, 0x4010, 0x4011, 0x4014, 0x4015,
+  0x4040, 0x4041, 0x4044, 0x4045, 0x4050, 0x4051, 0x4054, 0x4055,
+  0x4100, 0x4101, 0x4104, 0x4105, 0x4110, 0x4111, 0x4114, 0x4115,
+  0x4140, 0x4141, 0x4144, 0x4145, 0x4150, 0x4151, 0x4154, 0x4155,
+  0x4400, 0x4401, 0x4404, 0x4405, 0x4410, 0x4411, 0x4414, 0x4415,
+  0x4440, 0x4441, 0x4444, 0x4445, 0x4450, 0x4451, 0x4454, 0x4455,
+  0x4500, 0x4501, 0x4504, 0x4505, 0x4510, 0x4511, 0x4514, 0x4515,
+  0x4540, 0x4541, 0x4544, 0x4545, 0x4550, 0x4551, 0x4554, 0x4555,
+  0x5000, 0x5001, 0x5004, 0x5005, 0x5010, 0x5011, 0x5014, 0x5015,
+  0x5040, 0x5041, 0x5044, 0x5045, 0x5050, 0x5051, 0x5054, 0x5055,
+  0x5100, 0x5101, 0x5104, 0x5105, 0x5110, 0x5111, 0x5114, 0x5115,
+  0x5140, 0x5141, 0x5144, 0x5145, 0x5150, 0x5151, 0x5154, 0x5155,
+  0x5400, 0x5401, 0x5404, 0x5405, 0x5410, 0x5411, 0x5414, 0x5415,
+  0x5440, 0x5441, 0x5444, 0x5445, 0x5450, 0x5451, 0x5454, 0x5455,
+  0x5500, 0x5501, 0x5504, 0x5505, 0x5510, 0x5511, 0x5514, 0x5515,
+  0x5540, 0x5541, 0x5544, 0x5545, 0x5550, 0x5551, 0x5554, 0x5555
+};
+
+/* modular reduction 'z := c mod polynomial': the words over the degree are folded using x^m = r(x)
+   where r(x) are the polynomial terms below the degree (all of them are far enough from the degree) */
+static void gf2field_reduce(gf2elem_t z, quint32* c)
 {
-  int i;
-  gf2elem_t tmp;
-#if defined(CONST_TIME) && (CONST_TIME == 1)
-  gf2elem_t blind;
-  bitvec_set_zero(blind);
-#endif
+  const int nterms = static_cast<int>(sizeof(polynomial_terms) / sizeof(polynomial_terms[0]));
+  const int top_word = ECDH_CURVE_DEGREE / 32;
+  const int top_bits = ECDH_CURVE_DEGREE % 32;
+  int i, j;
 
-  bitvec_copy(tmp, x);
+  for (i = (ECDH_PRODUCT_NWORDS - 1); i >= (top_bits != 0 ? top_word + 1 : top_word); --i)
+  {
+    quint32 t = c[i];
+    c[i] = 0;
+    for (j = 0; j < nterms; ++j)
+    {
+      int pos = (32 * i) - ECDH_CURVE_DEGREE + polynomial_terms[j];
+      int bit = (pos & 31);
+      c[pos / 32] ^= (t << bit);
+      if (bit != 0)
+      {
+        c[(pos / 32) + 1] ^= (t >> (32 - bit));
+      }
+    }
+  }
 
-  /* LSB set? Then start with x */
-  if (bitvec_get_bit(y, 0) != 0)
+  if (top_bits != 0)
   {
-    bitvec_copy(z, x);
+    quint32 t = (c[top_word] >> top_bits);
+    c[top_word] &= (((quint32)1 << top_bits) - 1);
+    for (j = 0; j < nterms; ++j)
+    {
+      int pos = polynomial_terms[j];
+      int bit = (pos & 31);
+      c[pos / 32] ^= (t << bit);
+      if (bit != 0)
+      {
+        c[(pos / 32) + 1] ^= (t >> (32 - bit));
+      }
+    }
   }
-  else /* .. or else start with zero */
+
+  for (i = 0; i < ECDH_BITVEC_NWORDS; ++i)
+  {
+    z[i] = c[i];
+  }
+}
+
+/* field multiplication 'z := (x * y)' with the left-to-right comb method (window of 4 bits) */
+static void gf2field_mul_comb(gf2elem_t z, const gf2elem_t x, const gf2elem_t y)
+{
+  quint32 table[16][ECDH_BITVEC_NWORDS + 1];
+  quint32 c[ECDH_PRODUCT_NWORDS];
+  int i, j, k;
+
+  /* table[u] := u(x) * y for all the polynomials u(x) of degree < 4 */
+  for (i = 0; i < ECDH_BITVEC_NWORDS; ++i)
   {
-    bitvec_set_zero(z);
+    table[0][i] = 0;
+    table[1][i] = y[i];
+  }
+  table[0][ECDH_BITVEC_NWORDS] = 0;
+  table[1][ECDH_BITVEC_NWORDS] = 0;
+  for (k = 2; k < 16; k += 2)
+  {
+    quint32 carry = 0;
+    for (i = 0; i <= ECDH_BITVEC_NWORDS; ++i)
+    {
+      table[k][i] = (table[k / 2][i] << 1) | carry;
+      carry = (table[k / 2][i] >> 31);
+      table[k + 1][i] = table[k][i] ^ table[1][i];
+    }
   }
 
-  /* Then add 2^i * x for the rest */
-  for (i = 1; i < ECDH_CURVE_DEGREE; ++i)
+  for (i = 0; i < ECDH_PRODUCT_NWORDS; ++i)
   {
-    /* lshift 1 - doubling the value of tmp */
-    bitvec_lshift(tmp, tmp, 1);
+    c[i] = 0;
+  }
 
-    /* Modulo reduction polynomial if degree(tmp) > ECDH_CURVE_DEGREE */
-    if (bitvec_get_bit(tmp, ECDH_CURVE_DEGREE))
+  for (k = 28; k >= 0; k -= 4)
+  {
+    for (j = 0; j < ECDH_BITVEC_NWORDS; ++j)
     {
-      gf2field_add(tmp, tmp, polynomial);
+      const quint32* u = table[(x[j] >> k) & 15];
+      for (i = 0; i <= ECDH_BITVEC_NWORDS; ++i)
+      {
+        c[i + j] ^= u[i];
+      }
     }
-#if defined(CONST_TIME) && (CONST_TIME == 1)
-    else /* blinding operation */
+    if (k != 0)
     {
-      gf2field_add(tmp, tmp, blind);
+      for (i = (ECDH_PRODUCT_NWORDS - 1); i > 0; --i)
+      {
+        c[i] = (c[i] << 4) | (c[i - 1] >> 28);
+      }
+      c[0] <<= 4;
     }
+  }
+
+  gf2field_reduce(z, c);
+}
+
+#ifdef ECDH_USE_PCLMUL
+#define ECDH_PCLMUL_NLIMBS     ((ECDH_BITVEC_NWORDS + 1) / 2)
+
+static bool cpuHasCarrylessMultiply()
+{
+#if defined( _MSC_VER )
+  int cpu_info[ 4 ];
+  __cpuid( cpu_info, 1 );
+  return (cpu_info[ 2 ] & (1 << 1)) != 0;
+#else
+  unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+  if( !__get_cpuid( 1, &eax, &ebx, &ecx, &edx ) )
+    return false;
+  return (ecx & (1 << 1)) != 0;
 #endif
+}
+
+static const bool CPU_HAS_CARRYLESS_MULTIPLY = cpuHasCarrylessMultiply();
 
-    /* Add 2^i * tmp if this factor in y is non-zero */
-    if (bitvec_get_bit(y, i))
+/* field multiplication 'z := (x * y)' with the carry-less multiply instruction on 64 bit limbs */
+static ECDH_PCLMUL_TARGET void gf2field_mul_clmul(gf2elem_t z, const gf2elem_t x, const gf2elem_t y)
+{
+  __m128i a[ECDH_PCLMUL_NLIMBS];
+  __m128i b[ECDH_PCLMUL_NLIMBS];
+  quint64 c64[2 * ECDH_PCLMUL_NLIMBS];
+  quint32 c[4 * ECDH_PCLMUL_NLIMBS];
+  int i, j;
+
+  for (i = 0; i < ECDH_PCLMUL_NLIMBS; ++i)
+  {
+    quint64 xi = x[2 * i];
+    quint64 yi = y[2 * i];
+    if (((2 * i) + 1) < ECDH_BITVEC_NWORDS)
     {
-      gf2field_add(z, z, tmp);
+      xi |= ((quint64)x[(2 * i) + 1] << 32);
+      yi |= ((quint64)y[(2 * i) + 1] << 32);
     }
-#if defined(CONST_TIME) && (CONST_TIME == 1)
-    else /* blinding operation */
+    a[i] = _mm_cvtsi64_si128((long long)xi);
+    b[i] = _mm_cvtsi64_si128((long long)yi);
+    c64[2 * i] = 0;
+    c64[(2 * i) + 1] = 0;
+  }
+
+  for (i = 0; i < ECDH_PCLMUL_NLIMBS; ++i)
+  {
+    for (j = 0; j < ECDH_PCLMUL_NLIMBS; ++j)
     {
-      gf2field_add(z, z, blind);
+      __m128i t = _mm_clmulepi64_si128(a[i], b[j], 0x00);
+      c64[i + j] ^= (quint64)_mm_cvtsi128_si64(t);
+      c64[i + j + 1] ^= (quint64)_mm_cvtsi128_si64(_mm_unpackhi_epi64(t, t));
     }
+  }
+
+  for (i = 0; i < (2 * ECDH_PCLMUL_NLIMBS); ++i)
+  {
+    c[2 * i] = (quint32)c64[i];
+    c[(2 * i) + 1] = (quint32)(c64[i] >> 32);
+  }
+
+  gf2field_reduce(z, c);
+}
 #endif
+
+/* field multiplication 'z := (x * y)' */
+static void gf2field_mul(gf2elem_t z, const gf2elem_t x, const gf2elem_t y)
+{
+#ifdef ECDH_USE_PCLMUL
+  if (CPU_HAS_CARRYLESS_MULTIPLY)
+  {
+    gf2field_mul_clmul(z, x, y);
+    return;
   }
+#endif
+  gf2field_mul_comb(z, x, y);
 }
 
-/* field inversion 'z := 1/x' */
-static void gf2field_inv(gf2elem_t z, const gf2elem_t x)
+/* field squaring 'z := x^2' (squaring is linear in GF(2^m): it only spreads the bits) */
+static void gf2field_sqr(gf2elem_t z, const gf2elem_t x)
 {
-  gf2elem_t u, v, g, h;
+  quint32 c[ECDH_PRODUCT_NWORDS];
   int i;
 
-  bitvec_copy(u, x);
-  bitvec_copy(v, polynomial);
-  bitvec_set_zero(g);
-  gf2field_set_one(z);
+  for (i = 0; i < ECDH_BITVEC_NWORDS; ++i)
+  {
+    c[2 * i]       = (quint32)gf2_square_table[x[i] & 0xff] | ((quint32)gf2_square_table[(x[i] >> 8) & 0xff] << 16);
+    c[(2 * i) + 1] = (quint32)gf2_square_table[(x[i] >> 16) & 0xff] | ((quint32)gf2_square_table[x[i] >> 24] << 16);
+  }
+
+  gf2field_reduce(z, c);
+}
 
-  while (!gf2field_is_one(u))
+/* field inversion 'z := 1/x' with the Itoh-Tsujii method: 1/x = x^(2^m - 2) = (x^(2^(m-1) - 1))^2
+   where x^(2^k - 1) is built with an addition chain on the bits of (m - 1) */
+static void gf2field_inv(gf2elem_t z, const gf2elem_t x)
+{
+  gf2elem_t r, t;
+  int nbits = 0;
+  int k = 1;
+  int i, j;
+
+  while (((ECDH_CURVE_DEGREE - 1) >> nbits) > 1)
   {
-    i = (bitvec_degree(u) - bitvec_degree(v));
+    nbits += 1;
+  }
 
-    if (i < 0)
+  bitvec_copy(r, x);
+
+  for (i = (nbits - 1); i >= 0; --i)
+  {
+    /* r := x^(2^(2k) - 1) */
+    bitvec_copy(t, r);
+    for (j = 0; j < k; ++j)
     {
-      bitvec_swap(u, v);
-      bitvec_swap(g, z);
-      i = -i;
+      gf2field_sqr(t, t);
     }
-#if defined(CONST_TIME) && (CONST_TIME == 1)
-    else
+    gf2field_mul(r, t, r);
+    k *= 2;
+
+    /* r := x^(2^(k+1) - 1) */
+    if (((ECDH_CURVE_DEGREE - 1) >> i) & 1)
     {
-      bitvec_swap(u, v);
-      bitvec_swap(v, u);
+      gf2field_sqr(r, r);
+      gf2field_mul(r, r, x);
+      k += 1;
     }
-#endif
-    bitvec_lshift(h, v, i);
-    gf2field_add(u, u, h);
-    bitvec_lshift(h, g, i);
-    gf2field_add(z, z, h);
   }
+
+  gf2field_sqr(z, r);
 }
 
 /*************************************************************************************************/
@@ -550,6 +682,10 @@ static void gf2point_double(gf2elem_t x, gf2elem_t y)
     gf2field_add(x, x, l);
     gf2field_mul(l, l, x);
     gf2field_add(y, y, l);
+#if (coeff_a == 0)
+    /* y3 = x1^2 + (l + 1) * x3: with a == 1 the increment of l is already done */
+    gf2field_add(y, y, x);
+#endif
   }
 }
 
@@ -603,25 +739,295 @@ static void gf2point_add(gf2elem_t x1, gf2elem_t y1, const gf2elem_t x2, const g
 
 
 
+/*
+   Lopez-Dahab projective coordinates: (X:Y:Z) is the affine point (X/Z, Y/Z^2) and Z == 0 is the point at infinity.
+   Doubling and addition with an affine point need no field inversion: only one is needed at the end
+   to convert the result back to affine coordinates.
+*/
+
+static void gf2point_ld_set_zero(gf2elem_t X, gf2elem_t Y, gf2elem_t Z)
+{
+  gf2field_set_one(X);
+  bitvec_set_zero(Y);
+  bitvec_set_zero(Z);
+}
+
+/* double the point (X:Y:Z) */
+static void gf2point_ld_double(gf2elem_t X, gf2elem_t Y, gf2elem_t Z)
+{
+  if (!bitvec_is_zero(Z))
+  {
+    gf2elem_t t1, t2;
+
+    gf2field_sqr(t1, Z);
+    gf2field_sqr(t2, X);
+    gf2field_mul(Z, t1, t2);
+    gf2field_sqr(X, t2);
+    gf2field_sqr(t1, t1);
+#if defined(coeff_b_one) && (coeff_b_one == 1)
+    bitvec_copy(t2, t1);
+#else
+    gf2field_mul(t2, t1, coeff_b);
+#endif
+    gf2field_add(X, X, t2);
+    gf2field_sqr(t1, Y);
+#if (coeff_a == 1)
+    gf2field_add(t1, t1, Z);
+#endif
+    gf2field_add(t1, t1, t2);
+    gf2field_mul(Y, X, t1);
+    gf2field_mul(t1, t2, Z);
+    gf2field_add(Y, Y, t1);
+  }
+}
+
+/* add the affine point (x2, y2) to the point (X:Y:Z) */
+static void gf2point_ld_add_affine(gf2elem_t X, gf2elem_t Y, gf2elem_t Z, const gf2elem_t x2, const gf2elem_t y2)
+{
+  if (gf2point_is_zero(x2, y2))
+  {
+    return;
+  }
+
+  if (bitvec_is_zero(Z))
+  {
+    gf2point_copy(X, Y, x2, y2);
+    gf2field_set_one(Z);
+    return;
+  }
+
+  gf2elem_t t1, t2, t3;
+
+  gf2field_mul(t1, Z, x2);
+  gf2field_sqr(t2, Z);
+  gf2field_add(X, X, t1);
+  gf2field_mul(t1, Z, X);
+  gf2field_mul(t3, t2, y2);
+  gf2field_add(Y, Y, t3);
+
+  if (bitvec_is_zero(X))
+  {
+    if (bitvec_is_zero(Y))
+    {
+      /* same point: double it */
+      gf2point_copy(X, Y, x2, y2);
+      gf2field_set_one(Z);
+      gf2point_ld_double(X, Y, Z);
+    }
+    else
+    {
+      /* opposite point */
+      gf2point_ld_set_zero(X, Y, Z);
+    }
+    return;
+  }
+
+  gf2field_sqr(Z, t1);
+  gf2field_mul(t3, t1, Y);
+#if (coeff_a == 1)
+  gf2field_add(t1, t1, t2);
+#endif
+  gf2field_sqr(t2, X);
+  gf2field_mul(X, t2, t1);
+  gf2field_sqr(t2, Y);
+  gf2field_add(X, X, t2);
+  gf2field_add(X, X, t3);
+  gf2field_mul(t2, x2, Z);
+  gf2field_add(t2, t2, X);
+  gf2field_sqr(t1, Z);
+  gf2field_add(t3, t3, Z);
+  gf2field_mul(Y, t3, t2);
+  gf2field_add(t2, x2, y2);
+  gf2field_mul(t3, t1, t2);
+  gf2field_add(Y, Y, t3);
+}
+
+/* convert (X:Y:Z) to the affine point (x, y) */
+static void gf2point_ld_to_affine(gf2elem_t x, gf2elem_t y, const gf2elem_t X, const gf2elem_t Y, const gf2elem_t Z)
+{
+  if (bitvec_is_zero(Z))
+  {
+    gf2point_set_zero(x, y);
+  }
+  else
+  {
+    gf2elem_t z_inv, t;
+
+    gf2field_inv(z_inv, Z);
+    gf2field_mul(x, X, z_inv);
+    gf2field_sqr(t, z_inv);
+    gf2field_mul(y, Y, t);
+  }
+}
+
+
 #if defined(CONST_TIME) && (CONST_TIME == 0)
-/* point multiplication via double-and-add algorithm */
+/* width of the window used in the non-adjacent form of the scalar */
+#define ECDH_WNAF_WIDTH        4
+#define ECDH_WNAF_NPOINTS      (1 << (ECDH_WNAF_WIDTH - 2))
+#define ECDH_WNAF_MAXLEN       ((ECDH_BITVEC_NWORDS * 32) + 1)
+
+/* width-w non-adjacent form of the scalar: digits are zero or odd and |digit| < 2^(w-1) */
+static int scalar_wnaf(signed char* naf, const scalar_t exp)
+{
+  quint32 k[ECDH_BITVEC_NWORDS + 1];
+  int len = 0;
+  int i;
+
+  bitvec_copy(k, exp);
+  k[ECDH_BITVEC_NWORDS] = 0;
+
+  while (!bitvec_is_zero(k) || k[ECDH_BITVEC_NWORDS] != 0)
+  {
+    int digit = 0;
+    if (k[0] & 1)
+    {
+      digit = static_cast<int>(k[0] & ((1U << ECDH_WNAF_WIDTH) - 1));
+      if (digit >= (1 << (ECDH_WNAF_WIDTH - 1)))
+      {
+        /* k := k - digit (negative digit: add and carry) */
+        digit -= (1 << ECDH_WNAF_WIDTH);
+        quint32 carry = static_cast<quint32>(-digit);
+        for (i = 0; i <= ECDH_BITVEC_NWORDS && carry != 0; ++i)
+        {
+          k[i] += carry;
+          carry = (k[i] < carry) ? 1 : 0;
+        }
+      }
+      else
+      {
+        /* the lowest bits of k are the digit: no borrow */
+        k[0] -= static_cast<quint32>(digit);
+      }
+    }
+    naf[len++] = static_cast<signed char>(digit);
+
+    for (i = 0; i < ECDH_BITVEC_NWORDS; ++i)
+    {
+      k[i] = (k[i] >> 1) | (k[i + 1] << 31);
+    }
+    k[ECDH_BITVEC_NWORDS] >>= 1;
+  }
+  return len;
+}
+
+/* point multiplication with the width-w NAF of the scalar in Lopez-Dahab coordinates */
 static void gf2point_mul(gf2elem_t x, gf2elem_t y, const scalar_t exp)
 {
-  gf2elem_t tmpx, tmpy;
+  gf2elem_t px[ECDH_WNAF_NPOINTS], py[ECDH_WNAF_NPOINTS];
+  gf2elem_t dx, dy, ny;
+  gf2elem_t X, Y, Z;
+  signed char naf[ECDH_WNAF_MAXLEN];
   int i;
-  int nbits = bitvec_degree(exp);
 
-  gf2point_set_zero(tmpx, tmpy);
+  /* odd multiples P, 3P, 5P, ... */
+  gf2point_copy(px[0], py[0], x, y);
+  gf2point_copy(dx, dy, x, y);
+  gf2point_double(dx, dy);
+  for (i = 1; i < ECDH_WNAF_NPOINTS; ++i)
+  {
+    gf2point_copy(px[i], py[i], px[i - 1], py[i - 1]);
+    gf2point_add(px[i], py[i], dx, dy);
+  }
 
-  for (i = (nbits - 1); i >= 0; --i)
+  gf2point_ld_set_zero(X, Y, Z);
+  for (i = (scalar_wnaf(naf, exp) - 1); i >= 0; --i)
   {
-    gf2point_double(tmpx, tmpy);
-    if (bitvec_get_bit(exp, i))
+    gf2point_ld_double(X, Y, Z);
+    if (naf[i] > 0)
     {
-      gf2point_add(tmpx, tmpy, x, y);
+      gf2point_ld_add_affine(X, Y, Z, px[naf[i] / 2], py[naf[i] / 2]);
+    }
+    else if (naf[i] < 0)
+    {
+      /* -(x, y) = (x, x + y) */
+      gf2field_add(ny, px[(-naf[i]) / 2], py[(-naf[i]) / 2]);
+      gf2point_ld_add_affine(X, Y, Z, px[(-naf[i]) / 2], ny);
     }
   }
-  gf2point_copy(x, y, tmpx, tmpy);
+  gf2point_ld_to_affine(x, y, X, Y, Z);
+}
+
+/* fixed-base comb for the base point: the scalar is split in ECDH_COMB_WIDTH rows of ECDH_COMB_DEPTH bits */
+#define ECDH_COMB_WIDTH        5
+#define ECDH_COMB_NPOINTS      (1 << ECDH_COMB_WIDTH)
+#define ECDH_COMB_DEPTH        ((ECDH_CURVE_DEGREE + ECDH_COMB_WIDTH - 1) / ECDH_COMB_WIDTH)
+
+static gf2elem_t comb_x[ECDH_COMB_NPOINTS];
+static gf2elem_t comb_y[ECDH_COMB_NPOINTS];
+static bool comb_is_ready = false;
+static QMutex comb_mutex;
+
+/* comb[u] := sum of 2^(j * depth) * G for each bit j set in u */
+static void gf2point_comb_init()
+{
+  QMutexLocker comb_locker( &comb_mutex );
+  if (comb_is_ready)
+  {
+    return;
+  }
+
+  gf2elem_t rows_x[ECDH_COMB_WIDTH], rows_y[ECDH_COMB_WIDTH];
+  gf2elem_t X, Y, Z;
+  int i, j;
+
+  gf2point_copy(rows_x[0], rows_y[0], base_x, base_y);
+  for (j = 1; j < ECDH_COMB_WIDTH; ++j)
+  {
+    gf2point_copy(X, Y, rows_x[j - 1], rows_y[j - 1]);
+    gf2field_set_one(Z);
+    for (i = 0; i < ECDH_COMB_DEPTH; ++i)
+    {
+      gf2point_ld_double(X, Y, Z);
+    }
+    gf2point_ld_to_affine(rows_x[j], rows_y[j], X, Y, Z);
+  }
+
+  gf2point_set_zero(comb_x[0], comb_y[0]);
+  for (i = 1; i < ECDH_COMB_NPOINTS; ++i)
+  {
+    j = 0;
+    while ((i >> (j + 1)) != 0)
+    {
+      j += 1;
+    }
+    gf2point_copy(comb_x[i], comb_y[i], comb_x[i ^ (1 << j)], comb_y[i ^ (1 << j)]);
+    gf2point_add(comb_x[i], comb_y[i], rows_x[j], rows_y[j]);
+  }
+
+  comb_is_ready = true;
+}
+
+/* multiplication of the base point 'G': (x, y) := exp * G */
+static void gf2point_mul_base(gf2elem_t x, gf2elem_t y, const scalar_t exp)
+{
+  if (bitvec_degree(exp) > (ECDH_COMB_WIDTH * ECDH_COMB_DEPTH))
+  {
+    gf2point_copy(x, y, base_x, base_y);
+    gf2point_mul(x, y, exp);
+    return;
+  }
+
+  gf2point_comb_init();
+
+  gf2elem_t X, Y, Z;
+  int i, j;
+
+  gf2point_ld_set_zero(X, Y, Z);
+  for (i = (ECDH_COMB_DEPTH - 1); i >= 0; --i)
+  {
+    gf2point_ld_double(X, Y, Z);
+    int u = 0;
+    for (j = (ECDH_COMB_WIDTH - 1); j >= 0; --j)
+    {
+      u = (u << 1) | bitvec_get_bit(exp, (j * ECDH_COMB_DEPTH) + i);
+    }
+    if (u != 0)
+    {
+      gf2point_ld_add_affine(X, Y, Z, comb_x[u], comb_y[u]);
+    }
+  }
+  gf2point_ld_to_affine(x, y, X, Y, Z);
 }
 #else
 /* point multiplication via double-and-add-always algorithm using scalar blinding */
@@ -771,9 +1177,6 @@ bool Keys::generateSharedKey( const QString& other_public_key )
 /* STATIC functions */
 void generatePublicKey( quint8* public_key, quint8* private_key )
 {
-  /* Get copy of "base" point 'G' */
-  gf2point_copy((quint32*)public_key, (quint32*)(public_key + ECDH_BITVEC_NBYTES), base_x, base_y);
-
   /* Clear bits > ECDH_CURVE_DEGREE in highest word to satisfy constraint 1 <= exp < n. */
   int nbits = bitvec_degree(base_order);
   int i;
@@ -783,8 +1186,13 @@ void generatePublicKey( quint8* public_key, quint8* private_key )
     bitvec_clr_bit((quint32*)private_key, i);
   }
 
-  /* Multiply base-point with scalar (private-key) */
+  /* Multiply base-point 'G' with scalar (private-key) */
+#if defined(CONST_TIME) && (CONST_TIME == 0)
+  gf2point_mul_base((quint32*)public_key, (quint32*)(public_key + ECDH_BITVEC_NBYTES), (quint32*)private_key);
+#else
+  gf2point_copy((quint32*)public_key, (quint32*)(public_key + ECDH_BITVEC_NBYTES), base_x, base_y);
   gf2point_mul((quint32*)public_key, (quint32*)(public_key + ECDH_BITVEC_NBYTES), (quint32*)private_key);
+#endif
 }
 
 bool generateSharedKey(const quint8* private_key, const quint8* others_pub, quint8* output )
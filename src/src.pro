@@ -28,6 +28,8 @@ TEMPLATE = app
 #DEFINES += BEEBEEP_DISABLE_SEND_MESSAGE
 #DEFINES += BEEBEEP_DISABLE_VIDEO_CALL
 #DEFINES += BEEBEEP_USE_WEBENGINE
+#DEFINES += BEEBEEP_DISABLE_AESNI
+#DEFINES += BEEBEEP_DISABLE_PCLMUL
 
 TARGET = beebeep
 